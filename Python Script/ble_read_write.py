@@ -1,15 +1,25 @@
 # read_all.py
 import asyncio
+import struct
+import time
+
+import numpy as np
 from bleak import BleakClient
 
+import l4_cmd
+import l4_codec
+import l4_rec
+import l4_seq
+
 # ==== EDIT THESE TO MATCH YOUR BOARD ====
 DEVICE_ADDRESS   = "F3:4C:6C:A2:BD:C7"   # your board's MAC
 UUID_FFF1_WRITE  = "0000fff1-0000-1000-8000-00805f9b34fb"  # command write
 UUID_FFF2_NOTIFY = "0000fff2-0000-1000-8000-00805f9b34fb"  # DONE_xx notify
-CSV_CHAR_HANDLE  = 28  # 0x2B29 in your app service (from discover.py)
+UUID_FFF4_NOTIFY = "0000fff4-0000-1000-8000-00805f9b34fb"  # bulk frame notify
+UUID_FFF6_STATS  = "0000fff6-0000-1000-8000-00805f9b34fb"  # performance counters
+UUID_FFF7_BURST  = "0000fff7-0000-1000-8000-00805f9b34fb"  # burst frame select/read
+UUID_FFF8_SEQ    = "0000fff8-0000-1000-8000-00805f9b34fb"  # sequence program upload
 
-TOTAL_READS = 128
-NUM_PINS    = 14
 
 async def run_loop_1_to_3(client: BleakClient, loop_id: int):
     msg = f"{loop_id:02d}".encode()          # b"01"/b"02"/b"03"
@@ -50,58 +60,477 @@ async def run_loop_1_to_3(client: BleakClient, loop_id: int):
         await asyncio.sleep(1.0)
         print(f"Loop {loop_id:02d} command sent (no notify subscription).")
 
-async def run_loop_4_and_read(client: BleakClient):
-    done_event = asyncio.Event()
+# ---------------- Loop-4 over FFF4 (bulk notifications) ----------------
+# One frame = one binary record (see l4_codec.py), split over notifications.
+# Pipeline: notify callback -> chunk queue -> reassembly/decode -> frame
+# queue -> recording writer (l4_rec.py, in a worker thread, so file I/O
+# never delays the receive side).
+# Rows of the flat .bin files written before l4_rec (l4_rec.py convert)
+FRAME_DTYPE = np.dtype([("frame_id", "<u4"), ("timestamp_us", "<u8"),
+                        ("words", "<u2", (l4_codec.ROWS,))])
 
-    def _notify(_, data: bytearray):
-        msg = data.decode(errors="ignore").strip()
-        if "DONE_04" in msg:
-            print(f"[NOTIFY] {msg}")
-            done_event.set()
 
-    # 1) subscribe BEFORE triggering to avoid race
-    await client.start_notify(UUID_FFF2_NOTIFY, _notify)
+class FrameReassembler:
+    """Turns FFF4 chunks back into complete records. Chunks of a transfer
+    may arrive in any order (resent ones late); a transfer is yielded once
+    all of its chunks are in and its CRC matches. missing() lists what to
+    ask for again with "RT"; a transfer still incomplete after `tries`
+    requests is given up and counted in `lost`."""
 
-    # 2) trigger Loop-4 via the command characteristic (your firmware path that notifies DONE_04)
-    await client.write_gatt_char(UUID_FFF1_WRITE, b"04", response=True)
+    def __init__(self, retx_after: float = 0.25, tries: int = 3):
+        self.retx_after, self.tries = retx_after, tries
+        self.pending = {}           # id -> [count, crc, {idx: payload}, t_last_activity, requests]
+        self.last_id = None         # highest transfer id seen
+        self.done = set()           # recently completed ids (late duplicates)
+        self.resyncs = 0            # notifications that are not chunks (e.g. TP data)
+        self.crc_errors = self.recovered = self.lost = self.requests = 0
 
-    print("Loop 4 armed. Reading 128 CSV rows...")
+    def feed(self, chunk: bytes):
+        parsed = l4_codec.parse_chunk(chunk)
+        if parsed is None:
+            self.resyncs += 1
+            return
+        ch, payload = parsed
+        xid, now = ch["id"], time.monotonic()
+        if xid in self.done:
+            return
+        if self.last_id is not None and 0 < xid - self.last_id < 256:
+            for gap in range(self.last_id + 1, xid):      # transfers lost whole
+                self.pending.setdefault(gap, [None, None, {}, now, 0])
+        if self.last_id is None or xid > self.last_id:
+            self.last_id = xid
+        p = self.pending.setdefault(xid, [None, None, {}, now, 0])
+        p[0], p[1], p[3] = ch["count"], ch["crc"], now
+        p[2][ch["idx"]] = payload
+        if len(p[2]) < p[0]:
+            return
+        del self.pending[xid]
+        self._finished(xid)
+        data = b"".join(p[2][k] for k in range(p[0]))
+        if l4_codec.crc16(data) != p[1]:
+            self.crc_errors += 1
+            return
+        if p[4]:
+            self.recovered += 1
+        if data[0] == l4_codec.MAGIC and len(data) >= l4_codec.HDR_LEN:
+            yield l4_codec.parse_header(data), data[l4_codec.HDR_LEN:]
 
-    all_values = []
-    for i in range(TOTAL_READS):
-        raw = await client.read_gatt_char(CSV_CHAR_HANDLE)   # your FFF3 read|write char (0x2B29 handle 28)
-        txt = raw.decode(errors="ignore").strip()
-        parts = [p.strip() for p in txt.split(",") if p.strip() != ""]
-        if len(parts) != NUM_PINS:
-            print(f"Row {i}: expected {NUM_PINS}, got {len(parts)} -> {txt!r}")
-            break
-        all_values.extend(parts)
+    def _finished(self, xid: int):
+        self.done.add(xid)
+        if len(self.done) > 1024:
+            self.done = {i for i in self.done if i > xid - 512}
+
+    def missing(self) -> list:
+        """[(id, first chunk, mask)] due for an "RT" request (mask 0: all)."""
+        now, out = time.monotonic(), []
+        for xid, p in list(self.pending.items()):
+            if now - p[3] < self.retx_after:
+                continue
+            if p[4] >= self.tries:
+                del self.pending[xid]
+                self._finished(xid)
+                self.lost += 1
+                continue
+            p[3], p[4] = now, p[4] + 1
+            self.requests += 1
+            if p[0] is None:
+                out.append((xid, 0, 0))
+                continue
+            gaps = [k for k in range(p[0]) if k not in p[2]]
+            while gaps:
+                base = gaps[0]
+                out.append((xid, base, sum(1 << (k - base) for k in gaps if k < base + 32)))
+                gaps = [k for k in gaps if k >= base + 32]
+        return out
+
+
+async def request_missing(client: BleakClient, rx: FrameReassembler, stop: asyncio.Event,
+                          period: float = 0.1):
+    """Asks for the chunks rx is missing until stop is set."""
+    while not stop.is_set():
+        try:
+            await asyncio.wait_for(stop.wait(), timeout=period)
+        except asyncio.TimeoutError:
+            pass
+        for xid, base, mask in rx.missing():
+            try:
+                await client.write_gatt_char(UUID_FFF1_WRITE, f"RT i={xid} o={base} m={mask}".encode(),
+                                             response=True)
+            except Exception as e:
+                print(f"(warn) RT i={xid}: {e}")
+
+
+def is_retx_status(msg: str) -> bool:
+    """DONE_RT / ERR_RT / BUSY_RT answer "RT", not the running command."""
+    return msg.split(" ", 1)[0].endswith("_RT")
+
+
+class Stats:
+    def __init__(self):
+        self.frames = self.bytes = self.lost = self.errors = 0
+        self.last_id = None
+
+    def frame(self, frame_id: int):
+        if self.last_id is None:
+            self.last_id = frame_id
+        elif frame_id != self.last_id:
+            gap = (frame_id - self.last_id - 1) & 0xFFFFFFFF
+            if gap < 0x80000000:
+                self.lost += gap
+                self.last_id = frame_id
+            elif self.lost:             # resent late, fills an earlier gap
+                self.lost -= 1
+        self.frames += 1
 
-    # 3) wait for DONE (don’t block earlier; this avoids ordering races)
+
+async def _report(stats: Stats, stop: asyncio.Event, period: float = 1.0):
+    last_f, last_b, last_t = 0, 0, time.monotonic()
+    while not stop.is_set():
+        try:
+            await asyncio.wait_for(stop.wait(), timeout=period)
+        except asyncio.TimeoutError:
+            pass
+        now = time.monotonic()
+        dt = now - last_t
+        print(f"  {(stats.frames - last_f) / dt:7.1f} frames/s  "
+              f"{(stats.bytes - last_b) / dt / 1024:7.1f} KiB/s  "
+              f"total {stats.frames} frames, lost {stats.lost}, errors {stats.errors}")
+        last_f, last_b, last_t = stats.frames, stats.bytes, now
+
+
+async def _write_frames(frames: asyncio.Queue, path: str):
+    # Batches whatever is queued into one append in a worker thread
+    w = await asyncio.to_thread(l4_rec.RecordingWriter, path, "stream")
     try:
-        await asyncio.wait_for(done_event.wait(), timeout=10.0)
-    except asyncio.TimeoutError:
-        print("(warn) DONE_04 not received within 10s (rows were read).")
+        while True:
+            batch = [await frames.get()]
+            while not frames.empty():
+                batch.append(frames.get_nowait())
+            done = batch[-1] is None
+            batch = [b for b in batch if b is not None]
+            if batch:
+                rows = np.zeros(len(batch), dtype=l4_rec.REC_DTYPE)
+                for r, (fid, ts, enc, words) in zip(rows, batch):
+                    r["frame_id"], r["timestamp_us"], r["encoding"], r["words"] = fid, ts, enc, words
+                await asyncio.to_thread(w.append_rows, rows)
+            if done:
+                return
     finally:
+        await asyncio.to_thread(w.close)
+
+
+async def receive_frames(client: BleakClient, start_cmd: bytes, stop_cmd: bytes = None,
+                         done_token: str = "DONE_04", path: str = "l4_session.l4r",
+                         max_frames: int = None, on_record=None) -> list:
+    """Send start_cmd, collect FFF4 frame records until the firmware reports
+    done_token on FFF2 (or Enter is pressed, which sends stop_cmd), appending
+    decoded frames to the recording at `path`. Other records go to
+    on_record(hdr, payload) when given. Returns the last frame."""
+    chunks: asyncio.Queue = asyncio.Queue()
+    frames: asyncio.Queue = asyncio.Queue()
+    finished = asyncio.Event()
+    stats = Stats()
+    last = []
+
+    def _on_fff4(_, data: bytearray):
+        chunks.put_nowait(bytes(data))
+
+    def _on_fff2(_, data: bytearray):
+        msg = data.decode(errors="ignore").strip()
+        if is_retx_status(msg):
+            return
+        if msg.startswith(("DONE_", "ABORTED_", "ERR_", "BUSY_")):
+            print(f"[NOTIFY] {msg}")
+        if msg.startswith(done_token) or msg.startswith(("ABORTED_", "BUSY_", "ERR_")):
+            finished.set()
+
+    rx = FrameReassembler()
+    rx_done = asyncio.Event()
+
+    async def _decode():
+        while True:
+            chunk = await chunks.get()
+            if chunk is None:
+                return
+            stats.bytes += len(chunk)
+            for hdr, payload in rx.feed(chunk):
+                if hdr["type"] != l4_codec.REC_FRAME:
+                    if on_record:
+                        on_record(hdr, payload)
+                    continue
+                try:
+                    words = l4_codec.decode_words_np(hdr, payload)
+                except ValueError as e:
+                    stats.errors += 1
+                    print(f"(warn) frame {hdr['frame_id']}: {e}")
+                    continue
+                stats.frame(hdr["frame_id"])
+                last[:] = [words]
+                frames.put_nowait((hdr["frame_id"], hdr["timestamp_us"], hdr["encoding"], words))
+                if max_frames and stats.frames >= max_frames:
+                    finished.set()
+
+    await client.start_notify(UUID_FFF2_NOTIFY, _on_fff2)
+    await client.start_notify(UUID_FFF4_NOTIFY, _on_fff4)
+    tasks = [asyncio.create_task(_decode()),
+             asyncio.create_task(_write_frames(frames, path)),
+             asyncio.create_task(_report(stats, finished)),
+             asyncio.create_task(request_missing(client, rx, rx_done))]
+
+    await client.write_gatt_char(UUID_FFF1_WRITE, start_cmd, response=True)
+    t0 = time.monotonic()
+    if stop_cmd:
+        print("Streaming... press Enter to stop.")
+        enter = asyncio.create_task(asyncio.to_thread(input))
+        await asyncio.wait([enter, asyncio.create_task(finished.wait())],
+                           return_when=asyncio.FIRST_COMPLETED)
+        await client.write_gatt_char(UUID_FFF1_WRITE, stop_cmd, response=True)
+        try:
+            await asyncio.wait_for(finished.wait(), timeout=5.0)
+        except asyncio.TimeoutError:
+            pass
+    else:
+        try:
+            await asyncio.wait_for(finished.wait(), timeout=10.0)
+        except asyncio.TimeoutError:
+            print(f"(warn) {done_token} not received within 10s.")
+
+    await asyncio.sleep(0.2)            # let trailing notifications drain
+    for _ in range(20):                 # and outstanding retransmissions
+        if not rx.pending:
+            break
+        await asyncio.sleep(0.1)
+    rx_done.set()
+    for q in (chunks, frames):
+        q.put_nowait(None)
+    finished.set()
+    await asyncio.gather(*tasks)
+    for uuid in (UUID_FFF4_NOTIFY, UUID_FFF2_NOTIFY):
         try:
-            await client.stop_notify(UUID_FFF2_NOTIFY)
+            await client.stop_notify(uuid)
         except Exception:
             pass
 
-    # Pack pin0 = LSB into integer per row, then save
-    lines = []
-    for i in range(TOTAL_READS):
-        bits = [int(b) for b in all_values[i*NUM_PINS:(i+1)*NUM_PINS]]
-        v = 0
-        for bit_idx, bit in enumerate(bits):
-            v |= (bit & 1) << bit_idx
-        lines.append(str(v))
+    dt = time.monotonic() - t0
+    print(f"{stats.frames} frames, {stats.bytes} bytes in {dt:.1f}s "
+          f"({stats.frames / dt:.1f} frames/s, {stats.bytes / dt / 1024:.1f} KiB/s), "
+          f"lost {stats.lost} -> {path}")
+    if rx.requests or rx.lost or rx.crc_errors:
+        print(f"  retransmit: {rx.requests} requests, {rx.recovered} transfers recovered, "
+              f"{rx.lost} given up, {rx.crc_errors} CRC errors")
+    return last[0] if last else None
 
+
+async def run_loop_4_and_read(client: BleakClient):
+    # Single capture, delivered as one bulk record instead of 128 row reads;
+    # appended to the session recording, the text file holds the last one
+    words = await receive_frames(client, b"04D")
+    if words is None:
+        print("(warn) no frame received.")
+        return
     with open("gpio_binary_values.txt", "w") as f:
-        f.write("\n".join(lines))
+        f.write("\n".join(str(int(v)) for v in words))
     print("Saved gpio_binary_values.txt")
 
 
+async def run_loop_4_stream(client: BleakClient):
+    await receive_frames(client, b"04S", stop_cmd=b"04E", done_token="DONE_04S")
+
+
+# ---------------- Burst capture (04B) with random-access download ----------------
+async def run_burst(client: BleakClient, frames: int) -> tuple:
+    """Capture `frames` back to back into device RAM; returns (burst_id, n)."""
+    reply = asyncio.get_running_loop().create_future()
+
+    def _notify(_, data: bytearray):
+        msg = data.decode(errors="ignore").strip()
+        if msg.startswith(("DONE_04B", "ABORTED_04B", "BUSY_04B", "ERR_04B")) and not reply.done():
+            reply.set_result(msg)
+
+    await client.start_notify(UUID_FFF2_NOTIFY, _notify)
+    try:
+        await client.write_gatt_char(UUID_FFF1_WRITE, f"04B n={frames}".encode(), response=True)
+        msg = await asyncio.wait_for(reply, timeout=120.0)
+    finally:
+        await client.stop_notify(UUID_FFF2_NOTIFY)
+    print(f"[NOTIFY] {msg}")
+    kv = dict(t.split("=", 1) for t in msg.split() if "=" in t)
+    return int(kv.get("id", 0)), int(kv.get("n", 0))
+
+
+async def fetch_burst_frames(client: BleakClient, burst_id: int, indices,
+                             path: str = "l4_burst.l4r") -> int:
+    """Download the selected frames (any order, any subset). Each frame is a
+    select write + long read on FFF7; the burst id guards against reading a
+    newer burst after a reconnect. Returns the number of frames fetched, so
+    an interrupted download can resume from indices[count:]."""
+    done = 0
+    with l4_rec.RecordingWriter(path, note=f"burst {burst_id}") as w:
+        for i in indices:
+            await client.write_gatt_char(UUID_FFF7_BURST, struct.pack("<HI", i, burst_id),
+                                         response=True)
+            rec = bytes(await client.read_gatt_char(UUID_FFF7_BURST))
+            hdr, payload = l4_codec.parse_header(rec), rec[l4_codec.HDR_LEN:]
+            w.append(hdr["frame_id"], hdr["timestamp_us"], l4_codec.decode_words_np(hdr, payload),
+                     encoding=hdr["encoding"])
+            done += 1
+    return done
+
+
+async def run_burst_and_fetch(client: BleakClient):
+    n = int(input("Frames to capture (0 = as many as fit): ").strip() or "0")
+    burst_id, count = await run_burst(client, n)
+    sel = input(f"{count} frames in RAM. Fetch which (e.g. 0-9,50; Enter = all): ").strip()
+    indices = []
+    for part in filter(None, sel.split(",")):
+        a, _, b = part.partition("-")
+        indices += range(int(a), int(b or a) + 1)
+    indices = indices or list(range(count))
+    t0 = time.monotonic()
+    got = await fetch_burst_frames(client, burst_id, indices)
+    dt = time.monotonic() - t0
+    print(f"Fetched {got} frames in {dt:.1f}s -> l4_burst.l4r")
+
+
+# ---------------- Sequence programs (FFF8 + "SQ") ----------------
+async def upload_sequence(client: BleakClient, code: bytes) -> str:
+    """Upload a program (see l4_seq.py); returns the LOAD_SQ / ERR_SQ reply."""
+    reply = asyncio.get_running_loop().create_future()
+
+    def _notify(_, data: bytearray):
+        msg = data.decode(errors="ignore").strip()
+        if msg.startswith(("LOAD_SQ", "ERR_SQ")) and not reply.done():
+            reply.set_result(msg)
+
+    await client.start_notify(UUID_FFF2_NOTIFY, _notify)
+    try:
+        try:
+            await client.write_gatt_char(UUID_FFF8_SEQ, l4_seq.upload_payload(code), response=True)
+        except Exception as e:          # rejected programs also fail the write
+            print(f"(warn) upload: {e}")
+        msg = await asyncio.wait_for(reply, timeout=5.0)
+    finally:
+        await client.stop_notify(UUID_FFF2_NOTIFY)
+    print(f"[NOTIFY] {msg}")
+    return msg
+
+
+async def run_full_cycle(client: BleakClient):
+    # reset -> configure -> pulse -> capture in one command and one round trip
+    n = int(input("Pulses between configure and capture [100]: ").strip() or "100")
+    if not (await upload_sequence(client, l4_seq.full_cycle(n).assemble())).startswith("LOAD_SQ"):
+        return
+    words = await receive_frames(client, b"SQD", done_token="DONE_SQ")
+    if words is not None:
+        print(f"Captured {int((words != 0).sum())}/{l4_seq.MAX_SAMPLES} non-zero rows.")
+
+
+async def bench_commands(client: BleakClient, n: int = 20, line: str = "Z4?"):
+    # n immediate commands: ASCII with a round trip each vs. binary batches
+    # written without response, resolved by request id
+    pipe = l4_cmd.CommandPipe(client, UUID_FFF1_WRITE)
+    replies: asyncio.Queue = asyncio.Queue()
+
+    def _notify(_, data: bytearray):
+        if not pipe.on_status(bytes(data)):
+            replies.put_nowait(data.decode(errors="ignore").strip())
+
+    await client.start_notify(UUID_FFF2_NOTIFY, _notify)
+    try:
+        t0 = time.perf_counter()
+        for _ in range(n):
+            await client.write_gatt_char(UUID_FFF1_WRITE, line.encode(), response=True)
+            while not (await asyncio.wait_for(replies.get(), timeout=5.0)).startswith(("DONE_", "ERR_")):
+                pass
+        t1 = time.perf_counter()
+        res = await pipe.run([line] * n)
+        t2 = time.perf_counter()
+    finally:
+        await client.stop_notify(UUID_FFF2_NOTIFY)
+    bad = [r for r in res if r[0] != "DONE"]
+    print(f"{n} x {line}: ASCII {(t1 - t0) * 1e3 / n:.1f} ms/command, "
+          f"batched {(t2 - t1) * 1e3 / n:.1f} ms/command ({(t1 - t0) / max(t2 - t1, 1e-6):.1f}x)"
+          + (f", {len(bad)} failed: {bad[0]}" if bad else ""))
+
+
+async def run_cycles(client: BleakClient, period_us: int = 100000, n: int = 50, steps: int = 5):
+    # n timer-paced cycles (steps: 1 reset, 2 pulses, 4 capture); frames go to
+    # the session recording, one entry per cycle to l4_cycles.npy
+    import numpy as np
+    ents = []
+
+    def _on_record(hdr, payload):
+        if hdr["type"] == l4_codec.REC_CYCLE:
+            ents.extend(l4_codec.decode_cycles(hdr, payload))
+
+    await receive_frames(client, f"CY t={period_us} n={n} s={steps}".encode(), b"AB",
+                         done_token="DONE_CY", on_record=_on_record)
+    if not ents:
+        print("(warn) no cycle entries received.")
+        return
+    ents.sort(key=lambda e: e["cycle"])
+    a = np.array([tuple(-1 if v is None else v for v in e.values()) for e in ents],
+                 dtype=[(k, "<i8") for k in l4_codec.CYCLE_KEYS])
+    np.save("l4_cycles.npy", a)
+    late = a["late_ns"] / 1e3
+    iv = a["interval_ns"][1:] / (1 + a["missed"][1:]) / 1e3
+    print(f"{len(a)} cycles at {period_us} us: start latency {late.mean():.1f} us mean / "
+          f"{late.max():.1f} us max, period {iv.mean():.1f} us (sd {iv.std():.1f}, "
+          f"{iv.min():.1f}..{iv.max():.1f}), {int(a['missed'].sum())} missed, "
+          f"{int(((a['flags'] & l4_codec.CY_F_DROPPED) != 0).sum())} frames dropped, "
+          f"run {a['run_us'].mean():.0f} us -> l4_cycles.npy")
+
+
+# ---------------- Performance counters (FFF6) ----------------
+# struct app_stats_rec in firmware/main.c; cmd[] follows, one struct
+# app_stats_cmd (firmware/app_cmd.h) per op
+STATS_FMT = "<BBHII" "IIIIII" "IIIII" "hHI" "BBBB" "IIII" "IIIIHBB" "IIII"
+STATS_KEYS = ("version", "n_ops", "size", "uptime_ms", "since_reset_ms",
+              "cap_frames", "cap_last_us", "cap_max_us", "smp_min_ns", "smp_max_ns", "smp_jitter_ns",
+              "ntf_sent", "ntf_bytes", "ntf_failed", "ntf_retried", "ntf_stalled",
+              "ntf_last_err", "st_failed", "st_sent",
+              "cmd_q_hw", "ring_hw", "credits_hw", "reserved",
+              "rt_cmd_ms", "rt_capture_ms", "rt_tx_ms", "rt_all_ms",
+              "pwr_active_us", "pwr_idle_us", "pwr_charge_nc", "pwr_total_uc",
+              "pwr_late", "pwr_low_power", "reserved2",
+              "xfer_sent", "retx_req", "retx_chunks", "retx_gone")
+CMD_NAMES = ("01", "02", "03", "04", "D4", "B4", "CAL4", "H4", "TP", "SIM", "04B", "SQ", "CY")
+
+
+def parse_stats(raw: bytes) -> dict:
+    st = dict(zip(STATS_KEYS, struct.unpack_from(STATS_FMT, raw)))
+    off = struct.calcsize(STATS_FMT)
+    st["cmd"] = {}
+    for op in range(st["n_ops"]):
+        name = CMD_NAMES[op] if op < len(CMD_NAMES) else f"op{op}"
+        st["cmd"][name] = struct.unpack_from("<IIII", raw, off + 16 * op)
+    return st
+
+
+async def show_stats(client: BleakClient, reset: bool = False):
+    st = parse_stats(await client.read_gatt_char(UUID_FFF6_STATS))
+    secs = max(st["since_reset_ms"], 1) / 1000
+    print(f"Stats v{st['version']}, {secs:.1f}s since reset")
+    print(f"  capture : {st['cap_frames']} frames, last {st['cap_last_us']} us, max {st['cap_max_us']} us, "
+          f"sample interval {st['smp_min_ns']}..{st['smp_max_ns']} ns (jitter {st['smp_jitter_ns']} ns)")
+    print(f"  radio   : {st['ntf_sent']} sent ({st['ntf_bytes'] / secs / 1024:.1f} KiB/s), "
+          f"{st['ntf_failed']} failed (last err {st['ntf_last_err']}), {st['ntf_retried']} retried, "
+          f"{st['ntf_stalled']} stalled; status {st['st_sent']} sent / {st['st_failed']} failed")
+    print(f"  transfer: {st['xfer_sent']} sent, {st['retx_req']} RT requests, "
+          f"{st['retx_chunks']} chunks resent, {st['retx_gone']} no longer retained")
+    print(f"  queues  : cmd {st['cmd_q_hw']}, ring {st['ring_hw']}, credits {st['credits_hw']} (high-water)")
+    print(f"  cpu ms  : cmd {st['rt_cmd_ms']}, capture {st['rt_capture_ms']}, "
+          f"tx {st['rt_tx_ms']}, all {st['rt_all_ms']}")
+    print(f"  energy  : last frame {st['pwr_active_us']} us active / {st['pwr_idle_us']} us idle, "
+          f"{st['pwr_charge_nc'] / 1000:.1f} uC; {st['pwr_total_uc']} uC since reset; "
+          f"low-power {'on' if st['pwr_low_power'] else 'off'}, {st['pwr_late']} late wake-ups")
+    for name, (count, last_us, max_us, total_ms) in st["cmd"].items():
+        if count:
+            print(f"  {name:>5}   : {count} runs, last {last_us} us, max {max_us} us, total {total_ms} ms")
+    if reset:
+        await client.write_gatt_char(UUID_FFF1_WRITE, b"STR", response=True)
+
+
 async def menu_loop():
     async with BleakClient(DEVICE_ADDRESS) as client:
         if not client.is_connected:
@@ -114,8 +543,14 @@ async def menu_loop():
             print("  2) Loop 2 (96-bit CLK/DATA stream)")
             print("  3) Loop 3 (pulse/rst toggling)")
             print("  4) Loop 4 (14x128 capture to file)")
+            print("  5) Loop 4 continuous stream (until Enter)")
+            print("  6) Firmware performance counters (r: read and reset)")
+            print("  7) Loop 4 burst into device RAM, then fetch frames")
+            print("  8) Full cycle as one sequence program (reset, configure, pulse, capture)")
+            print("  9) Command round trips: ASCII vs. binary batches")
+            print(" 10) Timer-paced measurement cycles with jitter summary")
             print("  q) Quit")
-            choice = input("Enter 1, 2, 3, 4, or q: ").strip().lower()
+            choice = input("Enter 1-10, r, or q: ").strip().lower()
 
             if choice in {"q", "x", "exit"}:
                 print("Exiting.")
@@ -124,6 +559,18 @@ async def menu_loop():
                 await run_loop_1_to_3(client, int(choice))
             elif choice == "4":
                 await run_loop_4_and_read(client)
+            elif choice == "5":
+                await run_loop_4_stream(client)
+            elif choice in {"6", "r"}:
+                await show_stats(client, reset=(choice == "r"))
+            elif choice == "7":
+                await run_burst_and_fetch(client)
+            elif choice == "8":
+                await run_full_cycle(client)
+            elif choice == "9":
+                await bench_commands(client)
+            elif choice == "10":
+                await run_cycles(client)
             else:
                 print("Invalid choice. Try again.")
 
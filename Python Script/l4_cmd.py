@@ -0,0 +1,156 @@
+# l4_cmd.py
+# Binary FFF1 command batches (see app_cmd_batch in firmware/app_cmd.c) and a
+# pipe that sends them with write-without-response and resolves each
+# command by its request id.
+#
+#   python l4_cmd.py            # encode / decode self-check
+#
+# write  = [u8 0xB1][u8 flags][record]...       flags bit 0: no ACKs
+# record = [u8 cmd][u8 len][u16 request id][param]...  (bit 7 of cmd: "?")
+# param  = [u8 key][u8 size 1|2|4][value LE]
+# status = [u8 0xB2][u8 status][u16 request id][u16 command #id][text] on FFF2
+import asyncio
+import struct
+import sys
+
+MAGIC, ST_MAGIC = 0xB1, 0xB2
+F_QUIET, QUERY = 0x01, 0x80
+
+# Index = command code, mirrors app_bin_cmds[]
+CMDS = ("01", "02", "02F", "02V", "03", "04", "04D", "04C",
+        "04S", "04E", "04B", "B4", "AB", "WF", "T4", "CAL4",
+        "H4", "Z4", "TP", "SIM", "SQ", "SQD", "SQT", "BLE",
+        "PWR", "RT", "CFG", "STR", "LAT", "CY")
+ACK, DONE, ABORTED, BUSY, ERR, INFO = range(6)
+STATUS_NAMES = ("ACK", "DONE", "ABORTED", "BUSY", "ERR", "INFO")
+
+
+def parse_line(line: str) -> tuple:
+    """ASCII command "CAL4 r=5 m=40" / "Z4?" -> (code, query, {key: value})."""
+    line = line.strip()
+    name = max((c for c in CMDS if line.startswith(c)), key=len, default=None)
+    if name is None:
+        raise ValueError(f"unknown command {line!r}")
+    rest = line[len(name):]
+    query = rest.startswith("?")
+    params = {}
+    for tok in rest[query:].split():
+        key, _, val = tok.partition("=")
+        if len(key) != 1 or not key.islower() or not val:
+            raise ValueError(f"bad parameter {tok!r} in {line!r}")
+        params[key] = int(val, 0)
+    return CMDS.index(name), query, params
+
+
+def encode_record(code: int, req: int, params: dict = None, query: bool = False) -> bytes:
+    if not 1 <= req <= 0xFFFF:
+        raise ValueError("request id 1..65535")
+    body = bytearray()
+    for key, v in (params or {}).items():
+        size = 1 if v < 0x100 else 2 if v < 0x10000 else 4
+        body += struct.pack("<cB", key.encode(), size) + v.to_bytes(size, "little")
+    return struct.pack("<BBH", code | (QUERY if query else 0), len(body), req) + body
+
+
+def encode_batches(records, max_len: int = 244, quiet: bool = False) -> list:
+    """Packs encoded records into as few writes of <= max_len bytes as possible."""
+    head = bytes([MAGIC, F_QUIET if quiet else 0])
+    out, cur = [], bytearray(head)
+    for r in records:
+        if len(cur) + len(r) > max_len and len(cur) > len(head):
+            out.append(bytes(cur))
+            cur = bytearray(head)
+        cur += r
+    if len(cur) > len(head):
+        out.append(bytes(cur))
+    return out
+
+
+def parse_status(data: bytes):
+    """FFF2 binary status -> (status, request id, command #id, text), else None."""
+    if len(data) < 6 or data[0] != ST_MAGIC:
+        return None
+    st, req, cid = struct.unpack_from("<BHH", data, 1)
+    return st, req, cid, bytes(data[6:]).decode(errors="replace")
+
+
+class CommandPipe:
+    """Sends ASCII command lines as binary batches without waiting for write
+    responses; run() returns one (status, text) per line once every command
+    has finished. Feed FFF2 notifications to on_status()."""
+
+    def __init__(self, client, uuid_write: str):
+        self.client, self.uuid = client, uuid_write
+        self.req = 0
+        self.waiting = {}
+
+    def on_status(self, data: bytes) -> bool:
+        st = parse_status(data)
+        if st is None:
+            return False
+        fut = self.waiting.get(st[1])
+        if fut is not None and st[0] != ACK and not fut.done():
+            fut.set_result((STATUS_NAMES[st[0]], st[3]))
+        return True
+
+    def _next_req(self) -> int:
+        self.req = self.req % 0xFFFF + 1
+        return self.req
+
+    async def run(self, lines, timeout: float = 10.0, quiet: bool = True) -> list:
+        loop = asyncio.get_running_loop()
+        recs, futs = [], []
+        for line in lines:
+            code, query, params = parse_line(line)
+            req = self._next_req()
+            futs.append(self.waiting.setdefault(req, loop.create_future()))
+            recs.append(encode_record(code, req, params, query))
+        mtu = getattr(self.client, "mtu_size", 23) or 23
+        try:
+            for w in encode_batches(recs, max_len=max(mtu - 3, 20), quiet=quiet):
+                await self.client.write_gatt_char(self.uuid, w, response=False)
+            done, _ = await asyncio.wait(futs, timeout=timeout)
+            return [f.result() if f in done else ("TIMEOUT", "") for f in futs]
+        finally:
+            for r in recs:
+                self.waiting.pop(struct.unpack_from("<H", r, 2)[0], None)
+
+
+# ---------------- self-check ----------------
+def _firmware_lines(write: bytes) -> list:
+    """What app_cmd_batch() rebuilds from a write: the ASCII lines it runs."""
+    assert write[0] == MAGIC
+    off, out = 2, []
+    while off < len(write):
+        code, plen, req = struct.unpack_from("<BBH", write, off)
+        end, q = off + 4 + plen, off + 4
+        line = CMDS[code & ~QUERY] + ("?" if code & QUERY else "")
+        while q < end:
+            key, size = chr(write[q]), write[q + 1]
+            line += f" {key}={int.from_bytes(write[q + 2:q + 2 + size], 'little')}"
+            q += 2 + size
+        out.append((req, line))
+        off = end
+    return out
+
+
+if __name__ == "__main__":
+    lines = ["02F", "T4 h=300 l=300 a=1000 s=60", "CAL4 r=5 m=40 a=1", "Z4?",
+             "04D", "H4 n=100000 w=16 l=1 b=0", "04B n=0", "LAT"]
+    recs = []
+    for i, line in enumerate(lines, 1):
+        code, query, params = parse_line(line)
+        recs.append(encode_record(code, i, params, query))
+    batches = encode_batches(recs, max_len=40)
+    got = [x for w in batches for x in _firmware_lines(w)]
+    assert [r for r, _ in got] == list(range(1, len(lines) + 1))
+    assert [ln for _, ln in got] == [" ".join(ln.split()) for ln in lines], got
+    assert all(len(w) <= 40 for w in batches)
+    one = encode_batches(recs)[0]
+    assert parse_status(bytes([ST_MAGIC, DONE]) + struct.pack("<HH", 7, 42) + b"123us") == \
+        (DONE, 7, 42, "123us")
+    print(f"{len(lines)} commands: {len(one)} bytes in one write "
+          f"({sum(len(ln) for ln in lines)} bytes as {len(lines)} ASCII writes), "
+          f"{len(batches)} writes at MTU 43")
+    print("OK")
+    sys.exit(0)
@@ -0,0 +1,369 @@
+# l4_codec.py
+# Reference decoder (and matching encoder) for Loop-4 records sent on FFF4,
+# and for the chunks they travel in.
+#
+#   python l4_codec.py                          # round-trip synthetic frames
+#   python l4_codec.py gpio_binary_values.txt   # ... plus a recorded frame
+#
+# A recorded frame is the file written by ble_read_write.py: 128 lines, one
+# packed 14-bit word per line (pin0 = LSB).
+import binascii
+import random
+import struct
+import sys
+
+try:
+    import numpy  # noqa: F401  (only needed by decode_words_np)
+    HAVE_NUMPY = True
+except ImportError:
+    HAVE_NUMPY = False
+
+# ==== Record layout (must match struct l4_rec_hdr in firmware/l4_codec.h) ====
+HDR_FMT  = "<BBBBIQHHHHHH"
+HDR_LEN  = struct.calcsize(HDR_FMT)      # 28
+MAGIC    = 0xA4
+ROWS     = 128
+NUM_PINS = 14
+
+REC_FRAME, REC_CAL, REC_HIST, REC_SEQTRACE, REC_CYCLE = 1, 2, 3, 4, 5
+ENC_RAW, ENC_ZRLE, ENC_XBP = 0, 1, 2
+ENC_NAMES = {ENC_RAW: "raw", ENC_ZRLE: "zrle", ENC_XBP: "xbp"}
+
+# ==== Transfer chunks (struct ble_chunk_hdr in firmware/ble_xfer.h) ====
+# Every FFF4 notification is one chunk of a transfer (a record, or CSV
+# text): magic, flags, chunk index, chunk count, CRC of the transfer,
+# transfer id. Ids count up by one per transfer, so a gap means a
+# transfer was lost whole; "RT" asks for chunks again.
+CHUNK_FMT   = "<BBHHHI"
+CHUNK_LEN   = struct.calcsize(CHUNK_FMT)   # 12
+CHUNK_MAGIC = 0xC4
+CHUNK_RETX  = 0x01                         # flags: resent on request
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE, the firmware's crc16_itu_t(0xFFFF, ...)"""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def parse_chunk(c: bytes):
+    """-> (header dict, payload), or None if c is not a chunk."""
+    if len(c) < CHUNK_LEN or c[0] != CHUNK_MAGIC:
+        return None
+    magic, flags, idx, count, crc, xid = struct.unpack_from(CHUNK_FMT, c)
+    if idx >= count:
+        return None
+    return {"flags": flags, "idx": idx, "count": count, "crc": crc, "id": xid}, c[CHUNK_LEN:]
+
+
+def encode_chunks(data: bytes, xfer_id: int, room: int = 232) -> list:
+    """Split a transfer the way the firmware does (room = MTU - 3 - CHUNK_LEN)."""
+    count, crc = (len(data) + room - 1) // room, crc16(data)
+    return [struct.pack(CHUNK_FMT, CHUNK_MAGIC, 0, k, count, crc, xfer_id) +
+            data[k * room:(k + 1) * room] for k in range(count)]
+
+
+# ==== Cycle entries ("CY", struct l4_cycle_ent in firmware/cycle.h) ====
+CYCLE_FMT  = "<IIQIIIHH"
+CYCLE_LEN  = struct.calcsize(CYCLE_FMT)    # 32
+CYCLE_KEYS = ("cycle", "frame_id", "start_us", "late_ns", "interval_ns", "run_us",
+              "missed", "flags")
+CY_F_FRAME, CY_F_DROPPED, CY_F_ABORTED = 0x01, 0x02, 0x04
+
+
+def parse_header(rec: bytes) -> dict:
+    f = struct.unpack_from(HDR_FMT, rec)
+    keys = ("magic", "version", "type", "encoding", "frame_id", "timestamp_us",
+            "t_high_us", "t_low_us", "arm_us", "sample_us", "word_count", "payload_len")
+    hdr = dict(zip(keys, f))
+    if hdr["magic"] != MAGIC:
+        raise ValueError(f"bad magic 0x{hdr['magic']:02x}")
+    return hdr
+
+
+# ---------------- decoders ----------------
+def decode_zrle(p: bytes) -> list:
+    words, i = [], 0
+    while i < len(p):
+        t = p[i]; i += 1
+        n = (t & 0x7F) + 1
+        if t & 0x80:
+            words += [0] * n
+        else:
+            words += list(struct.unpack_from(f"<{n}H", p, i))
+            i += 2 * n
+    if len(words) != ROWS:
+        raise ValueError(f"zrle: {len(words)} rows")
+    return words
+
+
+def decode_xbp(p: bytes) -> list:
+    mask = struct.unpack_from("<H", p)[0]
+    d, i = [0] * ROWS, 2
+    for plane in range(NUM_PINS):
+        if not mask & (1 << plane):
+            continue
+        for r in range(ROWS):
+            if p[i + r // 8] & (1 << (r % 8)):
+                d[r] |= 1 << plane
+        i += ROWS // 8
+    if i != len(p):
+        raise ValueError("xbp: length mismatch")
+    words, prev = [], 0
+    for x in d:
+        prev ^= x
+        words.append(prev)
+    return words
+
+
+def decode_frame(rec: bytes):
+    """Full reassembled record -> (header dict, list of 128 words)."""
+    hdr = parse_header(rec)
+    p = rec[HDR_LEN:HDR_LEN + hdr["payload_len"]]
+    enc = hdr["encoding"]
+    if enc == ENC_RAW:
+        words = list(struct.unpack_from(f"<{hdr['word_count']}H", p))
+    elif enc == ENC_ZRLE:
+        words = decode_zrle(p)
+    elif enc == ENC_XBP:
+        words = decode_xbp(p)
+    else:
+        raise ValueError(f"unknown encoding {enc}")
+    return hdr, words
+
+
+def decode_cycles(hdr: dict, p: bytes) -> list:
+    """REC_CYCLE payload -> one dict per cycle; frame_id is None when the
+    cycle captured no frame."""
+    out = []
+    for f in struct.iter_unpack(CYCLE_FMT, p[:hdr["word_count"] * CYCLE_LEN]):
+        e = dict(zip(CYCLE_KEYS, f))
+        if not e["flags"] & CY_F_FRAME:
+            e["frame_id"] = None
+        out.append(e)
+    return out
+
+
+# ---------------- vectorized decoders (numpy) ----------------
+# Same results as decode_frame(), but fast enough for continuous streams.
+def decode_words_np(hdr: dict, p: bytes):
+    import numpy as np
+    enc = hdr["encoding"]
+    if enc == ENC_RAW:
+        return np.frombuffer(p, dtype="<u2", count=hdr["word_count"]).copy()
+    if enc == ENC_XBP:
+        mask = p[0] | (p[1] << 8)
+        planes = [b for b in range(NUM_PINS) if mask & (1 << b)]
+        bits = np.unpackbits(np.frombuffer(p, np.uint8, offset=2),
+                             bitorder="little").reshape(len(planes), ROWS)
+        weights = np.array([1 << b for b in planes], dtype=np.uint16)
+        d = (bits.astype(np.uint16) * weights[:, None]).sum(axis=0, dtype=np.uint16)
+        return np.bitwise_xor.accumulate(d)
+    if enc == ENC_ZRLE:
+        out = np.zeros(ROWS, dtype=np.uint16)
+        i = r = 0
+        while i < len(p):
+            t = p[i]; i += 1
+            n = (t & 0x7F) + 1
+            if not t & 0x80:
+                out[r:r + n] = np.frombuffer(p, "<u2", count=n, offset=i)
+                i += 2 * n
+            r += n
+        if r != ROWS:
+            raise ValueError(f"zrle: {r} rows")
+        return out
+    raise ValueError(f"unknown encoding {enc}")
+
+
+# ---------------- bulk decoders (numpy) ----------------
+# Many frames per call, for offline processing: one numpy pass per encoding
+# instead of one call per frame. All return (n, ROWS) uint16.
+def decode_csv_np(text):
+    """CSV dump(s) of "04C" (rows "b0,...,b13", pin0 first) -> frames."""
+    import numpy as np
+    a = np.frombuffer(text.encode() if isinstance(text, str) else bytes(text), np.uint8)
+    bits = a[(a == 0x30) | (a == 0x31)] - 0x30
+    if bits.size % (NUM_PINS * ROWS):
+        raise ValueError(f"csv: {bits.size} bits is not a whole number of frames")
+    weights = (1 << np.arange(NUM_PINS)).astype(np.uint16)
+    return (bits.reshape(-1, NUM_PINS).astype(np.uint16) @ weights).reshape(-1, ROWS)
+
+
+def split_records(buf) -> tuple:
+    """Concatenated records -> (headers as a structured array, payload offsets).
+    Only the 28-byte headers are parsed one by one."""
+    import numpy as np
+    hdr_dtype = np.dtype([("magic", "u1"), ("version", "u1"), ("type", "u1"),
+                          ("encoding", "u1"), ("frame_id", "<u4"), ("timestamp_us", "<u8"),
+                          ("t_high_us", "<u2"), ("t_low_us", "<u2"), ("arm_us", "<u2"),
+                          ("sample_us", "<u2"), ("word_count", "<u2"), ("payload_len", "<u2")])
+    assert hdr_dtype.itemsize == HDR_LEN
+    buf = memoryview(buf).cast("B")
+    offs, off = [], 0
+    while off + HDR_LEN <= len(buf):
+        if buf[off] != MAGIC:
+            raise ValueError(f"bad magic 0x{buf[off]:02x} at {off}")
+        offs.append(off)
+        off += HDR_LEN + (buf[off + HDR_LEN - 2] | buf[off + HDR_LEN - 1] << 8)
+    if off != len(buf):
+        raise ValueError(f"truncated record at {offs[-1] if offs else 0}")
+    a = np.frombuffer(buf, np.uint8)
+    offs = np.array(offs, dtype=np.int64)
+    hdrs = a[offs[:, None] + np.arange(HDR_LEN)].copy().view(hdr_dtype).ravel()
+    return hdrs, offs + HDR_LEN
+
+
+def decode_frames_np(buf) -> tuple:
+    """Concatenated frame records (any mix of encodings, e.g. a saved FFF4
+    stream) -> (headers, words)."""
+    import numpy as np
+    hdrs, offs = split_records(buf)
+    a = np.frombuffer(memoryview(buf).cast("B"), np.uint8)
+    if np.any(hdrs["type"] != REC_FRAME):
+        raise ValueError("not all records are frames")
+    out = np.zeros((len(hdrs), ROWS), dtype=np.uint16)
+
+    sel = np.flatnonzero(hdrs["encoding"] == ENC_RAW)
+    if sel.size:
+        if np.any(hdrs["word_count"][sel] != ROWS):
+            raise ValueError("raw frame without 128 words")
+        out[sel] = a[offs[sel, None] + np.arange(2 * ROWS)].view("<u2")
+
+    sel = np.flatnonzero(hdrs["encoding"] == ENC_XBP)
+    if sel.size:
+        # Scatter the stored planes into all 14 slots (absent planes stay 0),
+        # then the same unpack / weight / xor-scan as decode_words_np
+        o = offs[sel]
+        mask = a[o].astype(np.uint16) | a[o + 1].astype(np.uint16) << 8
+        has = (mask[:, None] >> np.arange(NUM_PINS)) & 1
+        slot = np.cumsum(has, axis=1) - 1
+        src = o[:, None, None] + 2 + slot[:, :, None] * (ROWS // 8) + np.arange(ROWS // 8)
+        planes = a[np.where(has[:, :, None] != 0, src, 0)] * has[:, :, None].astype(np.uint8)
+        bits = np.unpackbits(planes, axis=2, bitorder="little")
+        weights = (1 << np.arange(NUM_PINS)).astype(np.uint16)
+        d = np.einsum("fpr,p->fr", bits.astype(np.uint16), weights).astype(np.uint16)
+        out[sel] = np.bitwise_xor.accumulate(d, axis=1)
+
+    for i in np.flatnonzero(hdrs["encoding"] == ENC_ZRLE):   # token stream, per frame
+        out[i] = decode_words_np({"encoding": ENC_ZRLE},
+                                 a[offs[i]:offs[i] + hdrs["payload_len"][i]].tobytes())
+    if np.any(hdrs["encoding"] > ENC_XBP):
+        raise ValueError("unknown encoding")
+    return hdrs, out
+
+
+# ---------------- encoders (mirror the firmware, for testing) ----------------
+def encode_zrle(words: list) -> bytes:
+    out, r = bytearray(), 0
+    while r < ROWS:
+        zero = words[r] == 0
+        n = 0
+        while r + n < ROWS and (words[r + n] == 0) == zero and n < 128:
+            n += 1
+        if zero:
+            out.append(0x80 | (n - 1))
+        else:
+            out.append(n - 1)
+            out += struct.pack(f"<{n}H", *words[r:r + n])
+        r += n
+    return bytes(out)
+
+
+def encode_xbp(words: list) -> bytes:
+    d, prev = [], 0
+    for w in words:
+        d.append(w ^ prev)
+        prev = w
+    mask = 0
+    for x in d:
+        mask |= x
+    out = bytearray(struct.pack("<H", mask))
+    for plane in range(NUM_PINS):
+        if mask & (1 << plane):
+            bits = bytearray(ROWS // 8)
+            for r, x in enumerate(d):
+                if x & (1 << plane):
+                    bits[r // 8] |= 1 << (r % 8)
+            out += bits
+    return bytes(out)
+
+
+def encode_frame(words: list, enc: int, frame_id: int = 0) -> bytes:
+    if enc == ENC_ZRLE:
+        p = encode_zrle(words)
+    elif enc == ENC_XBP:
+        p = encode_xbp(words)
+    else:
+        p = struct.pack(f"<{ROWS}H", *words)
+    hdr = struct.pack(HDR_FMT, MAGIC, 1, REC_FRAME, enc, frame_id, 0,
+                      300, 300, 1000, 60, ROWS, len(p))
+    return hdr + p
+
+
+# ---------------- round-trip check ----------------
+def synthetic_frames():
+    rng = random.Random(1)
+    yield "empty",  [0] * ROWS
+    yield "single", [0x1234 if r == 77 else 0 for r in range(ROWS)]
+    yield "sparse", [rng.randrange(1 << NUM_PINS) if rng.random() < 0.1 else 0 for _ in range(ROWS)]
+    yield "count",  [1000 + r for r in range(ROWS)]
+    yield "random", [rng.randrange(1 << NUM_PINS) for _ in range(ROWS)]
+
+
+def load_recorded(path: str) -> list:
+    with open(path) as f:
+        words = [int(x) for x in f.read().split()]
+    if len(words) != ROWS:
+        raise ValueError(f"{path}: expected {ROWS} words, got {len(words)}")
+    return words
+
+
+def round_trip(frames) -> int:
+    fails = 0
+    for name, words in frames:
+        sizes = []
+        for enc in (ENC_RAW, ENC_ZRLE, ENC_XBP):
+            rec = encode_frame(words, enc)
+            _, back = decode_frame(rec)
+            sizes.append(len(rec) - HDR_LEN)
+            if back != words:
+                print(f"FAIL {name}: {ENC_NAMES[enc]} does not round-trip")
+                fails += 1
+            chunks = [parse_chunk(c) for c in encode_chunks(rec, 1, room=20)]
+            if b"".join(p for _, p in chunks) != rec or crc16(rec) != chunks[0][0]["crc"]:
+                print(f"FAIL {name}: {ENC_NAMES[enc]} chunks do not reassemble")
+                fails += 1
+            if HAVE_NUMPY:
+                hdr = parse_header(rec)
+                if decode_words_np(hdr, rec[HDR_LEN:]).tolist() != words:
+                    print(f"FAIL {name}: numpy {ENC_NAMES[enc]} decoder disagrees")
+                    fails += 1
+        print(f"{name:>8}: raw={sizes[0]} zrle={sizes[1]} xbp={sizes[2]} bytes")
+    if HAVE_NUMPY:
+        import numpy as np
+        ref = np.array([w for _, w in frames for _ in range(3)], dtype=np.uint16)
+        buf = b"".join(encode_frame(w, enc, i) for i, (_, w) in enumerate(frames)
+                       for enc in (ENC_RAW, ENC_ZRLE, ENC_XBP))
+        csv = "".join(",".join(str(w >> b & 1) for b in range(NUM_PINS)) + "\n"
+                      for _, words in frames for w in words)
+        if not np.array_equal(decode_frames_np(buf)[1], ref):
+            print("FAIL bulk: decode_frames_np disagrees")
+            fails += 1
+        if not np.array_equal(decode_csv_np(csv), ref[::3]):
+            print("FAIL bulk: decode_csv_np disagrees")
+            fails += 1
+    return fails
+
+
+if __name__ == "__main__":
+    frames = list(synthetic_frames())
+    for path in sys.argv[1:]:
+        frames.append((path, load_recorded(path)))
+    n = round_trip(frames)
+    ents = [(k, 100 + k, 1000 * k, 20000, 0 if k == 0 else 1000000, 700, 0,
+             CY_F_FRAME if k != 2 else 0) for k in range(3)]
+    cyc = decode_cycles({"word_count": 3}, b"".join(struct.pack(CYCLE_FMT, *e) for e in ents))
+    if [c["frame_id"] for c in cyc] != [100, 101, None] or cyc[1]["interval_ns"] != 1000000:
+        print("FAIL  cycle entries")
+        n += 1
+    print("OK" if n == 0 else f"{n} failure(s)")
+    sys.exit(1 if n else 0)
@@ -0,0 +1,236 @@
+# l4_multi.py
+# Loop-4 streaming from several boards at once, frames aligned on one host
+# timeline and written to a single merged file.
+#
+#   python l4_multi.py F3:4C:6C:A2:BD:C7 C8:1E:52:07:33:90 [-t 60] [-o l4_merged.l4r]
+#
+# Every board streams "04S" on its own connection. Each frame carries its
+# capture start in device uptime (timestamp_us); FFF9 returns that same
+# clock on a read, so bracketing the read with the host clock gives one
+# (host, device) point per probe with an error below half the round trip.
+# The fastest probe of each burst is kept and offset + drift are fitted
+# through them; probes are repeated during the run, so drift between the
+# boards' 32 kHz clocks does not accumulate. The merged file is an l4_rec
+# recording ordered by host_us (capture start on the host timeline, us
+# since the session started), with the board's index in `board`.
+import argparse
+import asyncio
+import heapq
+import struct
+import time
+
+import numpy as np
+from bleak import BleakClient
+
+import l4_codec
+import l4_rec
+from ble_read_write import (UUID_FFF1_WRITE, UUID_FFF2_NOTIFY, UUID_FFF4_NOTIFY,
+                            FrameReassembler, Stats, is_retx_status, request_missing)
+
+UUID_FFF9_CLOCK = "0000fff9-0000-1000-8000-00805f9b34fb"  # device uptime, u64 us
+
+PROBES_PER_SYNC = 8        # reads per burst; the fastest one is kept
+RESYNC_S = 5.0             # burst period while streaming
+MERGE_HORIZON_US = 1_000_000   # frames are held this long to sort across boards
+DRIFT_MIN_SPAN_US = 30_000_000  # fit drift only over this much probe history
+
+
+def host_us() -> int:
+    return time.perf_counter_ns() // 1000
+
+
+class ClockSync:
+    """Maps device uptime (us) to host_us(): host = dev * (1 + drift) + offset."""
+
+    def __init__(self):
+        self.points = []            # (dev_us, host_mid_us, rtt_us), fastest per burst
+        self.drift = 0.0
+        self.offset = 0.0
+
+    async def probe(self, client: BleakClient, n: int = PROBES_PER_SYNC):
+        best = None
+        for _ in range(n):
+            t0 = host_us()
+            raw = await client.read_gatt_char(UUID_FFF9_CLOCK)
+            t1 = host_us()
+            dev = struct.unpack_from("<Q", bytes(raw))[0]
+            if best is None or t1 - t0 < best[2]:
+                best = (dev, (t0 + t1) / 2, t1 - t0)
+        self.points.append(best)
+        self._fit()
+
+    def _fit(self):
+        dev = np.array([p[0] for p in self.points], dtype=np.float64)
+        host = np.array([p[1] for p in self.points], dtype=np.float64)
+        # Probe jitter is ~1 ms, so drift (tens of ppm) needs a long baseline
+        if len(dev) >= 3 and dev[-1] - dev[0] > DRIFT_MIN_SPAN_US:
+            slope, icpt = np.polyfit(dev - dev[0], host - host[0], 1)
+            self.drift = slope - 1.0
+            self.offset = host[0] + icpt - dev[0]
+        else:
+            self.drift = 0.0
+            self.offset = float(np.mean(host - dev))
+
+    def to_host(self, dev_us: int) -> float:
+        d0 = self.points[0][0]
+        return dev_us + (dev_us - d0) * self.drift + self.offset
+
+    @property
+    def rtt_us(self) -> int:
+        return self.points[-1][2]
+
+
+class Board:
+    def __init__(self, idx: int, address: str):
+        self.idx, self.address = idx, address
+        self.sync = ClockSync()
+        self.stats = Stats()
+        self.done = asyncio.Event()
+
+
+async def run_board(b: Board, t_ref: int, go: asyncio.Event, ready: asyncio.Queue,
+                    stop: asyncio.Event, merged: asyncio.Queue):
+    chunks: asyncio.Queue = asyncio.Queue()
+
+    def _on_fff4(_, data: bytearray):
+        chunks.put_nowait(bytes(data))
+
+    def _on_fff2(_, data: bytearray):
+        msg = data.decode(errors="ignore").strip()
+        if is_retx_status(msg):
+            return
+        if msg.startswith(("DONE_", "ABORTED_", "ERR_", "BUSY_", "DROP_")):
+            print(f"[{b.idx}] {msg}")
+        if msg.startswith(("DONE_04S", "BUSY_", "ERR_")):
+            b.done.set()
+
+    rx, rx_done = FrameReassembler(), asyncio.Event()
+
+    async def _decode():
+        while (chunk := await chunks.get()) is not None:
+            b.stats.bytes += len(chunk)
+            for hdr, payload in rx.feed(chunk):
+                if hdr["type"] != l4_codec.REC_FRAME:
+                    continue
+                try:
+                    words = l4_codec.decode_words_np(hdr, payload)
+                except ValueError:
+                    b.stats.errors += 1
+                    continue
+                b.stats.frame(hdr["frame_id"])
+                t = b.sync.to_host(hdr["timestamp_us"]) - t_ref
+                merged.put_nowait((int(t), b.idx, hdr["frame_id"], hdr["timestamp_us"],
+                                   hdr["encoding"], words))
+
+    async def _resync():
+        while not stop.is_set():
+            try:
+                await asyncio.wait_for(stop.wait(), timeout=RESYNC_S)
+            except asyncio.TimeoutError:
+                await b.sync.probe(b.client, n=PROBES_PER_SYNC // 2)
+
+    async with BleakClient(b.address) as client:
+        b.client = client
+        await b.sync.probe(client)
+        await client.start_notify(UUID_FFF2_NOTIFY, _on_fff2)
+        await client.start_notify(UUID_FFF4_NOTIFY, _on_fff4)
+        print(f"[{b.idx}] {b.address}: offset {b.sync.offset / 1e6:+.6f} s, rtt {b.sync.rtt_us} us")
+        ready.put_nowait(b.idx)
+        await go.wait()
+
+        tasks = [asyncio.create_task(_decode()), asyncio.create_task(_resync()),
+                 asyncio.create_task(request_missing(client, rx, rx_done))]
+        await client.write_gatt_char(UUID_FFF1_WRITE, b"04S", response=True)
+        await asyncio.wait([asyncio.create_task(stop.wait()), asyncio.create_task(b.done.wait())],
+                           return_when=asyncio.FIRST_COMPLETED)
+        await client.write_gatt_char(UUID_FFF1_WRITE, b"04E", response=True)
+        try:
+            await asyncio.wait_for(b.done.wait(), timeout=5.0)
+        except asyncio.TimeoutError:
+            pass
+        await asyncio.sleep(0.2)                # trailing notifications
+        for _ in range(20):                     # and outstanding retransmissions
+            if not rx.pending:
+                break
+            await asyncio.sleep(0.1)
+        rx_done.set()
+        chunks.put_nowait(None)
+        stop.set()
+        await asyncio.gather(*tasks)
+        for uuid in (UUID_FFF4_NOTIFY, UUID_FFF2_NOTIFY):
+            try:
+                await client.stop_notify(uuid)
+            except Exception:
+                pass
+
+
+async def merge_writer(merged: asyncio.Queue, path: str, note: str) -> int:
+    """Re-orders frames of all boards by host time. A frame is written once
+    a frame MERGE_HORIZON_US later has arrived from any board."""
+    heap, latest, written = [], None, 0
+    with l4_rec.RecordingWriter(path, note=note) as w:
+        while True:
+            item = await merged.get()
+            if item is not None:
+                heapq.heappush(heap, item)
+                latest = item[0] if latest is None else max(latest, item[0])
+            out = []
+            while heap and (item is None or heap[0][0] < latest - MERGE_HORIZON_US):
+                out.append(heapq.heappop(heap))
+            if out:
+                rows = np.zeros(len(out), dtype=l4_rec.REC_DTYPE)
+                for r, (t, idx, fid, ts, enc, words) in zip(rows, out):
+                    r["board"], r["frame_id"], r["timestamp_us"], r["host_us"] = idx, fid, ts, t
+                    r["encoding"], r["words"] = enc, words
+                await asyncio.to_thread(w.append_rows, rows)
+                written += len(out)
+            if item is None:
+                return written
+
+
+async def run(addresses, seconds: float, path: str):
+    boards = [Board(i, a) for i, a in enumerate(addresses)]
+    go, stop = asyncio.Event(), asyncio.Event()
+    ready: asyncio.Queue = asyncio.Queue()
+    merged: asyncio.Queue = asyncio.Queue()
+    t_ref = host_us()
+
+    sessions = [asyncio.create_task(run_board(b, t_ref, go, ready, stop, merged)) for b in boards]
+    writer = asyncio.create_task(merge_writer(merged, path, f"{len(boards)} boards"))
+
+    # Start all boards together once every link is up and synced
+    for _ in boards:
+        getter = asyncio.create_task(ready.get())
+        await asyncio.wait([getter, *sessions], return_when=asyncio.FIRST_COMPLETED)
+        if not getter.done():
+            getter.cancel()
+            stop.set()
+            break
+    go.set()
+    t0 = time.monotonic()
+
+    while not stop.is_set() and time.monotonic() - t0 < seconds:
+        try:
+            await asyncio.wait_for(stop.wait(), timeout=1.0)
+        except asyncio.TimeoutError:
+            pass
+        print("  " + "  ".join(f"[{b.idx}] {b.stats.frames} fr lost {b.stats.lost} "
+                               f"drift {b.sync.drift * 1e6:+.1f} ppm" for b in boards))
+    stop.set()
+
+    results = await asyncio.gather(*sessions, return_exceptions=True)
+    merged.put_nowait(None)
+    n = await writer
+    for b, r in zip(boards, results):
+        if isinstance(r, Exception):
+            print(f"[{b.idx}] {b.address}: {r!r}")
+    print(f"{n} frames from {len(boards)} boards -> {path}")
+
+
+if __name__ == "__main__":
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("address", nargs="+", help="board addresses")
+    ap.add_argument("-t", "--seconds", type=float, default=30.0)
+    ap.add_argument("-o", "--output", default="l4_merged.l4r")
+    args = ap.parse_args()
+    asyncio.run(run(args.address, args.seconds, args.output))
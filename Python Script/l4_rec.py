@@ -0,0 +1,339 @@
+# l4_rec.py
+# Append-only recording format for long Loop-4 sessions, and a reader that
+# memory-maps the file and hands out frames as zero-copy numpy views.
+#
+#   python l4_rec.py info  session.l4r
+#   python l4_rec.py convert l4_frames.bin session.l4r    # old FRAME_DTYPE rows
+#   python l4_rec.py check                                # write / read / recover round trip
+#
+# Layout (little-endian):
+#
+#   file header   HDR_FMT, HDR_LEN bytes
+#   chunk 0       index block (IX_DTYPE) + `count` records (REC_DTYPE)
+#   chunk 1       ...
+#   footer        IX_DTYPE[n_chunks] (the index blocks again, with offsets)
+#                 + trailer (FOOTER_FMT, magic last)
+#
+# Records are fixed size, so a chunk is one contiguous numpy array on disk.
+# A chunk is written when it is full or every `flush_s` seconds, so after a
+# crash at most that much is lost; the footer is only an accelerator, and
+# a file without one (or with a torn last chunk) is recovered by walking
+# the index blocks from the start. Re-opening a recording for writing
+# drops the footer and appends new chunks.
+import os
+import struct
+import sys
+import time
+import zlib
+
+import numpy as np
+
+import l4_codec
+
+MAGIC       = b"L4REC\r\n\x1a"
+VERSION     = 1
+HDR_FMT     = "<8sHHHHIQ32s4x"     # magic, version, header len, record size, rows,
+HDR_LEN     = struct.calcsize(HDR_FMT)  # chunk frames, created (unix us), note
+IX_MAGIC    = b"L4IX"
+FOOTER_FMT  = "<QQIH2x4s"          # table offset, frames, chunks, version, magic
+FOOTER_LEN  = struct.calcsize(FOOTER_FMT)
+FOOTER_MAGIC = b"L4FT"
+
+REC_DTYPE = np.dtype([("frame_id", "<u4"), ("encoding", "u1"), ("board", "u1"),
+                      ("flags", "<u2"), ("timestamp_us", "<u8"), ("host_us", "<i8"),
+                      ("words", "<u2", (l4_codec.ROWS,))])
+IX_DTYPE = np.dtype([("magic", "S4"), ("chunk", "<u4"), ("count", "<u4"), ("crc32", "<u4"),
+                     ("first_id", "<u4"), ("last_id", "<u4"), ("t_first", "<u8"),
+                     ("t_last", "<u8"), ("offset", "<u8")])   # offset of the first record
+
+CHUNK_FRAMES = 4096        # ~1.1 MiB of records per chunk
+
+
+class RecordingWriter:
+    """Buffers frames into chunks and appends them. Use as a context
+    manager, or call close(); an unclosed file is still readable."""
+
+    def __init__(self, path: str, note: str = "", chunk_frames: int = CHUNK_FRAMES,
+                 flush_s: float = 2.0):
+        self.path, self.flush_s = path, flush_s
+        if os.path.exists(path) and os.path.getsize(path) > 0:
+            rec = Recording(path)
+            self.table = [ix.copy() for ix in rec.table]
+            self.chunk_frames, self.frames = rec.chunk_frames, len(rec)
+            end = rec.data_end
+            rec.close()
+            self.f = open(path, "r+b")
+            self.f.truncate(end)
+            self.f.seek(end)
+        else:
+            self.table, self.chunk_frames, self.frames = [], chunk_frames, 0
+            self.f = open(path, "wb")
+            self.f.write(struct.pack(HDR_FMT, MAGIC, VERSION, HDR_LEN, REC_DTYPE.itemsize,
+                                     l4_codec.ROWS, chunk_frames, time.time_ns() // 1000,
+                                     note.encode()[:32]))
+        self.buf = np.zeros(self.chunk_frames, dtype=REC_DTYPE)
+        self.n = 0
+        self.t_flush = time.monotonic()
+
+    def append(self, frame_id: int, timestamp_us: int, words, host_us: int = 0,
+               board: int = 0, encoding: int = 0):
+        r = self.buf[self.n]
+        r["frame_id"], r["timestamp_us"], r["host_us"] = frame_id, timestamp_us, host_us
+        r["board"], r["encoding"], r["words"] = board, encoding, words
+        self.n += 1
+        self.frames += 1
+        if self.n == self.chunk_frames or time.monotonic() - self.t_flush >= self.flush_s:
+            self.flush()
+
+    def append_rows(self, rows: np.ndarray):
+        """rows: REC_DTYPE array (or any array with a subset of its fields)."""
+        i = 0
+        while i < len(rows):
+            k = min(len(rows) - i, self.chunk_frames - self.n)
+            dst = self.buf[self.n:self.n + k]
+            for name in rows.dtype.names:
+                if name in REC_DTYPE.names:
+                    dst[name] = rows[name][i:i + k]
+            self.n += k
+            self.frames += k
+            i += k
+            if self.n == self.chunk_frames:
+                self.flush()
+        if self.n and time.monotonic() - self.t_flush >= self.flush_s:
+            self.flush()
+
+    def flush(self):
+        self.t_flush = time.monotonic()
+        if not self.n:
+            return
+        recs = self.buf[:self.n]
+        ix = np.zeros(1, dtype=IX_DTYPE)[0]
+        ix["magic"], ix["chunk"], ix["count"] = IX_MAGIC, len(self.table), self.n
+        ix["crc32"] = zlib.crc32(recs.tobytes())
+        ix["first_id"], ix["last_id"] = recs["frame_id"][0], recs["frame_id"][-1]
+        ix["t_first"], ix["t_last"] = recs["timestamp_us"][0], recs["timestamp_us"][-1]
+        ix["offset"] = self.f.tell() + IX_DTYPE.itemsize
+        self.f.write(ix.tobytes())
+        self.f.write(recs.tobytes())
+        self.f.flush()
+        self.table.append(ix.copy())
+        self.buf[:self.n] = 0
+        self.n = 0
+
+    def close(self):
+        if self.f.closed:
+            return
+        self.flush()
+        table_off = self.f.tell()
+        self.f.write(np.array(self.table, dtype=IX_DTYPE).tobytes())
+        self.f.write(struct.pack(FOOTER_FMT, table_off, self.frames, len(self.table),
+                                 VERSION, FOOTER_MAGIC))
+        self.f.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+class Recording:
+    """Read side. rec[i] / rec.frames(a, b) / rec.chunk(k) are numpy views
+    into the mapped file (no copy, no parsing); only a range that spans
+    chunks is copied, and iter_frames() yields it chunk by chunk instead."""
+
+    def __init__(self, path: str, verify: bool = False):
+        self.path = path
+        self.mm = np.memmap(path, dtype=np.uint8, mode="r") if os.path.getsize(path) else \
+            np.zeros(0, dtype=np.uint8)
+        if len(self.mm) < HDR_LEN:
+            raise ValueError(f"{path}: not a recording (too short)")
+        (magic, version, hdr_len, rec_size, rows, self.chunk_frames, self.created_us,
+         note) = struct.unpack_from(HDR_FMT, self.mm)
+        if magic != MAGIC:
+            raise ValueError(f"{path}: not a recording (bad magic)")
+        if version != VERSION or rec_size != REC_DTYPE.itemsize or rows != l4_codec.ROWS:
+            raise ValueError(f"{path}: version {version}, record {rec_size} B / {rows} rows "
+                             f"not supported")
+        self.note = note.rstrip(b"\0").decode(errors="replace")
+        self.hdr_len = hdr_len
+        self.recovered = False
+        self.table = self._read_footer()
+        if self.table is None:
+            self.table = self._walk()
+            self.recovered = True
+        self.data_end = (int(self.table["offset"][-1]) + int(self.table["count"][-1]) *
+                         REC_DTYPE.itemsize) if len(self.table) else hdr_len
+        self.starts = np.concatenate(([0], np.cumsum(self.table["count"], dtype=np.int64)))
+        if verify:
+            for k in range(len(self.table)):
+                if zlib.crc32(self.chunk(k).tobytes()) != self.table["crc32"][k]:
+                    raise ValueError(f"{path}: chunk {k} fails its CRC")
+
+    def _read_footer(self):
+        n = len(self.mm)
+        if n < HDR_LEN + FOOTER_LEN:
+            return None
+        table_off, frames, chunks, version, magic = struct.unpack_from(
+            FOOTER_FMT, self.mm, n - FOOTER_LEN)
+        if magic != FOOTER_MAGIC or table_off + chunks * IX_DTYPE.itemsize != n - FOOTER_LEN:
+            return None
+        table = self.mm[table_off:n - FOOTER_LEN].view(IX_DTYPE)
+        if int(table["count"].sum()) != frames:
+            return None
+        return table
+
+    def _walk(self):
+        # No footer: follow the index blocks; stop at the first torn or
+        # foreign chunk (a crash while writing leaves at most one).
+        table, off, n = [], self.hdr_len, len(self.mm)
+        while off + IX_DTYPE.itemsize <= n:
+            ix = self.mm[off:off + IX_DTYPE.itemsize].view(IX_DTYPE)[0]
+            end = off + IX_DTYPE.itemsize + int(ix["count"]) * REC_DTYPE.itemsize
+            if ix["magic"] != IX_MAGIC or ix["chunk"] != len(table) or end > n:
+                break
+            if zlib.crc32(self.mm[off + IX_DTYPE.itemsize:end]) != ix["crc32"]:
+                break
+            ix = ix.copy()
+            ix["offset"] = off + IX_DTYPE.itemsize
+            table.append(ix)
+            off = end
+        return np.array(table, dtype=IX_DTYPE)
+
+    def close(self):
+        # Views handed out keep the mapping alive; it goes with the last one
+        self.mm = self.table = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __len__(self) -> int:
+        return int(self.starts[-1])
+
+    def chunk(self, k: int) -> np.ndarray:
+        off, cnt = int(self.table["offset"][k]), int(self.table["count"][k])
+        return self.mm[off:off + cnt * REC_DTYPE.itemsize].view(REC_DTYPE)
+
+    def _locate(self, i: int) -> tuple:
+        if not 0 <= i < len(self):
+            raise IndexError(i)
+        k = int(np.searchsorted(self.starts, i, side="right")) - 1
+        return k, i - int(self.starts[k])
+
+    def __getitem__(self, i: int):
+        k, j = self._locate(i if i >= 0 else len(self) + i)
+        return self.chunk(k)[j]
+
+    def frames(self, a: int, b: int) -> np.ndarray:
+        """Frames [a, b) in recording order; a view unless the range crosses
+        a chunk boundary (CHUNK_FRAMES per chunk on a steady stream)."""
+        b = min(b, len(self))
+        if a >= b:
+            return np.zeros(0, dtype=REC_DTYPE)
+        ka, ja = self._locate(a)
+        kb, jb = self._locate(b - 1)
+        if ka == kb:
+            return self.chunk(ka)[ja:jb + 1]
+        return np.concatenate(list(self.iter_frames(a, b)))
+
+    def iter_frames(self, a: int = 0, b: int = None):
+        """Zero-copy views covering [a, b), one per chunk."""
+        b = len(self) if b is None else min(b, len(self))
+        while a < b:
+            k, j = self._locate(a)
+            n = min(int(self.table["count"][k]) - j, b - a)
+            yield self.chunk(k)[j:j + n]
+            a += n
+
+    def find_frame(self, frame_id: int) -> int:
+        """Index of frame_id, for a recording of one board (ids increase);
+        -1 if absent. Uses the chunk index, then one chunk."""
+        k = int(np.searchsorted(self.table["first_id"], frame_id, side="right")) - 1
+        if k < 0 or frame_id > self.table["last_id"][k]:
+            return -1
+        ids = self.chunk(k)["frame_id"]
+        j = int(np.searchsorted(ids, frame_id))
+        return int(self.starts[k]) + j if j < len(ids) and ids[j] == frame_id else -1
+
+    def between(self, t0_us: int, t1_us: int) -> tuple:
+        """Index range [a, b) of the frames with t0_us <= timestamp_us < t1_us
+        (device time, one board)."""
+        def pos(t):
+            k = int(np.searchsorted(self.table["t_first"], t, side="right")) - 1
+            if k < 0:
+                return 0
+            return int(self.starts[k]) + int(np.searchsorted(self.chunk(k)["timestamp_us"], t))
+        return pos(t0_us), pos(t1_us)
+
+
+# ---------------- checks / tools ----------------
+def _synthetic(n: int, first: int = 0) -> np.ndarray:
+    rows = np.zeros(n, dtype=REC_DTYPE)
+    rows["frame_id"] = np.arange(first, first + n)
+    rows["timestamp_us"] = 1_000_000 + rows["frame_id"].astype(np.uint64) * 10_000
+    rows["words"] = (rows["frame_id"][:, None] * 7 + np.arange(l4_codec.ROWS)) & 0x3FFF
+    return rows
+
+
+def check(path: str = "l4_rec_check.l4r") -> int:
+    """Write / reopen-append / crash-recover round trip; returns failures."""
+    bad = 0
+    ref = _synthetic(2500)
+    with RecordingWriter(path, note="check", chunk_frames=1000) as w:
+        w.append_rows(ref[:1500])
+        for r in ref[1500:1600]:
+            w.append(r["frame_id"], r["timestamp_us"], r["words"])
+    with RecordingWriter(path) as w:                    # append to a closed file
+        w.append_rows(ref[1600:])
+    with Recording(path, verify=True) as rec:
+        bad += len(rec) != len(ref) or rec.recovered
+        bad += not np.array_equal(rec.frames(0, len(rec)), ref)
+        v = rec.frames(10, 20)
+        bad += v.base is None or not np.array_equal(v["words"], ref["words"][10:20])
+        bad += rec.find_frame(1234) != 1234 or rec.find_frame(99999) != -1
+        bad += rec.between(ref["timestamp_us"][100], ref["timestamp_us"][2100]) != (100, 2100)
+    # Tear the file: drop the footer and half of the last chunk
+    size = os.path.getsize(path)
+    with open(path, "r+b") as f:
+        f.truncate(size - FOOTER_LEN - 4 * IX_DTYPE.itemsize - 100 * REC_DTYPE.itemsize)
+    with Recording(path) as rec:
+        bad += not rec.recovered or len(rec) == 0
+        bad += not np.array_equal(rec.frames(0, len(rec)), ref[:len(rec)])
+    os.remove(path)
+    return bad
+
+
+def convert(src: str, dst: str) -> int:
+    """Old l4_frames.bin / l4_burst.bin rows (FRAME_DTYPE) -> recording."""
+    from ble_read_write import FRAME_DTYPE
+    rows = np.fromfile(src, dtype=FRAME_DTYPE)
+    with RecordingWriter(dst, note=os.path.basename(src)) as w:
+        w.append_rows(rows)
+    return len(rows)
+
+
+def info(path: str):
+    with Recording(path) as rec:
+        t = rec.table
+        print(f"{path}: {len(rec)} frames in {len(t)} chunks, note '{rec.note}', "
+              f"created {time.ctime(rec.created_us / 1e6)}"
+              f"{', recovered without footer' if rec.recovered else ''}")
+        if len(t):
+            print(f"  frame_id {t['first_id'][0]}..{t['last_id'][-1]}, "
+                  f"device time {(int(t['t_last'][-1]) - int(t['t_first'][0])) / 1e6:.1f} s")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) >= 3 and sys.argv[1] == "info":
+        info(sys.argv[2])
+    elif len(sys.argv) >= 4 and sys.argv[1] == "convert":
+        print(f"{convert(sys.argv[2], sys.argv[3])} frames -> {sys.argv[3]}")
+    elif len(sys.argv) >= 2 and sys.argv[1] == "check":
+        n = check()
+        print("recording round trip:", "ok" if n == 0 else f"{n} FAILED")
+        sys.exit(1 if n else 0)
+    else:
+        print("usage: l4_rec.py info <file> | convert <bin> <l4r> | check")
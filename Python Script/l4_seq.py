@@ -0,0 +1,166 @@
+# l4_seq.py
+# Assembler for the firmware's GPIO sequence programs (FFF8, see
+# firmware/seq.h), the built-in loops rewritten as programs, and a decoder
+# for the "SQT" dry-run trace (FFF4 record type 4).
+#
+#   python l4_seq.py            # assemble the example programs, print size / time
+#
+# Upload: write upload_payload(code) to FFF8 (bleak does the long write),
+# FFF2 answers LOAD_SQ or ERR_SQ @<byte offset> <reason>; then "SQ" / "SQD".
+import struct
+import sys
+
+# enum seq_sig
+RST, RST_CTR, ENBIAS, STAB, CLK_WRD, IN_WRD, PULSE, RST_TDC, CELL, CLK_SHIFT = range(10)
+SIG_NAMES = ("rst", "rst_ctr", "enbias", "stab", "clk_wrd", "in_wrd",
+             "pulse", "rst_tdc", "cell", "clk_shift")
+
+OP_END, OP_SET, OP_CLR, OP_WAIT, OP_REPEAT, OP_LOOP, OP_SAMPLE, OP_SHIFT = range(8)
+MAX_SAMPLES = 128
+
+# Power-on Loop-2 word (firmware/loops.c data[]), in shift order
+DEFAULT_CFG = [int(c) for c in
+               "11111"
+               "11111110111111111111001101111110"
+               "111111111111111111111111111111111111111111111110"
+               "0111101111"]
+
+
+def _mask(sigs) -> int:
+    m = 0
+    for s in sigs:
+        m |= 1 << s
+    return m
+
+
+class Program:
+    """Builds bytecode; mirrors the firmware's static checks loosely so
+    mistakes show up before the upload."""
+
+    def __init__(self):
+        self.code = bytearray()
+        self.samples = [0]          # per REPEAT level, multiplied out on LOOP
+        self.counts = []
+        self.wait_us = [0]
+
+    def set(self, *sigs):
+        self.code += struct.pack("<BH", OP_SET, _mask(sigs))
+        return self
+
+    def clr(self, *sigs):
+        self.code += struct.pack("<BH", OP_CLR, _mask(sigs))
+        return self
+
+    def wait(self, us: int):
+        if us <= 0:
+            raise ValueError("wait must be >= 1 us")
+        self.code += struct.pack("<BI", OP_WAIT, us)
+        self.wait_us[-1] += us
+        return self
+
+    def repeat(self, count: int):
+        if not 1 <= count <= 0xFFFF:
+            raise ValueError("repeat count 1..65535")
+        self.code += struct.pack("<BH", OP_REPEAT, count)
+        self.counts.append(count)
+        self.samples.append(0)
+        self.wait_us.append(0)
+        return self
+
+    def loop(self):
+        self.code += bytes([OP_LOOP])
+        n = self.counts.pop()
+        s, w = self.samples.pop(), self.wait_us.pop()
+        self.samples[-1] += n * s
+        self.wait_us[-1] += n * w
+        return self
+
+    def sample(self):
+        self.code += bytes([OP_SAMPLE])
+        self.samples[-1] += 1
+        return self
+
+    def shift(self, clk: int, dat: int, bits, half_us: int = 0):
+        """bits in shift order (first element goes out first)."""
+        bits = list(bits)
+        packed = bytearray((len(bits) + 7) // 8)
+        for i, b in enumerate(bits):
+            if b:
+                packed[i // 8] |= 1 << (i % 8)
+        self.code += struct.pack("<BBBHH", OP_SHIFT, clk, dat, len(bits), half_us) + packed
+        self.wait_us[-1] += 2 * half_us * len(bits)
+        return self
+
+    @property
+    def n_samples(self) -> int:
+        return self.samples[0]
+
+    def assemble(self) -> bytes:
+        if self.counts:
+            raise ValueError("REPEAT without LOOP")
+        if self.n_samples > MAX_SAMPLES:
+            raise ValueError(f"{self.n_samples} samples > {MAX_SAMPLES}")
+        return bytes(self.code)
+
+
+def upload_payload(code: bytes) -> bytes:
+    return struct.pack("<H", len(code)) + code
+
+
+# ---------------- the built-in loops as programs ----------------
+def loop1(p: Program = None) -> Program:
+    """Loop 1: reset pulse with bias and stability control."""
+    p = p or Program()
+    return (p.set(STAB).clr(RST, RST_CTR).wait(8000)
+             .set(RST, RST_CTR, ENBIAS).clr(STAB).set(STAB))
+
+
+def loop2(p: Program = None, bits=DEFAULT_CFG, half_us: int = 0) -> Program:
+    """Loop 2: configuration word on clk_wrd / in_wrd."""
+    p = p or Program()
+    return p.clr(CLK_WRD).shift(CLK_WRD, IN_WRD, bits, half_us)
+
+
+def pulses(p: Program, n: int, half_us: int) -> Program:
+    """Loop 3 in software: rst_tdc is the complement of pulse."""
+    return (p.repeat(n).set(PULSE).clr(RST_TDC).wait(half_us)
+             .clr(PULSE).set(RST_TDC).wait(half_us).loop())
+
+
+def loop4(p: Program = None, high=300, low=300, arm=1000, sample=60) -> Program:
+    """Loop 4: CEL window with 128 clk_shift pulses, one sample per pulse."""
+    p = p or Program()
+    p.set(CELL).wait(arm).repeat(MAX_SAMPLES).set(CLK_SHIFT)
+    if sample:
+        p.wait(sample)
+    p.sample()
+    if high - sample:
+        p.wait(high - sample)
+    return p.clr(CLK_SHIFT).wait(low).loop().clr(CELL)
+
+
+def full_cycle(n_pulses: int = 100, half_us: int = 50) -> Program:
+    """reset -> configure -> pulse -> capture, one upload and one "SQD"."""
+    p = loop1()
+    loop2(p)
+    pulses(p, n_pulses, half_us)
+    return loop4(p)
+
+
+# ---------------- "SQT" dry-run trace ----------------
+def decode_trace(hdr: dict, payload: bytes) -> list:
+    """l4_codec.REC_SEQTRACE record -> [(t_ns, {signal: level})] per output change."""
+    out = []
+    for t_ns, lv in struct.iter_unpack("<IH", payload[:6 * hdr["word_count"]]):
+        out.append((t_ns, {SIG_NAMES[s]: (lv >> s) & 1 for s in range(len(SIG_NAMES))}))
+    return out
+
+
+if __name__ == "__main__":
+    examples = {"loop1": loop1(), "loop2": loop2(), "loop4": loop4(),
+                "full": full_cycle()}
+    for name, prog in examples.items():
+        code = prog.assemble()
+        print(f"{name:>6}: {len(code):4d} bytes, {prog.n_samples:3d} samples, "
+              f"{prog.wait_us[0] / 1000:8.2f} ms of waits  {code[:16].hex()}...")
+    sys.exit(0)
@@ -0,0 +1,306 @@
+# l4_tdc.py
+# Offline Loop-4 analysis: TDC code -> time through a per-board calibration
+# table, histograms over whole recordings, and a benchmark of the decoders
+# and of the analysis itself.
+#
+#   python l4_tdc.py                                     # self-check
+#   python l4_tdc.py bench [frames]                      # frames/s on synthetic data
+#   python -m pytest tests/test_l4_tdc_bench.py          # the same cases under pytest-benchmark
+#   python l4_tdc.py cal  session.l4r <period ps> [-n board] [-a] [-o cal.npz]
+#   python l4_tdc.py hist session.l4r [-n board] [-l lo] [-w width] [-b bins] [-o out.npy]
+#   python l4_tdc.py hist session.l4r [-n board] -c cal.npz [-p bin ps] [-o out.npy]
+#
+# "cal" is a code-density calibration from a recording of hits uncorrelated
+# with the TDC clock over one period; -a adds the board to an existing file.
+#
+# Codes are the 14-bit words as captured (pin0 = LSB), the same values the
+# firmware bins for "H4". Everything works on (n, 128) uint16 arrays, i.e.
+# rec.frames(a, b)["words"] of a recording (l4_rec.py) or the output of the
+# bulk decoders in l4_codec.py.
+import sys
+import time
+
+import numpy as np
+
+import l4_codec
+
+CODES = 1 << l4_codec.NUM_PINS
+
+
+# ---------------- calibration ----------------
+class Calibration:
+    """Per-board lookup tables, code -> time in ps (bin centre), NaN for
+    codes the board never produces. Saved as .npz: boards (u8[n]) and
+    lut_ps (f4[n, 16384])."""
+
+    def __init__(self):
+        self.boards = np.zeros(0, dtype=np.uint8)
+        self.lut = np.zeros((0, CODES), dtype=np.float32)
+        self.row = np.full(256, -1, dtype=np.int16)    # board -> lut row
+
+    def add(self, board: int, lut_ps):
+        lut_ps = np.asarray(lut_ps, dtype=np.float32)
+        if lut_ps.shape != (CODES,):
+            raise ValueError(f"lut must have {CODES} entries")
+        if self.row[board] >= 0:
+            self.lut[self.row[board]] = lut_ps
+            return self
+        self.row[board] = len(self.boards)
+        self.boards = np.append(self.boards, np.uint8(board))
+        self.lut = np.vstack([self.lut, lut_ps[None, :]])
+        return self
+
+    @classmethod
+    def linear(cls, lsb_ps: float, offset_ps: float = 0.0, boards=(0,)):
+        """Ideal TDC: every code lsb_ps wide."""
+        cal = cls()
+        for b in boards:
+            cal.add(b, offset_ps + (np.arange(CODES) + 0.5) * lsb_ps)
+        return cal
+
+    @classmethod
+    def load(cls, path: str):
+        cal = cls()
+        with np.load(path) as z:
+            for b, lut in zip(z["boards"], z["lut_ps"]):
+                cal.add(int(b), lut)
+        return cal
+
+    def save(self, path: str):
+        np.savez(path, boards=self.boards, lut_ps=self.lut)
+
+    def code_density(self, board: int, words, period_ps: float, lo: int = 1, hi: int = CODES):
+        """Calibrate `board` from hits uncorrelated with the TDC clock (a
+        code-density test): each code's width is its share of the hits in
+        [lo, hi) times period_ps. Code 0 (no hit) is left out by default."""
+        counts = np.bincount(np.asarray(words, dtype=np.uint16).ravel(), minlength=CODES)
+        counts[:lo] = 0
+        counts[hi:] = 0
+        if counts.sum() == 0:
+            raise ValueError("no hits in range")
+        width = counts * (period_ps / counts.sum())
+        lut = np.cumsum(width) - width / 2
+        lut[counts == 0] = np.nan
+        return self.add(board, lut)
+
+    def _rows(self, board):
+        r = self.row[np.asarray(board, dtype=np.uint8)]
+        if np.any(r < 0):
+            raise KeyError(f"board(s) {np.unique(np.asarray(board)[r < 0])} not calibrated")
+        return r
+
+    def to_ps(self, words, board=0) -> np.ndarray:
+        """words (any shape) -> float32 ps. board is one board or one per
+        frame (words (n, 128), board (n,), e.g. the recording's column)."""
+        words = np.asarray(words)
+        r = self._rows(board)
+        if r.ndim:
+            r = r.reshape(r.shape + (1,) * (words.ndim - r.ndim))
+        return self.lut[r, words & (CODES - 1)]
+
+
+# ---------------- histograms ----------------
+def histogram(words, lo: int = 0, width: int = 1, bins: int = 0) -> tuple:
+    """Same binning as "H4": bin k counts lo + k*width .. lo + (k+1)*width - 1,
+    bins=0 covers lo..16383. -> (counts, under, over)."""
+    if bins == 0:
+        bins = -(-(CODES - lo) // width)
+    d = np.asarray(words, dtype=np.uint16).ravel().astype(np.int32) - lo
+    if width & (width - 1) == 0:
+        d >>= width.bit_length() - 1       # floor, negatives stay negative
+    else:
+        d //= width
+    # One pass: underflow lands in bin 0, overflow in bin bins + 1
+    c = np.bincount(np.clip(d, -1, bins) + 1, minlength=bins + 2)
+    return c[1:-1], int(c[0]), int(c[-1])
+
+
+def histogram_ps(words, cal: Calibration, board=0, bin_ps: float = 10.0,
+                 t_max_ps: float = None) -> tuple:
+    """Time histogram through the calibration -> (counts, bin edges in ps).
+    Uncalibrated codes and times past t_max_ps are dropped."""
+    t = cal.to_ps(words, board).ravel()
+    t = t[np.isfinite(t)]
+    if t_max_ps is None:
+        t_max_ps = float(np.nanmax(cal.lut)) if cal.lut.size else 0.0
+    nb = int(np.ceil(t_max_ps / bin_ps))
+    k = (t / bin_ps).astype(np.int64)
+    k = k[(k >= 0) & (k < nb)]
+    return np.bincount(k, minlength=nb), np.arange(nb + 1) * bin_ps
+
+
+def hist_recording(rec, lo: int = 0, width: int = 1, bins: int = 0, board: int = None) -> dict:
+    """histogram() over a whole recording, one chunk at a time (memory-mapped,
+    so memory use does not grow with the recording)."""
+    out = {"counts": None, "under": 0, "over": 0, "frames": 0}
+    for v in rec.iter_frames():
+        w = v["words"] if board is None else v["words"][v["board"] == board]
+        c, u, o = histogram(w, lo, width, bins)
+        out["counts"] = c if out["counts"] is None else out["counts"] + c
+        out["under"] += u
+        out["over"] += o
+        out["frames"] += len(w)
+    if out["counts"] is None:
+        out["counts"] = histogram(np.zeros(0, np.uint16), lo, width, bins)[0]
+    return out
+
+
+# ---------------- benchmark ----------------
+def synthetic(n: int, seed: int = 1) -> np.ndarray:
+    """n frames shaped like a measurement: ~10% of the rows hold a code from
+    a pulse-like distribution, the rest are 0 (no hit)."""
+    rng = np.random.default_rng(seed)
+    codes = np.clip(rng.normal(3000, 150, (n, l4_codec.ROWS)) +
+                    rng.exponential(400, (n, l4_codec.ROWS)), 1, CODES - 1).astype(np.uint16)
+    return np.where(rng.random((n, l4_codec.ROWS)) < 0.1, codes, 0).astype(np.uint16)
+
+
+def _best(fn, repeat: int = 3) -> float:
+    best = float("inf")
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        fn()
+        best = min(best, time.perf_counter() - t0)
+    return best
+
+
+def bench_data(n: int = 20000) -> dict:
+    """Inputs of the BENCH cases: n synthetic frames and the same frames as
+    bulk records per encoding, as CSV text and with a 2-board calibration."""
+    frames = synthetic(n)
+    # Encode a few hundred distinct frames (the reference encoders are pure
+    # Python) and repeat them up to n
+    k = min(n, 256)
+    reps = -(-n // k)
+    enc = {e: [l4_codec.encode_frame(f.tolist(), e, i) for i, f in enumerate(frames[:k])]
+           for e in (l4_codec.ENC_RAW, l4_codec.ENC_ZRLE, l4_codec.ENC_XBP)}
+    csv = "".join(",".join(str(w >> b & 1) for b in range(l4_codec.NUM_PINS)) + "\n"
+                  for w in frames[:k].ravel().tolist()) * reps
+    # Per-frame baselines run on a slice, they are slow
+    recs = (enc[l4_codec.ENC_XBP] * reps)[:min(n, 2000)]
+    return {"n": n, "frames": frames,
+            "ref": np.tile(frames[:k], (reps, 1))[:n],
+            "bufs": {e: b"".join((r * reps)[:n]) for e, r in enc.items()},
+            "csv": csv[:n * l4_codec.ROWS * 28],
+            "recs": recs, "xbp_hdr": l4_codec.parse_header(recs[0]),
+            "cal": Calibration.linear(lsb_ps=12.5, boards=(0, 1)),
+            "boards": np.arange(n, dtype=np.uint8) & 1}
+
+
+def _bulk(e):
+    return (lambda d: l4_codec.decode_frames_np(d["bufs"][e]),
+            lambda d, r: np.array_equal(r[1], d["ref"]))
+
+
+# name -> (run(data), check(data, result) or None); run() covers data["n"]
+# frames except for the per-frame baselines, which cover data["recs"]
+BENCH = {
+    "per frame, pure Python (xbp)": (
+        lambda d: [l4_codec.decode_frame(r) for r in d["recs"]], None),
+    "per frame, numpy (xbp)": (
+        lambda d: [l4_codec.decode_words_np(d["xbp_hdr"], r[l4_codec.HDR_LEN:]) for r in d["recs"]],
+        None),
+    **{f"bulk {name}": _bulk(e) for e, name in l4_codec.ENC_NAMES.items()},
+    "bulk csv": (lambda d: l4_codec.decode_csv_np(d["csv"]),
+                 lambda d, r: np.array_equal(r, d["ref"])),
+    "code -> ps, 2 boards": (lambda d: d["cal"].to_ps(d["frames"], d["boards"]), None),
+    "histogram, width 1": (lambda d: histogram(d["frames"]), None),
+    "histogram, width 10": (lambda d: histogram(d["frames"], lo=1000, width=10, bins=500), None),
+    "time histogram, 10 ps": (lambda d: histogram_ps(d["frames"], d["cal"], d["boards"], 10.0), None),
+}
+
+
+def bench_frames(name: str, d: dict) -> int:
+    """Frames one run of BENCH[name] goes through."""
+    return len(d["recs"]) if name.startswith("per frame") else d["n"]
+
+
+def bench(n: int = 20000):
+    d = bench_data(n)
+    ok_all = True
+
+    print(f"{n} synthetic frames ({l4_codec.ROWS} words each):")
+    for name, (run, check) in BENCH.items():
+        ok = check is None or check(d, run(d))
+        fps = bench_frames(name, d) / _best(lambda: run(d), 1 if "pure Python" in name else 3)
+        print(f"  {name:<30} {fps:>12,.0f} frames/s  {fps * l4_codec.ROWS / 1e6:>8.1f} Mwords/s"
+              + ("" if ok else "  MISMATCH"))
+        ok_all &= ok
+    return ok_all
+
+
+# ---------------- self-check ----------------
+def check() -> int:
+    bad = 0
+    rng = np.random.default_rng(2)
+    w = rng.integers(0, CODES, (500, l4_codec.ROWS), dtype=np.uint16)
+    # histogram() against a direct count, H4 semantics
+    for lo, width, bins in ((0, 1, 0), (1000, 10, 200), (5, 16, 0), (16000, 3, 1000)):
+        c, u, o = histogram(w, lo, width, bins)
+        d = w.ravel().astype(np.int64) - lo
+        nb = len(c)
+        ref = np.array([np.sum((d >= k * width) & (d < (k + 1) * width)) for k in range(nb)])
+        bad += not np.array_equal(c, ref) or u != np.sum(d < 0) or o != np.sum(d >= nb * width)
+        bad += c.sum() + u + o != w.size
+    # Code-density calibration recovers a known non-linear TDC
+    true_w = 1.0 + 0.5 * np.sin(np.arange(CODES) / 50.0) ** 2
+    true_w[0] = 0
+    edges = np.concatenate(([0.0], np.cumsum(true_w)))
+    hits = np.searchsorted(edges, rng.random(2_000_000) * edges[-1], side="right") - 1
+    cal = Calibration().code_density(3, hits, period_ps=edges[-1])
+    centre = edges[:-1] + true_w / 2
+    err = np.nanmax(np.abs(cal.lut[0][1:] - centre[1:]))
+    bad += not err < 1e-3 * edges[-1]         # statistics of ~120 hits per code
+    bad += not np.isnan(cal.to_ps(np.uint16(0), 3))
+    # Per-frame boards
+    lin = Calibration.linear(10.0, boards=(0, 7))
+    lin.add(7, lin.lut[0] + 1000)
+    t = lin.to_ps(w[:4], np.array([0, 7, 0, 7], dtype=np.uint8))
+    bad += not np.allclose(t[1] - t[0], (w[1].astype(float) - w[0]) * 10 + 1000)
+    try:
+        lin.to_ps(w, 5)
+        bad += 1
+    except KeyError:
+        pass
+    return bad
+
+
+if __name__ == "__main__":
+    args = sys.argv[1:]
+
+    def opt(flag, default, conv=int):
+        return conv(args[args.index(flag) + 1]) if flag in args else default
+
+    if args[:1] == ["bench"]:
+        sys.exit(0 if bench(int(args[1]) if len(args) > 1 else 20000) else 1)
+    if args[:1] in (["cal"], ["hist"]) and len(args) >= 2:
+        import l4_rec
+        with l4_rec.Recording(args[1]) as rec:
+            board = opt("-n", None)
+            if args[0] == "cal":
+                words = np.concatenate([v["words"][v["board"] == (board or 0)]
+                                        for v in rec.iter_frames()])
+                out = opt("-o", "l4_cal.npz", str)
+                cal = Calibration.load(out) if "-a" in args else Calibration()
+                cal.code_density(board or 0, words, float(args[2])).save(out)
+                print(f"board {board or 0}: {len(words)} frames, "
+                      f"{int(np.isfinite(cal.lut[cal.row[board or 0]]).sum())} codes -> {out}")
+            elif "-c" in args:
+                cal = Calibration.load(opt("-c", None, str))
+                counts, edges = None, None
+                for v in rec.iter_frames():
+                    sel = v if board is None else v[v["board"] == board]
+                    c, edges = histogram_ps(sel["words"], cal, sel["board"], opt("-p", 10.0, float),
+                                            float(np.nanmax(cal.lut)))
+                    counts = c if counts is None else counts + c
+                np.save(opt("-o", "l4_hist_ps.npy", str), counts)
+                print(f"{int(counts.sum())} hits, peak at {edges[int(np.argmax(counts))]:.0f} ps")
+            else:
+                h = hist_recording(rec, opt("-l", 0), opt("-w", 1), opt("-b", 0), board)
+                np.save(opt("-o", "l4_hist.npy", str), h["counts"])
+                print(f"{h['frames']} frames: {int(h['counts'].sum())} in range, "
+                      f"{h['under']} under, {h['over']} over")
+        sys.exit(0)
+    n = check()
+    print("OK" if n == 0 else f"{n} failure(s)")
+    sys.exit(1 if n else 0)
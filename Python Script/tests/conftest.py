@@ -0,0 +1,6 @@
+# Tests of the host tools; run from the repo root or this folder:
+#   python -m pytest "Python Script/tests"
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,106 @@
+# Round trip of Loop-4 records through the reference decoder, against the
+# firmware encoders' output in tests/data (see tests/data/README.md).
+import glob
+import os
+import struct
+
+import numpy as np
+import pytest
+
+import l4_codec as c
+
+DATA = os.path.join(os.path.dirname(os.path.abspath(__file__)), "data")
+ENCS = {"raw": c.ENC_RAW, "zrle": c.ENC_ZRLE, "xbp": c.ENC_XBP}
+FRAMES = sorted(os.path.splitext(os.path.basename(p))[0]
+                for p in glob.glob(os.path.join(DATA, "*.txt")))
+
+
+def golden(name: str, ext: str) -> bytes:
+    path = os.path.join(DATA, f"{name}.{ext}")
+    if not os.path.exists(path):
+        pytest.skip(f"no {name}.{ext}")
+    with open(path, "rb") as f:
+        return f.read()
+
+
+@pytest.fixture(params=FRAMES)
+def recorded(request):
+    return request.param, c.load_recorded(os.path.join(DATA, request.param + ".txt"))
+
+
+def test_fixtures_present():
+    assert "sim_s1" in FRAMES and "sparse" in FRAMES
+
+
+@pytest.mark.parametrize("enc", ENCS)
+def test_decode_firmware_record(recorded, enc):
+    name, words = recorded
+    rec = golden(name, f"{enc}.rec")
+    hdr, back = c.decode_frame(rec)
+    assert back == words
+    assert hdr["encoding"] == ENCS[enc] and hdr["type"] == c.REC_FRAME
+    assert hdr["frame_id"] == 1 and len(rec) == c.HDR_LEN + hdr["payload_len"]
+    assert c.decode_words_np(hdr, rec[c.HDR_LEN:]).tolist() == words
+
+
+@pytest.mark.parametrize("enc", ENCS)
+def test_encoder_matches_firmware(recorded, enc):
+    name, words = recorded
+    assert c.encode_frame(words, ENCS[enc], frame_id=1) == golden(name, f"{enc}.rec")
+
+
+def test_bulk_decoders(recorded):
+    name, words = recorded
+    recs = [golden(name, f"{enc}.rec") for enc in ENCS]
+    hdrs, out = c.decode_frames_np(b"".join(recs))
+    assert hdrs["encoding"].tolist() == list(ENCS.values())
+    assert (out == np.array(words, dtype=np.uint16)).all()
+    assert c.decode_csv_np(golden(name, "csv")).tolist() == [words]
+
+
+def test_chunks_reassemble(recorded):
+    _, words = recorded
+    rec = c.encode_frame(words, c.ENC_XBP)
+    chunks = [c.parse_chunk(x) for x in c.encode_chunks(rec, 7, room=20)]
+    assert [h["idx"] for h, _ in chunks] == list(range(len(chunks)))
+    assert all(h["count"] == len(chunks) and h["id"] == 7 for h, _ in chunks)
+    assert b"".join(p for _, p in chunks) == rec
+    assert chunks[0][0]["crc"] == c.crc16(rec)
+
+
+@pytest.mark.parametrize("name,words", list(c.synthetic_frames()), ids=lambda x: x
+                         if isinstance(x, str) else "")
+@pytest.mark.parametrize("enc", ENCS.values(), ids=ENCS.keys())
+def test_synthetic_round_trip(name, words, enc):
+    rec = c.encode_frame(words, enc)
+    assert c.decode_frame(rec)[1] == words
+    assert c.decode_words_np(c.parse_header(rec), rec[c.HDR_LEN:]).tolist() == words
+
+
+def test_zrle_long_runs():
+    # Runs are split at 128 rows: an empty frame is one token
+    assert c.encode_zrle([0] * c.ROWS) == bytes([0xFF])
+    assert c.encode_zrle([1] * c.ROWS)[0] == 0x7F
+
+
+def test_bad_records():
+    words = [0] * c.ROWS
+    rec = bytearray(c.encode_frame(words, c.ENC_ZRLE))
+    rec[c.HDR_LEN] = 0x80          # 1 zero row instead of 128
+    with pytest.raises(ValueError):
+        c.decode_frame(bytes(rec))
+    with pytest.raises(ValueError):
+        c.decode_xbp(c.encode_xbp(words) + b"\0")
+    rec = bytearray(c.encode_frame(words, c.ENC_RAW))
+    rec[0] = 0x00
+    with pytest.raises(ValueError):
+        c.parse_header(bytes(rec))
+
+
+def test_cycle_entries():
+    ents = [(k, 100 + k, 1000 * k, 20000, 0 if k == 0 else 1000000, 700, 0,
+             c.CY_F_FRAME if k != 2 else 0) for k in range(3)]
+    cyc = c.decode_cycles({"word_count": 3},
+                          b"".join(struct.pack(c.CYCLE_FMT, *e) for e in ents))
+    assert [x["frame_id"] for x in cyc] == [100, 101, None]
+    assert cyc[1]["interval_ns"] == 1000000
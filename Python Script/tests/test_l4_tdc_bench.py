@@ -0,0 +1,27 @@
+# Benchmarks of the offline analysis under pytest-benchmark: the cases of
+# "l4_tdc.py bench" (bulk decoders, code -> ps, histograms) on the same
+# synthetic frames, with their results checked against the source frames.
+#   python -m pytest "Python Script/tests/test_l4_tdc_bench.py" --benchmark-only
+#   ... --benchmark-autosave, later --benchmark-compare --benchmark-compare-fail=mean:25%
+import pytest
+
+pytest.importorskip("pytest_benchmark")
+
+import l4_tdc as t
+
+FRAMES = 2000
+
+
+@pytest.fixture(scope="module")
+def data():
+    return t.bench_data(FRAMES)
+
+
+@pytest.mark.parametrize("name", t.BENCH)
+def test_bench(benchmark, data, name):
+    run, check = t.BENCH[name]
+    benchmark.group = "l4_tdc"
+    benchmark.extra_info["frames"] = t.bench_frames(name, data)
+    result = benchmark(run, data)
+    if check is not None:
+        assert check(data, result)
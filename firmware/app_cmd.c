@@ -0,0 +1,394 @@
+/* app_cmd.c - FFF1 command parser and executor */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_cmd.h"
+#include "app_stat.h"
+
+LOG_MODULE_REGISTER(app_cmd, LOG_LEVEL_INF);
+
+/* Handlers run in the Bluetooth RX context and queue what takes longer;
+   app_cmd_thread runs the queue in order. */
+K_MSGQ_DEFINE(app_cmd_q, sizeof(struct app_cmd), CONFIG_APP_CMD_QUEUE_LEN, 4);
+
+static const struct app_cmd_ops *app_ops;
+static atomic_t app_abort = ATOMIC_INIT(0);
+static uint16_t app_cmd_seq;
+
+enum { L4_OWNER_NONE, L4_OWNER_EXEC, L4_OWNER_STREAM };
+static atomic_t l4_owner = ATOMIC_INIT(L4_OWNER_NONE);
+
+/* Written by the executor, read and cleared by FFF6 / "STR" */
+static atomic_t app_cmd_q_hw;
+static struct app_stats_cmd app_cmd_stats[APP_CMD_COUNT];
+static struct k_spinlock app_stats_lock;
+static struct app_cmd_lat app_lat;
+
+/* Index = binary command code; the Python host mirrors it (l4_cmd.py) */
+static const char *const app_bin_cmds[] = {
+    "01", "02", "02F", "02V", "03", "04", "04D", "04C",     /*  0 ..  7 */
+    "04S", "04E", "04B", "B4", "AB", "WF", "T4", "CAL4",    /*  8 .. 15 */
+    "H4", "Z4", "TP", "SIM", "SQ", "SQD", "SQT", "BLE",     /* 16 .. 23 */
+    "PWR", "RT", "CFG", "STR", "LAT", "CY",                 /* 24 .. 29 */
+};
+
+static const char *const app_cmd_names[] = {
+    [APP_CMD_LOOP1]  = "01",
+    [APP_CMD_LOOP2]  = "02",
+    [APP_CMD_LOOP3]  = "03",
+    [APP_CMD_LOOP4]  = "04",
+    [APP_CMD_DUMP4]  = "D4",
+    [APP_CMD_BENCH4] = "B4",
+    [APP_CMD_CAL4]   = "CAL4",
+    [APP_CMD_HIST4]  = "H4",
+    [APP_CMD_TPUT]   = "TP",
+    [APP_CMD_SIMCHK] = "SIM",
+    [APP_CMD_BURST4] = "04B",
+    [APP_CMD_SEQ]    = "SQ",
+    [APP_CMD_CYCLE]  = "CY",
+};
+BUILD_ASSERT(ARRAY_SIZE(app_cmd_names) == APP_CMD_COUNT);
+
+void app_cmd_init(const struct app_cmd_ops *ops)
+{
+    app_ops = ops;
+}
+
+static uint8_t app_bin_status_code(const char *s)
+{
+    static const char *const names[] = {
+        [APP_BIN_ACK] = "ACK_", [APP_BIN_DONE] = "DONE_", [APP_BIN_ABORTED] = "ABORTED_",
+        [APP_BIN_BUSY] = "BUSY_", [APP_BIN_ERR] = "ERR_",
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+        if (strncmp(s, names[i], strlen(names[i])) == 0) {
+            return i;
+        }
+    }
+    return APP_BIN_INFO;
+}
+
+static void app_bin_report(uint8_t status, uint16_t req, uint16_t id, const char *text)
+{
+    uint8_t msg[48] = { APP_BIN_ST_MAGIC, status };
+    size_t n = text ? MIN(strlen(text), sizeof(msg) - 6) : 0;
+
+    sys_put_le16(req, &msg[2]);
+    sys_put_le16(id, &msg[4]);
+    memcpy(&msg[6], text, n);
+    app_ops->notify(msg, 6 + n);
+}
+
+void app_cmd_reply(uint16_t req, const char *text)
+{
+    if (req) {
+        app_bin_report(app_bin_status_code(text), req, 0, text);
+    } else {
+        app_ops->notify(text, strlen(text));
+    }
+}
+
+static uint32_t app_us_since(timing_t t0)
+{
+    timing_t now = timing_counter_get();
+
+    return (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&t0, &now)) / NSEC_PER_USEC);
+}
+
+/* FFF2: "<status>_<op> #<id>[ <detail>]" */
+static void app_cmd_report(const char *status, const struct app_cmd *cmd, const char *detail)
+{
+    char msg[48];
+    int n;
+
+    if (cmd->req) {
+        char st[12];
+
+        snprintk(st, sizeof(st), "%s_", status);
+        app_bin_report(app_bin_status_code(st), cmd->req, cmd->id, detail);
+        return;
+    }
+    n = snprintk(msg, sizeof(msg), "%s_%s #%u%s%s", status,
+                     app_cmd_names[cmd->op], cmd->id,
+                     detail ? " " : "", detail ? detail : "");
+
+    app_ops->notify(msg, MIN(n, (int)sizeof(msg) - 1));
+}
+
+/* -------------------- Executor -------------------- */
+bool app_cmd_abort_requested(void)
+{
+    return atomic_get(&app_abort) != 0;
+}
+
+void app_cmd_abort_clear(void)
+{
+    atomic_clear(&app_abort);
+}
+
+void app_cmd_abort(void)
+{
+    struct app_cmd cmd;
+
+    atomic_set(&app_abort, 1);
+    while (k_msgq_get(&app_cmd_q, &cmd, K_NO_WAIT) == 0) {
+        app_cmd_report("ABORTED", &cmd, NULL);
+    }
+}
+
+bool app_cmd_l4_take(void)
+{
+    return atomic_cas(&l4_owner, L4_OWNER_NONE, L4_OWNER_STREAM);
+}
+
+void app_cmd_l4_give(void)
+{
+    atomic_set(&l4_owner, L4_OWNER_NONE);
+}
+
+/* Commands that drive the Loop-4 lines or take ring buffers */
+static bool app_cmd_uses_l4(uint8_t op)
+{
+    switch (op) {
+    case APP_CMD_LOOP4: case APP_CMD_DUMP4: case APP_CMD_BENCH4: case APP_CMD_CAL4:
+    case APP_CMD_HIST4: case APP_CMD_SIMCHK: case APP_CMD_BURST4: case APP_CMD_SEQ:
+    case APP_CMD_CYCLE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void app_cmd_execute(const struct app_cmd *cmd)
+{
+    char detail[32] = {0};
+
+    if (app_ops->execute(cmd, detail, sizeof(detail)) != 0) {
+        app_cmd_report("ERR", cmd, detail);
+        return;
+    }
+
+    app_lat.done_us = app_us_since(cmd->t_write);
+    LOG_INF("CMD %s #%u: write->ack %u us, write->done %u us",
+            app_cmd_names[cmd->op], cmd->id, app_lat.ack_us, app_lat.done_us);
+
+    app_cmd_report(atomic_clear(&app_abort) ? "ABORTED" : "DONE", cmd,
+                   detail[0] ? detail : NULL);
+}
+
+static void app_cmd_thread(void *p1, void *p2, void *p3)
+{
+    struct app_cmd cmd;
+
+    for (;;) {
+        (void)k_msgq_get(&app_cmd_q, &cmd, K_FOREVER);
+        atomic_clear(&app_abort);
+
+        bool l4 = app_cmd_uses_l4(cmd.op);
+
+        if (l4 && !atomic_cas(&l4_owner, L4_OWNER_NONE, L4_OWNER_EXEC)) {
+            app_cmd_report("BUSY", &cmd, "stream");
+            continue;
+        }
+
+        timing_t t0 = timing_counter_get();
+        app_cmd_execute(&cmd);
+        timing_t t1 = timing_counter_get();
+
+        if (l4) {
+            atomic_set(&l4_owner, L4_OWNER_NONE);
+        }
+
+        struct app_stats_cmd *st = &app_cmd_stats[cmd.op];
+        uint32_t us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&t0, &t1)) / 1000U);
+        k_spinlock_key_t key = k_spin_lock(&app_stats_lock);
+
+        st->count++;
+        st->last_us = us;
+        st->max_us = MAX(st->max_us, us);
+        st->total_ms += us / 1000U;
+        k_spin_unlock(&app_stats_lock, key);
+    }
+}
+K_THREAD_DEFINE(app_cmd_tid, 2048, app_cmd_thread, NULL, NULL, NULL,
+                CONFIG_APP_CMD_PRIO, 0, 0);
+
+/* Queue a command and acknowledge it from the caller's (BT RX) context. */
+void app_cmd_submit(const struct app_cmd_ctx *ctx, uint8_t op, char arg, const uint32_t *argv)
+{
+    struct app_cmd cmd = {
+        .id = ++app_cmd_seq,
+        .op = op,
+        .arg = arg,
+        .req = ctx->req,
+        .t_write = ctx->t_write,
+    };
+
+    if (argv) {
+        memcpy(cmd.argv, argv, sizeof(cmd.argv));
+    }
+
+    if (k_msgq_put(&app_cmd_q, &cmd, K_NO_WAIT) != 0) {
+        app_cmd_report("BUSY", &cmd, "queue");
+        return;
+    }
+    app_stat_max(&app_cmd_q_hw, k_msgq_num_used_get(&app_cmd_q));
+
+    if (!ctx->quiet) {
+        app_cmd_report("ACK", &cmd, NULL);
+    }
+    app_lat.ack_us = app_us_since(ctx->t_write);
+    app_lat.ack_max_us = MAX(app_lat.ack_max_us, app_lat.ack_us);
+}
+
+void app_cmd_stats_get(struct app_stats_cmd stats[APP_CMD_COUNT], uint8_t *q_hw)
+{
+    k_spinlock_key_t key = k_spin_lock(&app_stats_lock);
+
+    memcpy(stats, app_cmd_stats, sizeof(app_cmd_stats));
+    k_spin_unlock(&app_stats_lock, key);
+    *q_hw = (uint8_t)atomic_get(&app_cmd_q_hw);
+}
+
+void app_cmd_stats_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&app_stats_lock);
+
+    memset(app_cmd_stats, 0, sizeof(app_cmd_stats));
+    k_spin_unlock(&app_stats_lock, key);
+    atomic_clear(&app_cmd_q_hw);
+}
+
+void app_cmd_lat_get(struct app_cmd_lat *lat)
+{
+    *lat = app_lat;
+}
+
+/* -------------------- Parser -------------------- */
+int app_parse_kv(const char *s, const char *keys, uint32_t *vals)
+{
+    int found = 0;
+
+    while (*s) {
+        char *end;
+        const char *k;
+
+        while (*s == ' ') {
+            s++;
+        }
+        if (*s == '\0') {
+            break;
+        }
+        k = strchr(keys, *s);
+        if (k == NULL || s[1] != '=') {
+            return -EINVAL;
+        }
+        vals[k - keys] = strtoul(s + 2, &end, 0);
+        if (end == s + 2) {
+            return -EINVAL;
+        }
+        s = end;
+        found++;
+    }
+    return found;
+}
+
+/* One ASCII command line, from FFF1 or a binary record */
+static void app_cmd_dispatch(const char *line, timing_t t_write, uint16_t req, bool quiet)
+{
+    char reply[64] = "";
+    struct app_cmd_ctx ctx = {
+        .t_write = t_write,
+        .req = req,
+        .quiet = quiet,
+        .reply = reply,
+        .reply_len = sizeof(reply),
+    };
+
+    for (size_t i = 0; i < app_ops->n_cmds; i++) {
+        const struct app_cmd_def *d = &app_ops->cmds[i];
+        size_t n = strlen(d->name);
+
+        if (strncmp(line, d->name, n) == 0) {
+            d->fn(line + n, &ctx);
+            if (reply[0]) {
+                app_cmd_reply(req, reply);
+            }
+            return;
+        }
+    }
+    if (req) {
+        app_bin_report(APP_BIN_ERR, req, 0, "unknown");
+    }
+}
+
+void app_cmd_line(const char *line, timing_t t_write)
+{
+    app_cmd_dispatch(line, t_write, 0, false);
+}
+
+/* A binary batch: every record is rebuilt as its ASCII line and run in
+   order. A malformed record ends the batch (later lengths can't be
+   trusted) with ERR "tlv @<offset>" for its request id. */
+void app_cmd_batch(const uint8_t *p, uint16_t len, timing_t t_write)
+{
+    uint16_t off = 2, at = 2, req = 0;
+    bool quiet = (p[1] & APP_BIN_F_QUIET) != 0;
+
+    while (off < len) {
+        uint8_t code, plen;
+        uint16_t end;
+        char line[64];
+        size_t n;
+
+        at = off;
+        req = 0;
+        if (off + 4 > len) {
+            goto bad;
+        }
+        code = p[off] & ~APP_BIN_QUERY;
+        plen = p[off + 1];
+        req = sys_get_le16(&p[off + 2]);
+        end = off + 4 + plen;
+        if (code >= ARRAY_SIZE(app_bin_cmds) || req == 0 || end > len) {
+            goto bad;
+        }
+        n = snprintk(line, sizeof(line), "%s%s", app_bin_cmds[code],
+                     (p[off] & APP_BIN_QUERY) ? "?" : "");
+        for (uint16_t q = off + 4; q < end; q += 2 + p[q + 1]) {
+            uint8_t key = p[q];
+            uint8_t size = (q + 1 < end) ? p[q + 1] : 0;
+            uint32_t v;
+
+            at = q;
+            if (key < 'a' || key > 'z' || (size != 1 && size != 2 && size != 4) ||
+                q + 2 + size > end || n + 14 > sizeof(line)) {
+                goto bad;
+            }
+            v = (size == 1) ? p[q + 2] :
+                (size == 2) ? sys_get_le16(&p[q + 2]) : sys_get_le32(&p[q + 2]);
+            n += snprintk(line + n, sizeof(line) - n, " %c=%u", key, v);
+        }
+        app_cmd_dispatch(line, t_write, req, quiet);
+        off = end;
+    }
+    return;
+
+bad:
+    {
+        char msg[16];
+
+        snprintk(msg, sizeof(msg), "tlv @%u", at);
+        app_bin_report(APP_BIN_ERR, req, 0, msg);
+    }
+}
@@ -0,0 +1,152 @@
+/* app_cmd.h - FFF1 command parser and executor
+ *
+ * A write on FFF1 is either one ASCII line ("CAL4 r=5 m=40") or a binary
+ * batch of type-length-value records, each rebuilt as its ASCII line.
+ * Lines are matched by prefix against the caller's command table. A
+ * handler either answers at once, writing its reply, or queues an
+ * app_cmd for the executor thread, which is acknowledged at once and
+ * reported when it ends. Status goes out on FFF2 as
+ * "<STATUS>_<op> #<id>" with STATUS in ACK/BUSY/DONE/ABORTED/ERR, or as a
+ * binary status carrying the record's request id.
+ *
+ * The commands themselves, the FFF2 notification and the Loop-4 users
+ * outside the executor are the caller's (main.c), so parsing, batching
+ * and queueing run without any radio or GPIO.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/toolchain.h>
+
+enum app_cmd_op {
+    APP_CMD_LOOP1,
+    APP_CMD_LOOP2,     /* arg: 0 if changed, 'F' force, 'V' verify */
+    APP_CMD_LOOP3,
+    APP_CMD_LOOP4,     /* arg: 0 capture only, 'D' binary dump, 'C' CSV dump */
+    APP_CMD_DUMP4,     /* arg: 'D' / 'C', no capture (FFF3 write) */
+    APP_CMD_BENCH4,
+    APP_CMD_CAL4,      /* argv: repeats, min period us, apply */
+    APP_CMD_HIST4,     /* argv: shots, bin width, lo, bins */
+    APP_CMD_TPUT,      /* argv: bytes */
+    APP_CMD_SIMCHK,    /* argv: seed */
+    APP_CMD_BURST4,    /* argv: frames */
+    APP_CMD_SEQ,       /* arg: 0 run, 'D' run + binary dump, 'T' dry run + trace */
+    APP_CMD_CYCLE,     /* argv: period us, cycles, steps */
+    APP_CMD_COUNT
+};
+
+#define APP_CMD_ARGC 4
+
+struct app_cmd {
+    uint16_t id;
+    uint8_t  op;       /* enum app_cmd_op */
+    char     arg;
+    uint16_t req;      /* binary request id, 0 for an ASCII command */
+    uint32_t argv[APP_CMD_ARGC];  /* op specific numeric arguments */
+    timing_t t_write;  /* write_callback entry, for write-to-ack/done latency */
+};
+
+/* Binary batches:
+
+     write  = [u8 0xB1][u8 flags][record]...     flags bit 0: no ACKs
+     record = [u8 cmd][u8 len][u16 request id][param]...   len = param bytes
+     param  = [u8 key][u8 size 1|2|4][value LE]
+
+   cmd indexes app_bin_cmds[] in app_cmd.c (bit 7 set: the "?" query form)
+   and keys are the letters of the ASCII syntax, so "CAL4 r=5 m=40" is
+   cmd 15 with params 'r'=5, 'm'=40. Status goes out on FFF2 as
+   [u8 0xB2][u8 status][u16 request id][u16 command #id, 0 if immediate]
+   [text: detail or the ASCII reply]. */
+#define APP_BIN_MAGIC     0xB1
+#define APP_BIN_ST_MAGIC  0xB2
+#define APP_BIN_F_QUIET   BIT(0)
+#define APP_BIN_QUERY     0x80
+
+enum app_bin_status {
+    APP_BIN_ACK,
+    APP_BIN_DONE,
+    APP_BIN_ABORTED,
+    APP_BIN_BUSY,
+    APP_BIN_ERR,
+    APP_BIN_INFO,      /* immediate reply that is none of the above */
+};
+
+/* The line being handled */
+struct app_cmd_ctx {
+    timing_t t_write;
+    uint16_t req;      /* binary request id, 0 for an ASCII line */
+    bool quiet;        /* the batch asked for no ACKs */
+    char *reply;       /* immediate answer; left empty, nothing is sent */
+    size_t reply_len;
+};
+
+struct app_cmd_def {
+    const char *name;  /* matched as a prefix, in table order */
+    void (*fn)(const char *args, struct app_cmd_ctx *ctx);
+};
+
+struct app_cmd_ops {
+    const struct app_cmd_def *cmds;
+    size_t n_cmds;
+    /* Executor thread: runs a queued command, 0 = DONE (ABORTED after
+       app_cmd_abort()), else ERR with detail */
+    int (*execute)(const struct app_cmd *cmd, char *detail, size_t len);
+    void (*notify)(const void *msg, uint16_t len);      /* FFF2 */
+};
+
+/* Per-command run time (FFF6) */
+struct app_stats_cmd {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t total_ms;
+} __packed;
+
+/* Latency of the last command, in microseconds ("LAT") */
+struct app_cmd_lat {
+    uint32_t ack_us;
+    uint32_t ack_max_us;
+    uint32_t done_us;
+};
+
+/* ops is kept, not copied */
+void app_cmd_init(const struct app_cmd_ops *ops);
+
+/* BT RX context: one ASCII line, or one binary batch */
+void app_cmd_line(const char *line, timing_t t_write);
+void app_cmd_batch(const uint8_t *p, uint16_t len, timing_t t_write);
+
+/* From a handler (or an FFF3 write, ctx without reply): queue op and ACK it */
+void app_cmd_submit(const struct app_cmd_ctx *ctx, uint8_t op, char arg, const uint32_t *argv);
+
+/* A reply sent later: binary status for request id req, else the text */
+void app_cmd_reply(uint16_t req, const char *text);
+
+/* "k=<uint>" tokens (space separated) after the command name. For each
+   character in keys that is found, the value lands at the same index in
+   vals; other entries are left untouched. The number of keys parsed or
+   -EINVAL on a malformed token. */
+int app_parse_kv(const char *s, const char *keys, uint32_t *vals);
+
+/* "AB": end the running command and drop everything queued behind it */
+void app_cmd_abort(void);
+bool app_cmd_abort_requested(void);
+void app_cmd_abort_clear(void);
+
+/* The Loop-4 lines and frame ring have one user at a time: the executor
+   while a command that captures runs, or the "04S" stream. The stream
+   takes them (false while a command holds them) and gives them back once
+   its capture thread is done; such commands end in BUSY meanwhile. */
+bool app_cmd_l4_take(void);
+void app_cmd_l4_give(void);
+
+void app_cmd_stats_get(struct app_stats_cmd stats[APP_CMD_COUNT], uint8_t *q_hw);
+void app_cmd_stats_reset(void);
+void app_cmd_lat_get(struct app_cmd_lat *lat);
+
+extern const k_tid_t app_cmd_tid;
@@ -0,0 +1,36 @@
+/* app_stat.h - lock-free running extremes for the performance counters
+ *
+ * The counters are atomic_t (written from several contexts, read and
+ * cleared from the BT RX context); these keep a maximum or minimum in
+ * one without a lock.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+
+/* High-water mark / running maximum */
+static inline void app_stat_max(atomic_t *a, uint32_t v)
+{
+    atomic_val_t old;
+
+    do {
+        old = atomic_get(a);
+        if ((uint32_t)old >= v) {
+            return;
+        }
+    } while (!atomic_cas(a, old, (atomic_val_t)v));
+}
+
+/* Running minimum; 0 means nothing recorded yet */
+static inline void app_stat_min(atomic_t *a, uint32_t v)
+{
+    atomic_val_t old;
+
+    do {
+        old = atomic_get(a);
+        if (old != 0 && (uint32_t)old <= v) {
+            return;
+        }
+    } while (!atomic_cas(a, old, (atomic_val_t)v));
+}
@@ -0,0 +1,193 @@
+/* ble_xfer.c - chunked FFF4 transfers and the retention arena for "RT" */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ble_xfer.h"
+
+LOG_MODULE_REGISTER(ble_xfer, LOG_LEVEL_INF);
+
+#define BLE_RETX_BYTES    (CONFIG_APP_BLE_RETX_KB * 1024)
+#define BLE_RETX_ENTRIES  64
+
+struct ble_retx_ent {
+    uint32_t id;
+    uint32_t off;           /* in ble_retx_buf */
+    uint16_t len;
+    uint16_t crc;
+    uint16_t room;          /* payload bytes per chunk when first sent */
+};
+
+static uint8_t ble_retx_buf[BLE_RETX_BYTES];
+static struct ble_retx_ent ble_retx[BLE_RETX_ENTRIES];   /* ring, oldest first */
+static uint16_t ble_retx_head, ble_retx_n;
+static uint32_t ble_retx_end;           /* arena offset after the newest */
+static uint32_t ble_xfer_id;
+static K_MUTEX_DEFINE(ble_retx_lock);
+static int (*ble_xfer_tx)(const void *data, uint16_t len);
+static uint16_t (*ble_xfer_payload)(void);
+
+static uint16_t ble_chunk_room(void)
+{
+    return MIN(ble_xfer_payload(), BLE_NOTIFY_MAX) - sizeof(struct ble_chunk_hdr);
+}
+
+/* Keep a copy of a transfer; the oldest ones make room. Lock held. */
+static void ble_retx_put(const struct ble_retx_ent *e, const void *data)
+{
+    uint32_t pos = ble_retx_end;
+
+    if (pos + e->len > BLE_RETX_BYTES) {
+        pos = 0;
+    }
+    while (ble_retx_n) {
+        bool overlap = (ble_retx_n == BLE_RETX_ENTRIES);
+
+        for (uint16_t i = 0; i < ble_retx_n && !overlap; i++) {
+            const struct ble_retx_ent *o = &ble_retx[(ble_retx_head + i) % BLE_RETX_ENTRIES];
+
+            overlap = (o->off < pos + e->len) && (pos < o->off + o->len);
+        }
+        if (!overlap) {
+            break;
+        }
+        ble_retx_head = (ble_retx_head + 1) % BLE_RETX_ENTRIES;
+        ble_retx_n--;
+    }
+
+    struct ble_retx_ent *n = &ble_retx[(ble_retx_head + ble_retx_n) % BLE_RETX_ENTRIES];
+
+    *n = *e;
+    n->off = pos;
+    memcpy(&ble_retx_buf[pos], data, e->len);
+    ble_retx_n++;
+    ble_retx_end = pos + e->len;
+}
+
+static const struct ble_retx_ent *ble_retx_find(uint32_t id)
+{
+    for (uint16_t i = 0; i < ble_retx_n; i++) {
+        const struct ble_retx_ent *e = &ble_retx[(ble_retx_head + i) % BLE_RETX_ENTRIES];
+
+        if (e->id == id) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Chunk k of a transfer: header + `slice`, the chunk's bytes of the transfer */
+static int ble_bulk_chunk(const struct ble_retx_ent *e, const uint8_t *slice, uint16_t k,
+                          uint8_t flags)
+{
+    uint8_t pkt[BLE_NOTIFY_MAX];
+    struct ble_chunk_hdr h = {
+        .magic = BLE_CHUNK_MAGIC,
+        .flags = flags,
+        .idx   = sys_cpu_to_le16(k),
+        .count = sys_cpu_to_le16(DIV_ROUND_UP(e->len, e->room)),
+        .crc   = sys_cpu_to_le16(e->crc),
+        .id    = sys_cpu_to_le32(e->id),
+    };
+    uint16_t n = MIN(e->room, e->len - k * e->room);
+
+    memcpy(pkt, &h, sizeof(h));
+    memcpy(pkt + sizeof(h), slice, n);
+    return ble_xfer_tx(pkt, sizeof(h) + n);
+}
+
+void ble_xfer_init(int (*tx)(const void *data, uint16_t len), uint16_t (*payload)(void))
+{
+    k_mutex_lock(&ble_retx_lock, K_FOREVER);
+    ble_xfer_tx = tx;
+    ble_xfer_payload = payload;
+    ble_retx_head = ble_retx_n = 0;
+    ble_retx_end = 0;
+    ble_xfer_id = 0;
+    k_mutex_unlock(&ble_retx_lock);
+}
+
+uint32_t ble_xfer_last_id(void)
+{
+    return ble_xfer_id;
+}
+
+int ble_xfer_send(const void *data, size_t len)
+{
+    /* ble_retx_ent.len is 16 bits, and a transfer that cannot be retained
+       could not be resent */
+    if (len > BLE_XFER_MAX_LEN) {
+        LOG_WRN("FFF4: transfer of %u bytes is larger than %u", (unsigned)len,
+                (unsigned)BLE_XFER_MAX_LEN);
+        return -EMSGSIZE;
+    }
+
+    struct ble_retx_ent e = {
+        .len  = len,
+        .crc  = crc16_itu_t(0xFFFF, data, len),
+        .room = ble_chunk_room(),
+    };
+    uint16_t count = DIV_ROUND_UP(e.len, e.room);
+
+    k_mutex_lock(&ble_retx_lock, K_FOREVER);
+    e.id = ++ble_xfer_id;
+    ble_retx_put(&e, data);
+    k_mutex_unlock(&ble_retx_lock);
+
+    for (uint16_t k = 0; k < count; k++) {
+        int err = ble_bulk_chunk(&e, (const uint8_t *)data + k * e.room, k, 0);
+
+        if (err) {
+            LOG_WRN("FFF4: transfer %u stopped at chunk %u/%u (err %d)", e.id, k, count, err);
+            return err;
+        }
+    }
+    return 0;
+}
+
+int ble_xfer_resend(uint32_t id, uint16_t base, uint32_t mask, uint16_t *sent)
+{
+    uint8_t slice[BLE_NOTIFY_MAX];
+    int err = 0;
+
+    *sent = 0;
+    for (uint32_t k = base; k < base + (mask ? 32U : UINT16_MAX); k++) {
+        const struct ble_retx_ent *e;
+        struct ble_retx_ent copy;
+        bool have;
+
+        if (mask && !(mask & BIT(k - base))) {
+            continue;
+        }
+        /* Copy the chunk out under the lock: a new transfer may reuse
+           the arena while this one is on the air */
+        k_mutex_lock(&ble_retx_lock, K_FOREVER);
+        e = ble_retx_find(id);
+        have = e && k * e->room < e->len;
+        if (have) {
+            copy = *e;
+            memcpy(slice, &ble_retx_buf[e->off + k * e->room],
+                   MIN(e->room, e->len - k * e->room));
+        }
+        k_mutex_unlock(&ble_retx_lock);
+        if (!e) {
+            err = -ENOENT;
+            break;
+        }
+        if (!have) {
+            break;      /* past the last chunk */
+        }
+        err = ble_bulk_chunk(&copy, slice, k, BLE_CHUNK_RETX);
+        if (err) {
+            break;
+        }
+        (*sent)++;
+    }
+    return err;
+}
@@ -0,0 +1,54 @@
+/* ble_xfer.h - reliable FFF4 transfers: chunk framing and retention
+ *
+ * Every FFF4 transfer (a binary record, or the CSV text of "04C") goes out
+ * as numbered chunks, each behind a struct ble_chunk_hdr: transfer id,
+ * chunk index and count, and the CRC of the whole transfer, so the host
+ * knows exactly which chunks it is missing. A copy of recent transfers is
+ * kept in a FIFO arena (CONFIG_APP_BLE_RETX_KB); ble_xfer_resend() sends
+ * chunks again from there instead of the frame being captured again.
+ * Resent chunks carry BLE_CHUNK_RETX and the original chunk boundaries.
+ *
+ * The notification itself is the caller's (main.c hands in the FFF4
+ * sender and the current MTU), so the framing runs without a connection.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#define BLE_CHUNK_MAGIC   0xC4
+#define BLE_CHUNK_RETX    BIT(0)
+#define BLE_NOTIFY_MAX    244
+
+/* Largest transfer: ble_xfer_send() refuses anything that could not be
+   retained whole (the retained length is 16 bits) */
+#define BLE_XFER_MAX_LEN  MIN(UINT16_MAX, CONFIG_APP_BLE_RETX_KB * 1024)
+
+struct ble_chunk_hdr {
+    uint8_t  magic;
+    uint8_t  flags;         /* BLE_CHUNK_RETX */
+    uint16_t idx;
+    uint16_t count;         /* chunks in this transfer */
+    uint16_t crc;           /* CRC-16/CCITT-FALSE (crc16_itu_t, seed 0xFFFF) of the transfer */
+    uint32_t id;            /* transfer id, +1 per transfer since init */
+} __packed;
+
+/* tx queues one notification (thread context, may block for radio
+   credits); payload returns the bytes a notification can carry now
+   (ATT_MTU - 3). Forgets retained transfers and restarts the ids. */
+void ble_xfer_init(int (*tx)(const void *data, uint16_t len), uint16_t (*payload)(void));
+
+/* Send one transfer. Chunks that fail are not retried here: the transfer
+   is retained, and the host asks for what it lacks. -EMSGSIZE, and
+   nothing sent, if len exceeds the retention arena or 65535 bytes. */
+int ble_xfer_send(const void *data, size_t len);
+
+/* Send chunk base + n of transfer `id` again for every bit n set in mask
+   (mask 0: all of it). *sent counts the chunks sent; -ENOENT once the
+   transfer is no longer retained, or the tx error that stopped it. */
+int ble_xfer_resend(uint32_t id, uint16_t base, uint32_t mask, uint16_t *sent);
+
+/* Id of the newest transfer (transfers sent since init) */
+uint32_t ble_xfer_last_id(void);
@@ -0,0 +1,208 @@
+/* chip_model.c - behavioural chip model on the GPIO emulator
+ *
+ * gpio_emul fires the port's callbacks whenever an output pin changes, in
+ * the context of the write. The model registers one callback per port that
+ * carries a control line, tracks the levels of cell / clk_shift / clk_wrd
+ * and reacts to rising edges by setting the emulated inputs, all before
+ * the firmware's next instruction: no thread, no timing assumptions.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+#include "chip_model.h"
+
+LOG_MODULE_REGISTER(chip_model, LOG_LEVEL_INF);
+
+#define CM_TX_COUNT   14
+#define CM_CFG_WORDS  DIV_ROUND_UP(CHIP_MODEL_CFG_BITS, 32)
+#define CM_MAX_PORTS  2
+
+static const struct gpio_dt_spec cm_cell  = GPIO_DT_SPEC_GET(DT_ALIAS(cell), gpios);
+static const struct gpio_dt_spec cm_clk   = GPIO_DT_SPEC_GET(DT_ALIAS(clk_shift), gpios);
+static const struct gpio_dt_spec cm_wclk  = GPIO_DT_SPEC_GET(DT_ALIAS(clk_wrd), gpios);
+static const struct gpio_dt_spec cm_wdat  = GPIO_DT_SPEC_GET(DT_ALIAS(in_wrd), gpios);
+#if DT_NODE_EXISTS(DT_ALIAS(cfg_sdo))
+static const struct gpio_dt_spec cm_sdo   = GPIO_DT_SPEC_GET(DT_ALIAS(cfg_sdo), gpios);
+#define CM_HAVE_SDO 1
+#else
+#define CM_HAVE_SDO 0
+#endif
+
+#define CM_TX(i) GPIO_DT_SPEC_GET(DT_ALIAS(tx##i), gpios)
+static const struct gpio_dt_spec cm_tx[CM_TX_COUNT] = {
+    CM_TX(0), CM_TX(1), CM_TX(2),  CM_TX(3),  CM_TX(4),  CM_TX(5),  CM_TX(6),
+    CM_TX(7), CM_TX(8), CM_TX(9), CM_TX(10), CM_TX(11), CM_TX(12), CM_TX(13),
+};
+
+/* TX lines grouped per port, so one word is one masked input write per port */
+static struct {
+    const struct device *dev;
+    gpio_port_pins_t mask;
+    uint8_t pin[CM_TX_COUNT];       /* 0xFF: TX line i is on another port */
+} cm_txport[CM_MAX_PORTS];
+
+static struct gpio_callback cm_cb[CM_MAX_PORTS];
+
+static uint16_t cm_seq[CHIP_MODEL_MAX_WORDS];
+static size_t cm_seq_len;
+static size_t cm_idx;
+static uint32_t cm_cfg[CM_CFG_WORDS];
+static struct chip_model_stats cm_stats;
+static bool cm_cell_lvl, cm_clk_lvl, cm_wclk_lvl;
+static struct k_spinlock cm_lock;
+
+static void cm_drive_word(uint16_t word)
+{
+    for (int p = 0; p < CM_MAX_PORTS && cm_txport[p].dev; p++) {
+        gpio_port_value_t v = 0;
+
+        for (int i = 0; i < CM_TX_COUNT; i++) {
+            if (cm_txport[p].pin[i] != 0xFF && (word & BIT(i))) {
+                v |= BIT(cm_txport[p].pin[i]);
+            }
+        }
+        /* Fails (harmlessly) while the firmware has the lines as outputs */
+        (void)gpio_emul_input_set_masked(cm_txport[p].dev, cm_txport[p].mask, v);
+    }
+}
+
+static void cm_drive_sdo(void)
+{
+#if CM_HAVE_SDO
+    int last = CHIP_MODEL_CFG_BITS - 1;
+
+    (void)gpio_emul_input_set(cm_sdo.port, cm_sdo.pin, (cm_cfg[last / 32] >> (last % 32)) & 1U);
+#endif
+}
+
+static void cm_cfg_shift(bool bit)
+{
+    for (int k = CM_CFG_WORDS - 1; k > 0; k--) {
+        cm_cfg[k] = (cm_cfg[k] << 1) | (cm_cfg[k - 1] >> 31);
+    }
+    cm_cfg[0] = (cm_cfg[0] << 1) | bit;
+    if (CHIP_MODEL_CFG_BITS % 32) {
+        cm_cfg[CM_CFG_WORDS - 1] &= BIT_MASK(CHIP_MODEL_CFG_BITS % 32);
+    }
+}
+
+static bool cm_level(const struct gpio_dt_spec *s)
+{
+    return gpio_emul_output_get(s->port, s->pin) > 0;
+}
+
+static void cm_on_output(const struct device *port, struct gpio_callback *cb,
+                         gpio_port_pins_t pins)
+{
+    k_spinlock_key_t key = k_spin_lock(&cm_lock);
+    bool cell = cm_level(&cm_cell);
+    bool clk  = cm_level(&cm_clk);
+    bool wclk = cm_level(&cm_wclk);
+
+    if (cell && !cm_cell_lvl) {
+        cm_idx = 0;
+        cm_stats.frames++;
+    }
+    if (cell && clk && !cm_clk_lvl) {
+        cm_drive_word(cm_idx < cm_seq_len ? cm_seq[cm_idx] : 0);
+        cm_idx++;
+        cm_stats.shift_edges++;
+    }
+    if (wclk && !cm_wclk_lvl) {
+        cm_cfg_shift(cm_level(&cm_wdat));
+        cm_stats.cfg_edges++;
+    }
+    cm_cell_lvl = cell;
+    cm_clk_lvl  = clk;
+    cm_wclk_lvl = wclk;
+
+    /* Re-driven on every event: the pin only accepts it once it is an input */
+    cm_drive_sdo();
+    k_spin_unlock(&cm_lock, key);
+}
+
+int chip_model_load(const uint16_t *words, size_t n)
+{
+    if (n > CHIP_MODEL_MAX_WORDS) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&cm_lock);
+    memcpy(cm_seq, words, n * sizeof(*words));
+    cm_seq_len = n;
+    cm_idx = 0;
+    k_spin_unlock(&cm_lock, key);
+    return 0;
+}
+
+size_t chip_model_cfg_get(uint32_t *w, size_t nwords)
+{
+    k_spinlock_key_t key = k_spin_lock(&cm_lock);
+    memcpy(w, cm_cfg, MIN(nwords, (size_t)CM_CFG_WORDS) * sizeof(*w));
+    k_spin_unlock(&cm_lock, key);
+    return CHIP_MODEL_CFG_BITS;
+}
+
+void chip_model_stats_get(struct chip_model_stats *st)
+{
+    k_spinlock_key_t key = k_spin_lock(&cm_lock);
+    *st = cm_stats;
+    k_spin_unlock(&cm_lock, key);
+}
+
+static int chip_model_init(void)
+{
+    const struct gpio_dt_spec *ctl[] = { &cm_cell, &cm_clk, &cm_wclk };
+    const struct device *watched[CM_MAX_PORTS] = { 0 };
+    int nwatched = 0;
+
+    for (int i = 0; i < CM_TX_COUNT; i++) {
+        int p = 0;
+
+        while (p < CM_MAX_PORTS && cm_txport[p].dev && cm_txport[p].dev != cm_tx[i].port) {
+            p++;
+        }
+        if (p == CM_MAX_PORTS) {
+            LOG_ERR("TX lines span more than %d ports", CM_MAX_PORTS);
+            return -ENOTSUP;
+        }
+        if (cm_txport[p].dev == NULL) {
+            cm_txport[p].dev = cm_tx[i].port;
+            memset(cm_txport[p].pin, 0xFF, sizeof(cm_txport[p].pin));
+        }
+        cm_txport[p].pin[i] = cm_tx[i].pin;
+        cm_txport[p].mask |= BIT(cm_tx[i].pin);
+    }
+
+    /* One callback per port that carries cell / clk_shift / clk_wrd */
+    for (int i = 0; i < (int)ARRAY_SIZE(ctl); i++) {
+        int p = 0;
+
+        while (p < nwatched && watched[p] != ctl[i]->port) {
+            p++;
+        }
+        if (p < nwatched) {
+            cm_cb[p].pin_mask |= BIT(ctl[i]->pin);
+            continue;
+        }
+        if (nwatched == CM_MAX_PORTS) {
+            return -ENOTSUP;
+        }
+        watched[nwatched] = ctl[i]->port;
+        gpio_init_callback(&cm_cb[nwatched], cm_on_output, BIT(ctl[i]->pin));
+        (void)gpio_add_callback(ctl[i]->port, &cm_cb[nwatched]);
+        nwatched++;
+    }
+
+    LOG_INF("Chip model attached (%u-bit config register%s)",
+            CHIP_MODEL_CFG_BITS, CM_HAVE_SDO ? ", sdo readback" : "");
+    return 0;
+}
+
+SYS_INIT(chip_model_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
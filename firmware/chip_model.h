@@ -0,0 +1,36 @@
+/* chip_model.h - behavioural LD-SPAD-TDC chip model for native_sim
+ *
+ * Sits on the emulated GPIOs and answers the firmware the way the chip
+ * does, so capture and configuration can be checked bit for bit without
+ * hardware:
+ *
+ *   Loop 4 : `cell` rising rewinds the word sequence; every `clk_shift`
+ *            rising edge while `cell` is high drives the next 14-bit word
+ *            on tx0..tx13 (tx0 = bit 0).
+ *   Loop 2 : every `clk_wrd` rising edge shifts `in_wrd` into a
+ *            CONFIG_APP_CHIP_MODEL_CFG_BITS long register; its last stage
+ *            is driven on `cfg-sdo` (if that alias exists).
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHIP_MODEL_MAX_WORDS 128
+#define CHIP_MODEL_CFG_BITS  CONFIG_APP_CHIP_MODEL_CFG_BITS
+
+struct chip_model_stats {
+    uint32_t frames;        /* cell rising edges */
+    uint32_t shift_edges;   /* clk_shift rising edges with cell high */
+    uint32_t cfg_edges;     /* clk_wrd rising edges */
+};
+
+/* Program the word sequence played on the TX lines (n <= 128). Words past
+   the end of the sequence read as 0. */
+int chip_model_load(const uint16_t *words, size_t n);
+
+/* Copy the configuration register (bit k in w[k / 32], bit k % 32) and
+   return its length in bits. */
+size_t chip_model_cfg_get(uint32_t *w, size_t nwords);
+
+void chip_model_stats_get(struct chip_model_stats *st);
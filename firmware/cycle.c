@@ -0,0 +1,144 @@
+/* cycle.c - periodic measurement cycles ("CY") */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+
+#include "cycle.h"
+
+LOG_MODULE_REGISTER(cycle, LOG_LEVEL_INF);
+
+/* Runs in the caller's thread, woken by cy_timer. The timer period is the
+   requested one rounded up to whole kernel ticks; deviations are measured
+   against that. Entries wait in cy_q for the caller's transport, so the
+   radio never delays the next cycle. */
+K_MSGQ_DEFINE(cy_q, sizeof(struct l4_cycle_ent), 2 * CY_REC_ENTRIES, 4);
+
+static const struct cy_ops *cy_ops;
+static struct k_spinlock cy_lock;
+static timing_t cy_expiry_t;            /* last expiry, cy_lock */
+
+/* Last run, for "CY?" and DONE_CY */
+static struct {
+    uint32_t cycles, missed, dropped;
+    uint32_t lost;                      /* entries that found no room in cy_q */
+    uint32_t late_max_ns, dev_max_ns;
+    uint64_t late_sum_ns;
+} cy_last;
+
+static void cy_expiry(struct k_timer *timer)
+{
+    k_spinlock_key_t key = k_spin_lock(&cy_lock);
+
+    cy_expiry_t = timing_counter_get();
+    k_spin_unlock(&cy_lock, key);
+}
+K_TIMER_DEFINE(cy_timer, cy_expiry, NULL);
+
+void cy_init(const struct cy_ops *ops)
+{
+    cy_ops = ops;
+}
+
+void cy_stop(void)
+{
+    k_timer_stop(&cy_timer);
+}
+
+size_t cy_take(struct l4_cycle_ent *ent, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max && k_msgq_get(&cy_q, &ent[n], K_NO_WAIT) == 0) {
+        n++;
+    }
+    return n;
+}
+
+void cy_summary(char *out, size_t out_len)
+{
+    snprintk(out, out_len, "n=%u l=%u/%uus j=%uus m=%u d=%u e=%u", cy_last.cycles,
+             cy_last.cycles ? (uint32_t)(cy_last.late_sum_ns / cy_last.cycles / NSEC_PER_USEC) : 0,
+             cy_last.late_max_ns / NSEC_PER_USEC, cy_last.dev_max_ns / NSEC_PER_USEC,
+             cy_last.missed, cy_last.dropped, cy_last.lost);
+}
+
+void cy_run(uint32_t period_us, uint32_t cycles, uint32_t steps, char *out, size_t out_len)
+{
+    uint64_t ticks = k_us_to_ticks_ceil64(period_us);
+    uint64_t period_ns = k_ticks_to_ns_floor64(ticks);
+    timing_t prev = 0;
+
+    memset(&cy_last, 0, sizeof(cy_last));
+    k_timer_start(&cy_timer, K_NO_WAIT, K_TICKS(ticks));
+
+    for (uint32_t k = 0; cycles == 0 || k < cycles; k++) {
+        uint32_t st = k_timer_status_sync(&cy_timer);
+        timing_t start = timing_counter_get();
+        struct l4_cycle_ent e = { .cycle = k };
+        timing_t expiry, end;
+
+        if (st == 0 || cy_ops->abort()) {
+            break;      /* timer stopped by "AB" */
+        }
+        k_spinlock_key_t key = k_spin_lock(&cy_lock);
+        expiry = cy_expiry_t;
+        k_spin_unlock(&cy_lock, key);
+
+        e.start_us = k_ticks_to_us_floor64(k_uptime_ticks());
+        e.missed = MIN(st - 1, UINT16_MAX);
+        e.late_ns = (uint32_t)MIN(timing_cycles_to_ns(timing_cycles_get(&expiry, &start)),
+                                  UINT32_MAX);
+        if (k > 0) {
+            uint64_t iv = timing_cycles_to_ns(timing_cycles_get(&prev, &expiry));
+            uint64_t due = period_ns * st;
+
+            e.interval_ns = (uint32_t)MIN(iv, UINT32_MAX);
+            cy_last.dev_max_ns = MAX(cy_last.dev_max_ns,
+                                     (uint32_t)MIN(iv > due ? iv - due : due - iv, UINT32_MAX));
+        }
+        prev = expiry;
+
+        if (steps & CY_STEP_RESET) {
+            cy_ops->reset();
+        }
+        if ((steps & CY_STEP_PULSES) && !cy_ops->abort()) {
+            cy_ops->pulses();
+        }
+        if ((steps & CY_STEP_CAPTURE) && !cy_ops->abort()) {
+            (void)cy_ops->capture(&e);
+        }
+        if (cy_ops->abort()) {
+            e.flags |= CY_F_ABORTED;
+        }
+        end = timing_counter_get();
+        e.run_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&start, &end)) / NSEC_PER_USEC);
+
+        cy_last.cycles++;
+        cy_last.missed += e.missed;
+        cy_last.dropped += (e.flags & CY_F_DROPPED) != 0;
+        cy_last.late_sum_ns += e.late_ns;
+        cy_last.late_max_ns = MAX(cy_last.late_max_ns, e.late_ns);
+
+        /* A full queue is flushed before the put, which may then wait up
+           to one period for the transport to make room */
+        if (k_msgq_num_free_get(&cy_q) == 0) {
+            cy_ops->flush();
+        }
+        if (k_msgq_put(&cy_q, &e, K_USEC(period_us)) != 0) {
+            cy_last.lost++;
+        }
+        if (k_msgq_num_used_get(&cy_q) >= CY_REC_ENTRIES) {
+            cy_ops->flush();
+        }
+    }
+    k_timer_stop(&cy_timer);
+    cy_ops->flush();
+
+    cy_summary(out, out_len);
+    LOG_INF("CY: period %u us (%llu ns), steps 0x%x: %s", period_us,
+            (unsigned long long)period_ns, steps, out);
+}
@@ -0,0 +1,70 @@
+/* cycle.h - periodic measurement cycles ("CY")
+ *
+ * A k_timer paces reset / pulse train / capture at a fixed period. Every
+ * cycle yields one entry; the caller sends them in batches as
+ * L4_REC_CYCLE records (frame_id = first cycle) next to the frames they
+ * describe, joined on frame_id. late_ns runs from the timer expiry to the
+ * start of the cycle, interval_ns between consecutive expiries (both from
+ * the timing API), missed counts periods that passed while the previous
+ * cycle was still running.
+ *
+ * The steps, the abort poll and the transport are the caller's (main.c
+ * runs Loops 1 and 3 and streams the frame through the FFF4 ring), so the
+ * scheduler runs and can be timed without any GPIO or radio.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#define CY_REC_ENTRIES   16
+#define CY_MIN_PERIOD_US 1000
+
+enum cy_step {
+    CY_STEP_RESET   = BIT(0),      /* Loop 1 */
+    CY_STEP_PULSES  = BIT(1),      /* Loop 3, WF n= pulses */
+    CY_STEP_CAPTURE = BIT(2),      /* Loop 4, frame streamed on FFF4 */
+};
+#define CY_STEP_ALL (CY_STEP_RESET | CY_STEP_PULSES | CY_STEP_CAPTURE)
+
+#define CY_F_FRAME   BIT(0)        /* frame_id is valid */
+#define CY_F_DROPPED BIT(1)        /* captured, but no buffer free to send it */
+#define CY_F_ABORTED BIT(2)
+
+struct l4_cycle_ent {
+    uint32_t cycle;
+    uint32_t frame_id;
+    uint64_t start_us;      /* uptime at the start of the cycle */
+    uint32_t late_ns;
+    uint32_t interval_ns;   /* 0 for the first cycle */
+    uint32_t run_us;        /* time spent in the steps */
+    uint16_t missed;
+    uint16_t flags;         /* CY_F_* */
+} __packed;
+
+struct cy_ops {
+    void (*reset)(void);                        /* CY_STEP_RESET */
+    void (*pulses)(void);                       /* CY_STEP_PULSES */
+    int (*capture)(struct l4_cycle_ent *e);     /* CY_STEP_CAPTURE: frame_id, CY_F_FRAME / _DROPPED */
+    void (*flush)(void);                        /* entries are waiting in cy_take() */
+    bool (*abort)(void);
+};
+
+/* ops is kept, not copied */
+void cy_init(const struct cy_ops *ops);
+
+/* `cycles` cycles of `steps` (enum cy_step) every period_us (0 cycles = until
+   cy_stop() or an abort); blocks the caller. The summary goes into out. */
+void cy_run(uint32_t period_us, uint32_t cycles, uint32_t steps, char *out, size_t out_len);
+
+/* "AB", any context: wakes a cy_run() waiting for its next period */
+void cy_stop(void);
+
+/* "CY?": the last run */
+void cy_summary(char *out, size_t out_len);
+
+/* Up to max queued entries, oldest first; the number taken */
+size_t cy_take(struct l4_cycle_ent *ent, size_t max);
@@ -0,0 +1,143 @@
+/* gpio_out.c - port-wide output transitions and the native_sim edge trace */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+
+#include "gpio_out.h"
+
+LOG_MODULE_REGISTER(gpio_out, LOG_LEVEL_INF);
+
+/* Where a signal lives; resolved once from the devicetree specs */
+struct out_pin {
+    uint8_t port;               /* index into out_port[] */
+    gpio_port_pins_t mask;
+    bool active_low;
+};
+
+const struct device *out_port[OUT_MAX_PORTS];
+static struct out_pin out_pin[OUT_MAX_SIGS];
+static uint16_t out_bound;
+
+int out_init(const struct gpio_dt_spec *const sig[], size_t n)
+{
+    int nports = 0;
+
+    for (size_t s = 0; s < MIN(n, (size_t)OUT_MAX_SIGS); s++) {
+        int p = 0;
+
+        if (sig[s] == NULL || !device_is_ready(sig[s]->port)) {
+            continue;
+        }
+        while (p < nports && out_port[p] != sig[s]->port) {
+            p++;
+        }
+        if (p == OUT_MAX_PORTS) {
+            LOG_WRN("Signal %u on a third port; left unbound", (unsigned)s);
+            continue;
+        }
+        if (p == nports) {
+            out_port[nports++] = sig[s]->port;
+        }
+        out_pin[s] = (struct out_pin){
+            .port = (uint8_t)p,
+            .mask = BIT(sig[s]->pin),
+            .active_low = (sig[s]->dt_flags & GPIO_ACTIVE_LOW) != 0,
+        };
+        out_bound |= BIT(s);
+    }
+    if (nports == 0) {
+        return -ENODEV;
+    }
+    LOG_INF("Outputs: signals 0x%03x on %d port(s)", out_bound, nports);
+    return 0;
+}
+
+uint16_t out_avail(void)
+{
+    return out_bound;
+}
+
+void out_build(struct out_xfer *x, uint16_t on, uint16_t off)
+{
+    memset(x, 0, sizeof(*x));
+    for (int s = 0; s < OUT_MAX_SIGS; s++) {
+        const struct out_pin *pin = &out_pin[s];
+
+        if (!(out_bound & BIT(s)) || !((on | off) & BIT(s))) {
+            continue;
+        }
+        if (((on & BIT(s)) != 0) != pin->active_low) {
+            x->set[pin->port] |= pin->mask;
+        } else {
+            x->clr[pin->port] |= pin->mask;
+        }
+    }
+    for (int p = 0; p < OUT_MAX_PORTS; p++) {
+        x->nwrites += (x->set[p] | x->clr[p]) != 0;
+    }
+}
+
+/* -------------------- Edge trace (native_sim) --------------------
+   gpio_emul runs a port's callbacks inside the write that changed its
+   outputs, with the pins that changed, so one entry is one port write. */
+#if defined(CONFIG_GPIO_EMUL)
+static struct gpio_callback out_cb[OUT_MAX_PORTS];
+static struct out_edge *out_trace;
+static size_t out_trace_cap, out_trace_len;
+
+static void out_on_change(const struct device *port, struct gpio_callback *cb,
+                          gpio_port_pins_t pins)
+{
+    if (out_trace_len < out_trace_cap) {
+        out_trace[out_trace_len++] = (struct out_edge){
+            .t = timing_counter_get(),
+            .port = (uint8_t)(cb - out_cb),
+            .pins = pins,
+        };
+    }
+}
+
+int out_trace_start(struct out_edge *buf, size_t cap)
+{
+    out_trace = buf;
+    out_trace_cap = cap;
+    out_trace_len = 0;
+    for (int p = 0; p < OUT_MAX_PORTS && out_port[p]; p++) {
+        gpio_port_pins_t mask = 0;
+
+        for (int s = 0; s < OUT_MAX_SIGS; s++) {
+            if ((out_bound & BIT(s)) && out_pin[s].port == p) {
+                mask |= out_pin[s].mask;
+            }
+        }
+        gpio_init_callback(&out_cb[p], out_on_change, mask);
+        (void)gpio_add_callback(out_port[p], &out_cb[p]);
+    }
+    return 0;
+}
+
+size_t out_trace_stop(void)
+{
+    for (int p = 0; p < OUT_MAX_PORTS && out_port[p]; p++) {
+        (void)gpio_remove_callback(out_port[p], &out_cb[p]);
+    }
+    out_trace_cap = 0;
+    return out_trace_len;
+}
+#else
+int out_trace_start(struct out_edge *buf, size_t cap)
+{
+    ARG_UNUSED(buf);
+    ARG_UNUSED(cap);
+    return -ENOTSUP;
+}
+
+size_t out_trace_stop(void)
+{
+    return 0;
+}
+#endif
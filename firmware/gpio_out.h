@@ -0,0 +1,72 @@
+/* gpio_out.h - port-wide output transitions for the chip's control lines
+ *
+ * The control lines are bound once, from their devicetree specs, and
+ * grouped per GPIO port. A transition (some signals asserted, others
+ * deasserted at the same instant) is precomputed into per-port raw
+ * set / clear masks with GPIO_ACTIVE_LOW folded in, so applying it is one
+ * gpio_port_set_clr_bits_raw() per port it touches: the lines of a port
+ * move together and no per-pin flag handling runs on the hot path.
+ *
+ * Signal numbers are the caller's (main.c binds enum seq_sig), up to 16.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/timing/timing.h>
+
+#define OUT_MAX_PORTS 2
+#define OUT_MAX_SIGS  16
+
+/* Per-port raw masks of one transition; out_apply_inv() swaps them */
+struct out_xfer {
+    gpio_port_pins_t set[OUT_MAX_PORTS];
+    gpio_port_pins_t clr[OUT_MAX_PORTS];
+    uint8_t nwrites;            /* ports touched */
+};
+
+/* One output change seen by the native_sim edge trace */
+struct out_edge {
+    timing_t t;                 /* timing counter at the write */
+    uint8_t  port;
+    gpio_port_pins_t pins;      /* pins that changed */
+};
+
+extern const struct device *out_port[OUT_MAX_PORTS];
+
+/* Bind sig[0..n) (NULL entries stay unbound). Signals on a third port are
+   left out with a warning. -ENODEV if nothing could be bound. */
+int out_init(const struct gpio_dt_spec *const sig[], size_t n);
+
+/* Bitmask of bound signals */
+uint16_t out_avail(void);
+
+/* Transition that asserts `on` and deasserts `off` (logical levels) */
+void out_build(struct out_xfer *x, uint16_t on, uint16_t off);
+
+static inline void out_apply(const struct out_xfer *x)
+{
+    for (int p = 0; p < OUT_MAX_PORTS; p++) {
+        if (x->set[p] | x->clr[p]) {
+            (void)gpio_port_set_clr_bits_raw(out_port[p], x->set[p], x->clr[p]);
+        }
+    }
+}
+
+/* The opposite transition: asserted signals deasserted and vice versa */
+static inline void out_apply_inv(const struct out_xfer *x)
+{
+    for (int p = 0; p < OUT_MAX_PORTS; p++) {
+        if (x->set[p] | x->clr[p]) {
+            (void)gpio_port_set_clr_bits_raw(out_port[p], x->clr[p], x->set[p]);
+        }
+    }
+}
+
+/* native_sim: record every output change of the bound ports (gpio_emul
+   callbacks, timestamped with the timing counter) into buf until
+   out_trace_stop(), which returns the number of edges recorded. */
+int out_trace_start(struct out_edge *buf, size_t cap);
+size_t out_trace_stop(void);
@@ -0,0 +1,206 @@
+/* l4_codec.c - Loop-4 frame encodings and CSV formatting */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <string.h>
+
+#include "l4_codec.h"
+
+/* -------------------- Encodings --------------------
+   Most rows of a frame are zero (no photon in that TDC slot), and the
+   non-zero ones often differ from their neighbour in a few low bits.
+
+   ZRLE: a stream of tokens. 0x80 | (n - 1) is a run of n zero rows;
+         0x00 | (n - 1) is followed by n literal rows (uint16 LE); n <= 128.
+   XBP:  d[r] = words[r] ^ words[r - 1] (words[-1] = 0), then a uint16 LE
+         mask of non-zero bit planes followed, for every plane p in the mask
+         from bit 0 up, by 16 bytes holding bit p of d[0..127] (row r in
+         byte r / 8, bit r % 8).
+
+   Both return the payload length, or -ENOSPC once they would reach `cap`,
+   so a frame is never sent larger than needed. */
+int l4_enc_zrle(const struct l4_frame *f, uint8_t *out, size_t cap)
+{
+    size_t n = 0;
+    int r = 0;
+
+    while (r < L4_TOTAL_READS) {
+        int run = 0;
+
+        if (f->words[r] == 0) {
+            while (r + run < L4_TOTAL_READS && f->words[r + run] == 0 && run < 128) {
+                run++;
+            }
+            if (n + 1 >= cap) {
+                return -ENOSPC;
+            }
+            out[n++] = 0x80 | (run - 1);
+        } else {
+            while (r + run < L4_TOTAL_READS && f->words[r + run] != 0 && run < 128) {
+                run++;
+            }
+            if (n + 1 + 2 * run >= cap) {
+                return -ENOSPC;
+            }
+            out[n++] = run - 1;
+            for (int i = 0; i < run; i++) {
+                sys_put_le16(f->words[r + i], &out[n]);
+                n += 2;
+            }
+        }
+        r += run;
+    }
+    return n;
+}
+
+int l4_enc_xbp(const struct l4_frame *f, uint8_t *out, size_t cap)
+{
+    uint8_t planes[L4_NUM_PINS][L4_TOTAL_READS / 8] = {0};
+    uint16_t mask = 0, prev = 0;
+    size_t n = 2;
+
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        uint16_t d = f->words[r] ^ prev;
+
+        prev = f->words[r];
+        mask |= d;
+        for (; d; d &= d - 1) {
+            planes[__builtin_ctz(d)][r / 8] |= BIT(r % 8);
+        }
+    }
+
+    if (2 + __builtin_popcount(mask) * sizeof(planes[0]) >= cap) {
+        return -ENOSPC;
+    }
+    sys_put_le16(mask, out);
+    for (int p = 0; p < L4_NUM_PINS; p++) {
+        if (mask & BIT(p)) {
+            memcpy(&out[n], planes[p], sizeof(planes[p]));
+            n += sizeof(planes[p]);
+        }
+    }
+    return n;
+}
+
+const struct l4_rec_hdr *l4_encode(const struct l4_frame *f, struct l4_enc_frame *e,
+                                   enum l4_enc_mode mode, size_t *bytes)
+{
+    size_t best = sizeof(f->words);
+    uint8_t enc = L4_ENC_RAW;
+    int n;
+
+    if (mode == L4_ENC_MODE_AUTO || mode == L4_ENC_MODE_XBP) {
+        n = l4_enc_xbp(f, e->payload, best);
+        if (n >= 0) {
+            best = n;
+            enc = L4_ENC_XBP;
+        }
+    }
+    if (mode == L4_ENC_MODE_AUTO || mode == L4_ENC_MODE_ZRLE) {
+        /* Only overwrites e->payload if it beats what is already there */
+        uint8_t tmp[sizeof(e->payload)];
+
+        n = l4_enc_zrle(f, tmp, best);
+        if (n >= 0) {
+            memcpy(e->payload, tmp, n);
+            best = n;
+            enc = L4_ENC_ZRLE;
+        }
+    }
+
+    if (bytes) {
+        *bytes = best;
+    }
+    if (enc == L4_ENC_RAW) {
+        return &f->hdr;
+    }
+
+    e->hdr = f->hdr;
+    e->hdr.encoding    = enc;
+    e->hdr.payload_len = sys_cpu_to_le16(best);
+    return &e->hdr;
+}
+
+int l4_decode(const struct l4_rec_hdr *hdr, uint16_t *w)
+{
+    const uint8_t *in = (const uint8_t *)(hdr + 1);
+    size_t len = sys_le16_to_cpu(hdr->payload_len);
+    size_t i = 0;
+    int r = 0;
+
+    switch (hdr->encoding) {
+    case L4_ENC_RAW:
+        for (; r < L4_TOTAL_READS; r++) {
+            w[r] = sys_get_le16(&in[2 * r]);
+        }
+        return 0;
+    case L4_ENC_ZRLE:
+        while (i < len) {
+            uint8_t t = in[i++];
+            int run = (t & 0x7F) + 1;
+
+            if (r + run > L4_TOTAL_READS) {
+                return -EINVAL;
+            }
+            for (int k = 0; k < run; k++, r++) {
+                w[r] = (t & 0x80) ? 0 : sys_get_le16(&in[i + 2 * k]);
+            }
+            if (!(t & 0x80)) {
+                i += 2 * run;
+            }
+        }
+        return (r == L4_TOTAL_READS) ? 0 : -EINVAL;
+    case L4_ENC_XBP: {
+        uint16_t mask = sys_get_le16(in), prev = 0;
+
+        memset(w, 0, L4_TOTAL_READS * sizeof(*w));
+        i = 2;
+        for (int p = 0; p < L4_NUM_PINS; p++) {
+            if (!(mask & BIT(p))) {
+                continue;
+            }
+            for (r = 0; r < L4_TOTAL_READS; r++) {
+                if (in[i + r / 8] & BIT(r % 8)) {
+                    w[r] |= BIT(p);
+                }
+            }
+            i += L4_TOTAL_READS / 8;
+        }
+        for (r = 0; r < L4_TOTAL_READS; r++) {
+            w[r] ^= prev;
+            prev = w[r];
+        }
+        return (i == len) ? 0 : -EINVAL;
+    }
+    default:
+        return -ENOTSUP;
+    }
+}
+
+/* -------------------- CSV ("04C", FFF3 reads) -------------------- */
+int l4_format_csv_row(char *line, uint16_t word, char term)
+{
+    int off = 0;
+
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        line[off++] = '0' + ((word >> i) & 1U);
+        line[off++] = ',';
+    }
+    off--;                       /* drop trailing comma */
+    if (term) {
+        line[off++] = term;
+    }
+    return off;
+}
+
+size_t l4_format_csv(const struct l4_frame *f, char *out)
+{
+    size_t used = 0;
+
+    for (int row = 0; row < L4_TOTAL_READS; row++) {
+        used += l4_format_csv_row(out + used, f->words[row], '\n');
+    }
+    return used;
+}
@@ -0,0 +1,93 @@
+/* l4_codec.h - Loop-4 frame record and its encodings
+ *
+ * A frame is 128 packed words (tx0 = bit 0) behind a binary header. This
+ * is also the on-air record streamed on FFF4 (little-endian, packed):
+ *   magic, version, type, encoding, frame_id, timestamp_us,
+ *   t_high/t_low/arm/sample (us), word_count, payload_len, words[]
+ * Other record types (calibration, histogram, trace, cycles) share the
+ * header. Bump L4_REC_VERSION whenever the header layout changes.
+ *
+ * Nothing here touches a GPIO or the radio, so the encoders and formatters
+ * can be checked and timed on their own ("Python Script/l4_codec.py" is the
+ * host-side reference decoder).
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+
+#define L4_NUM_PINS     14
+#define L4_TOTAL_READS  128
+#define L4_REC_MAGIC    0xA4
+#define L4_REC_VERSION  1
+
+/* One frame as "04C" CSV text: rows "b0,...,b13\n" */
+#define L4_CSV_BYTES    (L4_TOTAL_READS * 2 * L4_NUM_PINS)
+
+enum l4_rec_type {
+    L4_REC_FRAME = 1,
+    L4_REC_CAL   = 2,    /* payload: struct l4_cal_point[word_count] */
+    L4_REC_HIST  = 3,    /* payload: struct l4_hist_meta + uint32 counts[word_count] */
+    L4_REC_SEQTRACE = 4, /* payload: struct seq_trace_edge[word_count] */
+    L4_REC_CYCLE = 5,    /* payload: struct l4_cycle_ent[word_count] */
+};
+
+enum l4_rec_encoding {
+    L4_ENC_RAW  = 0,     /* words[] as uint16 LE */
+    L4_ENC_ZRLE = 1,     /* zero-row run length, see l4_enc_zrle() */
+    L4_ENC_XBP  = 2,     /* row-to-row XOR, bit planes, see l4_enc_xbp() */
+};
+
+/* "Z4 m=<mode>": which encoding FFF4 frames use */
+enum l4_enc_mode {
+    L4_ENC_MODE_RAW  = 0,
+    L4_ENC_MODE_AUTO = 1,     /* smallest of RAW / ZRLE / XBP per frame */
+    L4_ENC_MODE_ZRLE = 2,
+    L4_ENC_MODE_XBP  = 3,
+};
+
+struct l4_rec_hdr {
+    uint8_t  magic;
+    uint8_t  version;
+    uint8_t  type;          /* enum l4_rec_type */
+    uint8_t  encoding;      /* enum l4_rec_encoding */
+    uint32_t frame_id;      /* monotonic since boot */
+    uint64_t timestamp_us;  /* capture start (uptime) */
+    uint16_t t_high_us;
+    uint16_t t_low_us;
+    uint16_t arm_us;
+    uint16_t sample_us;
+    uint16_t word_count;
+    uint16_t payload_len;   /* bytes following the header */
+} __packed;
+
+struct l4_frame {
+    struct l4_rec_hdr hdr;
+    uint16_t words[L4_TOTAL_READS];
+} __packed;
+
+/* A frame re-encoded for the air; payload never exceeds the raw words[]
+   (the encoder falls back to L4_ENC_RAW rather than grow a frame). */
+struct l4_enc_frame {
+    struct l4_rec_hdr hdr;
+    uint8_t payload[L4_TOTAL_READS * sizeof(uint16_t)];
+} __packed;
+
+/* Payload encoders: the payload length, or -ENOSPC once it would reach cap */
+int l4_enc_zrle(const struct l4_frame *f, uint8_t *out, size_t cap);
+int l4_enc_xbp(const struct l4_frame *f, uint8_t *out, size_t cap);
+
+/* Header to transmit for f: f itself, or e re-encoded per mode when that
+   is smaller. *bytes (may be NULL) gets the payload length. */
+const struct l4_rec_hdr *l4_encode(const struct l4_frame *f, struct l4_enc_frame *e,
+                                   enum l4_enc_mode mode, size_t *bytes);
+
+/* Inverse of l4_encode(): the 128 words of a frame record */
+int l4_decode(const struct l4_rec_hdr *hdr, uint16_t *w);
+
+/* One word as "b0,b1,...,b13" plus term (if non-zero); returns the length */
+int l4_format_csv_row(char *line, uint16_t word, char term);
+
+/* All rows of a frame, '\n'-terminated, into out[L4_CSV_BYTES] */
+size_t l4_format_csv(const struct l4_frame *f, char *out);
@@ -0,0 +1,674 @@
+/* loop4.c - Loop 4: TX word capture, TDC histogram and timing calibration */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#if defined(CONFIG_GPIO_EMUL)
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#endif
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+
+#include "app_stat.h"
+#include "loop4.h"
+
+LOG_MODULE_REGISTER(loop4, LOG_LEVEL_INF);
+
+/* ---- Timing (boot defaults; "T4" changes them, "CAL4" searches) ---- */
+#define L4_T_HIGH_US   300   /* clk_shift high time per sample */
+#define L4_T_LOW_US    300   /* clk_shift low time per sample  */
+#define L4_ARM_US      1000   /* settle after (re)arming CEL    */
+#define L4_SAMPLE_US   60
+
+/* Written from the BT RX context ("T4"), by CAL4 and at settings load;
+   every frame takes one copy at its start. Both go through l4_timing_lock,
+   so a frame never runs on half an old and half a new timing. */
+static struct l4_timing l4_timing = {
+    .t_high_us = L4_T_HIGH_US,
+    .t_low_us  = L4_T_LOW_US,
+    .arm_us    = L4_ARM_US,
+    .sample_us = L4_SAMPLE_US,
+};
+static struct k_spinlock l4_timing_lock;
+
+/* ---- Low-power waits ("PWR") ----
+   Waits of at least L4_SLEEP_MIN_US sleep instead of spinning: the kernel
+   is tickless, so the CPU halts in the idle thread until the timer fires.
+   It wakes L4_WAKE_MARGIN_US early and busy-waits the rest against the
+   timing counter, so the clk_shift edges keep their busy-wait positions.
+   Charge per frame is the scheduler's active / idle split of the frame
+   multiplied by the CONFIG_APP_PWR_*_UA currents. */
+#define L4_SLEEP_MIN_US     CONFIG_APP_L4_SLEEP_MIN_US
+#define L4_WAKE_MARGIN_US   CONFIG_APP_L4_WAKE_MARGIN_US
+
+BUILD_ASSERT(L4_SLEEP_MIN_US > L4_WAKE_MARGIN_US, "sleep must outlast the wake-up margin");
+
+static atomic_t l4_low_power = ATOMIC_INIT(IS_ENABLED(CONFIG_APP_L4_LOW_POWER));
+static atomic_t l4_charge_uc;           /* since l4_stats_reset() */
+static uint32_t l4_charge_rem_nc;       /* capture paths: what is not a whole uC yet */
+
+/* Written by whichever context captures, read and cleared from the BT RX
+   context: every counter is atomic. */
+static atomic_t l4_cap_frames, l4_cap_last_us, l4_cap_max_us;
+static atomic_t l4_smp_min_ns, l4_smp_max_ns, l4_smp_jitter_ns;
+static atomic_t l4_pwr_active_us, l4_pwr_idle_us, l4_pwr_charge_nc, l4_pwr_late;
+
+/* Frames, histograms and sequencer samples share one frame_id sequence */
+static atomic_t l4_frame_seq;
+
+/* ---- Calibration ("CAL4") ---- */
+#define L4_CAL_SAMPLE_STEPS   4     /* sample points per period, 0..(steps-1)/steps of HIGH */
+
+struct l4_cal_rec {
+    struct l4_rec_hdr hdr;
+    struct l4_cal_point pt[L4_CAL_MAX_POINTS];
+} __packed;
+
+/* ---- TDC histogram ("H4") ----
+   Every 14-bit word of `shots` captures is binned as (word - lo) / width
+   into word_count uint32 counters; words below lo or at/above
+   lo + width * bins are only counted in underflow / overflow. */
+struct l4_hist_rec {
+    struct l4_rec_hdr hdr;
+    struct l4_hist_meta meta;
+    uint32_t counts[L4_HIST_MAX_BINS];
+} __packed;
+
+/* ---- Port-wide sampling ----
+   The TX lines are spread over gpio0/gpio1. Instead of 14 gpio_pin_get_dt()
+   calls per cycle we latch every port once with gpio_port_get_raw() and
+   rebuild the word from a gather table derived from the TX line specs
+   (i.e. the devicetree). The table is built once, by l4_init(). */
+#define L4_MAX_PORTS   2
+#define L4_BENCH_SAMPLES 4096
+#define L4_BENCH_PATTERN 0x2A5Bu   /* driven on the emulated TX lines */
+
+struct l4_gather {
+    const struct device *port[L4_MAX_PORTS];
+    uint8_t nports;
+    uint8_t src_port[L4_NUM_PINS];   /* index into port[] for each TX line */
+    uint8_t src_pin[L4_NUM_PINS];    /* pin number on that port            */
+    uint16_t invert;                 /* TX lines flagged GPIO_ACTIVE_LOW   */
+};
+static struct l4_gather l4_gather;
+static bool l4_gather_ready = false;
+
+static struct l4_lines l4_io;
+static bool (*l4_abort)(void);
+static int (*l4_send)(const struct l4_rec_hdr *rec);
+
+static int l4_gather_init(void)
+{
+    memset(&l4_gather, 0, sizeof(l4_gather));
+
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        const struct gpio_dt_spec *spec = l4_io.tx[i];
+        int p;
+
+        for (p = 0; p < l4_gather.nports; p++) {
+            if (l4_gather.port[p] == spec->port) {
+                break;
+            }
+        }
+        if (p == l4_gather.nports) {
+            if (l4_gather.nports >= L4_MAX_PORTS) {
+                LOG_ERR("Loop4: TX lines span more than %d ports", L4_MAX_PORTS);
+                return -ENOTSUP;
+            }
+            l4_gather.port[l4_gather.nports++] = spec->port;
+        }
+
+        l4_gather.src_port[i] = (uint8_t)p;
+        l4_gather.src_pin[i]  = spec->pin;
+        if (spec->dt_flags & GPIO_ACTIVE_LOW) {
+            l4_gather.invert |= BIT(i);
+        }
+    }
+
+    l4_gather_ready = true;
+    return 0;
+}
+
+int l4_init(const struct l4_lines *lines, bool (*abort)(void),
+            int (*send)(const struct l4_rec_hdr *rec))
+{
+    l4_io = *lines;
+    l4_abort = abort;
+    l4_send = send;
+    l4_gather_ready = false;
+    return l4_gather_init();
+}
+
+struct l4_timing l4_timing_get(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&l4_timing_lock);
+    struct l4_timing t = l4_timing;
+
+    k_spin_unlock(&l4_timing_lock, key);
+    return t;
+}
+
+void l4_timing_set(const struct l4_timing *t)
+{
+    k_spinlock_key_t key = k_spin_lock(&l4_timing_lock);
+
+    l4_timing = *t;
+    k_spin_unlock(&l4_timing_lock, key);
+}
+
+void l4_low_power_set(bool on)
+{
+    atomic_set(&l4_low_power, on);
+}
+
+bool l4_low_power_get(void)
+{
+    return atomic_get(&l4_low_power) != 0;
+}
+
+void l4_stats_get(struct l4_stats *s)
+{
+    s->frames        = atomic_get(&l4_cap_frames);
+    s->last_us       = atomic_get(&l4_cap_last_us);
+    s->max_us        = atomic_get(&l4_cap_max_us);
+    s->smp_min_ns    = atomic_get(&l4_smp_min_ns);
+    s->smp_max_ns    = atomic_get(&l4_smp_max_ns);
+    s->smp_jitter_ns = atomic_get(&l4_smp_jitter_ns);
+    s->active_us     = atomic_get(&l4_pwr_active_us);
+    s->idle_us       = atomic_get(&l4_pwr_idle_us);
+    s->charge_nc     = atomic_get(&l4_pwr_charge_nc);
+    s->total_uc      = atomic_get(&l4_charge_uc);
+    s->late          = atomic_get(&l4_pwr_late);
+}
+
+void l4_stats_reset(void)
+{
+    atomic_clear(&l4_cap_frames);
+    atomic_clear(&l4_cap_last_us);
+    atomic_clear(&l4_cap_max_us);
+    atomic_clear(&l4_smp_min_ns);
+    atomic_clear(&l4_smp_max_ns);
+    atomic_clear(&l4_smp_jitter_ns);
+    atomic_clear(&l4_pwr_active_us);
+    atomic_clear(&l4_pwr_idle_us);
+    atomic_clear(&l4_pwr_charge_nc);
+    atomic_clear(&l4_pwr_late);
+    atomic_clear(&l4_charge_uc);
+}
+
+uint32_t l4_next_frame_id(void)
+{
+    return (uint32_t)atomic_inc(&l4_frame_seq);
+}
+
+/* -------------------- Sampling paths -------------------- */
+/* Reference path: one driver call per line, lines sampled at different times. */
+static inline uint16_t l4_sample_pins(void)
+{
+    uint16_t word = 0;
+
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        if (gpio_pin_get_dt(l4_io.tx[i]) > 0) {
+            word |= BIT(i);
+        }
+    }
+    return word;
+}
+
+/* Fast path: latch all ports back to back, then gather bits off the hot window. */
+static inline uint16_t l4_sample_port(void)
+{
+    gpio_port_value_t val[L4_MAX_PORTS] = {0};
+    uint16_t word = 0;
+
+    for (int p = 0; p < l4_gather.nports; p++) {
+        (void)gpio_port_get_raw(l4_gather.port[p], &val[p]);
+    }
+
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        word |= (uint16_t)(((val[l4_gather.src_port[i]] >> l4_gather.src_pin[i]) & 1U) << i);
+    }
+    return word ^ l4_gather.invert;
+}
+
+uint16_t l4_sample(void)
+{
+    return l4_sample_port();
+}
+
+/* -------------------- Capture -------------------- */
+static void l4_wait_us(uint32_t us)
+{
+    if (us < L4_SLEEP_MIN_US || !atomic_get(&l4_low_power)) {
+        k_busy_wait(us);
+        return;
+    }
+
+    timing_t t0 = timing_counter_get(), t1;
+    uint32_t slept_us;
+
+    k_sleep(K_USEC(us - L4_WAKE_MARGIN_US));
+    t1 = timing_counter_get();
+    slept_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&t0, &t1)) / NSEC_PER_USEC);
+    if (slept_us < us) {
+        k_busy_wait(us - slept_us);
+    } else {
+        atomic_inc(&l4_pwr_late);
+    }
+}
+
+/* CPU cycles (all threads) spent active and idle, for the per-frame split */
+static void l4_cpu_cycles(uint64_t *active, uint64_t *idle)
+{
+#if defined(CONFIG_THREAD_RUNTIME_STATS) && defined(CONFIG_SCHED_THREAD_USAGE_ALL)
+    k_thread_runtime_stats_t rt;
+
+    if (k_thread_runtime_stats_all_get(&rt) == 0) {
+        *active = rt.total_cycles;
+        *idle = rt.idle_cycles;
+        return;
+    }
+#endif
+    *active = *idle = 0;
+}
+
+int l4_capture_prepare(void)
+{
+    if (!device_is_ready(l4_io.cell->port) || !device_is_ready(l4_io.clk_shift->port)) {
+        LOG_ERR("Loop4: control GPIOs not ready!");
+        return -ENODEV;
+    }
+
+    /* Configure inputs with NO pulls (don’t force them low) */
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        if (!device_is_ready(l4_io.tx[i]->port)) {
+            LOG_ERR("Loop4: TX GPIO %d not ready!", i);
+            return -ENODEV;
+        }
+        (void)gpio_pin_configure_dt(l4_io.tx[i], GPIO_INPUT);
+    }
+
+    if (!l4_gather_ready) {
+        return -ENOTSUP;
+    }
+
+    (void)gpio_pin_configure_dt(l4_io.cell,      GPIO_OUTPUT_INACTIVE);
+    (void)gpio_pin_configure_dt(l4_io.clk_shift, GPIO_OUTPUT_INACTIVE);
+    return 0;
+}
+
+int l4_capture_run(struct l4_frame *f, const struct l4_timing *t)
+{
+    uint64_t t_start_us = k_ticks_to_us_floor64(k_uptime_ticks());
+
+    /* Start capture window and keep it HIGH for the whole frame */
+    timing_t t_frame = timing_counter_get();
+    timing_t t_prev = t_frame, t_now;
+    uint64_t smp_min = UINT64_MAX, smp_max = 0;
+    uint64_t act0, idle0, act1, idle1;
+
+    l4_cpu_cycles(&act0, &idle0);
+    gpio_pin_set_dt(l4_io.cell, 1);
+    l4_wait_us(t->arm_us);
+
+    for (int cycle = 0; cycle < L4_TOTAL_READS; cycle++) {
+        if (l4_abort()) {
+            gpio_pin_set_dt(l4_io.clk_shift, 0);
+            gpio_pin_set_dt(l4_io.cell, 0);
+            LOG_INF("Loop4: capture aborted at cycle %d.", cycle);
+            return -ECANCELED;
+        }
+
+        /* Rising edge requests/advances the next word */
+        gpio_pin_set_dt(l4_io.clk_shift, 1);
+        l4_wait_us(t->sample_us);
+
+        /* Sample during the stable portion of HIGH (all ports in one go) */
+        f->words[cycle] = l4_sample_port();
+
+        /* Sample-to-sample interval; conversion to ns waits for the end */
+        t_now = timing_counter_get();
+        if (cycle > 0) {
+            uint64_t d = timing_cycles_get(&t_prev, &t_now);
+
+            smp_min = MIN(smp_min, d);
+            smp_max = MAX(smp_max, d);
+        }
+        t_prev = t_now;
+
+        /* Finish the pulse */
+        l4_wait_us(t->t_high_us - t->sample_us);
+        gpio_pin_set_dt(l4_io.clk_shift, 0);
+        l4_wait_us(t->t_low_us);
+    }
+
+    /* End capture window (only after all 128 pulses) */
+    gpio_pin_set_dt(l4_io.cell, 0);
+    t_now = timing_counter_get();
+
+    uint32_t cap_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&t_frame, &t_now)) / 1000U);
+    uint32_t min_ns = (uint32_t)timing_cycles_to_ns(smp_min);
+    uint32_t max_ns = (uint32_t)timing_cycles_to_ns(smp_max);
+
+    atomic_inc(&l4_cap_frames);
+    atomic_set(&l4_cap_last_us, cap_us);
+    app_stat_max(&l4_cap_max_us, cap_us);
+    app_stat_min(&l4_smp_min_ns, min_ns);
+    app_stat_max(&l4_smp_max_ns, max_ns);
+    atomic_set(&l4_smp_jitter_ns, max_ns - min_ns);
+
+    l4_cpu_cycles(&act1, &idle1);
+    uint32_t act_us = (uint32_t)k_cyc_to_us_floor64(act1 - act0);
+    uint32_t idle_us = (uint32_t)k_cyc_to_us_floor64(idle1 - idle0);
+    uint32_t q_nc = (uint32_t)(((uint64_t)act_us * CONFIG_APP_PWR_ACTIVE_UA +
+                                (uint64_t)idle_us * CONFIG_APP_PWR_IDLE_UA) / 1000U);
+
+    atomic_set(&l4_pwr_active_us, act_us);
+    atomic_set(&l4_pwr_idle_us, idle_us);
+    atomic_set(&l4_pwr_charge_nc, q_nc);
+    l4_charge_rem_nc += q_nc;
+    (void)atomic_add(&l4_charge_uc, l4_charge_rem_nc / 1000U);
+    l4_charge_rem_nc %= 1000U;
+
+    /* Optional: pulse rstctrl if its device is ready (harmless if alias not present) */
+    if (l4_io.rst_ctr && device_is_ready(l4_io.rst_ctr->port)) {
+        (void)gpio_pin_configure_dt(l4_io.rst_ctr, GPIO_OUTPUT_INACTIVE);
+        gpio_pin_set_dt(l4_io.rst_ctr, 0);
+        gpio_pin_set_dt(l4_io.rst_ctr, 1);
+    }
+
+    f->hdr.magic       = L4_REC_MAGIC;
+    f->hdr.version     = L4_REC_VERSION;
+    f->hdr.type        = L4_REC_FRAME;
+    f->hdr.encoding    = L4_ENC_RAW;
+    f->hdr.frame_id    = sys_cpu_to_le32(l4_next_frame_id());
+    f->hdr.timestamp_us = sys_cpu_to_le64(t_start_us);
+    f->hdr.t_high_us   = sys_cpu_to_le16(t->t_high_us);
+    f->hdr.t_low_us    = sys_cpu_to_le16(t->t_low_us);
+    f->hdr.arm_us      = sys_cpu_to_le16(t->arm_us);
+    f->hdr.sample_us   = sys_cpu_to_le16(t->sample_us);
+    f->hdr.word_count  = sys_cpu_to_le16(L4_TOTAL_READS);
+    f->hdr.payload_len = sys_cpu_to_le16(sizeof(f->words));
+    return 0;
+}
+
+int l4_capture_frame(struct l4_frame *f, const struct l4_timing *t)
+{
+    int err = l4_capture_prepare();
+
+    return err ? err : l4_capture_run(f, t);
+}
+
+int run_led_loop4(struct l4_frame *f)
+{
+    struct l4_timing t = l4_timing_get();
+    int err = l4_capture_frame(f, &t);
+
+    if (err) {
+        return err;
+    }
+
+int ones = 0, first_nonzero = -1, last_nonzero = -1;
+for (int r = 0; r < L4_TOTAL_READS; r++) {
+    if (f->words[r]) {
+        ones++;
+        if (first_nonzero < 0) first_nonzero = r;
+        last_nonzero = r;
+    }
+}
+LOG_INF("L4 diag: rows with any '1' = %d/%d (first=%d last=%d)",
+        ones, L4_TOTAL_READS, first_nonzero, last_nonzero);
+
+    LOG_INF("Loop4: 128 pulses with continuous CEL=HIGH complete.");
+    return 0;
+}
+
+/* -------------------- Sampling benchmark --------------------
+   Cycles per sample for the per-pin path and the port-wide path, measured
+   with the timing API (DWT on the nRF5340, gpio_emul on native_sim). Both
+   paths must agree on the sampled word or the result is flagged. */
+uint32_t l4_bench_sampling(char *out, size_t out_len, uint32_t *pin_cyc)
+{
+    volatile uint16_t sink = 0;
+    timing_t start, end;
+    uint64_t pin_sum, port_sum;
+    uint16_t ref, fast;
+
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        if (!device_is_ready(l4_io.tx[i]->port)) {
+            LOG_ERR("Bench: TX GPIO %d not ready!", i);
+            return 0;
+        }
+        (void)gpio_pin_configure_dt(l4_io.tx[i], GPIO_INPUT);
+    }
+    if (!l4_gather_ready) {
+        return 0;
+    }
+
+#if defined(CONFIG_GPIO_EMUL)
+    /* Give both paths a non-trivial word to agree on */
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        (void)gpio_emul_input_set(l4_io.tx[i]->port, l4_io.tx[i]->pin,
+                                  (L4_BENCH_PATTERN >> i) & 1U);
+    }
+#endif
+
+    start = timing_counter_get();
+    for (int n = 0; n < L4_BENCH_SAMPLES; n++) {
+        sink ^= l4_sample_pins();
+    }
+    end = timing_counter_get();
+    pin_sum = timing_cycles_get(&start, &end);
+
+    start = timing_counter_get();
+    for (int n = 0; n < L4_BENCH_SAMPLES; n++) {
+        sink ^= l4_sample_port();
+    }
+    end = timing_counter_get();
+    port_sum = timing_cycles_get(&start, &end);
+
+    ref  = l4_sample_pins();
+    fast = l4_sample_port();
+    (void)sink;
+
+    LOG_INF("Bench L4 sample: pin=%u cyc port=%u cyc (%u ports, word %s)",
+            (unsigned)(pin_sum / L4_BENCH_SAMPLES),
+            (unsigned)(port_sum / L4_BENCH_SAMPLES),
+            l4_gather.nports, (ref == fast) ? "match" : "MISMATCH");
+
+    if (out) {
+        snprintk(out, out_len, "%u/%u%s",
+                 (unsigned)(pin_sum / L4_BENCH_SAMPLES),
+                 (unsigned)(port_sum / L4_BENCH_SAMPLES),
+                 (ref == fast) ? "" : " ERR");
+    }
+    if (pin_cyc) {
+        *pin_cyc = (uint32_t)(pin_sum / L4_BENCH_SAMPLES);
+    }
+    return (uint32_t)(port_sum / L4_BENCH_SAMPLES);
+}
+
+/* -------------------- Timing calibration --------------------
+   Captures a reference frame at the current (known good) timing, then walks
+   the clk_shift period down in 3/4 steps and, per period, tries several
+   sample positions inside the HIGH phase. A point passes when `repeats`
+   frames are bit-identical to the reference on all 14 lines. The sweep
+   ends at the first period with no passing point; the shortest passing
+   period, sampled at the centre of its passing window, is the result.
+   The whole scan (eye map) goes out as an L4_REC_CAL record. */
+static struct l4_frame l4_cal_ref;
+static struct l4_frame l4_cal_try;
+static struct l4_cal_rec l4_cal_rec;
+
+/* Lines that differ from the reference anywhere in the frame, plus bit count */
+static uint16_t l4_cal_compare(const struct l4_frame *a, const struct l4_frame *b,
+                               uint32_t *bit_errors)
+{
+    uint16_t bad = 0;
+
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        uint16_t diff = a->words[r] ^ b->words[r];
+
+        bad |= diff;
+        for (; diff; diff &= diff - 1) {
+            (*bit_errors)++;
+        }
+    }
+    return bad;
+}
+
+int l4_calibrate(uint32_t repeats, uint32_t min_period_us, struct l4_timing *best)
+{
+    struct l4_timing base = l4_timing_get();
+    uint32_t period = base.t_high_us + base.t_low_us;
+    uint16_t npts = 0;
+    uint32_t errs = 0;
+    int err;
+
+    *best = base;
+
+    /* Reference, and check it is reproducible at the starting timing */
+    err = l4_capture_frame(&l4_cal_ref, &base);
+    if (err) {
+        return err;
+    }
+    for (uint32_t n = 0; n < repeats; n++) {
+        if (l4_capture_frame(&l4_cal_try, &base) != 0 ||
+            l4_cal_compare(&l4_cal_ref, &l4_cal_try, &errs) != 0) {
+            return -EIO;
+        }
+    }
+
+    while (period >= MAX(min_period_us, 2U) && npts < L4_CAL_MAX_POINTS) {
+        struct l4_timing t = base;
+        int pass_lo = -1, pass_hi = -1;
+
+        t.t_high_us = period / 2;
+        t.t_low_us  = period - t.t_high_us;
+
+        for (int k = 0; k < L4_CAL_SAMPLE_STEPS && npts < L4_CAL_MAX_POINTS; k++) {
+            struct l4_cal_point *pt = &l4_cal_rec.pt[npts++];
+            uint16_t bad = 0;
+
+            errs = 0;
+            t.sample_us = (t.t_high_us * k) / L4_CAL_SAMPLE_STEPS;
+
+            for (uint32_t n = 0; n < repeats; n++) {
+                if (l4_abort() || l4_capture_frame(&l4_cal_try, &t) != 0) {
+                    return -ECANCELED;
+                }
+                bad |= l4_cal_compare(&l4_cal_ref, &l4_cal_try, &errs);
+            }
+
+            pt->period_us   = sys_cpu_to_le16(period);
+            pt->sample_us   = sys_cpu_to_le16(t.sample_us);
+            pt->stable_mask = sys_cpu_to_le16(L4_ALL_LINES & ~bad);
+            pt->bit_errors  = sys_cpu_to_le16(MIN(errs, UINT16_MAX));
+
+            if (bad == 0) {
+                if (pass_lo < 0) {
+                    pass_lo = k;
+                }
+                pass_hi = k;
+            }
+        }
+
+        if (pass_lo < 0) {
+            break;      /* nothing passes at this period: stop here */
+        }
+        *best = t;
+        best->sample_us = (t.t_high_us * ((pass_lo + pass_hi) / 2)) / L4_CAL_SAMPLE_STEPS;
+
+        period = (period * 3) / 4;
+    }
+
+    LOG_INF("Loop4 cal: %u points, best h=%u l=%u s=%u",
+            npts, best->t_high_us, best->t_low_us, best->sample_us);
+
+    l4_cal_rec.hdr = l4_cal_ref.hdr;
+    l4_cal_rec.hdr.type        = L4_REC_CAL;
+    l4_cal_rec.hdr.t_high_us   = sys_cpu_to_le16(best->t_high_us);
+    l4_cal_rec.hdr.t_low_us    = sys_cpu_to_le16(best->t_low_us);
+    l4_cal_rec.hdr.arm_us      = sys_cpu_to_le16(best->arm_us);
+    l4_cal_rec.hdr.sample_us   = sys_cpu_to_le16(best->sample_us);
+    l4_cal_rec.hdr.word_count  = sys_cpu_to_le16(npts);
+    l4_cal_rec.hdr.payload_len = sys_cpu_to_le16(npts * sizeof(struct l4_cal_point));
+    return l4_send ? l4_send(&l4_cal_rec.hdr) : 0;
+}
+
+/* -------------------- TDC histogram --------------------
+   Repeats the capture `shots` times at the current T4 timing and bins
+   every word on the fly, so only the histogram crosses the radio: a long
+   integration costs one L4_REC_HIST record instead of one frame per shot.
+   An abort stops early and still sends what was accumulated. */
+static struct l4_hist_rec l4_hist;
+
+int l4_histogram(struct l4_frame *f, uint32_t shots, uint32_t width, uint32_t lo,
+                 uint32_t bins, char *out, size_t out_len)
+{
+    struct l4_timing t = l4_timing_get();
+    uint32_t span = width * bins;
+    uint32_t under = 0, over = 0, n;
+    uint64_t t0_us = 0;
+
+    memset(l4_hist.counts, 0, bins * sizeof(l4_hist.counts[0]));
+
+    for (n = 0; n < shots; n++) {
+        if (l4_capture_frame(f, &t) != 0) {
+            break;      /* aborted (or no GPIOs): keep the partial histogram */
+        }
+        if (n == 0) {
+            t0_us = sys_le64_to_cpu(f->hdr.timestamp_us);
+        }
+
+        for (int r = 0; r < L4_TOTAL_READS; r++) {
+            uint32_t d = (uint32_t)f->words[r] - lo;   /* wraps below lo */
+
+            if ((int32_t)d < 0) {
+                under++;
+            } else if (d >= span) {
+                over++;
+            } else {
+                l4_hist.counts[d / width]++;
+            }
+        }
+    }
+
+    LOG_INF("Loop4 hist: %u/%u shots, %u bins x %u from %u, under=%u over=%u",
+            n, shots, bins, width, lo, under, over);
+
+    l4_hist.hdr = f->hdr;
+    l4_hist.hdr.type         = L4_REC_HIST;
+    l4_hist.hdr.frame_id     = sys_cpu_to_le32(l4_next_frame_id());
+    l4_hist.hdr.timestamp_us = sys_cpu_to_le64(t0_us);
+    l4_hist.hdr.word_count   = sys_cpu_to_le16(bins);
+    l4_hist.hdr.payload_len  = sys_cpu_to_le16(sizeof(l4_hist.meta) +
+                                               bins * sizeof(l4_hist.counts[0]));
+    l4_hist.meta.shots     = sys_cpu_to_le32(n);
+    l4_hist.meta.lo        = sys_cpu_to_le16(lo);
+    l4_hist.meta.width     = sys_cpu_to_le16(width);
+    l4_hist.meta.underflow = sys_cpu_to_le32(under);
+    l4_hist.meta.overflow  = sys_cpu_to_le32(over);
+    for (uint32_t b = 0; b < bins; b++) {
+        l4_hist.counts[b] = sys_cpu_to_le32(l4_hist.counts[b]);
+    }
+
+    if (n > 0 && l4_send) {
+        int err = l4_send(&l4_hist.hdr);
+
+        if (err) {
+            LOG_WRN("Loop4 hist: record not sent (err %d)", err);
+            if (out) {
+                snprintk(out, out_len, "send %d", err);
+            }
+            return err;
+        }
+    }
+    if (out) {
+        snprintk(out, out_len, "n=%u u=%u o=%u", n, under, over);
+    }
+    return (int)n;
+}
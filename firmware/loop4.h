@@ -0,0 +1,140 @@
+/* loop4.h - Loop 4: TX word capture, TDC histogram and timing calibration
+ *
+ * A frame is 128 words of the chip: `cell` is held high for the frame and
+ * every clk_shift pulse brings the next 14-bit word onto tx0..tx13, which
+ * is sampled `sample_us` after the rising edge with one raw read per GPIO
+ * port (the gather table that rebuilds the word comes from the TX line
+ * specs). The timing is tunable at runtime ("T4", "CAL4") and published
+ * under a lock, so a frame never runs on half an old and half a new one.
+ *
+ * The lines, the abort poll and the record sink are the caller's (main.c
+ * binds the devicetree aliases and FFF4), so captures, the histogram and
+ * the CAL4 sweep run on any set of GPIOs, the emulated ones included.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/util.h>
+
+#include "l4_codec.h"
+
+#define L4_ALL_LINES      BIT_MASK(L4_NUM_PINS)
+#define L4_CODE_MAX       BIT(L4_NUM_PINS)     /* exclusive */
+#define L4_HIST_MAX_BINS  CONFIG_APP_L4_HIST_BINS
+
+/* "CAL4" defaults */
+#define L4_CAL_REPEATS        4
+#define L4_CAL_MIN_PERIOD_US  2
+#define L4_CAL_MAX_POINTS     64
+
+struct l4_timing {
+    uint16_t t_high_us;
+    uint16_t t_low_us;
+    uint16_t arm_us;
+    uint16_t sample_us;      /* <= t_high_us, measured from the rising edge */
+};
+
+/* "CAL4": one point per (clock period, sample position) step; stable_mask
+   has a bit set for every TX line that matched the reference in all
+   repeats. */
+struct l4_cal_point {
+    uint16_t period_us;
+    uint16_t sample_us;
+    uint16_t stable_mask;
+    uint16_t bit_errors;     /* saturating, over all repeats */
+} __packed;
+
+/* "H4": leads the counts of an L4_REC_HIST record */
+struct l4_hist_meta {
+    uint32_t shots;         /* captures actually binned (less on abort) */
+    uint16_t lo;            /* first code of bin 0 */
+    uint16_t width;         /* codes per bin */
+    uint32_t underflow;
+    uint32_t overflow;
+} __packed;
+
+/* Largest H4 and CAL4 records, header included */
+#define L4_HIST_REC_MAX_BYTES (sizeof(struct l4_rec_hdr) + sizeof(struct l4_hist_meta) + \
+                               L4_HIST_MAX_BINS * sizeof(uint32_t))
+#define L4_CAL_REC_MAX_BYTES  (sizeof(struct l4_rec_hdr) + \
+                               L4_CAL_MAX_POINTS * sizeof(struct l4_cal_point))
+
+struct l4_lines {
+    const struct gpio_dt_spec *tx[L4_NUM_PINS];
+    const struct gpio_dt_spec *cell;
+    const struct gpio_dt_spec *clk_shift;
+    const struct gpio_dt_spec *rst_ctr;     /* pulsed after each frame, may be NULL */
+};
+
+/* Capture counters (FFF6, "PWR?") since l4_stats_reset() */
+struct l4_stats {
+    uint32_t frames;
+    uint32_t last_us;        /* frame duration */
+    uint32_t max_us;
+    uint32_t smp_min_ns;     /* clk_shift sample-to-sample interval */
+    uint32_t smp_max_ns;
+    uint32_t smp_jitter_ns;  /* longest - shortest, last frame */
+    uint32_t active_us;      /* CPU active / idle time, last frame */
+    uint32_t idle_us;
+    uint32_t charge_nc;      /* estimated charge, last frame */
+    uint32_t total_uc;       /* all frames */
+    uint32_t late;           /* low-power sleeps that overran their deadline */
+};
+
+/* Bind the lines (copied) and build the gather table. abort is polled
+   once per sample; send (may be NULL) takes the H4 and CAL4 records. */
+int l4_init(const struct l4_lines *lines, bool (*abort)(void),
+            int (*send)(const struct l4_rec_hdr *rec));
+
+struct l4_timing l4_timing_get(void);
+void l4_timing_set(const struct l4_timing *t);
+
+/* "PWR l=": sleep through waits of at least CONFIG_APP_L4_SLEEP_MIN_US */
+void l4_low_power_set(bool on);
+bool l4_low_power_get(void);
+
+void l4_stats_get(struct l4_stats *s);
+void l4_stats_reset(void);
+
+/* frame_id for the next record (frames, histograms, sequencer samples) */
+uint32_t l4_next_frame_id(void);
+
+/* One TX word, port-wide read; the inputs must be prepared */
+uint16_t l4_sample(void);
+
+/* Ready the TX inputs and control outputs; once per frame or per burst */
+int l4_capture_prepare(void);
+
+/* One frame on prepared lines: cell window, 128 clk_shift pulses, header.
+   -ECANCELED on abort. */
+int l4_capture_run(struct l4_frame *f, const struct l4_timing *t);
+
+/* Prepare and run */
+int l4_capture_frame(struct l4_frame *f, const struct l4_timing *t);
+
+/* Cycles per sample of the per-pin and the port-wide path ("B4"); the
+   port-wide figure, 0 if the lines are unavailable. pin_cyc (may be NULL)
+   gets the per-pin one. */
+uint32_t l4_bench_sampling(char *out, size_t out_len, uint32_t *pin_cyc);
+
+/* "04": one capture into f at the current timing */
+int run_led_loop4(struct l4_frame *f);
+
+/* "H4": `shots` captures binned as (word - lo) / width into `bins`
+   counters (width < L4_CODE_MAX, width * bins <= UINT32_MAX, bins <=
+   L4_HIST_MAX_BINS), sent as an L4_REC_HIST record. The last shot stays in
+   f. Returns the shots binned (fewer on abort), or the send error; the
+   record is only sent, and can only fail, after at least one shot. */
+int l4_histogram(struct l4_frame *f, uint32_t shots, uint32_t width, uint32_t lo,
+                 uint32_t bins, char *out, size_t out_len);
+
+/* "CAL4": sweep clk_shift period and sample position against a reference
+   frame taken at the current timing, send the eye map as an L4_REC_CAL
+   record and leave the shortest passing timing in *best (the current one
+   if nothing shorter passes). -EIO if the reference does not reproduce,
+   -ECANCELED on abort, the send error if the eye map could not be sent
+   (*best is set all the same). */
+int l4_calibrate(uint32_t repeats, uint32_t min_period_us, struct l4_timing *best);
@@ -0,0 +1,232 @@
+/* loops.c - Loops 1-3: chip reset, configuration word, pulse train */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+
+#include "gpio_out.h"
+#include "loops.h"
+#include "waveform.h"
+
+LOG_MODULE_REGISTER(loops, LOG_LEVEL_INF);
+
+#define L1_SIGS (L1_RESET | BIT(SEQ_SIG_ENBIAS) | BIT(SEQ_SIG_STAB))
+#define L2_SIGS (BIT(SEQ_SIG_CLK_WRD) | BIT(SEQ_SIG_IN_WRD))
+
+/* 95 bits, MSB-first in the sender; we output 95 pulses.
+   Power-on default of the configuration word; FFF5 replaces it at runtime. */
+static const bool data[95] = {
+    1,1,1,1,1,
+    1,1,1,1,1,1,1,0,1,1,1,1,1,1,1,1,1,1,1,1,0,0,1,1,0,1,1,1,1,1,1,0,
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,
+    0,1,1,1,1,0,1,1,1,1
+};
+
+static const struct gpio_dt_spec *lp_sig[SEQ_SIG_COUNT];
+static const struct gpio_dt_spec *lp_sdo;     /* optional cfg-sdo readback */
+static bool (*lp_abort)(void);
+
+static struct l2_word l2_staged;          /* applied by the next "02" */
+static struct l2_word l2_applied;         /* last word shifted out */
+static bool l2_applied_valid = false;
+static struct k_spinlock l2_lock;         /* l2_staged: BT RX vs executor */
+
+/* Loops 1 and 2 drive the control lines through gpio_out: every
+   transition is precomputed once into per-port masks, so lines that
+   change together move in the same port write. */
+static struct out_xfer l1_hold, l1_release, l1_stab;
+
+/* Loop-2 transitions: data = bit together with clk low, then clk high */
+static struct out_xfer l2_lo[2], l2_clk_hi, l2_idle;
+
+/* Bound lines of `mask` as inactive outputs */
+static void lp_configure(uint16_t mask)
+{
+    mask &= out_avail();
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        if (mask & BIT(s)) {
+            (void)gpio_pin_configure_dt(lp_sig[s], GPIO_OUTPUT_INACTIVE);
+        }
+    }
+}
+
+int loops_init(const struct gpio_dt_spec *const sig[SEQ_SIG_COUNT],
+               const struct gpio_dt_spec *sdo, bool (*abort)(void))
+{
+    memcpy(lp_sig, sig, sizeof(lp_sig));
+    lp_sdo = sdo;
+    lp_abort = abort;
+
+    out_build(&l1_hold, BIT(SEQ_SIG_STAB), L1_RESET);
+    out_build(&l1_release, L1_RESET | BIT(SEQ_SIG_ENBIAS), 0);
+    out_build(&l1_stab, BIT(SEQ_SIG_STAB), 0);
+
+    /* Pack the power-on table into the staged word */
+    memset(&l2_staged, 0, sizeof(l2_staged));
+    l2_staged.nbits = ARRAY_SIZE(data);
+    for (int k = 0; k < (int)ARRAY_SIZE(data); k++) {
+        if (data[k]) {
+            l2_staged.w[k / 32] |= BIT(k % 32);
+        }
+    }
+    l2_applied_valid = false;
+
+    out_build(&l2_lo[0], 0, L2_SIGS);
+    out_build(&l2_lo[1], BIT(SEQ_SIG_IN_WRD), BIT(SEQ_SIG_CLK_WRD));
+    out_build(&l2_clk_hi, BIT(SEQ_SIG_CLK_WRD), 0);
+    out_build(&l2_idle, 0, L2_SIGS);
+
+    return ((out_avail() & L2_SIGS) == L2_SIGS) ? 0 : -ENODEV;
+}
+
+/* -------------------- Loop 1 -------------------- */
+void run_led_loop1(void)
+{
+    lp_configure(L1_SIGS);
+
+    out_apply(&l1_hold);            /* stab on, rst / rst_ctr held low */
+    k_msleep(8);
+    out_apply(&l1_release);         /* rst, rst_ctr and enbias together */
+    out_apply_inv(&l1_stab);        /* stab low pulse */
+    k_busy_wait(CONFIG_APP_L1_STAB_LOW_US);
+    out_apply(&l1_stab);
+}
+
+/* -------------------- Loop 2 -------------------- */
+void l2_staged_get(struct l2_word *cw)
+{
+    k_spinlock_key_t key = k_spin_lock(&l2_lock);
+
+    *cw = l2_staged;
+    k_spin_unlock(&l2_lock, key);
+}
+
+void l2_stage(const struct l2_word *cw)
+{
+    k_spinlock_key_t key = k_spin_lock(&l2_lock);
+
+    l2_staged = *cw;
+    k_spin_unlock(&l2_lock, key);
+}
+
+/* Shift cw out MSB first. If `rb` is given, the chip's serial output is
+   sampled before every rising edge, which yields the word that was in the
+   register before this pass, in the same bit positions. */
+static void l2_shift_out(const struct l2_word *cw, struct l2_word *rb)
+{
+    for (int b = cw->nbits - 1; b >= 0; b--) {
+        /* Data changes with clk going low, then is held for the setup
+           time before the rising edge latches it */
+        out_apply(&l2_lo[l2_bit(cw, b)]);
+        k_busy_wait(CONFIG_APP_L2_SETUP_US);
+
+        if (rb && gpio_pin_get_dt(lp_sdo) > 0) {
+            rb->w[b / 32] |= BIT(b % 32);
+        }
+
+        out_apply(&l2_clk_hi);
+    }
+    out_apply(&l2_idle);
+}
+
+int l2_apply(bool force, bool verify, char *out, size_t out_len)
+{
+    struct l2_word cw;
+
+    l2_staged_get(&cw);
+
+    if (!force && !verify && l2_applied_valid &&
+        memcmp(&cw, &l2_applied, sizeof(cw)) == 0) {
+        if (out) {
+            snprintk(out, out_len, "cached %ub", cw.nbits);
+        }
+        return 0;
+    }
+
+    lp_configure(L2_SIGS);
+
+    l2_shift_out(&cw, NULL);
+    l2_applied = cw;
+    l2_applied_valid = true;
+
+    if (verify && lp_sdo == NULL) {
+        if (out) {
+            snprintk(out, out_len, "%ub verify n/a", cw.nbits);
+        }
+        return 0;
+    }
+    if (verify) {
+        struct l2_word rb = { .nbits = cw.nbits };
+
+        (void)gpio_pin_configure_dt(lp_sdo, GPIO_INPUT);
+        l2_shift_out(&cw, &rb);   /* reloads the same word */
+        if (memcmp(&rb, &cw, sizeof(rb)) != 0) {
+            l2_applied_valid = false;
+            if (out) {
+                snprintk(out, out_len, "verify FAIL");
+            }
+            return -EIO;
+        }
+        if (out) {
+            snprintk(out, out_len, "%ub verify ok", cw.nbits);
+        }
+        return 0;
+    }
+
+    if (out) {
+        snprintk(out, out_len, "%ub", cw.nbits);
+    }
+    return 0;
+}
+
+void run_led_loop2(void)
+{
+    (void)l2_apply(false, false, NULL, 0);
+}
+
+/* Performance check: the shift alone, lines configured beforehand */
+uint32_t l2_bench_ns(void)
+{
+    struct l2_word cw;
+    uint64_t best = UINT64_MAX;
+
+    if ((out_avail() & L2_SIGS) != L2_SIGS) {
+        return 0;
+    }
+    l2_staged_get(&cw);
+    lp_configure(L2_SIGS);
+    for (int i = 0; i < 5; i++) {
+        timing_t t0 = timing_counter_get();
+
+        l2_shift_out(&cw, NULL);
+
+        timing_t t1 = timing_counter_get();
+
+        best = MIN(best, timing_cycles_to_ns(timing_cycles_get(&t0, &t1)));
+    }
+    return (uint32_t)MIN(best, UINT32_MAX);
+}
+
+/* -------------------- Loop 3 -------------------- */
+void run_led_loop3(void)
+{
+    /* The pulse train is timed by the waveform generator ("WF" sets it up);
+       this thread only waits for it and polls for an abort. */
+    int err = wfg_start();
+    if (err) {
+        LOG_ERR("Loop3: waveform start failed (err %d)", err);
+        return;
+    }
+
+    while (wfg_wait(K_MSEC(20)) == -EAGAIN) {
+        if (lp_abort()) {
+            (void)wfg_stop();
+            LOG_INF("Loop3: aborted.");
+            break;
+        }
+    }
+}
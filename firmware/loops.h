@@ -0,0 +1,63 @@
+/* loops.h - Loops 1-3: chip reset, configuration word, pulse train
+ *
+ *   Loop 1: rst / rst_ctr held low for 8 ms with stab on, then released
+ *           together with enbias
+ *   Loop 2: the configuration word shifted into the chip on clk_wrd /
+ *           in_wrd, optionally read back on cfg-sdo
+ *   Loop 3: the pulse / rst_tdc train of the waveform generator
+ *
+ * Loops 1 and 2 drive their lines through gpio_out (the caller binds the
+ * signals with out_init() first); Loop 3 needs wfg_init(). The specs are
+ * the caller's (main.c binds the devicetree aliases), so the loops run on
+ * any set of GPIOs, the emulated ones included.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/util.h>
+
+#include "seq.h"
+
+#define L1_RESET (BIT(SEQ_SIG_RST) | BIT(SEQ_SIG_RST_CTR))   /* held low for 8 ms */
+
+/* ---- Loop-2 configuration word ----
+   Packed LSB-first into uint32_t words: bit k is the k-th bit of the
+   power-on table, and bits are shifted out from bit nbits-1 down to bit 0.
+   The last applied word is cached and a repeated "02" with an unchanged
+   word skips the shift. */
+#define L2_MAX_BITS    CONFIG_APP_L2_MAX_BITS
+#define L2_MAX_WORDS   DIV_ROUND_UP(L2_MAX_BITS, 32)
+
+struct l2_word {
+    uint16_t nbits;
+    uint32_t w[L2_MAX_WORDS];
+};
+
+static inline bool l2_bit(const struct l2_word *cw, int b)
+{
+    return (cw->w[b / 32] >> (b % 32)) & 1U;
+}
+
+/* Precompute the Loop-1 and Loop-2 transitions and stage the power-on
+   word. sdo (the chip's configuration readback) may be NULL; abort is
+   polled while Loop 3 runs. -ENODEV if clk_wrd or in_wrd is not bound. */
+int loops_init(const struct gpio_dt_spec *const sig[SEQ_SIG_COUNT],
+               const struct gpio_dt_spec *sdo, bool (*abort)(void));
+
+/* The word the next "02" applies; safe from any context */
+void l2_staged_get(struct l2_word *cw);
+void l2_stage(const struct l2_word *cw);
+
+/* Apply the staged word. 'force' shifts even if unchanged; 'verify' runs a
+   second pass and compares the readback (needs sdo). -EIO on a mismatch. */
+int l2_apply(bool force, bool verify, char *out, size_t out_len);
+
+/* Best of 5 shifts of the staged word (ns), 0 if the lines are unavailable */
+uint32_t l2_bench_ns(void);
+
+void run_led_loop1(void);
+void run_led_loop2(void);
+void run_led_loop3(void);
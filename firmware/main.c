@@ -6,10 +6,36 @@
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/timing/timing.h>
 #include <string.h>
+#include <stdlib.h>
+
+#include "waveform.h"
+#include "gpio_out.h"
+#include "l4_codec.h"
+#include "ble_xfer.h"
+#if defined(CONFIG_APP_PERF_CHECK)
+#include "perf_check.h"
+#endif
+#if defined(CONFIG_APP_PERF_EXIT)
+#include <posix_board_if.h>
+#endif
+#include "seq.h"
+#include "app_stat.h"
+#include "loops.h"
+#include "loop4.h"
+#include "cycle.h"
+#include "app_cmd.h"
+#if defined(CONFIG_APP_CHIP_MODEL)
+#include "chip_model.h"
+#endif
 
 LOG_MODULE_REGISTER(ble_led_loop, LOG_LEVEL_INF);
 
@@ -18,10 +44,17 @@ LOG_MODULE_REGISTER(ble_led_loop, LOG_LEVEL_INF);
 
 /* -------------------- Forward decls for loop functions -------------------- */
 static void l4_dump_csv_notify(void);
-void run_led_loop1(void);
-void run_led_loop2(void);
-void run_led_loop3(void);
-void run_led_loop4(void);
+static void l4_dump_bin_notify(void);
+static void l4_stream_init(void);
+static int l4_stream_start(void);
+static void l4_stream_stop(void);
+static int app_calibrate(uint32_t repeats, uint32_t min_period_us, bool apply,
+                         char *out, size_t out_len);
+static void ble_bench_tput(uint32_t bytes, char *out, size_t out_len);
+static int app_sim_check(uint32_t seed, char *out, size_t out_len);
+static void l4_burst_capture(uint32_t frames, char *out, size_t out_len);
+static int app_seq_exec(char mode, char *out, size_t out_len);
+static int ble_retx_request(uint32_t id, uint16_t base, uint32_t mask, uint16_t req);
 
 /* -------------------- Loop 1 GPIOs -------------------- */
 #define RST_LED_NODE      DT_ALIAS(rst)
@@ -39,13 +72,19 @@ static const struct gpio_dt_spec stab_led    = GPIO_DT_SPEC_GET(STAB_LED_NODE, g
 static const struct gpio_dt_spec clk_gpio  = GPIO_DT_SPEC_GET(CLK_WRD_NODE, gpios);
 static const struct gpio_dt_spec data_gpio = GPIO_DT_SPEC_GET(IN_WRD_NODE, gpios);
 
-/* 95 bits, MSB-first in the sender; we output 95 pulses. */
-static bool data[95] = {
-    1,1,1,1,1,
-    1,1,1,1,1,1,1,0,1,1,1,1,1,1,1,1,1,1,1,1,0,0,1,1,0,1,1,1,1,1,1,0,
-    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,
-    0,1,1,1,1,0,1,1,1,1
-};
+#if DT_NODE_EXISTS(DT_ALIAS(cfg_sdo))
+/* Optional serial output of the chip's configuration shift register */
+static const struct gpio_dt_spec sdo_gpio = GPIO_DT_SPEC_GET(DT_ALIAS(cfg_sdo), gpios);
+#define L2_SDO (&sdo_gpio)
+#else
+#define L2_SDO NULL
+#endif
+
+/* FFF5 uploads a word as [u16 nbits LE][ceil(nbits/8) bytes, bit k at
+   byte k/8, bit k%8] (struct l2_word packing, see loops.h) */
+#define L2_UPLOAD_MAX  (2 + DIV_ROUND_UP(L2_MAX_BITS, 8))
+
+static uint8_t l2_upload[L2_UPLOAD_MAX];  /* FFF5 long-write assembly */
 
 /* -------------------- Loop 3 GPIOs -------------------- */
 #define PULSE_NODE   DT_ALIAS(pulse)
@@ -61,6 +100,7 @@ static const struct gpio_dt_spec clk_shift_gpio = GPIO_DT_SPEC_GET(CLK_SHIFT_NOD
 
 #define TX_COUNT  14
 #define CYCLES    128
+BUILD_ASSERT(TX_COUNT == L4_NUM_PINS && CYCLES == L4_TOTAL_READS, "frame layout is l4_codec.h");
 
 static const struct gpio_dt_spec tx_gpios[TX_COUNT] = {
     GPIO_DT_SPEC_GET(DT_ALIAS(tx0), gpios),
@@ -79,24 +119,488 @@ static const struct gpio_dt_spec tx_gpios[TX_COUNT] = {
     GPIO_DT_SPEC_GET(DT_ALIAS(tx13), gpios),
 };
 
-/* Loop-4 CSV readout state */
-#define L4_NUM_PINS     TX_COUNT
-#define L4_TOTAL_READS  CYCLES
-static uint8_t l4_matrix[L4_TOTAL_READS][L4_NUM_PINS];  // 128 × 14
+/* Loop-4 lines as loop4.c sees them */
+static const struct l4_lines l4_lines = {
+    .tx = {
+        &tx_gpios[0], &tx_gpios[1], &tx_gpios[2], &tx_gpios[3], &tx_gpios[4],
+        &tx_gpios[5], &tx_gpios[6], &tx_gpios[7], &tx_gpios[8], &tx_gpios[9],
+        &tx_gpios[10], &tx_gpios[11], &tx_gpios[12], &tx_gpios[13],
+    },
+    .cell      = &cel_gpio,
+    .clk_shift = &clk_shift_gpio,
+    .rst_ctr   = &rstctrl_led,
+};
+
+/* "CY" entries on FFF4, batched by cy_tx_work (see cycle.h) */
+struct l4_cycle_rec {
+    struct l4_rec_hdr hdr;
+    struct l4_cycle_ent ent[CY_REC_ENTRIES];
+} __packed;
+
+/* ---- Loop-4 burst ("04B") ----
+   N frames captured back to back into a RAM arena, then fetched frame by
+   frame through FFF7: write [u16 index][u32 burst_id (optional)], then
+   (long-)read the frame record at any offset. burst_id changes with every
+   burst, so a host resuming after a disconnect can tell its selection is
+   still about the same data. */
+#define L4_BURST_FRAMES  ((CONFIG_APP_L4_BURST_KB * 1024) / sizeof(struct l4_frame))
+
+static __noinit struct l4_frame l4_burst[L4_BURST_FRAMES];
+static uint16_t l4_burst_count;          /* valid frames in l4_burst[] */
+static uint32_t l4_burst_id;
+static uint16_t l4_burst_sel;            /* FFF7 selection */
+
+/* ---- Sequence programs ("SQ", FFF8) ----
+   FFF8 takes [u16 len][bytecode] (long writes supported, see seq.h); the
+   program is compiled as soon as all bytes are in. A dry run ("SQT")
+   streams the level trace of the first SEQ_TRACE_EDGES output changes. */
+#define SEQ_TRACE_EDGES  256
+#define SEQ_UPLOAD_MAX   (2 + SEQ_MAX_BYTES)
+
+struct l4_seq_trace_rec {
+    struct l4_rec_hdr hdr;
+    struct seq_trace_edge edge[SEQ_TRACE_EDGES];
+} __packed;
+
+static uint8_t seq_upload[SEQ_UPLOAD_MAX];
+
+/* Signal numbers of the bytecode (enum seq_sig) */
+static const struct gpio_dt_spec *const seq_sigs[SEQ_SIG_COUNT] = {
+    [SEQ_SIG_RST]       = &rst_led,
+    [SEQ_SIG_RST_CTR]   = &rstctrl_led,
+    [SEQ_SIG_ENBIAS]    = &enbias_led,
+    [SEQ_SIG_STAB]      = &stab_led,
+    [SEQ_SIG_CLK_WRD]   = &clk_gpio,
+    [SEQ_SIG_IN_WRD]    = &data_gpio,
+    [SEQ_SIG_PULSE]     = &pulse_gpio,
+    [SEQ_SIG_RST_TDC]   = &rst_gpio,
+    [SEQ_SIG_CELL]      = &cel_gpio,
+    [SEQ_SIG_CLK_SHIFT] = &clk_shift_gpio,
+};
+
+/* Loop-4 transfer encoding; byte counters feed the "Z4?" ratio */
+static atomic_t l4_enc_mode = ATOMIC_INIT(IS_ENABLED(CONFIG_APP_L4_COMPRESS) ?
+                                          L4_ENC_MODE_AUTO : L4_ENC_MODE_RAW);
+static atomic_t l4_enc_raw_bytes = ATOMIC_INIT(0);
+static atomic_t l4_enc_sent_bytes = ATOMIC_INIT(0);
+
+/* Loop-4 readout state */
+static struct l4_frame l4_frame;          /* 28 + 256 bytes */
 static volatile bool l4_ready = false;
 static uint16_t l4_read_idx = 0;
 
-/* ---- Loop-4 timing (tune if needed) ---- */
-#define L4_T_HIGH_US   300   /* clk_shift high time per sample */
-#define L4_T_LOW_US    300   /* clk_shift low time per sample  */
-#define L4_ARM_US      1000   /* settle after (re)arming CEL    */
-#define L4_SAMPLE_US   60 
+/* ---- Loop-4 streaming ("04S" / "04E") ----
+   Ring of frame buffers passed by index between a capture thread and a
+   transmit work item: free -> capture -> ready -> transmit -> free. */
+#define L4_RING_FRAMES  CONFIG_APP_L4_RING_FRAMES
+static struct l4_frame l4_ring[L4_RING_FRAMES];
+K_MSGQ_DEFINE(l4_free_q,  sizeof(uint8_t), L4_RING_FRAMES, 1);
+K_MSGQ_DEFINE(l4_ready_q, sizeof(uint8_t), L4_RING_FRAMES, 1);
+K_SEM_DEFINE(l4_stream_sem, 0, 1);
+/* Set from "04S" to "04E"; the stream holds the Loop-4 lines until its
+   capture thread has finished (app_cmd_l4_take) */
+static atomic_t l4_streaming = ATOMIC_INIT(0);
+static atomic_t l4_stream_frames = ATOMIC_INIT(0);
+static atomic_t l4_dropped = ATOMIC_INIT(0);
 
 /* -------------------- BLE globals -------------------- */
 static bool notify_enabled = false;       /* used for both FFF2 and FFF4 CCCs */
-static uint8_t command_value[20] = {0};   /* DONE_xx messages on FFF2 */
 static struct bt_conn *current_conn = NULL;
 
+/* Link parameters as last negotiated, reported by "BLE?" */
+static struct {
+    uint8_t  tx_phy, rx_phy;          /* BT_GAP_LE_PHY_* */
+    uint16_t tx_len, rx_len;          /* LL payload octets */
+    uint16_t interval;                /* 1.25 ms units */
+    uint16_t latency;
+    uint16_t timeout;                 /* 10 ms units */
+} ble_link;
+
+/* Bulk (FFF4) notifications in flight; each one holds a credit until its
+   completion callback, so the radio queue stays full without sleeping. */
+#define BLE_TX_CREDITS  CONFIG_APP_BLE_TX_CREDITS
+K_SEM_DEFINE(ble_tx_credits, BLE_TX_CREDITS, BLE_TX_CREDITS);
+
+/* Fast: 2M PHY, max data length, 7.5-15 ms. Relaxed: 50-100 ms, for idle links. */
+static bool ble_fast = IS_ENABLED(CONFIG_APP_BLE_THROUGHPUT);
+static void ble_request_params(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(ble_param_work, ble_request_params);
+
+/* -------------------- Performance counters (FFF6, "STR") --------------------
+   Read on FFF6 as one packed struct app_stats_rec, cleared by "STR". Both
+   targets are little-endian, so the struct goes out as is. Times come from
+   the timing API (DWT cycle counter on the nRF5340). */
+#define APP_STATS_VERSION 3
+
+struct app_stats_rec {
+    uint8_t  version;
+    uint8_t  n_ops;             /* entries in cmd[], indexed by enum app_cmd_op */
+    uint16_t size;              /* sizeof(struct app_stats_rec) */
+    uint32_t uptime_ms;
+    uint32_t since_reset_ms;
+    /* Loop-4 capture: frame duration and clk_shift sample-to-sample interval */
+    uint32_t cap_frames;
+    uint32_t cap_last_us;
+    uint32_t cap_max_us;
+    uint32_t smp_min_ns;        /* shortest interval since reset */
+    uint32_t smp_max_ns;        /* longest interval since reset */
+    uint32_t smp_jitter_ns;     /* longest - shortest, last frame */
+    /* FFF4 bulk notifications */
+    uint32_t ntf_sent;
+    uint32_t ntf_bytes;
+    uint32_t ntf_failed;
+    uint32_t ntf_retried;       /* -ENOMEM from the host stack, retried */
+    uint32_t ntf_stalled;       /* no credit back within 2 s */
+    int16_t  ntf_last_err;
+    /* FFF2 status notifications */
+    uint16_t st_failed;
+    uint32_t st_sent;
+    /* High-water marks */
+    uint8_t  cmd_q_hw;          /* app_cmd_q entries */
+    uint8_t  ring_hw;           /* Loop-4 frames waiting for the radio */
+    uint8_t  credits_hw;        /* FFF4 notifications in flight */
+    uint8_t  reserved;
+    /* CPU time since reset (ms), CONFIG_THREAD_RUNTIME_STATS */
+    uint32_t rt_cmd_ms;
+    uint32_t rt_capture_ms;
+    uint32_t rt_tx_ms;
+    uint32_t rt_all_ms;
+    /* Loop-4 energy, last frame: CPU active / idle time and estimated charge */
+    uint32_t pwr_active_us;
+    uint32_t pwr_idle_us;
+    uint32_t pwr_charge_nc;
+    uint32_t pwr_total_uc;      /* all frames since reset */
+    uint16_t pwr_late;          /* sleeps that overran their deadline */
+    uint8_t  pwr_low_power;     /* "PWR l=" */
+    uint8_t  reserved2;
+    /* FFF4 transfers and "RT" retransmissions */
+    uint32_t xfer_sent;         /* transfers started */
+    uint32_t retx_req;          /* "RT" requests accepted */
+    uint32_t retx_chunks;       /* chunks resent */
+    uint32_t retx_gone;         /* requests for transfers no longer retained */
+    struct app_stats_cmd cmd[APP_CMD_COUNT];
+} __packed;
+
+/* Written from the capture, transmit, BT RX and executor contexts, read by
+   FFF6 / "PWR?" and cleared by "STR" from the BT RX context: every counter
+   is atomic. Per-command times are the executor's (app_cmd.c). */
+static atomic_t app_ntf_sent, app_ntf_bytes, app_ntf_failed, app_ntf_retried, app_ntf_stalled;
+static atomic_t app_ntf_last_err;
+static atomic_t app_st_sent, app_st_failed;
+static atomic_t app_ring_hw, app_credits_hw;
+static int64_t app_stats_reset_ms;
+static void app_stats_snapshot(struct app_stats_rec *out);
+static void app_stats_reset(void);
+
+static void app_status_notify(const void *msg, uint16_t len);
+
+/* -------------------- Persistent settings --------------------
+   What a session would otherwise have to send again after every reset
+   lives in the settings subsystem under "app/" (NVS on the storage
+   partition; the flash simulator on native_sim): the staged Loop-2 word,
+   Loop-4 timing, the Loop-3 waveform, the FFF4 encoding, the link and
+   power preferences, and the last bonded central. A change schedules one
+   deferred save of every key; NVS skips values that did not change, so
+   the flash is only written when something really did. */
+enum app_cfg_key {
+    APP_CFG_L2,
+    APP_CFG_T4,
+    APP_CFG_WF,
+    APP_CFG_Z4,
+    APP_CFG_BLE,
+    APP_CFG_PWR,
+    APP_CFG_NKEYS
+};
+
+struct app_cfg {
+    struct l2_word l2;
+    struct l4_timing t4;
+    struct wfg_params wf;
+    uint8_t z4;              /* enum l4_enc_mode */
+    uint8_t ble_fast;
+    uint8_t low_power;
+};
+
+static const struct {
+    const char *name;
+    uint16_t off;
+    uint16_t len;
+} app_cfg_keys[APP_CFG_NKEYS] = {
+    [APP_CFG_L2]  = { "l2",  offsetof(struct app_cfg, l2),        sizeof(struct l2_word) },
+    [APP_CFG_T4]  = { "t4",  offsetof(struct app_cfg, t4),        sizeof(struct l4_timing) },
+    [APP_CFG_WF]  = { "wf",  offsetof(struct app_cfg, wf),        sizeof(struct wfg_params) },
+    [APP_CFG_Z4]  = { "z4",  offsetof(struct app_cfg, z4),        sizeof(uint8_t) },
+    [APP_CFG_BLE] = { "ble", offsetof(struct app_cfg, ble_fast),  sizeof(uint8_t) },
+    [APP_CFG_PWR] = { "pwr", offsetof(struct app_cfg, low_power), sizeof(uint8_t) },
+};
+
+#define APP_CFG_F_ERASE  0       /* app_cfg_flags: drop the stored keys */
+
+static struct app_cfg app_cfg_loaded;    /* read by settings_load, applied on commit */
+static uint32_t app_cfg_loaded_mask;     /* BIT(enum app_cfg_key) */
+static bt_addr_le_t app_cfg_peer;        /* last bonded central */
+static bool app_cfg_peer_valid;
+static atomic_t app_cfg_flags;
+static uint32_t app_cfg_saves;
+static int app_cfg_err;
+static void app_cfg_save(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(app_cfg_work, app_cfg_save);
+
+static void app_cfg_snapshot(struct app_cfg *c)
+{
+    memset(c, 0, sizeof(*c));
+    l2_staged_get(&c->l2);
+    c->t4 = l4_timing_get();
+    wfg_get_params(&c->wf);
+    c->z4 = (uint8_t)atomic_get(&l4_enc_mode);
+    c->ble_fast = ble_fast;
+    c->low_power = l4_low_power_get();
+}
+
+/* One stored key into c; *mask gets BIT(key) once its value is read */
+static int app_cfg_read(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg,
+                        struct app_cfg *c, uint32_t *mask)
+{
+    const char *next;
+
+    for (int i = 0; i < APP_CFG_NKEYS; i++) {
+        if (!settings_name_steq(name, app_cfg_keys[i].name, &next) || next) {
+            continue;
+        }
+        /* A layout change between firmware versions shows up as a size change */
+        if (len != app_cfg_keys[i].len) {
+            LOG_WRN("Settings: app/%s is %u bytes, expected %u; ignored",
+                    app_cfg_keys[i].name, (unsigned)len, app_cfg_keys[i].len);
+            return 0;
+        }
+        if (read_cb(cb_arg, (uint8_t *)c + app_cfg_keys[i].off, len) == (ssize_t)len) {
+            *mask |= BIT(i);
+        }
+        return 0;
+    }
+    return -ENOENT;
+}
+
+static int app_cfg_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    const char *next;
+
+    if (settings_name_steq(name, "peer", &next) && !next) {
+        app_cfg_peer_valid = (len == sizeof(app_cfg_peer) &&
+                              read_cb(cb_arg, &app_cfg_peer, len) == (ssize_t)len);
+        return 0;
+    }
+    return app_cfg_read(name, len, read_cb, cb_arg, &app_cfg_loaded, &app_cfg_loaded_mask);
+}
+
+/* Values are checked the same way the commands check them; anything out
+   of range keeps its compiled-in default. */
+static int app_cfg_commit(void)
+{
+    const struct app_cfg *c = &app_cfg_loaded;
+    uint32_t m = app_cfg_loaded_mask;
+    uint32_t ok = 0;
+
+    if ((m & BIT(APP_CFG_L2)) && c->l2.nbits > 0 && c->l2.nbits <= L2_MAX_BITS) {
+        l2_stage(&c->l2);
+        ok |= BIT(APP_CFG_L2);
+    }
+    if ((m & BIT(APP_CFG_T4)) && c->t4.t_high_us && c->t4.t_low_us &&
+        c->t4.sample_us <= c->t4.t_high_us) {
+        l4_timing_set(&c->t4);
+        ok |= BIT(APP_CFG_T4);
+    }
+    if ((m & BIT(APP_CFG_WF)) && c->wf.duty_pct <= 99 && wfg_configure(&c->wf) == 0) {
+        ok |= BIT(APP_CFG_WF);
+    }
+    if ((m & BIT(APP_CFG_Z4)) && c->z4 <= L4_ENC_MODE_XBP) {
+        atomic_set(&l4_enc_mode, c->z4);
+        ok |= BIT(APP_CFG_Z4);
+    }
+    if (m & BIT(APP_CFG_BLE)) {
+        ble_fast = (c->ble_fast != 0);
+        ok |= BIT(APP_CFG_BLE);
+    }
+    if (m & BIT(APP_CFG_PWR)) {
+        l4_low_power_set(c->low_power != 0);
+        ok |= BIT(APP_CFG_PWR);
+    }
+    app_cfg_loaded_mask = 0;
+
+    if (m) {
+        LOG_INF("Settings: restored 0x%02x of 0x%02x%s", ok, m,
+                app_cfg_peer_valid ? ", bonded central known" : "");
+    }
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app_cfg, "app", NULL, app_cfg_set, app_cfg_commit, NULL);
+
+/* System work queue: flash writes never block the BT RX or executor threads */
+static void app_cfg_save(struct k_work *work)
+{
+    struct app_cfg c;
+    char name[16];
+    int err = 0;
+    int e;
+
+    if (atomic_test_and_clear_bit(&app_cfg_flags, APP_CFG_F_ERASE)) {
+        for (int i = 0; i < APP_CFG_NKEYS; i++) {
+            snprintk(name, sizeof(name), "app/%s", app_cfg_keys[i].name);
+            e = settings_delete(name);
+            err = e ? e : err;
+        }
+        e = settings_delete("app/peer");
+        app_cfg_err = e ? e : err;
+        err = app_cfg_err;
+        LOG_INF("Settings: erased (err %d), defaults after the next reset", err);
+        return;
+    }
+
+    app_cfg_snapshot(&c);
+    for (int i = 0; i < APP_CFG_NKEYS; i++) {
+        snprintk(name, sizeof(name), "app/%s", app_cfg_keys[i].name);
+        e = settings_save_one(name, (const uint8_t *)&c + app_cfg_keys[i].off,
+                              app_cfg_keys[i].len);
+        err = e ? e : err;
+    }
+    if (app_cfg_peer_valid) {
+        e = settings_save_one("app/peer", &app_cfg_peer, sizeof(app_cfg_peer));
+        err = e ? e : err;
+    }
+    app_cfg_err = err;
+    if (err) {
+        LOG_WRN("Settings: save failed (err %d)", err);
+    } else {
+        app_cfg_saves++;
+    }
+}
+
+/* Called by every command that changes a persisted value */
+static void app_cfg_changed(void)
+{
+    (void)k_work_reschedule(&app_cfg_work, K_MSEC(CONFIG_APP_CFG_SAVE_DELAY_MS));
+}
+
+static void app_cfg_set_peer(const bt_addr_le_t *addr)
+{
+    if (app_cfg_peer_valid && bt_addr_le_cmp(&app_cfg_peer, addr) == 0) {
+        return;
+    }
+    bt_addr_le_copy(&app_cfg_peer, addr);
+    app_cfg_peer_valid = true;
+    app_cfg_changed();
+}
+
+/* Parameters first, so that the values below are restored over the
+   compiled-in defaults before anything runs; bonds need the stack and
+   are loaded from bt_ready(). */
+static void app_cfg_init(void)
+{
+    int err = settings_subsys_init();
+
+    if (err == 0) {
+        err = settings_load_subtree("app");
+    }
+    if (err) {
+        app_cfg_err = err;
+        LOG_ERR("Settings unavailable (err %d); using defaults.", err);
+    }
+}
+
+/* Scratch tree of the self-check, outside "app": never restored, and
+   nothing of it is left in flash afterwards */
+#define APP_CFG_SCRATCH "app_st"
+
+struct app_cfg_back {
+    struct app_cfg c;
+    uint32_t mask;
+};
+
+static int app_cfg_back_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+                            void *param)
+{
+    struct app_cfg_back *b = param;
+
+    return app_cfg_read(key, len, read_cb, cb_arg, &b->c, &b->mask);
+}
+
+/* Write every key of the running configuration under APP_CFG_SCRATCH,
+   read them back through the same parser as "app" and compare, then
+   delete them. Neither the stored nor the running configuration is
+   touched. 0 if the round trip is exact. */
+static int app_cfg_selftest(void)
+{
+    struct app_cfg c;
+    struct app_cfg_back back = { 0 };
+    char name[16];
+    int err = 0;
+    int e;
+
+    app_cfg_snapshot(&c);
+    for (int i = 0; i < APP_CFG_NKEYS && err == 0; i++) {
+        snprintk(name, sizeof(name), APP_CFG_SCRATCH "/%s", app_cfg_keys[i].name);
+        err = settings_save_one(name, (const uint8_t *)&c + app_cfg_keys[i].off,
+                                app_cfg_keys[i].len);
+    }
+    if (err == 0) {
+        err = settings_load_subtree_direct(APP_CFG_SCRATCH, app_cfg_back_set, &back);
+    }
+    if (err == 0 && (back.mask != BIT_MASK(APP_CFG_NKEYS) ||
+                     memcmp(&c, &back.c, sizeof(c)) != 0)) {
+        err = -EIO;
+    }
+    for (int i = 0; i < APP_CFG_NKEYS; i++) {
+        snprintk(name, sizeof(name), APP_CFG_SCRATCH "/%s", app_cfg_keys[i].name);
+        e = settings_delete(name);
+        err = err ? err : e;
+    }
+    if (err) {
+        app_cfg_err = err;
+    }
+    return err;
+}
+
+/* ---- Advertising ----
+   With a bonded central on record, the board first advertises directed
+   at it (high duty cycle: the central's next connection attempt succeeds
+   within a few ms). The controller gives up after 1.28 s and reports
+   BT_HCI_ERR_ADV_TIMEOUT through connected(); from then on, and for
+   unknown centrals, advertising is undirected at the 30-60 ms interval.
+   Both are one-shot and restarted here after every disconnect. */
+static bool ble_adv_dir_tried;
+
+static void ble_adv_start(struct k_work *work)
+{
+    char addr[BT_ADDR_LE_STR_LEN];
+    int err;
+
+    if (IS_ENABLED(CONFIG_APP_BLE_DIRECTED_ADV) && !ble_adv_dir_tried &&
+        app_cfg_peer_valid && bt_addr_le_is_bonded(BT_ID_DEFAULT, &app_cfg_peer)) {
+        ble_adv_dir_tried = true;
+        bt_addr_le_to_str(&app_cfg_peer, addr, sizeof(addr));
+        err = bt_le_adv_start(BT_LE_ADV_CONN_DIR(&app_cfg_peer), NULL, 0, NULL, 0);
+        if (err == 0) {
+            LOG_INF("Directed advertising to %s", addr);
+            return;
+        }
+        LOG_WRN("Directed advertising failed (err %d)", err);
+    }
+
+    err = bt_le_adv_start(BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_USE_NAME |
+                                          BT_LE_ADV_OPT_ONE_TIME,
+                                          BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1,
+                                          NULL),
+                          NULL, 0, NULL, 0);
+    if (err) {
+        LOG_ERR("Advertising failed to start (err %d)", err);
+    } else {
+        LOG_INF("Bluetooth advertising started.");
+    }
+}
+
+static K_WORK_DEFINE(ble_adv_work, ble_adv_start);
+
 /* -------------------- BLE callbacks -------------------- */
 static void notify_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
 {
@@ -105,11 +609,32 @@ static void notify_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
-    if (err) {
+    if (err == BT_HCI_ERR_ADV_TIMEOUT) {
+        LOG_INF("Directed advertising timed out");
+        k_work_submit(&ble_adv_work);
+    } else if (err) {
         LOG_ERR("Connection failed (err %u)", err);
+        k_work_submit(&ble_adv_work);
     } else {
+        struct bt_conn_info info;
+
         LOG_INF("Connected");
         current_conn = bt_conn_ref(conn);
+        /* Bonds a new central (Just Works), re-encrypts a known one */
+        if (IS_ENABLED(CONFIG_APP_BLE_BOND) && bt_conn_set_security(conn, BT_SECURITY_L2)) {
+            LOG_WRN("Security request failed");
+        }
+        if (bt_conn_get_info(conn, &info) == 0) {
+            ble_link.tx_phy   = info.le.phy->tx_phy;
+            ble_link.rx_phy   = info.le.phy->rx_phy;
+            ble_link.tx_len   = info.le.data_len->tx_max_len;
+            ble_link.rx_len   = info.le.data_len->rx_max_len;
+            ble_link.interval = info.le.interval;
+            ble_link.latency  = info.le.latency;
+            ble_link.timeout  = info.le.timeout;
+        }
+        /* Let the central finish its own discovery/MTU exchange first */
+        (void)k_work_schedule(&ble_param_work, K_MSEC(500));
     }
 }
 
@@ -120,105 +645,190 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
         current_conn = NULL;
     }
     LOG_INF("Disconnected (reason %u)", reason);
+
+    /* Completions of notifications still queued may never arrive */
+    (void)k_work_cancel_delayable(&ble_param_work);
+    for (int i = 0; i < BLE_TX_CREDITS; i++) {
+        k_sem_give(&ble_tx_credits);
+    }
+    ble_adv_dir_tried = false;
 }
 
-BT_CONN_CB_DEFINE(conn_callbacks) = {
-    .connected = connected,
-    .disconnected = disconnected,
+/* The connection object is free again: advertising can restart */
+static void recycled(void)
+{
+    k_work_submit(&ble_adv_work);
+}
+
+static void security_changed(struct bt_conn *conn, bt_security_t level,
+                             enum bt_security_err err)
+{
+    const bt_addr_le_t *dst = bt_conn_get_dst(conn);
+
+    LOG_INF("Security level %u (err %d)", level, err);
+    if (!err && bt_addr_le_is_bonded(BT_ID_DEFAULT, dst)) {
+        app_cfg_set_peer(dst);
+    }
+}
+
+static void pairing_complete(struct bt_conn *conn, bool bonded)
+{
+    LOG_INF("Pairing complete%s", bonded ? ", bonded" : "");
+    if (bonded) {
+        app_cfg_set_peer(bt_conn_get_dst(conn));
+    }
+}
+
+static struct bt_conn_auth_info_cb auth_info_callbacks = {
+    .pairing_complete = pairing_complete,
 };
 
-/* -------------------- Loop-4 capture (CSV mode) -------------------- */
-static void l4_capture_once(void)
+static void ble_request_params(struct k_work *work)
 {
-    if (!device_is_ready(cel_gpio.port) || !device_is_ready(clk_shift_gpio.port)) {
-        LOG_ERR("Loop4: control GPIOs not ready!");
+    struct bt_conn *conn = current_conn;
+    int err;
+
+    if (!conn) {
         return;
     }
 
-    /* Configure inputs with NO pulls (don’t force them low) */
-    for (int i = 0; i < TX_COUNT; i++) {
-        if (!device_is_ready(tx_gpios[i].port)) {
-            LOG_ERR("Loop4: TX GPIO %d not ready!", i);
-            return;
+    if (ble_fast) {
+        err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+        if (err) {
+            LOG_WRN("PHY update request failed (err %d)", err);
+        }
+        err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+        if (err) {
+            LOG_WRN("Data length update request failed (err %d)", err);
         }
-        (void)gpio_pin_configure_dt(&tx_gpios[i], GPIO_INPUT);
+        err = bt_conn_le_param_update(conn, BT_LE_CONN_PARAM(6, 12, 0, 400));
+    } else {
+        err = bt_conn_le_param_update(conn, BT_LE_CONN_PARAM(40, 80, 0, 400));
+    }
+    if (err) {
+        LOG_WRN("Connection parameter request failed (err %d)", err);
     }
+}
 
-    (void)gpio_pin_configure_dt(&cel_gpio,       GPIO_OUTPUT_INACTIVE);
-    (void)gpio_pin_configure_dt(&clk_shift_gpio, GPIO_OUTPUT_INACTIVE);
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+    ble_link.tx_phy = param->tx_phy;
+    ble_link.rx_phy = param->rx_phy;
+    LOG_INF("PHY updated: tx %u rx %u", param->tx_phy, param->rx_phy);
+}
 
-    /* Start capture window and keep it HIGH for the whole frame */
-    gpio_pin_set_dt(&cel_gpio, 1);
-    k_busy_wait(L4_ARM_US);
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    ble_link.tx_len = info->tx_max_len;
+    ble_link.rx_len = info->rx_max_len;
+    LOG_INF("Data length updated: tx %u rx %u", info->tx_max_len, info->rx_max_len);
+}
 
-    for (int cycle = 0; cycle < L4_TOTAL_READS; cycle++) {
-        /* Rising edge requests/advances the next word */
-        gpio_pin_set_dt(&clk_shift_gpio, 1);
-        k_busy_wait(L4_SAMPLE_US);
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+                             uint16_t latency, uint16_t timeout)
+{
+    ble_link.interval = interval;
+    ble_link.latency  = latency;
+    ble_link.timeout  = timeout;
+    LOG_INF("Conn params updated: interval %u us, latency %u, timeout %u ms",
+            interval * 1250U, latency, timeout * 10U);
+}
 
-        /* Sample during the stable portion of HIGH */
-        for (int i = 0; i < L4_NUM_PINS; i++) {
-            l4_matrix[cycle][i] = gpio_pin_get_dt(&tx_gpios[i]) ? 1 : 0;
-        }
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+    .le_param_updated = le_param_updated,
+    .le_phy_updated = le_phy_updated,
+    .le_data_len_updated = le_data_len_updated,
+    .security_changed = security_changed,
+    .recycled = recycled,
+};
 
-        /* Finish the pulse */
-            k_busy_wait(L4_T_HIGH_US - L4_SAMPLE_US);
-        gpio_pin_set_dt(&clk_shift_gpio, 0);
-        k_busy_wait(L4_T_LOW_US);
-    }
+/* -------------------- Output transition benchmark --------------------
+   The Loop-1 release (rst, rst_ctr and enbias rising together), done pin
+   by pin as before and as one gpio_out transition. On native_sim the edge
+   trace shows the port writes per transition and the skew from the first
+   to the last line of a transition; transitions per ms come from the
+   timing API on both targets. */
+#define OUT_BENCH_N 64
 
-    /* End capture window (only after all 128 pulses) */
-    gpio_pin_set_dt(&cel_gpio, 0);
+static const struct gpio_dt_spec *const out_bench_pins[] = { &rst_led, &rstctrl_led, &enbias_led };
 
-    /* Optional: pulse rstctrl if its device is ready (harmless if alias not present) */
-    if (device_is_ready(rstctrl_led.port)) {
-        (void)gpio_pin_configure_dt(&rstctrl_led, GPIO_OUTPUT_INACTIVE);
-        gpio_pin_set_dt(&rstctrl_led, 0);
-        gpio_pin_set_dt(&rstctrl_led, 1);
+static void out_bench_pass(bool port, const struct out_xfer *x, uint32_t *writes,
+                           uint32_t *skew_ns, uint32_t *per_ms)
+{
+    static struct out_edge trace[2 * OUT_BENCH_N * ARRAY_SIZE(out_bench_pins)];
+    bool traced = (out_trace_start(trace, ARRAY_SIZE(trace)) == 0);
+    timing_t t0 = timing_counter_get();
+
+    for (int n = 0; n < OUT_BENCH_N; n++) {
+        if (port) {
+            out_apply(x);
+            out_apply_inv(x);
+            continue;
+        }
+        for (size_t i = 0; i < ARRAY_SIZE(out_bench_pins); i++) {
+            gpio_pin_set_dt(out_bench_pins[i], 1);
+        }
+        for (size_t i = 0; i < ARRAY_SIZE(out_bench_pins); i++) {
+            gpio_pin_set_dt(out_bench_pins[i], 0);
+        }
     }
-int ones = 0, first_nonzero = -1, last_nonzero = -1;
-for (int r = 0; r < L4_TOTAL_READS; r++) {
-    uint16_t acc = 0;
-    for (int i = 0; i < L4_NUM_PINS; i++) acc |= l4_matrix[r][i];
-    if (acc) {
-        ones++;
-        if (first_nonzero < 0) first_nonzero = r;
-        last_nonzero = r;
+    timing_t t1 = timing_counter_get();
+    size_t edges = traced ? out_trace_stop() : 0;
+    uint64_t ns = MAX(timing_cycles_to_ns(timing_cycles_get(&t0, &t1)), 1);
+    size_t per = MAX(edges / (2 * OUT_BENCH_N), 1);
+
+    *writes = edges / (2 * OUT_BENCH_N);
+    *skew_ns = 0;
+    for (size_t e = 0; e + per <= edges; e += per) {
+        uint64_t d = timing_cycles_to_ns(timing_cycles_get(&trace[e].t, &trace[e + per - 1].t));
+
+        *skew_ns = MAX(*skew_ns, (uint32_t)MIN(d, UINT32_MAX));
     }
+    *per_ms = (uint32_t)((2ULL * OUT_BENCH_N * NSEC_PER_MSEC) / ns);
 }
-LOG_INF("L4 diag: rows with any '1' = %d/%d (first=%d last=%d)",
-        ones, L4_TOTAL_READS, first_nonzero, last_nonzero);
 
-    l4_read_idx = 0;
-    l4_ready = true;
-    LOG_INF("Loop4: 128 pulses with continuous CEL=HIGH complete.");
+static void out_bench(void)
+{
+    uint32_t w[2], skew[2], rate[2];
+    struct out_xfer x;
+
+    for (size_t i = 0; i < ARRAY_SIZE(out_bench_pins); i++) {
+        if (!device_is_ready(out_bench_pins[i]->port)) {
+            return;
+        }
+        (void)gpio_pin_configure_dt(out_bench_pins[i], GPIO_OUTPUT_INACTIVE);
+    }
+    out_build(&x, L1_RESET | BIT(SEQ_SIG_ENBIAS), 0);
+    out_bench_pass(false, &x, &w[0], &skew[0], &rate[0]);
+    out_bench_pass(true, &x, &w[1], &skew[1], &rate[1]);
+
+    LOG_INF("Bench outputs: pin=%u writes %u ns skew %u/ms port=%u writes %u ns skew %u/ms",
+            w[0], skew[0], rate[0], w[1], skew[1], rate[1]);
 }
 
 /* -------------------- FFF3 READ: return next CSV row "b0,b1,...,b13" -------------------- */
 static ssize_t l4_read_csv(struct bt_conn *conn, const struct bt_gatt_attr *attr,
                            void *buf, uint16_t len, uint16_t offset)
 {
-    char line[64];
-    int off = 0;
+    char line[2 * L4_NUM_PINS];
+    int off;
 
     if (!l4_ready && (l4_read_idx == 0)) {
         /* Serve zeros until a capture is performed */
-        for (int i = 0; i < L4_NUM_PINS; i++) {
-            off += snprintk(line + off, sizeof(line) - off,
-                            (i == L4_NUM_PINS - 1) ? "0" : "0,");
-        }
+        off = l4_format_csv_row(line, 0, 0);
         return bt_gatt_attr_read(conn, attr, buf, len, offset, line, off);
     }
 
-    /* Clamp to last valid row if client keeps reading */
-    uint16_t row = (l4_read_idx < L4_TOTAL_READS) ? l4_read_idx : (L4_TOTAL_READS - 1);
+    /* Clamp to last valid row if client keeps reading. A Read Blob
+       (offset > 0) continues the row served last instead of advancing. */
+    uint16_t next = (offset == 0) ? l4_read_idx : (l4_read_idx ? l4_read_idx - 1 : 0);
+    uint16_t row = (next < L4_TOTAL_READS) ? next : (L4_TOTAL_READS - 1);
 
-    for (int i = 0; i < L4_NUM_PINS; i++) {
-        off += snprintk(line + off, sizeof(line) - off,
-                        (i == L4_NUM_PINS - 1) ? "%d" : "%d,", l4_matrix[row][i]);
-    }
+    off = l4_format_csv_row(line, l4_frame.words[row], 0);
 
-    if (l4_read_idx < L4_TOTAL_READS) {
+    if (offset == 0 && l4_read_idx < L4_TOTAL_READS) {
         l4_read_idx++;
         if (l4_read_idx >= L4_TOTAL_READS) {
             LOG_INF("Loop4: row-by-row read completed.");
@@ -228,24 +838,190 @@ static ssize_t l4_read_csv(struct bt_conn *conn, const struct bt_gatt_attr *attr
     return bt_gatt_attr_read(conn, attr, buf, len, offset, line, off);
 }
 
-/* -------------------- FFF3 WRITE: 'R' capture, 'D' dump (no capture) -------------------- */
+/* -------------------- FFF3 WRITE: 'R' capture, 'D' binary dump, 'C' CSV dump -------------------- */
 static ssize_t l4_write_ctrl(struct bt_conn *conn, const struct bt_gatt_attr *attr,
                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
 {
+    struct app_cmd_ctx ctx = { .t_write = timing_counter_get() };
+
     if (len > 0) {
         const uint8_t c = ((const uint8_t*)buf)[0];
         if (c == 'R') {
+            if (atomic_get(&l4_streaming)) {
+                return BT_GATT_ERR(BT_ATT_ERR_WRITE_REQ_REJECTED);
+            }
             l4_read_idx = 0;
             l4_ready = false;
-            l4_capture_once();
-        } else if (c == 'D') {
-            if (notify_enabled) {
-                l4_dump_csv_notify();
-            }
+            app_cmd_submit(&ctx, APP_CMD_LOOP4, 0, NULL);
+        } else if (c == 'D' || c == 'C') {
+            app_cmd_submit(&ctx, APP_CMD_DUMP4, c, NULL);
+        }
+    }
+    return len;
+}
+/* -------------------- FFF5: Loop-2 configuration word -------------------- */
+static ssize_t l2_read_word(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t rec[L2_UPLOAD_MAX] = {0};
+    struct l2_word cw;
+
+    l2_staged_get(&cw);
+    sys_put_le16(cw.nbits, rec);
+    for (int k = 0; k < cw.nbits; k++) {
+        if (l2_bit(&cw, k)) {
+            rec[2 + k / 8] |= BIT(k % 8);
+        }
+    }
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, rec,
+                             2 + DIV_ROUND_UP(cw.nbits, 8));
+}
+
+/* Accepts plain and long (prepared) writes; the word is staged once all
+   ceil(nbits/8) bytes have arrived and is shifted out by the next "02". */
+static ssize_t l2_write_word(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (offset + len > sizeof(l2_upload)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    if (flags & BT_GATT_WRITE_FLAG_PREPARE) {
+        return 0;
+    }
+
+    memcpy(l2_upload + offset, buf, len);
+    if (offset + len < 2) {
+        return len;
+    }
+
+    uint16_t nbits = sys_get_le16(l2_upload);
+    if (nbits == 0 || nbits > L2_MAX_BITS) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    if (offset + len < 2 + DIV_ROUND_UP(nbits, 8)) {
+        return len;     /* more to come */
+    }
+
+    struct l2_word cw = { .nbits = nbits };
+    for (int k = 0; k < nbits; k++) {
+        if (l2_upload[2 + k / 8] & BIT(k % 8)) {
+            cw.w[k / 32] |= BIT(k % 32);
         }
     }
+
+    l2_stage(&cw);
+    app_cfg_changed();
+
+    LOG_INF("Loop2: staged %u-bit configuration word.", nbits);
+    return len;
+}
+
+/* -------------------- FFF7: burst frame access -------------------- */
+static ssize_t l4_burst_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             void *buf, uint16_t len, uint16_t offset)
+{
+    uint16_t idx = l4_burst_sel;
+
+    if (idx >= l4_burst_count) {
+        return bt_gatt_attr_read(conn, attr, buf, len, offset, NULL, 0);
+    }
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &l4_burst[idx], sizeof(l4_burst[idx]));
+}
+
+/* [u16 frame index] or [u16 frame index][u32 burst id]; the id, when given,
+   must match the burst in RAM */
+static ssize_t l4_burst_select(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                               const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    const uint8_t *in = buf;
+
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    if (len != 2 && len != 6) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    if (sys_get_le16(in) >= l4_burst_count ||
+        (len == 6 && sys_get_le32(in + 2) != l4_burst_id)) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    l4_burst_sel = sys_get_le16(in);
     return len;
 }
+
+/* -------------------- FFF8: sequence program upload -------------------- */
+/* Same assembly as FFF5: plain or long writes, compiled once 2 + len bytes
+   are in. The outcome is also reported on FFF2 (LOAD_SQ / ERR_SQ). */
+static ssize_t seq_write_prog(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    struct seq_err err;
+    struct seq_info info;
+    char msg[40];
+    uint16_t plen;
+    int ret;
+
+    if (offset + len > sizeof(seq_upload)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    if (flags & BT_GATT_WRITE_FLAG_PREPARE) {
+        return 0;
+    }
+
+    memcpy(seq_upload + offset, buf, len);
+    if (offset + len < 2) {
+        return len;
+    }
+
+    plen = sys_get_le16(seq_upload);
+    if (plen == 0 || plen > SEQ_MAX_BYTES) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    if (offset + len < 2 + plen) {
+        return len;     /* more to come */
+    }
+
+    ret = seq_load(seq_upload + 2, plen, &err);
+    if (ret == -EBUSY) {
+        return BT_GATT_ERR(BT_ATT_ERR_WRITE_REQ_REJECTED);
+    }
+    if (ret != 0) {
+        snprintk(msg, sizeof(msg), "ERR_SQ @%u %s", err.pc, err.why);
+        app_status_notify(msg, strlen(msg));
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    (void)seq_get_info(&info);
+    snprintk(msg, sizeof(msg), "LOAD_SQ ops=%u s=%u t=%uus", info.ops, info.samples,
+             (uint32_t)(info.time_ns / NSEC_PER_USEC));
+    app_status_notify(msg, strlen(msg));
+    return len;
+}
+
+/* -------------------- FFF9: device clock -------------------- */
+/* Uptime in us, on the clock of the frame timestamp_us field, sampled when
+   the read arrives. A host brackets the read with its own clock; the round
+   trip bounds the offset error, so it keeps the fastest of a few reads. */
+static ssize_t app_read_clock(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                              void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t now[8];
+
+    sys_put_le64(k_ticks_to_us_floor64(k_uptime_ticks()), now);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, now, sizeof(now));
+}
+
+/* -------------------- FFF6: performance counters -------------------- */
+static ssize_t app_read_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                              void *buf, uint16_t len, uint16_t offset)
+{
+    struct app_stats_rec rec;
+
+    app_stats_snapshot(&rec);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &rec, sizeof(rec));
+}
+
 /* Forward decl for FFF1 write handler */
 static ssize_t write_callback(struct bt_conn *conn,
                               const struct bt_gatt_attr *attr,
@@ -256,28 +1032,38 @@ static ssize_t write_callback(struct bt_conn *conn,
    Attr indices for reference (do not rely on these externally):
    [0]  PRIMARY SERVICE (0xFFF0)
    [1]  FFF1 decl
-   [2]  FFF1 value (WRITE)
+   [2]  FFF1 value (WRITE|WRITE_WITHOUT_RESP)
    [3]  FFF2 decl
    [4]  FFF2 value (NOTIFY)  <-- DONE_xx notifications
    [5]  FFF2 CCC
    [6]  FFF3 decl
-   [7]  FFF3 value (READ|WRITE)  <-- row-by-row CSV read, 'R'/'D' write
+   [7]  FFF3 value (READ|WRITE)  <-- row-by-row CSV read, 'R'/'D'/'C' write
    [8]  FFF4 decl
-   [9]  FFF4 value (NOTIFY)  <-- bulk CSV stream
+   [9]  FFF4 value (NOTIFY)  <-- bulk stream (binary record or CSV)
    [10] FFF4 CCC
+   [11] FFF5 decl
+   [12] FFF5 value (READ|WRITE)  <-- Loop-2 configuration word
+   [13] FFF6 decl
+   [14] FFF6 value (READ)        <-- performance counters
+   [15] FFF7 decl
+   [16] FFF7 value (READ|WRITE)  <-- burst frame select / read
+   [17] FFF8 decl
+   [18] FFF8 value (WRITE)       <-- sequence program upload
+   [19] FFF9 decl
+   [20] FFF9 value (READ)        <-- device clock (multi-board alignment)
 ------------------------------------------------------------------ */
 BT_GATT_SERVICE_DEFINE(my_service,
     BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_16(0xFFF0)),
 
-    /* FFF1: command write */
-    /* FFF1: command write */
-BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF1), BT_GATT_CHRC_WRITE,
-                       BT_GATT_PERM_WRITE, NULL, write_callback, NULL),
+    /* FFF1: command write (ASCII line or binary batch, see app_cmd.h) */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF1),
+                           BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+                           BT_GATT_PERM_WRITE, NULL, write_callback, NULL),
 
 
     /* FFF2: notification value + CCC (used for DONE_xx messages) */
     BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF2), BT_GATT_CHRC_NOTIFY,
-                           BT_GATT_PERM_NONE, NULL, NULL, command_value),
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
     BT_GATT_CCC(notify_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 
     /* FFF3: Loop-4 CSV read|write */
@@ -286,159 +1072,1254 @@ BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF1), BT_GATT_CHRC_WRITE,
                            BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
                            l4_read_csv, l4_write_ctrl, NULL),
 
-    /* FFF4: Bulk CSV NOTIFY (entire matrix as text) */
+    /* FFF4: Bulk NOTIFY (binary frame record, or CSV text on request) */
     BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF4), BT_GATT_CHRC_NOTIFY,
                            BT_GATT_PERM_NONE, NULL, NULL, NULL),
-    BT_GATT_CCC(notify_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+    BT_GATT_CCC(notify_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+    /* FFF5: Loop-2 configuration word, [u16 nbits][packed bits] */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF5),
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_READ | BT_GATT_PERM_WRITE | BT_GATT_PERM_PREPARE_WRITE,
+                           l2_read_word, l2_write_word, NULL),
+
+    /* FFF6: performance counters, struct app_stats_rec (long read) */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF6), BT_GATT_CHRC_READ,
+                           BT_GATT_PERM_READ, app_read_stats, NULL, NULL),
+
+    /* FFF7: burst frames; write selects a frame, read returns its record */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF7),
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+                           l4_burst_read, l4_burst_select, NULL),
+
+    /* FFF8: sequence program, [u16 len][bytecode] (long write) */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF8), BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_WRITE | BT_GATT_PERM_PREPARE_WRITE,
+                           NULL, seq_write_prog, NULL),
+
+    /* FFF9: device uptime (u64 us), same clock as the frame timestamps */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0xFFF9), BT_GATT_CHRC_READ,
+                           BT_GATT_PERM_READ, app_read_clock, NULL, NULL)
 );
 
-/* -------------------- FFF1 command write handler -------------------- */
-static ssize_t write_callback(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+/* All FFF2 status messages go through here so they are counted */
+static void app_status_notify(const void *msg, uint16_t len)
 {
-    char received[20] = {0};
-    memcpy(received, buf, MIN(len, sizeof(received)-1));
-    LOG_INF("Received CMD: %s", received);
+    if (!notify_enabled) {
+        return;
+    }
+    if (bt_gatt_notify(NULL, &my_service.attrs[4], msg, len) == 0) {
+        atomic_inc(&app_st_sent);
+    } else {
+        atomic_inc(&app_st_failed);
+    }
+}
 
-    if (strncmp(received, "01", 2) == 0)      { run_led_loop1();  strcpy((char *)command_value, "DONE_01"); }
-    else if (strncmp(received, "02", 2) == 0) { run_led_loop2();  strcpy((char *)command_value, "DONE_02"); }
-    else if (strncmp(received, "03", 2) == 0) { run_led_loop3();  strcpy((char *)command_value, "DONE_03"); }
-    else if (strncmp(received, "04", 2) == 0) {
-        /* "04" -> capture; "04D" -> capture then dump */
-        run_led_loop4();
-        if (received[2] == 'D' && notify_enabled) {
+/* -------------------- Queued commands (executor thread, app_cmd.c) -------------------- */
+static int app_execute(const struct app_cmd *cmd, char *detail, size_t len)
+{
+    switch (cmd->op) {
+    case APP_CMD_LOOP1: run_led_loop1(); break;
+    case APP_CMD_LOOP2:
+        /* "02" apply if changed, "02F" force, "02V" apply + readback verify */
+        return l2_apply(cmd->arg == 'F', cmd->arg == 'V', detail, len);
+    case APP_CMD_LOOP3: run_led_loop3(); break;
+    case APP_CMD_LOOP4:
+    case APP_CMD_DUMP4:
+        if (cmd->op == APP_CMD_LOOP4 && run_led_loop4(&l4_frame) == 0) {
+            l4_read_idx = 0;
+            l4_ready = true;
+        }
+        if (app_cmd_abort_requested()) {
+            break;
+        }
+        if (cmd->arg == 'D' && notify_enabled) {
+            l4_dump_bin_notify();
+        } else if (cmd->arg == 'C' && notify_enabled) {
             l4_dump_csv_notify();
         }
-        strcpy((char *)command_value, "DONE_04");
+        break;
+    case APP_CMD_BENCH4:
+        (void)l4_bench_sampling(detail, len, NULL);
+        break;
+    case APP_CMD_CAL4:
+        return app_calibrate(cmd->argv[0], cmd->argv[1], cmd->argv[2] != 0, detail, len);
+    case APP_CMD_TPUT:
+        if (!notify_enabled || !current_conn) {
+            snprintk(detail, len, "notify off");
+            return -ENOTCONN;
+        }
+        ble_bench_tput(cmd->argv[0], detail, len);
+        break;
+    case APP_CMD_BURST4:
+        l4_burst_capture(cmd->argv[0], detail, len);
+        break;
+    case APP_CMD_SEQ:
+        return app_seq_exec(cmd->arg, detail, len);
+    case APP_CMD_SIMCHK:
+        (void)app_sim_check(cmd->argv[0], detail, len);
+        break;
+    case APP_CMD_CYCLE:
+        cy_run(cmd->argv[0], cmd->argv[1], cmd->argv[2], detail, len);
+        break;
+    case APP_CMD_HIST4:
+    {
+        /* The last shot stays readable through FFF3 / "D4", also when the
+           record could not be sent (the send follows the first shot) */
+        int n = l4_histogram(&l4_frame, cmd->argv[0], cmd->argv[1], cmd->argv[2],
+                             cmd->argv[3], detail, len);
+
+        l4_ready = (n != 0);
+        l4_read_idx = 0;
+        return MIN(n, 0);
     }
-
-    if (notify_enabled) {
-        bt_gatt_notify(NULL, &my_service.attrs[4], command_value, strlen((char *)command_value));
+    default:
+        return -ENOTSUP;
     }
-    return len;
+    return 0;
 }
 
-/* -------------------- New: bulk CSV notify (FFF4) -------------------- */
-static void l4_dump_csv_notify(void)
+/* -------------------- FFF1 commands (parser: app_cmd.c) --------------------
+   Each handler gets the text after its name and either writes its answer
+   to ctx->reply or queues the command, which the executor reports. */
+static void cmd_loop1(const char *args, struct app_cmd_ctx *c)
 {
-    if (!current_conn) {
-        LOG_WRN("No connection; cannot dump CSV.");
-        return;
-    }
-
-    /* Determine max payload per notification (ATT_MTU - 3 for ATT header). */
-    uint16_t mtu = bt_gatt_get_mtu(current_conn);
-    uint16_t chunk = (mtu > 3) ? (mtu - 3) : 20;   /* safe fallback */
-    if (chunk > 244) chunk = 244;                  /* practical upper bound */
+    app_cmd_submit(c, APP_CMD_LOOP1, 0, NULL);
+}
 
-    char outbuf[256];
-    size_t used = 0;
+static void cmd_loop2(const char *args, struct app_cmd_ctx *c)
+{
+    char arg = (args[0] == 'F' || args[0] == 'V') ? args[0] : 0;
 
-    /* Stream all rows as CSV lines "b0,...,b13\n" */
-    for (uint16_t row = 0; row < L4_TOTAL_READS; row++) {
-        char line[64];
-        int off = 0;
-        for (int i = 0; i < L4_NUM_PINS; i++) {
-            off += snprintk(line + off, sizeof(line) - off,
-                            (i == L4_NUM_PINS - 1) ? "%d\n" : "%d,", l4_matrix[row][i]);
-        }
+    app_cmd_submit(c, APP_CMD_LOOP2, arg, NULL);
+}
 
-        /* If this line would overflow the buffer, flush first */
-        if (used + off > chunk) {
-            (void)bt_gatt_notify(NULL, &my_service.attrs[9], outbuf, used); // FFF4 value attr
-            used = 0;
-            /* tiny pacing to avoid controller congestion */
-            k_msleep(1);
+static void cmd_loop3(const char *args, struct app_cmd_ctx *c)
+{
+    app_cmd_submit(c, APP_CMD_LOOP3, 0, NULL);
+}
+
+/* Abort the running command and drop everything queued behind it */
+static void cmd_abort(const char *args, struct app_cmd_ctx *c)
+{
+    app_cmd_abort();
+    l4_stream_stop();
+    cy_stop();
+    strcpy(c->reply, "ACK_AB");
+}
+
+/* "WF f=<hz> d=<duty %> p=<rst phase ns> n=<pulses, 0 = until AB>" / "WF?" */
+static void cmd_waveform(const char *args, struct app_cmd_ctx *c)
+{
+    struct wfg_params p;
+    uint32_t v[4];
+
+    wfg_get_params(&p);
+    v[0] = p.freq_hz;
+    v[1] = p.duty_pct;
+    v[2] = p.phase_ns;
+    v[3] = p.count;
+
+    if (args[0] != '?') {
+        if (app_parse_kv(args, "fdpn", v) < 0 || v[1] > 99) {
+            strcpy(c->reply, "ERR_WF");
+            return;
+        }
+        p.freq_hz  = v[0];
+        p.duty_pct = (uint8_t)v[1];
+        p.phase_ns = v[2];
+        p.count    = v[3];
+        if (wfg_configure(&p) != 0) {
+            strcpy(c->reply, "ERR_WF");
+            return;
+        }
+        app_cfg_changed();
+    }
+
+    snprintk(c->reply, c->reply_len, "DONE_WF f=%u d=%u p=%u n=%u",
+             p.freq_hz, p.duty_pct, p.phase_ns, p.count);
+}
+
+/* "T4 h=<high us> l=<low us> a=<arm us> s=<sample us>" / "T4?" */
+static void cmd_timing(const char *args, struct app_cmd_ctx *c)
+{
+    struct l4_timing t = l4_timing_get();
+    uint32_t v[4] = { t.t_high_us, t.t_low_us, t.arm_us, t.sample_us };
+
+    if (args[0] != '?') {
+        if (app_parse_kv(args, "hlas", v) < 0 ||
+            v[0] == 0 || v[0] > UINT16_MAX || v[1] == 0 || v[1] > UINT16_MAX ||
+            v[2] > UINT16_MAX || v[3] > v[0]) {
+            strcpy(c->reply, "ERR_T4");
+            return;
+        }
+        t.t_high_us = v[0];
+        t.t_low_us  = v[1];
+        t.arm_us    = v[2];
+        t.sample_us = v[3];
+        l4_timing_set(&t);  /* picked up at the start of the next frame */
+        app_cfg_changed();
+    }
+
+    snprintk(c->reply, c->reply_len, "DONE_T4 h=%u l=%u a=%u s=%u",
+             t.t_high_us, t.t_low_us, t.arm_us, t.sample_us);
+}
+
+/* "CAL4 r=<repeats> m=<min period us> a=<1: apply result>" */
+static void cmd_calibrate(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { L4_CAL_REPEATS, L4_CAL_MIN_PERIOD_US, 0 };
+
+    if (app_parse_kv(args, "rma", v) < 0 || v[0] == 0) {
+        strcpy(c->reply, "ERR_CAL4");
+    } else {
+        app_cmd_submit(c, APP_CMD_CAL4, 0, v);
+    }
+}
+
+/* "H4 n=<shots> w=<bin width> l=<lo code> b=<bins>"; b=0 covers lo..16383.
+   The record carries the width as a uint16 and the firmware bins
+   against width * bins in 32 bits: both are checked here. */
+static void cmd_histogram(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { 1000, 16, 1, 0 };
+
+    if (app_parse_kv(args, "nwlb", v) < 0 || v[0] == 0 || v[0] > INT32_MAX || v[1] == 0 ||
+        v[1] >= L4_CODE_MAX || v[2] >= L4_CODE_MAX) {
+        strcpy(c->reply, "ERR_H4");
+        return;
+    }
+    if (v[3] == 0) {
+        v[3] = DIV_ROUND_UP(L4_CODE_MAX - v[2], v[1]);
+    }
+    if (v[3] > L4_HIST_MAX_BINS) {
+        snprintk(c->reply, c->reply_len, "ERR_H4 bins>%u", L4_HIST_MAX_BINS);
+    } else if ((uint64_t)v[1] * v[3] > UINT32_MAX) {
+        strcpy(c->reply, "ERR_H4 span");
+    } else {
+        app_cmd_submit(c, APP_CMD_HIST4, 0, v);
+    }
+}
+
+/* "Z4 m=<0 raw, 1 auto, 2 zrle, 3 xbp>" / "Z4?" (adds raw:sent bytes so far) */
+static void cmd_encoding(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[1] = { atomic_get(&l4_enc_mode) };
+
+    if (args[0] != '?' &&
+        (app_parse_kv(args, "m", v) < 0 || v[0] > L4_ENC_MODE_XBP)) {
+        strcpy(c->reply, "ERR_Z4");
+        return;
+    }
+    if (args[0] != '?') {
+        atomic_set(&l4_enc_mode, v[0]);
+        app_cfg_changed();
+    }
+    snprintk(c->reply, c->reply_len, "DONE_Z4 m=%u %u:%u",
+             v[0], (unsigned)atomic_get(&l4_enc_raw_bytes),
+             (unsigned)atomic_get(&l4_enc_sent_bytes));
+}
+
+/* "TP n=<bytes>": FFF4 bulk throughput, "DONE_TP #id n= t= kbps" */
+static void cmd_throughput(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { 100000 };
+
+    if (app_parse_kv(args, "n", v) < 0 || v[0] == 0) {
+        strcpy(c->reply, "ERR_TP");
+    } else {
+        app_cmd_submit(c, APP_CMD_TPUT, 0, v);
+    }
+}
+
+/* "SIM s=<seed>": chip-model bit-for-bit check (native_sim) */
+static void cmd_sim_check(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { k_cycle_get_32() };
+
+    if (app_parse_kv(args, "s", v) < 0) {
+        strcpy(c->reply, "ERR_SIM");
+    } else {
+        app_cmd_submit(c, APP_CMD_SIMCHK, 0, v);
+    }
+}
+
+/* "SQ" run the FFF8 program, "SQD" run + dump samples, "SQT" dry run + trace, "SQ?" */
+static void cmd_seq(const char *args, struct app_cmd_ctx *c)
+{
+    struct seq_info info;
+
+    if (args[0] != '?') {
+        char arg = (args[0] == 'D' || args[0] == 'T') ? args[0] : 0;
+
+        app_cmd_submit(c, APP_CMD_SEQ, arg, NULL);
+    } else if (seq_get_info(&info)) {
+        snprintk(c->reply, c->reply_len,
+                 "DONE_SQ ops=%u len=%u s=%u w=%u t=%uus", info.ops, info.bytes,
+                 info.samples, info.writes, (uint32_t)(info.time_ns / NSEC_PER_USEC));
+    } else {
+        strcpy(c->reply, "ERR_SQ none");
+    }
+}
+
+/* "BLE f=<1 fast, 0 relaxed>" requests new link parameters; "BLE?" reports */
+static void cmd_link(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[1] = { ble_fast };
+    bool set = (args[0] != '?');
+
+    if (set && app_parse_kv(args, "f", v) < 0) {
+        strcpy(c->reply, "ERR_BLE");
+        return;
+    }
+    if (set) {
+        ble_fast = (v[0] != 0);
+        (void)k_work_reschedule(&ble_param_work, K_NO_WAIT);
+        app_cfg_changed();
+    }
+    /* ci in us, to in ms; the answer reflects the link before the new request */
+    snprintk(c->reply, c->reply_len,
+             "DONE_BLE f=%u phy=%u/%u dl=%u/%u mtu=%u ci=%u lat=%u to=%u",
+             ble_fast, ble_link.tx_phy, ble_link.rx_phy,
+             ble_link.tx_len, ble_link.rx_len,
+             current_conn ? bt_gatt_get_mtu(current_conn) : 0,
+             ble_link.interval * 1250U, ble_link.latency, ble_link.timeout * 10U);
+}
+
+/* "PWR l=<1 sleep through long Loop-4 waits, 0 spin>" / "PWR?": last frame's
+   CPU active / idle us and charge (nC), sleeps past their deadline */
+static void cmd_power(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[1] = { l4_low_power_get() };
+    struct l4_stats st;
+
+    if (args[0] != '?' && app_parse_kv(args, "l", v) < 0) {
+        strcpy(c->reply, "ERR_PWR");
+        return;
+    }
+    if (args[0] != '?') {
+        l4_low_power_set(v[0] != 0);
+        app_cfg_changed();
+    }
+    l4_stats_get(&st);
+    snprintk(c->reply, c->reply_len,
+             "DONE_PWR l=%u a=%u i=%u q=%u late=%u", v[0] != 0,
+             st.active_us, st.idle_us, st.charge_nc, st.late);
+}
+
+/* "RT i=<transfer id> o=<first chunk> m=<chunk mask from o, 0 = all>":
+   resend FFF4 chunks from the retained transfers: "ACK_RT" now, "DONE_RT i= n="
+   once sent, both under the batch request id when there is one */
+static void cmd_retransmit(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[3] = { 0, 0, 0 };
+
+    if (app_parse_kv(args, "iom", v) < 0 || v[0] == 0 || v[1] > UINT16_MAX) {
+        strcpy(c->reply, "ERR_RT");
+    } else if (ble_retx_request(v[0], v[1], v[2], c->req) != 0) {
+        strcpy(c->reply, "BUSY_RT");
+    } else if (!c->quiet) {
+        strcpy(c->reply, "ACK_RT");
+    }
+}
+
+/* "CFG s=1" save now, "CFG x=1" erase (defaults after reset), "CFG u=1" forget
+   all bonds; "CFG?": saves since boot, last error, bonded central */
+static void cmd_settings(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[3] = { 0, 0, 0 };
+    char peer[BT_ADDR_LE_STR_LEN] = "-";
+
+    if (args[0] != '?' && app_parse_kv(args, "sxu", v) < 0) {
+        strcpy(c->reply, "ERR_CFG");
+        return;
+    }
+    if (v[2]) {
+        (void)bt_unpair(BT_ID_DEFAULT, NULL);
+        app_cfg_peer_valid = false;
+    }
+    if (v[1]) {
+        atomic_set_bit(&app_cfg_flags, APP_CFG_F_ERASE);
+    }
+    if (v[0] || v[1] || v[2]) {
+        (void)k_work_reschedule(&app_cfg_work, K_NO_WAIT);
+    }
+    if (app_cfg_peer_valid) {
+        bt_addr_le_to_str(&app_cfg_peer, peer, sizeof(peer));
+    }
+    snprintk(c->reply, c->reply_len,
+             "DONE_CFG n=%u err=%d peer=%s", app_cfg_saves, app_cfg_err, peer);
+}
+
+/* "CY t=<period us> n=<cycles, 0 = until AB> s=<steps: 1 reset, 2 pulses,
+   4 capture>"; "CY?" reports the last run */
+static void cmd_cycle(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { 100000, 0, CY_STEP_CAPTURE };
+    struct wfg_params wp;
+
+    wfg_get_params(&wp);
+    if (args[0] == '?') {
+        int n = snprintk(c->reply, c->reply_len, "DONE_CY ");
+
+        cy_summary(c->reply + n, c->reply_len - n);
+    } else if (app_parse_kv(args, "tns", v) < 0 || v[0] < CY_MIN_PERIOD_US ||
+               v[2] == 0 || (v[2] & ~CY_STEP_ALL) ||
+               ((v[2] & CY_STEP_PULSES) && wp.count == 0)) {
+        strcpy(c->reply, "ERR_CY");
+    } else {
+        app_cmd_submit(c, APP_CMD_CYCLE, 0, v);
+    }
+}
+
+static void cmd_stats_reset(const char *args, struct app_cmd_ctx *c)
+{
+    app_stats_reset();
+    strcpy(c->reply, "DONE_STR");
+}
+
+static void cmd_latency(const char *args, struct app_cmd_ctx *c)
+{
+    struct app_cmd_lat lat;
+
+    app_cmd_lat_get(&lat);
+    snprintk(c->reply, c->reply_len, "LAT %u/%u/%u", lat.ack_us, lat.ack_max_us, lat.done_us);
+}
+
+/* "04B n=<frames>" burst into RAM (0 = as many as fit); "04B?" reports */
+static void cmd_burst(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { 0 };
+
+    if (args[0] == '?') {
+        snprintk(c->reply, c->reply_len,
+                 "DONE_04B id=%u n=%u max=%u", l4_burst_id, l4_burst_count,
+                 (unsigned)L4_BURST_FRAMES);
+    } else if (app_parse_kv(args, "n", v) < 0 || v[0] > L4_BURST_FRAMES) {
+        strcpy(c->reply, "ERR_04B");
+    } else {
+        app_cmd_submit(c, APP_CMD_BURST4, 0, v);
+    }
+}
+
+/* Continuous acquisition on FFF4 until "04E"; not while a command holds
+   the Loop-4 lines */
+static void cmd_stream_start(const char *args, struct app_cmd_ctx *c)
+{
+    strcpy(c->reply, l4_stream_start() == 0 ? "START_04S" : "BUSY_04S");
+}
+
+static void cmd_stream_stop(const char *args, struct app_cmd_ctx *c)
+{
+    l4_stream_stop();
+    strcpy(c->reply, "STOP_04S");
+}
+
+/* "04" -> capture; "04D" -> capture then binary dump; "04C" -> capture then CSV dump */
+static void cmd_loop4(const char *args, struct app_cmd_ctx *c)
+{
+    char arg = (args[0] == 'D' || args[0] == 'C') ? args[0] : 0;
+
+    app_cmd_submit(c, APP_CMD_LOOP4, arg, NULL);
+}
+
+/* Sampling benchmark; "DONE_B4 #id <pin>/<port>" cycles per sample */
+static void cmd_bench4(const char *args, struct app_cmd_ctx *c)
+{
+    app_cmd_submit(c, APP_CMD_BENCH4, 0, NULL);
+}
+
+/* Matched in order: a name must come before the names it is a prefix of */
+static const struct app_cmd_def app_cmds[] = {
+    { "01", cmd_loop1 },
+    { "02", cmd_loop2 },
+    { "03", cmd_loop3 },
+    { "AB", cmd_abort },
+    { "WF", cmd_waveform },
+    { "T4", cmd_timing },
+    { "CAL4", cmd_calibrate },
+    { "H4", cmd_histogram },
+    { "Z4", cmd_encoding },
+    { "TP", cmd_throughput },
+    { "SIM", cmd_sim_check },
+    { "SQ", cmd_seq },
+    { "BLE", cmd_link },
+    { "PWR", cmd_power },
+    { "RT", cmd_retransmit },
+    { "CFG", cmd_settings },
+    { "CY", cmd_cycle },
+    { "STR", cmd_stats_reset },
+    { "LAT", cmd_latency },
+    { "04B", cmd_burst },
+    { "04S", cmd_stream_start },
+    { "04E", cmd_stream_stop },
+    { "04", cmd_loop4 },
+    { "B4", cmd_bench4 },
+};
+
+static const struct app_cmd_ops app_cmd_ops = {
+    .cmds = app_cmds,
+    .n_cmds = ARRAY_SIZE(app_cmds),
+    .execute = app_execute,
+    .notify = app_status_notify,
+};
+
+static ssize_t write_callback(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    timing_t t_write = timing_counter_get();
+    char received[64] = {0};
+
+    if (len >= 2 && ((const uint8_t *)buf)[0] == APP_BIN_MAGIC) {
+        app_cmd_batch(buf, len, t_write);
+        return len;
+    }
+    memcpy(received, buf, MIN(len, sizeof(received)-1));
+    LOG_INF("Received CMD: %s", received);
+    app_cmd_line(received, t_write);
+    return len;
+}
+
+
+
+/* -------------------- Loop-4 frame encoding -------------------- */
+/* Header to transmit for `f`: either f itself or `e`, re-encoded per the
+   current "Z4" mode. */
+static const struct l4_rec_hdr *l4_encode_frame(const struct l4_frame *f,
+                                                struct l4_enc_frame *e)
+{
+    size_t bytes;
+    const struct l4_rec_hdr *h = l4_encode(f, e, atomic_get(&l4_enc_mode), &bytes);
+
+    (void)atomic_add(&l4_enc_raw_bytes, sizeof(f->words));
+    (void)atomic_add(&l4_enc_sent_bytes, bytes);
+    return h;
+}
+
+/* -------------------- Bulk notify (FFF4) -------------------- */
+/* Max payload per notification (ATT_MTU - 3 for ATT header). */
+static uint16_t l4_notify_chunk(void)
+{
+    uint16_t mtu = bt_gatt_get_mtu(current_conn);
+    uint16_t chunk = (mtu > 3) ? (mtu - 3) : 20;   /* safe fallback */
+    if (chunk > 244) chunk = 244;                  /* practical upper bound */
+    return chunk;
+}
+
+static void ble_tx_sent(struct bt_conn *conn, void *user_data)
+{
+    k_sem_give(&ble_tx_credits);
+}
+
+/* Queue one FFF4 notification; blocks (thread context only) while
+   BLE_TX_CREDITS notifications are still waiting for the radio. */
+static int ble_tx_notify(const void *data, uint16_t len)
+{
+    struct bt_gatt_notify_params params = {
+        .attr = &my_service.attrs[9],     // FFF4 value attr
+        .data = data,
+        .len  = len,
+        .func = ble_tx_sent,
+    };
+    int err;
+
+    if (k_sem_take(&ble_tx_credits, K_MSEC(2000)) != 0) {
+        atomic_inc(&app_ntf_stalled);
+        return -ETIMEDOUT;
+    }
+    app_stat_max(&app_credits_hw, BLE_TX_CREDITS - k_sem_count_get(&ble_tx_credits));
+    for (int retry = 0; retry < 10; retry++) {
+        err = bt_gatt_notify_cb(current_conn, &params);
+        if (err != -ENOMEM) {
+            break;
+        }
+        atomic_inc(&app_ntf_retried);
+        k_msleep(1);    /* host buffers exhausted despite credits; rare */
+    }
+    if (err) {
+        k_sem_give(&ble_tx_credits);
+        atomic_inc(&app_ntf_failed);
+        atomic_set(&app_ntf_last_err, err);
+    } else {
+        atomic_inc(&app_ntf_sent);
+        (void)atomic_add(&app_ntf_bytes, len);
+    }
+    return err;
+}
+
+/* Wait until every queued notification has been handed to the radio */
+static int ble_tx_drain(k_timeout_t timeout)
+{
+    int taken = 0, err = 0;
+
+    for (; taken < BLE_TX_CREDITS; taken++) {
+        err = k_sem_take(&ble_tx_credits, timeout);
+        if (err) {
+            break;
+        }
+    }
+    while (taken--) {
+        k_sem_give(&ble_tx_credits);
+    }
+    return err;
+}
+
+/* ---- "RT" retransmit requests (framing and retention: ble_xfer.c) ---- */
+struct ble_retx_req {
+    uint32_t id;
+    uint32_t mask;
+    uint16_t base;
+    uint16_t req;               /* batch request id, 0 for an ASCII "RT" */
+};
+
+K_MSGQ_DEFINE(ble_retx_q, sizeof(struct ble_retx_req), 8, 4);
+static atomic_t app_retx_req, app_retx_chunks, app_retx_gone;
+static uint32_t app_xfer_base;          /* ble_xfer_last_id() at "STR" */
+
+/* "RT" requests, on the transmit queue so they interleave with streaming */
+static void ble_retx_work_handler(struct k_work *work)
+{
+    struct ble_retx_req req;
+
+    while (k_msgq_get(&ble_retx_q, &req, K_NO_WAIT) == 0) {
+        uint16_t sent;
+        int err = ble_xfer_resend(req.id, req.base, req.mask, &sent);
+
+        char msg[40];
+
+        (void)atomic_add(&app_retx_chunks, sent);
+        if (err == -ENOENT && sent == 0) {
+            atomic_inc(&app_retx_gone);
+            snprintk(msg, sizeof(msg), "ERR_RT i=%u gone", req.id);
+        } else {
+            snprintk(msg, sizeof(msg), "DONE_RT i=%u n=%u", req.id, sent);
+        }
+        app_cmd_reply(req.req, msg);
+    }
+}
+static K_WORK_DEFINE(ble_retx_work, ble_retx_work_handler);
+
+/* Binary record: header + packed words, as one reliable transfer */
+static int l4_notify_record(const struct l4_rec_hdr *hdr)
+{
+    return ble_xfer_send(hdr, sizeof(*hdr) + sys_le16_to_cpu(hdr->payload_len));
+}
+
+/* Every record must fit one retained transfer, or it could never be sent */
+BUILD_ASSERT(L4_HIST_REC_MAX_BYTES <= BLE_XFER_MAX_LEN,
+             "APP_L4_HIST_BINS is too large for APP_BLE_RETX_KB");
+BUILD_ASSERT(L4_CAL_REC_MAX_BYTES <= BLE_XFER_MAX_LEN &&
+             sizeof(struct l4_cycle_rec) <= BLE_XFER_MAX_LEN &&
+             sizeof(struct l4_frame) <= BLE_XFER_MAX_LEN &&
+             L4_CSV_BYTES <= BLE_XFER_MAX_LEN, "FFF4 record larger than APP_BLE_RETX_KB");
+
+/* loop4.c records ("H4", "CAL4"): only while a central listens on FFF4 */
+static int app_send_record(const struct l4_rec_hdr *hdr)
+{
+    if (!notify_enabled || !current_conn) {
+        return -ENOTCONN;
+    }
+    return l4_notify_record(hdr);
+}
+
+/* -------------------- Bulk throughput benchmark ("TP") --------------------
+   Sends `bytes` of a counting pattern (byte i = i & 0xFF, so the host can
+   check for loss) on FFF4 in full-MTU notifications, then waits for the
+   last completion. The host discards FFF4 data between ACK_TP and DONE_TP. */
+static void ble_bench_tput(uint32_t bytes, char *out, size_t out_len)
+{
+    static uint8_t buf[244];
+    uint16_t chunk = l4_notify_chunk();
+    uint32_t sent = 0;
+    int64_t t0 = k_uptime_get();
+    int err = 0;
+
+    while (sent < bytes && !app_cmd_abort_requested()) {
+        uint16_t n = MIN(chunk, bytes - sent);
+
+        for (uint16_t i = 0; i < n; i++) {
+            buf[i] = (uint8_t)(sent + i);
+        }
+        err = ble_tx_notify(buf, n);
+        if (err) {
+            break;
+        }
+        sent += n;
+    }
+    (void)ble_tx_drain(K_MSEC(2000));
+
+    uint32_t ms = MAX((uint32_t)(k_uptime_get() - t0), 1U);
+
+    LOG_INF("TP: %u bytes in %u ms = %u kbit/s (chunk %u, err %d)",
+            sent, ms, (uint32_t)(((uint64_t)sent * 8U) / ms), chunk, err);
+    snprintk(out, out_len, "n=%u t=%ums %ukbps%s", sent, ms,
+             (uint32_t)(((uint64_t)sent * 8U) / ms), err ? " ERR" : "");
+}
+
+static void l4_dump_bin_notify(void)
+{
+    if (!current_conn) {
+        LOG_WRN("No connection; cannot dump frame.");
+        return;
+    }
+
+    static struct l4_enc_frame enc;     /* executor thread only */
+
+    if (l4_notify_record(l4_encode_frame(&l4_frame, &enc)) == 0) {
+        LOG_INF("Loop4: binary dump complete (frame %u).",
+                sys_le32_to_cpu(l4_frame.hdr.frame_id));
+    }
+}
+
+static void l4_dump_csv_notify(void)
+{
+    if (!current_conn) {
+        LOG_WRN("No connection; cannot dump CSV.");
+        return;
+    }
+
+    /* All rows as CSV lines "b0,...,b13\n", sent as one transfer */
+    static char csv[L4_CSV_BYTES];      /* executor thread only */
+    size_t used = l4_format_csv(&l4_frame, csv);
+
+    if (ble_xfer_send(csv, used) == 0) {
+        LOG_INF("Loop4: CSV dump complete (%u rows).", L4_TOTAL_READS);
+    }
+}
+
+/* -------------------- Loop-4 streaming --------------------
+   The capture thread keeps the TX lines clocked back to back; the transmit
+   work runs on its own queue at a higher priority so it can hand finished
+   frames to the host while the capture loop is busy-waiting. Preemption only
+   stretches a clk_shift phase, which the chip tolerates (all timings are
+   minimums). When no free buffer is left the just-captured frame is dropped
+   and its buffer reused, so capture never stalls on the radio. */
+static K_THREAD_STACK_DEFINE(l4_tx_stack, 2048);
+static struct k_work_q l4_tx_wq;
+
+static void l4_stream_report(const char *tag)
+{
+    char msg[40];
+    int n = snprintk(msg, sizeof(msg), "%s f=%u d=%u", tag,
+                     (unsigned)atomic_get(&l4_stream_frames),
+                     (unsigned)atomic_get(&l4_dropped));
+
+    app_status_notify(msg, n);
+}
+
+static void l4_tx_work_handler(struct k_work *work)
+{
+    static atomic_val_t reported_drops;
+    static struct l4_enc_frame enc;     /* l4_tx_wq only */
+    uint8_t idx;
+
+    while (k_msgq_get(&l4_ready_q, &idx, K_NO_WAIT) == 0) {
+        if (notify_enabled && current_conn) {
+            (void)l4_notify_record(l4_encode_frame(&l4_ring[idx], &enc));
         }
+        (void)k_msgq_put(&l4_free_q, &idx, K_NO_WAIT);
+    }
 
-        memcpy(outbuf + used, line, off);
-        used += off;
+    atomic_val_t drops = atomic_get(&l4_dropped);
+    if (drops != reported_drops) {
+        reported_drops = drops;
+        l4_stream_report("DROP_04S");
     }
+}
+static K_WORK_DEFINE(l4_tx_work, l4_tx_work_handler);
 
-    /* Flush any remainder */
-    if (used) {
-        (void)bt_gatt_notify(NULL, &my_service.attrs[9], outbuf, used); // FFF4 value attr
+static void l4_stream_init(void)
+{
+    for (uint8_t i = 0; i < L4_RING_FRAMES; i++) {
+        (void)k_msgq_put(&l4_free_q, &i, K_NO_WAIT);
     }
 
-    LOG_INF("Loop4: CSV dump complete (%u rows).", L4_TOTAL_READS);
+    k_work_queue_start(&l4_tx_wq, l4_tx_stack, K_THREAD_STACK_SIZEOF(l4_tx_stack),
+                       CONFIG_APP_L4_TX_PRIO, NULL);
+}
+
+/* BT RX context: queue an "RT" request for the transmit queue */
+static int ble_retx_request(uint32_t id, uint16_t base, uint32_t mask, uint16_t req)
+{
+    struct ble_retx_req r = { .id = id, .mask = mask, .base = base, .req = req };
+
+    if (k_msgq_put(&ble_retx_q, &r, K_NO_WAIT) != 0) {
+        return -EBUSY;
+    }
+    atomic_inc(&app_retx_req);
+    k_work_submit_to_queue(&l4_tx_wq, &ble_retx_work);
+    return 0;
+}
+
+static void l4_capture_thread(void *p1, void *p2, void *p3)
+{
+    uint8_t idx, next;
+
+    for (;;) {
+        k_sem_take(&l4_stream_sem, K_FOREVER);
+        (void)k_msgq_get(&l4_free_q, &idx, K_FOREVER);
+
+        while (atomic_get(&l4_streaming)) {
+            struct l4_timing t = l4_timing_get();
+
+            if (l4_capture_frame(&l4_ring[idx], &t) != 0) {
+                atomic_clear(&l4_streaming);
+                break;
+            }
+            atomic_inc(&l4_stream_frames);
+
+            if (k_msgq_get(&l4_free_q, &next, K_NO_WAIT) == 0) {
+                (void)k_msgq_put(&l4_ready_q, &idx, K_NO_WAIT);
+                app_stat_max(&app_ring_hw, k_msgq_num_used_get(&l4_ready_q));
+                (void)k_work_submit_to_queue(&l4_tx_wq, &l4_tx_work);
+                idx = next;
+            } else {
+                atomic_inc(&l4_dropped);
+            }
+        }
+
+        (void)k_msgq_put(&l4_free_q, &idx, K_NO_WAIT);
+        LOG_INF("Loop4: stream stopped (%u frames, %u dropped).",
+                (unsigned)atomic_get(&l4_stream_frames),
+                (unsigned)atomic_get(&l4_dropped));
+        l4_stream_report("DONE_04S");
+        app_cmd_l4_give();
+    }
+}
+K_THREAD_DEFINE(l4_capture_tid, 2048, l4_capture_thread, NULL, NULL, NULL,
+                CONFIG_APP_L4_CAPTURE_PRIO, 0, 0);
+
+static int l4_stream_start(void)
+{
+    if (!app_cmd_l4_take()) {
+        /* Already streaming, or the lines are the executor's (or the
+           last stream's until its capture thread is done) */
+        return atomic_get(&l4_streaming) ? 0 : -EBUSY;
+    }
+    atomic_set(&l4_streaming, 1);
+    atomic_clear(&l4_stream_frames);
+    atomic_clear(&l4_dropped);
+    app_cmd_abort_clear();        /* a stale "AB" must not end the new stream */
+    l4_ready = false;
+    k_sem_give(&l4_stream_sem);
+    LOG_INF("Loop4: stream started (%d buffers).", L4_RING_FRAMES);
+    return 0;
+}
+
+static void l4_stream_stop(void)
+{
+    /* Capture thread finishes the frame in progress and reports DONE_04S;
+       frames already queued still drain to FFF4. */
+    atomic_clear(&l4_streaming);
 }
 
-/* -------------------- Loop implementations -------------------- */
-void run_led_loop1(void)
+/* -------------------- Periodic measurement cycles ("CY") --------------------
+   The scheduler (cycle.c) runs in the command thread. Frames go through
+   the streaming ring and the transmit queue, and cycle entries out in
+   L4_REC_CYCLE records from the same queue, so the radio never delays the
+   next cycle; with no free ring buffer the frame is kept out of the
+   stream and the entry flagged CY_F_DROPPED. */
+static void cy_tx_work_handler(struct k_work *work)
 {
-    gpio_pin_configure_dt(&rst_led,     GPIO_OUTPUT_INACTIVE);
-    gpio_pin_configure_dt(&rstctrl_led, GPIO_OUTPUT_INACTIVE);
-    gpio_pin_configure_dt(&enbias_led,  GPIO_OUTPUT_INACTIVE);
-    gpio_pin_configure_dt(&stab_led,    GPIO_OUTPUT_INACTIVE);
+    static struct l4_cycle_rec rec;     /* l4_tx_wq only */
+    uint16_t n;
 
-    gpio_pin_set_dt(&stab_led, 1);
+    do {
+        n = cy_take(rec.ent, CY_REC_ENTRIES);
+        if (n == 0 || !notify_enabled || !current_conn) {
+            continue;
+        }
+        rec.hdr = (struct l4_rec_hdr){
+            .magic        = L4_REC_MAGIC,
+            .version      = L4_REC_VERSION,
+            .type         = L4_REC_CYCLE,
+            .encoding     = L4_ENC_RAW,
+            .frame_id     = sys_cpu_to_le32(rec.ent[0].cycle),
+            .timestamp_us = sys_cpu_to_le64(rec.ent[0].start_us),
+            .word_count   = sys_cpu_to_le16(n),
+            .payload_len  = sys_cpu_to_le16(n * sizeof(rec.ent[0])),
+        };
+        (void)l4_notify_record(&rec.hdr);
+    } while (n == CY_REC_ENTRIES);
+}
+static K_WORK_DEFINE(cy_tx_work, cy_tx_work_handler);
 
-    gpio_pin_set_dt(&rst_led, 0);
-    gpio_pin_set_dt(&rstctrl_led, 0);
-    k_msleep(8);
+/* Capture into a free ring buffer and queue it for the transmit work */
+static int cy_capture(struct l4_cycle_ent *e)
+{
+    struct l4_timing t = l4_timing_get();
+    struct l4_frame *f = &l4_frame;
+    uint8_t idx;
+    bool ring = (k_msgq_get(&l4_free_q, &idx, K_NO_WAIT) == 0);
 
-    gpio_pin_set_dt(&rst_led, 1);
-    gpio_pin_set_dt(&rstctrl_led, 1);
+    if (ring) {
+        f = &l4_ring[idx];
+    }
+    if (l4_capture_frame(f, &t) != 0) {
+        if (ring) {
+            (void)k_msgq_put(&l4_free_q, &idx, K_NO_WAIT);
+        }
+        return -ECANCELED;
+    }
+    e->frame_id = f->hdr.frame_id;
+    e->flags |= CY_F_FRAME;
+    if (!ring) {
+        e->flags |= CY_F_DROPPED;
+        return 0;
+    }
+    (void)k_msgq_put(&l4_ready_q, &idx, K_NO_WAIT);
+    app_stat_max(&app_ring_hw, k_msgq_num_used_get(&l4_ready_q));
+    (void)k_work_submit_to_queue(&l4_tx_wq, &l4_tx_work);
+    return 0;
+}
 
-    gpio_pin_set_dt(&enbias_led, 1);
+static void cy_flush(void)
+{
+    (void)k_work_submit_to_queue(&l4_tx_wq, &cy_tx_work);
+}
 
-    gpio_pin_set_dt(&stab_led, 0);
-    gpio_pin_set_dt(&stab_led, 0);
-    gpio_pin_set_dt(&stab_led, 0);
+static const struct cy_ops app_cy_ops = {
+    .reset   = run_led_loop1,
+    .pulses  = run_led_loop3,
+    .capture = cy_capture,
+    .flush   = cy_flush,
+    .abort   = app_cmd_abort_requested,
+};
 
-    gpio_pin_set_dt(&stab_led, 1);
+/* -------------------- Loop-4 timing calibration ("CAL4") --------------------
+   The sweep (loop4.c) streams its eye map; applying the result is a
+   settings change like "T4". */
+static int app_calibrate(uint32_t repeats, uint32_t min_period_us, bool apply,
+                         char *out, size_t out_len)
+{
+    struct l4_timing best;
+    int err = l4_calibrate(repeats, min_period_us, &best);
 
-    if (notify_enabled) {
-        strcpy((char *)command_value, "DONE_01");
-        bt_gatt_notify(NULL, &my_service.attrs[4], command_value, strlen((char *)command_value));
+    if (err == -EIO) {
+        snprintk(out, out_len, "unstable ref");
+        return err;
+    }
+    if (err == -ECANCELED) {
+        snprintk(out, out_len, "aborted");
+        return 0;       /* reported as ABORTED */
+    }
+    if (err) {
+        /* Capture failed, or the host never got the eye map: keep the
+           current timing */
+        snprintk(out, out_len, "err %d", err);
+        return err;
     }
+    if (apply) {
+        l4_timing_set(&best);
+        app_cfg_changed();
+    }
+    snprintk(out, out_len, "h=%u l=%u s=%u%s", best.t_high_us, best.t_low_us,
+             best.sample_us, apply ? " applied" : "");
+    return 0;
 }
 
-void run_led_loop2(void)
+/* -------------------- Loop-4 burst ("04B") --------------------
+   Lines are prepared once and the frames are clocked back to back with no
+   radio work in between; the only gap is the header fill and the counter
+   update of l4_capture_run(). Timing is snapshotted for the whole burst.
+   An abort keeps the frames captured so far. */
+static void l4_burst_capture(uint32_t frames, char *out, size_t out_len)
 {
-    gpio_pin_configure_dt(&clk_gpio,  GPIO_OUTPUT_INACTIVE);
-    gpio_pin_configure_dt(&data_gpio, GPIO_OUTPUT_INACTIVE);
+    struct l4_timing t = l4_timing_get();
+    uint32_t n = 0;
+    int64_t t0;
+
+    if (frames == 0) {
+        frames = L4_BURST_FRAMES;
+    }
+
+    l4_burst_count = 0;         /* FFF7 reads nothing while the arena changes */
+    l4_burst_id++;
+    l4_burst_sel = 0;
+
+    if (l4_capture_prepare() != 0) {
+        snprintk(out, out_len, "ERR gpio");
+        return;
+    }
+
+    t0 = k_uptime_get();
+    while (n < frames && l4_capture_run(&l4_burst[n], &t) == 0) {
+        n++;
+    }
+
+    uint32_t ms = (uint32_t)(k_uptime_get() - t0);
+
+    l4_burst_count = n;
+    LOG_INF("Loop4 burst %u: %u/%u frames in %u ms (%u us/frame)",
+            l4_burst_id, n, frames, ms, n ? (ms * 1000U) / n : 0);
+    snprintk(out, out_len, "id=%u n=%u %uus", l4_burst_id, n, n ? (ms * 1000U) / n : 0);
+}
+
+/* -------------------- Sequence programs ("SQ") --------------------
+   Samples land in l4_frame, zero-filled to 128 rows, so "SQD", FFF3 and
+   "D4" deliver them like a Loop-4 capture. The header timing fields are 0:
+   the frame was clocked by the program, not by T4. */
+static int app_seq_exec(char mode, char *out, size_t out_len)
+{
+    uint16_t words[L4_TOTAL_READS] = {0};
+    struct seq_info info;
+    uint32_t ns = 0;
+    int n;
+
+    if (!seq_get_info(&info)) {
+        snprintk(out, out_len, "no program");
+        return -ENOENT;
+    }
+
+    /* pulse / rst_tdc belong to the waveform generator while it runs. A
+       dry run only moves pins when it is timed on the emulated lines. */
+    if (mode != 'T' || SEQ_DRY_TIMED) {
+        if (wfg_busy() && (info.signals & (BIT(SEQ_SIG_PULSE) | BIT(SEQ_SIG_RST_TDC)))) {
+            snprintk(out, out_len, "busy 03");
+            return -EBUSY;
+        }
+        if (info.samples > 0 && l4_capture_prepare() != 0) {
+            snprintk(out, out_len, "gpio");
+            return -ENODEV;
+        }
+    }
+
+    if (mode == 'T') {
+        static struct l4_seq_trace_rec rec;     /* executor thread only */
+        struct seq_dry dry;
+
+        n = seq_dry_run(rec.edge, ARRAY_SIZE(rec.edge), &dry);
+        if (n != 0) {
+            snprintk(out, out_len, "dry err %d", n);
+            return n;
+        }
+        for (uint32_t i = 0; i < dry.edges; i++) {
+            rec.edge[i].t_ns = sys_cpu_to_le32(rec.edge[i].t_ns);
+            rec.edge[i].levels = sys_cpu_to_le16(rec.edge[i].levels);
+        }
+        rec.hdr = (struct l4_rec_hdr){
+            .magic        = L4_REC_MAGIC,
+            .version      = L4_REC_VERSION,
+            .type         = L4_REC_SEQTRACE,
+            .encoding     = L4_ENC_RAW,
+            .timestamp_us = sys_cpu_to_le64(k_ticks_to_us_floor64(k_uptime_ticks())),
+            .word_count   = sys_cpu_to_le16(dry.edges),
+            .payload_len  = sys_cpu_to_le16(dry.edges * sizeof(rec.edge[0])),
+        };
+        if (notify_enabled && current_conn) {
+            (void)l4_notify_record(&rec.hdr);
+        }
+        snprintk(out, out_len, "t=%uus e=%u%s%s", (uint32_t)(dry.time_ns / NSEC_PER_USEC),
+                 dry.edges, dry.truncated ? "+" : "", dry.measured ? " timed" : "");
+        return 0;
+    }
 
-    for (int i = 0; i < 95; i++) {
-        int bit = data[94 - i];
-        gpio_pin_set_dt(&data_gpio, bit);
-        gpio_pin_set_dt(&clk_gpio, 0);
-        gpio_pin_set_dt(&clk_gpio, 0);
-        gpio_pin_set_dt(&clk_gpio, 1);
+    uint64_t t_start_us = k_ticks_to_us_floor64(k_uptime_ticks());
+
+    n = seq_run(words, ARRAY_SIZE(words), &ns);
+    if (n == -ECANCELED) {
+        return 0;       /* reported as ABORTED_SQ */
+    }
+    if (n < 0) {
+        snprintk(out, out_len, "run err %d", n);
+        return n;
     }
-    gpio_pin_set_dt(&data_gpio, 0);
-    gpio_pin_set_dt(&clk_gpio, 0);
 
-    if (notify_enabled) {
-        strcpy((char *)command_value, "DONE_02");
-        bt_gatt_notify(NULL, &my_service.attrs[4], command_value, strlen((char *)command_value));
+    if (info.samples > 0) {
+        memcpy(l4_frame.words, words, sizeof(l4_frame.words));
+        l4_frame.hdr = (struct l4_rec_hdr){
+            .magic        = L4_REC_MAGIC,
+            .version      = L4_REC_VERSION,
+            .type         = L4_REC_FRAME,
+            .encoding     = L4_ENC_RAW,
+            .frame_id     = sys_cpu_to_le32(l4_next_frame_id()),
+            .timestamp_us = sys_cpu_to_le64(t_start_us),
+            .word_count   = sys_cpu_to_le16(L4_TOTAL_READS),
+            .payload_len  = sys_cpu_to_le16(sizeof(l4_frame.words)),
+        };
+        l4_read_idx = 0;
+        l4_ready = true;
+        if (mode == 'D' && notify_enabled) {
+            l4_dump_bin_notify();
+        }
     }
+
+    LOG_INF("SQ: %d samples in %u ns (estimate %u ns)", n, ns, (uint32_t)info.time_ns);
+    snprintk(out, out_len, "n=%d %uus", n, ns / NSEC_PER_USEC);
+    return 0;
 }
 
-void run_led_loop3(void)
+/* -------------------- Chip-model check ("SIM") --------------------
+   native_sim only. Plays a pseudo-random word sequence through the chip
+   model, captures it at the current T4 timing and compares it row by row,
+   then force-shifts the staged Loop-2 word (with readback) and compares
+   it with the model's register. Capture cycles per frame make timing and
+   sampling changes comparable between builds. Returns the error count. */
+static int app_sim_check(uint32_t seed, char *out, size_t out_len)
 {
-    gpio_pin_configure_dt(&pulse_gpio, GPIO_OUTPUT_INACTIVE);
-    gpio_pin_configure_dt(&rst_gpio,   GPIO_OUTPUT_INACTIVE);
+#if defined(CONFIG_APP_CHIP_MODEL)
+    static struct l4_frame f;
+    uint16_t seq[L4_TOTAL_READS];
+    uint32_t reg[L2_MAX_WORDS] = {0};
+    struct l4_timing t = l4_timing_get();
+    struct l2_word cw;
+    char l2[24];
+    uint32_t x = seed | 1U;
+    int rows = 0, bits = 0, err;
+    size_t nbits;
+    timing_t t0, t1;
+
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        x = x * 1103515245u + 12345u;
+        seq[r] = (r % 3) ? ((x >> 10) & L4_ALL_LINES) : 0;
+    }
+    (void)chip_model_load(seq, L4_TOTAL_READS);
 
-    for (int i = 0; i < 1000000; i++) {
-        gpio_pin_set_dt(&pulse_gpio, 1);
-        gpio_pin_set_dt(&rst_gpio,   0);
-        gpio_pin_set_dt(&pulse_gpio, 0);
-        gpio_pin_set_dt(&rst_gpio,   1);
+    t0 = timing_counter_get();
+    err = l4_capture_frame(&f, &t);
+    t1 = timing_counter_get();
+    if (err) {
+        snprintk(out, out_len, "capture err %d", err);
+        return 1;
     }
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        rows += (f.words[r] != seq[r]);
+    }
+
+    (void)l2_apply(true, true, l2, sizeof(l2));
+    nbits = chip_model_cfg_get(reg, ARRAY_SIZE(reg));
+
+    l2_staged_get(&cw);
 
-    if (notify_enabled) {
-        strcpy((char *)command_value, "DONE_03");
-        bt_gatt_notify(NULL, &my_service.attrs[4], command_value, strlen((char *)command_value));
+    if (cw.nbits != nbits) {
+        bits = -1;      /* chip register length differs from the word */
+    } else {
+        for (int k = 0; k < (int)nbits; k++) {
+            bits += (l2_bit(&cw, k) != ((reg[k / 32] >> (k % 32)) & 1U));
+        }
     }
+
+    uint32_t cyc = (uint32_t)timing_cycles_get(&t0, &t1);
+
+    LOG_INF("SIM seed %u: %d/%u rows differ, cfg %d bits differ (%s), %u cyc/frame",
+            seed, rows, L4_TOTAL_READS, bits, l2, cyc);
+    snprintk(out, out_len, "rows=%d cfg=%d %ucyc", rows, bits, cyc);
+    return rows + (bits != 0);
+#else
+    ARG_UNUSED(seed);
+    snprintk(out, out_len, "n/a");
+    return 0;
+#endif
+}
+
+/* -------------------- Performance counter snapshot / reset -------------------- */
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+/* Runtime cannot be cleared in the kernel; "STR" keeps a baseline instead */
+static uint64_t app_rt_base[4];
+
+static void app_rt_cycles(uint64_t cyc[4])
+{
+    k_thread_runtime_stats_t rt;
+    k_tid_t tid[3] = { app_cmd_tid, l4_capture_tid, k_work_queue_thread_get(&l4_tx_wq) };
+
+    for (int i = 0; i < 3; i++) {
+        cyc[i] = (k_thread_runtime_stats_get(tid[i], &rt) == 0) ? rt.execution_cycles : 0;
+    }
+    cyc[3] = (k_thread_runtime_stats_all_get(&rt) == 0) ? rt.execution_cycles : 0;
+}
+#endif
+
+static void app_stats_snapshot(struct app_stats_rec *out)
+{
+    int64_t now = k_uptime_get();
+    struct l4_stats l4;
+
+    memset(out, 0, sizeof(*out));
+    out->version        = APP_STATS_VERSION;
+    out->n_ops          = APP_CMD_COUNT;
+    out->size           = sizeof(*out);
+    out->uptime_ms      = (uint32_t)now;
+    out->since_reset_ms = (uint32_t)(now - app_stats_reset_ms);
+    l4_stats_get(&l4);
+    out->cap_frames     = l4.frames;
+    out->cap_last_us    = l4.last_us;
+    out->cap_max_us     = l4.max_us;
+    out->smp_min_ns     = l4.smp_min_ns;
+    out->smp_max_ns     = l4.smp_max_ns;
+    out->smp_jitter_ns  = l4.smp_jitter_ns;
+    out->ntf_sent       = atomic_get(&app_ntf_sent);
+    out->ntf_bytes      = atomic_get(&app_ntf_bytes);
+    out->ntf_failed     = atomic_get(&app_ntf_failed);
+    out->ntf_retried    = atomic_get(&app_ntf_retried);
+    out->ntf_stalled    = atomic_get(&app_ntf_stalled);
+    out->ntf_last_err   = (int16_t)atomic_get(&app_ntf_last_err);
+    out->st_sent        = atomic_get(&app_st_sent);
+    out->st_failed      = MIN(atomic_get(&app_st_failed), UINT16_MAX);
+    out->ring_hw        = (uint8_t)atomic_get(&app_ring_hw);
+    out->credits_hw     = (uint8_t)atomic_get(&app_credits_hw);
+    out->pwr_active_us  = l4.active_us;
+    out->pwr_idle_us    = l4.idle_us;
+    out->pwr_charge_nc  = l4.charge_nc;
+    out->pwr_total_uc   = l4.total_uc;
+    out->pwr_late       = MIN(l4.late, UINT16_MAX);
+    out->pwr_low_power  = l4_low_power_get();
+    out->xfer_sent      = ble_xfer_last_id() - app_xfer_base;
+    out->retx_req       = atomic_get(&app_retx_req);
+    out->retx_chunks    = atomic_get(&app_retx_chunks);
+    out->retx_gone      = atomic_get(&app_retx_gone);
+
+    app_cmd_stats_get(out->cmd, &out->cmd_q_hw);
+
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+    uint64_t cyc[4];
+
+    app_rt_cycles(cyc);
+    out->rt_cmd_ms     = k_cyc_to_ms_floor64(cyc[0] - app_rt_base[0]);
+    out->rt_capture_ms = k_cyc_to_ms_floor64(cyc[1] - app_rt_base[1]);
+    out->rt_tx_ms      = k_cyc_to_ms_floor64(cyc[2] - app_rt_base[2]);
+    out->rt_all_ms     = k_cyc_to_ms_floor64(cyc[3] - app_rt_base[3]);
+#endif
 }
 
-void run_led_loop4(void)
+static void app_stats_reset(void)
 {
-    /* Perform capture; DONE_04 is sent by the command handler */
-    l4_capture_once();
+    app_cmd_stats_reset();
+    l4_stats_reset();
+    atomic_clear(&app_ring_hw);
+    atomic_clear(&app_credits_hw);
+    atomic_clear(&app_ntf_last_err);
+    atomic_clear(&app_ntf_sent);
+    atomic_clear(&app_ntf_bytes);
+    atomic_clear(&app_ntf_failed);
+    atomic_clear(&app_ntf_retried);
+    atomic_clear(&app_ntf_stalled);
+    atomic_clear(&app_st_sent);
+    atomic_clear(&app_st_failed);
+    atomic_clear(&app_retx_req);
+    atomic_clear(&app_retx_chunks);
+    atomic_clear(&app_retx_gone);
+    app_xfer_base = ble_xfer_last_id();
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+    app_rt_cycles(app_rt_base);
+#endif
+    app_stats_reset_ms = k_uptime_get();
 }
 
+/* -------------------- Performance regression check --------------------
+   The loop metrics come from the loop units, formatting, transfer path,
+   baselines and the verdict from perf_check.c. */
+#if defined(CONFIG_APP_PERF_CHECK)
+static int app_perf_check(void)
+{
+    perf_set(PERF_L4_SAMPLE, l4_bench_sampling(NULL, 0, NULL));
+    perf_set(PERF_L2_SHIFT, l2_bench_ns());
+    perf_measure_fmt();
+    perf_measure_xfer();
+    return perf_check();
+}
+#endif
+
 /* -------------------- Main -------------------- */
 static void bt_ready(int err)
 {
@@ -446,12 +2327,66 @@ static void bt_ready(int err)
         LOG_ERR("Bluetooth init failed (err %d)", err);
         return;
     }
-    bt_le_adv_start(BT_LE_ADV_CONN_NAME, NULL, 0, NULL, 0);
-    LOG_INF("Bluetooth advertising started.");
+    /* Identity and bonds; the bonded central decides how to advertise */
+    err = settings_load_subtree("bt");
+    if (err) {
+        LOG_WRN("Bond storage unavailable (err %d)", err);
+    }
+    if (IS_ENABLED(CONFIG_APP_BLE_BOND)) {
+        bt_conn_auth_info_cb_register(&auth_info_callbacks);
+    }
+    k_work_submit(&ble_adv_work);
 }
 
 void main(void)
 {
+    timing_init();
+    timing_start();
+
+    app_cmd_init(&app_cmd_ops);
+    l4_stream_init();
+    if (out_init(seq_sigs, SEQ_SIG_COUNT) != 0) {
+        LOG_ERR("No control line available.");
+    }
+    if (loops_init(seq_sigs, L2_SDO, app_cmd_abort_requested) != 0) {
+        LOG_ERR("Configuration lines unavailable; Loop 2 disabled.");
+    }
+    if (wfg_init(&pulse_gpio, &rst_gpio) != 0) {
+        LOG_ERR("Waveform generator unavailable; Loop 3 disabled.");
+    }
+    cy_init(&app_cy_ops);
+    if (l4_init(&l4_lines, app_cmd_abort_requested, app_send_record) != 0 ||
+        seq_init(seq_sigs, l4_sample, app_cmd_abort_requested) != 0) {
+        LOG_ERR("Sequencer unavailable; SQ disabled.");
+    }
+    app_cfg_init();
+
+    if (IS_ENABLED(CONFIG_APP_L4_BENCH_AT_BOOT)) {
+        (void)l4_bench_sampling(NULL, 0, NULL);
+        out_bench();
+        if (IS_ENABLED(CONFIG_APP_CHIP_MODEL)) {
+            char res[32];
+
+            if (app_sim_check(1, res, sizeof(res)) != 0) {
+                LOG_ERR("Chip-model self-check FAILED: %s", res);
+            }
+        }
+        if (app_cfg_selftest() != 0) {
+            LOG_ERR("Settings self-check FAILED (err %d)", app_cfg_err);
+        }
+    }
+
+#if defined(CONFIG_APP_PERF_CHECK)
+    int bad = app_perf_check();
+
+#if defined(CONFIG_APP_PERF_EXIT)
+    posix_exit(bad ? 1 : 0);        /* CI gate: 0 = no regression */
+#else
+    ARG_UNUSED(bad);
+#endif
+#endif
+    ble_xfer_init(ble_tx_notify, l4_notify_chunk);
+
     int err = bt_enable(bt_ready);
     if (err) {
         LOG_ERR("Bluetooth enable failed (err %d)", err);
@@ -0,0 +1,53 @@
+/* native_timing.c - timing API on the host clock (native_sim)
+ *
+ * Simulated time stands still while the firmware runs, so the default
+ * counter reads every piece of code as free. This one counts host
+ * nanoseconds (CLOCK_MONOTONIC, read by native_timing_bottom.c).
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
+
+uint64_t native_timing_host_ns(void);
+
+void board_timing_init(void)
+{
+}
+
+void board_timing_start(void)
+{
+}
+
+void board_timing_stop(void)
+{
+}
+
+timing_t board_timing_counter_get(void)
+{
+    return (timing_t)native_timing_host_ns();
+}
+
+uint64_t board_timing_cycles_get(volatile timing_t *const start, volatile timing_t *const end)
+{
+    return (*end > *start) ? (uint64_t)(*end - *start) : 0;
+}
+
+uint64_t board_timing_freq_get(void)
+{
+    return NSEC_PER_SEC;
+}
+
+uint64_t board_timing_cycles_to_ns(uint64_t cycles)
+{
+    return cycles;
+}
+
+uint64_t board_timing_cycles_to_ns_avg(uint64_t cycles, uint32_t count)
+{
+    return count ? cycles / count : 0;
+}
+
+uint32_t board_timing_freq_get_mhz(void)
+{
+    return NSEC_PER_SEC / USEC_PER_SEC;
+}
@@ -0,0 +1,15 @@
+/* native_timing_bottom.c - host side of native_timing.c
+ *
+ * Built into the native simulator runner (host libc), not the Zephyr image.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t native_timing_host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
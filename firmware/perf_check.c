@@ -0,0 +1,159 @@
+/* perf_check.c - boot-time performance regression check */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+
+#include "perf_check.h"
+#include "l4_codec.h"
+#include "ble_xfer.h"
+
+LOG_MODULE_REGISTER(perf_check, LOG_LEVEL_INF);
+
+#define PERF_RUNS    5          /* best of */
+#define PERF_FRAMES  32         /* per run */
+
+static const struct {
+    const char *name;
+    const char *unit;
+    uint32_t baseline;
+} perf_def[PERF_COUNT] = {
+    [PERF_L4_SAMPLE] = { "l4_sample", "cyc",     CONFIG_APP_PERF_BASE_L4_SAMPLE_CYC },
+    [PERF_L2_SHIFT]  = { "l2_shift",  "ns",      CONFIG_APP_PERF_BASE_L2_SHIFT_NS },
+    [PERF_FMT_CSV]   = { "fmt_csv",   "ns",      CONFIG_APP_PERF_BASE_FMT_CSV_NS },
+    [PERF_FMT_ENC]   = { "fmt_enc",   "ns",      CONFIG_APP_PERF_BASE_FMT_ENC_NS },
+    [PERF_XFER]      = { "xfer",      "ns/KiB",  CONFIG_APP_PERF_BASE_XFER_NS },
+};
+
+static uint32_t perf_val[PERF_COUNT];
+
+void perf_set(enum perf_metric m, uint32_t value)
+{
+    perf_val[m] = value;
+}
+
+/* Sparse frame as in a measurement: a hit in about one row in ten */
+static void perf_frame(struct l4_frame *f)
+{
+    uint32_t lfsr = 0xACE1u;
+
+    memset(f, 0, sizeof(*f));
+    f->hdr.magic       = L4_REC_MAGIC;
+    f->hdr.version     = L4_REC_VERSION;
+    f->hdr.type        = L4_REC_FRAME;
+    f->hdr.word_count  = L4_TOTAL_READS;
+    f->hdr.payload_len = sizeof(f->words);
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        lfsr = lfsr * 1103515245u + 12345u;
+        f->words[r] = ((lfsr >> 16) % 10 == 0) ? ((lfsr >> 4) & BIT_MASK(L4_NUM_PINS)) : 0;
+    }
+}
+
+static uint32_t perf_best_ns(void (*run)(void *arg), void *arg, uint32_t per)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int i = 0; i < PERF_RUNS; i++) {
+        timing_t t0 = timing_counter_get();
+
+        run(arg);
+
+        timing_t t1 = timing_counter_get();
+
+        best = MIN(best, timing_cycles_to_ns(timing_cycles_get(&t0, &t1)));
+    }
+    return (uint32_t)MIN(best / per, UINT32_MAX);
+}
+
+static struct l4_frame perf_f;
+static struct l4_enc_frame perf_e;
+static char perf_csv[L4_CSV_BYTES];
+static volatile size_t perf_sink;
+
+static void perf_run_csv(void *arg)
+{
+    for (int n = 0; n < PERF_FRAMES; n++) {
+        perf_sink += l4_format_csv(&perf_f, perf_csv);
+    }
+}
+
+static void perf_run_enc(void *arg)
+{
+    for (int n = 0; n < PERF_FRAMES; n++) {
+        size_t bytes;
+
+        (void)l4_encode(&perf_f, &perf_e, L4_ENC_MODE_AUTO, &bytes);
+        perf_sink += bytes;
+    }
+}
+
+void perf_measure_fmt(void)
+{
+    perf_frame(&perf_f);
+    perf_val[PERF_FMT_CSV] = perf_best_ns(perf_run_csv, NULL, PERF_FRAMES);
+    perf_val[PERF_FMT_ENC] = perf_best_ns(perf_run_enc, NULL, PERF_FRAMES);
+}
+
+static int perf_null_tx(const void *data, uint16_t len)
+{
+    perf_sink += len;
+    return 0;
+}
+
+static uint16_t perf_null_payload(void)
+{
+    return BLE_NOTIFY_MAX;
+}
+
+static void perf_run_xfer(void *arg)
+{
+    uint32_t frames = *(uint32_t *)arg;
+
+    for (uint32_t n = 0; n < frames; n++) {
+        (void)ble_xfer_send(&perf_f, sizeof(perf_f));
+    }
+}
+
+uint32_t perf_xfer_ns(uint32_t frames)
+{
+    perf_frame(&perf_f);
+    ble_xfer_init(perf_null_tx, perf_null_payload);
+    return perf_best_ns(perf_run_xfer, &frames, MAX(frames * sizeof(perf_f) / 1024, 1));
+}
+
+void perf_measure_xfer(void)
+{
+    perf_val[PERF_XFER] = perf_xfer_ns(PERF_FRAMES);
+}
+
+uint32_t perf_get(enum perf_metric m)
+{
+    return perf_val[m];
+}
+
+int perf_check(void)
+{
+    int bad = 0;
+
+    for (int m = 0; m < PERF_COUNT; m++) {
+        uint32_t v = perf_val[m], base = perf_def[m].baseline;
+        uint64_t limit = (uint64_t)base * (100 + CONFIG_APP_PERF_TOLERANCE_PCT) / 100;
+
+        if (v == 0) {
+            LOG_WRN("Perf %-9s: not measured", perf_def[m].name);
+        } else if (base == 0) {
+            LOG_INF("Perf %-9s: %u %s (no baseline)", perf_def[m].name, v, perf_def[m].unit);
+        } else if (v > limit) {
+            LOG_ERR("Perf %-9s: %u %s, baseline %u: REGRESSION (+%u%%)", perf_def[m].name,
+                    v, perf_def[m].unit, base, (unsigned)((uint64_t)(v - base) * 100 / base));
+            bad++;
+        } else {
+            LOG_INF("Perf %-9s: %u %s, baseline %u: ok", perf_def[m].name, v,
+                    perf_def[m].unit, base);
+        }
+    }
+    LOG_INF("Perf check: %d regression(s), tolerance %d%%", bad, CONFIG_APP_PERF_TOLERANCE_PCT);
+    return bad;
+}
@@ -0,0 +1,44 @@
+/* perf_check.h - boot-time performance regression check
+ *
+ * Every metric is a cost (lower is better), measured with the timing API
+ * as the best of a few runs, and compared with a stored baseline,
+ * CONFIG_APP_PERF_BASE_<metric> (0: none stored, the value is only
+ * reported). A metric more than CONFIG_APP_PERF_TOLERANCE_PCT above its
+ * baseline is a regression. Baselines are per build target: record them
+ * from the "Perf" log lines of a known-good build into the board's .conf.
+ *
+ * The loop metrics drive GPIOs and are measured by main.c (perf_set());
+ * the formatting and transfer metrics need nothing but RAM and are
+ * measured here.
+ */
+#pragma once
+
+#include <stdint.h>
+
+enum perf_metric {
+    PERF_L4_SAMPLE,     /* cycles per Loop-4 sample, port-wide path */
+    PERF_L2_SHIFT,      /* ns per shift of the power-on Loop-2 word */
+    PERF_FMT_CSV,       /* ns per frame formatted as "04C" CSV text */
+    PERF_FMT_ENC,       /* ns per frame encoded for FFF4 in auto mode */
+    PERF_XFER,          /* ns per KiB through chunk framing and retention */
+    PERF_COUNT
+};
+
+/* A measurement taken by the caller; 0 means it could not be taken */
+void perf_set(enum perf_metric m, uint32_t value);
+
+/* CSV and binary formatting of a synthetic sparse frame */
+void perf_measure_fmt(void);
+
+/* ble_xfer_send() of frame records into a sink that drops them. Leaves
+   ble_xfer initialised with that sink: call ble_xfer_init() afterwards. */
+void perf_measure_xfer(void);
+
+/* The same for `frames` records per run: ns per KiB, not stored */
+uint32_t perf_xfer_ns(uint32_t frames);
+
+/* The last measurement of m (0: not taken) */
+uint32_t perf_get(enum perf_metric m);
+
+/* Log every metric against its baseline; the number of regressions */
+int perf_check(void);
@@ -0,0 +1,555 @@
+/* seq.c - GPIO sequence programs: compiler, interpreter and dry run */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#ifdef CONFIG_GPIO_EMUL
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#endif
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+
+#include "gpio_out.h"
+#include "seq.h"
+
+LOG_MODULE_REGISTER(seq, LOG_LEVEL_INF);
+
+#define SEQ_BUSY_MAX_US  1000      /* longer waits sleep (tick resolution) */
+#define SEQ_SLEEP_MAX_US 100000    /* abort is polled at least this often */
+#define SEQ_MAX_RUN_NS   ((uint64_t)CONFIG_APP_SEQ_MAX_RUN_MS * NSEC_PER_MSEC)
+
+struct seq_insn {
+    uint8_t  op;                /* enum seq_opcode */
+    uint8_t  clk, dat;          /* SHIFT: signals */
+    uint16_t arg;               /* REPEAT count, LOOP body start, SHIFT nbits */
+    uint16_t sigs;              /* SET / CLR sigmask */
+    uint16_t bits;              /* SHIFT: byte offset into seq_prog.bits */
+    uint32_t us;                /* WAIT time, SHIFT half period */
+    struct out_xfer d;          /* asserts `sigs` (SHIFT: clk); applied inverted for CLR */
+    struct out_xfer dx;         /* SHIFT: asserts dat */
+};
+
+struct seq_prog {
+    struct seq_info info;
+    struct seq_insn insn[SEQ_MAX_OPS];
+    uint8_t bits[SEQ_MAX_BYTES];        /* SHIFT payloads */
+};
+
+/* How the interpreter treats pins and time */
+enum seq_mode {
+    SEQ_RUN,            /* drive the pins, wait for real */
+    SEQ_MODEL,          /* no pin moves; virtual clock from the cost model */
+    SEQ_TIMED,          /* drive the (emulated) pins and time every write and
+                           sample on the host clock; waits are added, not waited */
+};
+
+/* Interpreter state; the dry-run modes record levels */
+struct seq_vm {
+    enum seq_mode mode;
+    uint16_t *words;
+    size_t cap, n;
+    uint64_t t_ns;
+    uint16_t levels;
+    struct seq_trace_edge *trace;
+    size_t trace_cap, edges;
+    bool full;                  /* an edge did not fit */
+};
+
+static const struct gpio_dt_spec *seq_spec[SEQ_SIG_COUNT];
+static uint16_t seq_avail;              /* sigmask of bound signals */
+static uint16_t (*seq_sample)(void);
+static bool (*seq_abort)(void);
+static uint32_t seq_write_ns = 1, seq_sample_ns = 1;
+
+static struct seq_prog seq_progs[2];
+static struct seq_prog *seq_cur;        /* NULL until a program is loaded */
+static atomic_t seq_running = ATOMIC_INIT(0);
+
+static inline uint64_t seq_sat_add(uint64_t a, uint64_t b)
+{
+    return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
+static inline uint64_t seq_sat_mul(uint64_t a, uint64_t b)
+{
+    return (a != 0 && b > UINT64_MAX / a) ? UINT64_MAX : a * b;
+}
+
+int seq_init(const struct gpio_dt_spec *const sig[SEQ_SIG_COUNT],
+             uint16_t (*sample)(void), bool (*abort)(void))
+{
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        if (sig[s] != NULL && (out_avail() & BIT(s))) {
+            seq_spec[s] = sig[s];
+            seq_avail |= BIT(s);
+        }
+    }
+    if (seq_avail == 0) {
+        return -ENODEV;
+    }
+    seq_sample = sample;
+    seq_abort = abort;
+
+    /* Cost model for the static analysis and the dry run. A write with
+       empty masks goes through the same driver path without moving a pin. */
+    timing_t t0 = timing_counter_get();
+    for (int i = 0; i < 32; i++) {
+        (void)gpio_port_set_clr_bits_raw(out_port[0], 0, 0);
+    }
+    timing_t t1 = timing_counter_get();
+    for (int i = 0; i < 32; i++) {
+        (void)seq_sample();
+    }
+    timing_t t2 = timing_counter_get();
+
+    seq_write_ns  = MAX((uint32_t)(timing_cycles_to_ns(timing_cycles_get(&t0, &t1)) / 32U), 1U);
+    seq_sample_ns = MAX((uint32_t)(timing_cycles_to_ns(timing_cycles_get(&t1, &t2)) / 32U), 1U);
+
+    LOG_INF("Sequencer: signals 0x%03x, write %u ns, sample %u ns",
+            seq_avail, seq_write_ns, seq_sample_ns);
+    return 0;
+}
+
+/* -------------------- Compiler --------------------
+   One pass: decode, check, translate, and accumulate cost per REPEAT
+   level; closing a block multiplies its cost by the count and folds it
+   into the enclosing one. */
+struct seq_acc {
+    uint64_t ns;
+    uint64_t samples;
+    uint64_t writes;
+    uint16_t start;             /* first insn of the block */
+    uint16_t count;
+};
+
+#define SEQ_FAIL(at, reason) do { err->pc = (uint16_t)(at); err->why = (reason); return -EINVAL; } while (0)
+
+static int seq_compile(const uint8_t *code, size_t len, struct seq_prog *p, struct seq_err *err)
+{
+    struct seq_acc acc[SEQ_MAX_DEPTH + 1] = {0};
+    int depth = 0;
+    size_t pc = 0, n = 0, nbytes = 0;
+
+    memset(p, 0, sizeof(*p));
+    if (len == 0 || len > SEQ_MAX_BYTES) {
+        SEQ_FAIL(0, "len");
+    }
+
+    while (pc < len && code[pc] != SEQ_OP_END) {
+        static const uint8_t oplen[] = {
+            [SEQ_OP_SET] = 3, [SEQ_OP_CLR] = 3, [SEQ_OP_WAIT] = 5, [SEQ_OP_REPEAT] = 3,
+            [SEQ_OP_LOOP] = 1, [SEQ_OP_SAMPLE] = 1, [SEQ_OP_SHIFT] = 7,
+        };
+        const uint8_t *a = &code[pc + 1];
+        uint8_t op = code[pc];
+        struct seq_acc *cur = &acc[depth];
+        struct seq_insn *in;
+        size_t size;
+
+        if (op >= ARRAY_SIZE(oplen) || oplen[op] == 0) {
+            SEQ_FAIL(pc, "op");
+        }
+        size = oplen[op];
+        if (pc + size > len) {
+            SEQ_FAIL(pc, "len");
+        }
+        if (n == SEQ_MAX_OPS) {
+            SEQ_FAIL(pc, "ops");
+        }
+        in = &p->insn[n];
+        in->op = op;
+
+        switch (op) {
+        case SEQ_OP_SET:
+        case SEQ_OP_CLR:
+            in->sigs = sys_get_le16(a);
+            if (in->sigs == 0) {
+                SEQ_FAIL(pc, "arg");
+            }
+            if (in->sigs & ~seq_avail) {
+                SEQ_FAIL(pc, "sig");
+            }
+            out_build(&in->d, in->sigs, 0);
+            p->info.signals |= in->sigs;
+            cur->writes = seq_sat_add(cur->writes, in->d.nwrites);
+            cur->ns = seq_sat_add(cur->ns, (uint64_t)in->d.nwrites * seq_write_ns);
+            break;
+        case SEQ_OP_WAIT:
+            in->us = sys_get_le32(a);
+            if (in->us == 0) {
+                SEQ_FAIL(pc, "arg");
+            }
+            cur->ns = seq_sat_add(cur->ns, (uint64_t)in->us * NSEC_PER_USEC);
+            break;
+        case SEQ_OP_REPEAT:
+            if (depth == SEQ_MAX_DEPTH) {
+                SEQ_FAIL(pc, "nest");
+            }
+            if (sys_get_le16(a) == 0) {
+                SEQ_FAIL(pc, "arg");
+            }
+            in->arg = sys_get_le16(a);
+            depth++;
+            acc[depth] = (struct seq_acc){ .start = (uint16_t)(n + 1), .count = in->arg };
+            break;
+        case SEQ_OP_LOOP:
+            if (depth == 0) {
+                SEQ_FAIL(pc, "nest");
+            }
+            if (cur->start == n) {
+                SEQ_FAIL(pc, "arg");        /* empty block */
+            }
+            in->arg = cur->start;
+            acc[depth - 1].ns = seq_sat_add(acc[depth - 1].ns, seq_sat_mul(cur->ns, cur->count));
+            acc[depth - 1].samples = seq_sat_add(acc[depth - 1].samples,
+                                                 seq_sat_mul(cur->samples, cur->count));
+            acc[depth - 1].writes = seq_sat_add(acc[depth - 1].writes,
+                                                seq_sat_mul(cur->writes, cur->count));
+            depth--;
+            break;
+        case SEQ_OP_SAMPLE:
+            cur->samples = seq_sat_add(cur->samples, 1);
+            cur->ns = seq_sat_add(cur->ns, seq_sample_ns);
+            break;
+        case SEQ_OP_SHIFT: {
+            size_t nb;
+
+            in->clk = a[0];
+            in->dat = a[1];
+            in->arg = sys_get_le16(a + 2);
+            in->us  = sys_get_le16(a + 4);
+            nb = DIV_ROUND_UP(in->arg, 8);
+            if (in->arg == 0 || in->clk == in->dat) {
+                SEQ_FAIL(pc, "arg");
+            }
+            if (in->clk >= SEQ_SIG_COUNT || in->dat >= SEQ_SIG_COUNT ||
+                !(seq_avail & BIT(in->clk)) || !(seq_avail & BIT(in->dat))) {
+                SEQ_FAIL(pc, "sig");
+            }
+            if (pc + size + nb > len) {
+                SEQ_FAIL(pc, "len");
+            }
+            out_build(&in->d, BIT(in->clk), 0);
+            out_build(&in->dx, BIT(in->dat), 0);
+            in->bits = (uint16_t)nbytes;
+            memcpy(&p->bits[nbytes], a + 6, nb);
+            nbytes += nb;
+            size += nb;
+            p->info.signals |= BIT(in->clk) | BIT(in->dat);
+            /* per bit: data, clk high, clk low */
+            cur->writes = seq_sat_add(cur->writes,
+                                      (uint64_t)in->arg * (in->dx.nwrites + 2U * in->d.nwrites));
+            cur->ns = seq_sat_add(cur->ns, (uint64_t)in->arg *
+                                  ((in->dx.nwrites + 2U * in->d.nwrites) * seq_write_ns +
+                                   2U * in->us * NSEC_PER_USEC));
+            break;
+        }
+        }
+
+        pc += size;
+        n++;
+    }
+
+    if (depth != 0) {
+        SEQ_FAIL(pc, "nest");
+    }
+    if (n == 0) {
+        SEQ_FAIL(0, "empty");
+    }
+    if (acc[0].samples > SEQ_MAX_SAMPLES) {
+        SEQ_FAIL(0, "samples");
+    }
+    if (acc[0].ns > SEQ_MAX_RUN_NS) {
+        SEQ_FAIL(0, "time");
+    }
+
+    p->info.bytes   = (uint16_t)MIN(pc + 1, len);
+    p->info.ops     = (uint16_t)n;
+    p->info.samples = (uint16_t)acc[0].samples;
+    p->info.writes  = (uint32_t)MIN(acc[0].writes, UINT32_MAX);
+    p->info.time_ns = acc[0].ns;
+    return 0;
+}
+
+#undef SEQ_FAIL
+
+int seq_load(const uint8_t *code, size_t len, struct seq_err *err)
+{
+    struct seq_prog *next;
+    int ret;
+
+    if (atomic_get(&seq_running)) {
+        return -EBUSY;
+    }
+    next = (seq_cur == &seq_progs[0]) ? &seq_progs[1] : &seq_progs[0];
+    ret = seq_compile(code, len, next, err);
+    if (ret == 0) {
+        seq_cur = next;
+        LOG_INF("Sequencer: %u ops, %u samples, ~%u us", next->info.ops,
+                next->info.samples, (uint32_t)(next->info.time_ns / NSEC_PER_USEC));
+    }
+    return ret;
+}
+
+bool seq_get_info(struct seq_info *info)
+{
+    struct seq_prog *p = seq_cur;
+
+    if (p == NULL) {
+        return false;
+    }
+    *info = p->info;
+    return true;
+}
+
+/* -------------------- Interpreter -------------------- */
+static void seq_trace(struct seq_vm *vm)
+{
+    if (vm->edges == vm->trace_cap || vm->t_ns > UINT32_MAX) {
+        vm->full = true;
+        return;
+    }
+    vm->trace[vm->edges].t_ns = (uint32_t)vm->t_ns;
+    vm->trace[vm->edges].levels = vm->levels;
+    vm->edges++;
+}
+
+static inline void seq_vm_apply(const struct out_xfer *d, bool on)
+{
+    if (on) {
+        out_apply(d);
+    } else {
+        out_apply_inv(d);
+    }
+}
+
+static void seq_vm_drive(struct seq_vm *vm, const struct out_xfer *d, uint16_t sigs, bool on)
+{
+    switch (vm->mode) {
+    case SEQ_RUN:
+        seq_vm_apply(d, on);
+        return;
+    case SEQ_MODEL:
+        vm->t_ns += (uint64_t)d->nwrites * seq_write_ns;
+        break;
+    case SEQ_TIMED: {
+        timing_t t0 = timing_counter_get();
+
+        seq_vm_apply(d, on);
+
+        timing_t t1 = timing_counter_get();
+
+        vm->t_ns += timing_cycles_to_ns(timing_cycles_get(&t0, &t1));
+        break;
+    }
+    }
+    vm->levels = on ? (vm->levels | sigs) : (vm->levels & ~sigs);
+    seq_trace(vm);
+}
+
+static int seq_vm_wait(struct seq_vm *vm, uint32_t us)
+{
+    if (vm->mode != SEQ_RUN) {
+        vm->t_ns += (uint64_t)us * NSEC_PER_USEC;
+        return 0;
+    }
+    if (us <= SEQ_BUSY_MAX_US) {
+        k_busy_wait(us);
+        return 0;
+    }
+    while (us > 0) {
+        uint32_t chunk = MIN(us, SEQ_SLEEP_MAX_US);
+
+        k_sleep(K_USEC(chunk));
+        us -= chunk;
+        if (seq_abort && seq_abort()) {
+            return -ECANCELED;
+        }
+    }
+    return 0;
+}
+
+static void seq_vm_sample(struct seq_vm *vm)
+{
+    switch (vm->mode) {
+    case SEQ_RUN:
+        if (vm->n < vm->cap) {
+            vm->words[vm->n] = seq_sample();
+        }
+        break;
+    case SEQ_MODEL:
+        vm->t_ns += seq_sample_ns;
+        break;
+    case SEQ_TIMED: {
+        timing_t t0 = timing_counter_get();
+
+        (void)seq_sample();
+
+        timing_t t1 = timing_counter_get();
+
+        vm->t_ns += timing_cycles_to_ns(timing_cycles_get(&t0, &t1));
+        break;
+    }
+    }
+    vm->n++;
+}
+
+static int seq_exec(const struct seq_prog *p, struct seq_vm *vm)
+{
+    uint16_t count[SEQ_MAX_DEPTH];
+    int depth = 0;
+
+    for (size_t i = 0; i < p->info.ops; i++) {
+        const struct seq_insn *in = &p->insn[i];
+
+        /* A modelled dry run only walks as far as its trace buffer reaches;
+           a timed one runs to the end for the total */
+        if (vm->full && vm->mode == SEQ_MODEL) {
+            return -ENOSPC;
+        }
+
+        switch (in->op) {
+        case SEQ_OP_SET:
+        case SEQ_OP_CLR:
+            seq_vm_drive(vm, &in->d, in->sigs, in->op == SEQ_OP_SET);
+            break;
+        case SEQ_OP_WAIT:
+            if (seq_vm_wait(vm, in->us) != 0) {
+                return -ECANCELED;
+            }
+            break;
+        case SEQ_OP_REPEAT:
+            count[depth++] = in->arg;
+            break;
+        case SEQ_OP_LOOP:
+            if (--count[depth - 1] > 0) {
+                if (seq_abort && seq_abort()) {
+                    return -ECANCELED;
+                }
+                i = in->arg - 1;
+            } else {
+                depth--;
+            }
+            break;
+        case SEQ_OP_SAMPLE:
+            seq_vm_sample(vm);
+            break;
+        case SEQ_OP_SHIFT:
+            for (uint16_t b = 0; b < in->arg; b++) {
+                bool bit = (p->bits[in->bits + b / 8] >> (b % 8)) & 1U;
+
+                seq_vm_drive(vm, &in->dx, BIT(in->dat), bit);
+                if (in->us) {
+                    (void)seq_vm_wait(vm, in->us);
+                }
+                seq_vm_drive(vm, &in->d, BIT(in->clk), true);
+                if (in->us) {
+                    (void)seq_vm_wait(vm, in->us);
+                }
+                seq_vm_drive(vm, &in->d, BIT(in->clk), false);
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Take the sequencer for a program that moves pins */
+static int seq_claim(struct seq_prog **pp)
+{
+    struct seq_prog *p;
+
+    if (!atomic_cas(&seq_running, 0, 1)) {
+        return -EBUSY;
+    }
+    p = seq_cur;
+    if (p == NULL) {
+        atomic_clear(&seq_running);
+        return -ENOENT;
+    }
+
+    /* GPIO_OUTPUT without an INIT flag keeps the current level */
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        if (p->info.signals & BIT(s)) {
+            (void)gpio_pin_configure_dt(seq_spec[s], GPIO_OUTPUT);
+        }
+    }
+    *pp = p;
+    return 0;
+}
+
+/* Logical levels of the program's lines as the emulator drives them */
+static uint16_t seq_levels(const struct seq_prog *p)
+{
+    uint16_t levels = 0;
+
+#ifdef CONFIG_GPIO_EMUL
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        if (p->info.signals & BIT(s)) {
+            bool high = gpio_emul_output_get(seq_spec[s]->port, seq_spec[s]->pin) > 0;
+
+            if (high != ((seq_spec[s]->dt_flags & GPIO_ACTIVE_LOW) != 0)) {
+                levels |= BIT(s);
+            }
+        }
+    }
+#endif
+    return levels;
+}
+
+int seq_run(uint16_t *words, size_t cap, uint32_t *elapsed_ns)
+{
+    struct seq_prog *p;
+    struct seq_vm vm = { .mode = SEQ_RUN, .words = words, .cap = cap };
+    timing_t t0, t1;
+    int err;
+
+    err = seq_claim(&p);
+    if (err) {
+        return err;
+    }
+
+    t0 = timing_counter_get();
+    err = seq_exec(p, &vm);
+    t1 = timing_counter_get();
+    atomic_clear(&seq_running);
+
+    if (elapsed_ns) {
+        *elapsed_ns = (uint32_t)MIN(timing_cycles_to_ns(timing_cycles_get(&t0, &t1)), UINT32_MAX);
+    }
+    return err ? err : (int)MIN(vm.n, cap);
+}
+
+int seq_dry_run(struct seq_trace_edge *trace, size_t cap, struct seq_dry *res)
+{
+    struct seq_prog *p;
+    struct seq_vm vm = { .mode = SEQ_MODEL, .trace = trace, .trace_cap = trace ? cap : 0 };
+    int err = 0;
+
+    if (SEQ_DRY_TIMED) {
+        vm.mode = SEQ_TIMED;
+        err = seq_claim(&p);
+        if (err) {
+            return err;
+        }
+        vm.levels = seq_levels(p);
+        err = seq_exec(p, &vm);
+        atomic_clear(&seq_running);
+        res->time_ns = vm.t_ns;
+    } else {
+        p = seq_cur;
+        if (p == NULL) {
+            return -ENOENT;
+        }
+        if (vm.trace_cap > 0) {
+            err = seq_exec(p, &vm);
+        }
+        res->time_ns = p->info.time_ns;
+    }
+    res->measured = (vm.mode == SEQ_TIMED);
+    res->edges = vm.edges;
+    res->truncated = vm.full || (vm.trace_cap == 0);
+    return (err == -ENOSPC) ? 0 : err;
+}
@@ -0,0 +1,125 @@
+/* seq.h - uploadable GPIO sequence programs
+ *
+ * A host uploads a small bytecode program (FFF8) that drives the chip's
+ * control lines and samples the TX word, so a complete reset -> configure
+ * -> pulse -> capture cycle runs as one command. Programs are validated
+ * and compiled once, on upload: signal masks become per-port set/clear
+ * masks (active-low lines folded in), REPEAT blocks become jump targets,
+ * and the run time and sample count are bounded before anything runs.
+ *
+ * Bytecode (little-endian, one opcode byte followed by its operands):
+ *
+ *   0x00 END                                  optional, ends the program
+ *   0x01 SET    u16 sigmask                   assert the signals in mask
+ *   0x02 CLR    u16 sigmask                   deassert them
+ *   0x03 WAIT   u32 us                        busy-wait <= 1 ms, sleep above
+ *   0x04 REPEAT u16 count                     run the block up to LOOP count times
+ *   0x05 LOOP
+ *   0x06 SAMPLE                               latch one TX word
+ *   0x07 SHIFT  u8 clk, u8 dat, u16 nbits, u16 half_us, bits
+ *                                             nbits data bits (bit 0 of byte 0
+ *                                             first), each latched by a clk pulse
+ *
+ * Signal numbers are enum seq_sig; sigmask bit n is signal n. Levels are
+ * logical (GPIO_ACTIVE_LOW honoured), as with gpio_pin_set_dt().
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/gpio.h>
+
+enum seq_sig {
+    SEQ_SIG_RST,
+    SEQ_SIG_RST_CTR,
+    SEQ_SIG_ENBIAS,
+    SEQ_SIG_STAB,
+    SEQ_SIG_CLK_WRD,
+    SEQ_SIG_IN_WRD,
+    SEQ_SIG_PULSE,
+    SEQ_SIG_RST_TDC,
+    SEQ_SIG_CELL,
+    SEQ_SIG_CLK_SHIFT,
+    SEQ_SIG_COUNT
+};
+
+enum seq_opcode {
+    SEQ_OP_END    = 0x00,
+    SEQ_OP_SET    = 0x01,
+    SEQ_OP_CLR    = 0x02,
+    SEQ_OP_WAIT   = 0x03,
+    SEQ_OP_REPEAT = 0x04,
+    SEQ_OP_LOOP   = 0x05,
+    SEQ_OP_SAMPLE = 0x06,
+    SEQ_OP_SHIFT  = 0x07,
+};
+
+#define SEQ_MAX_BYTES    CONFIG_APP_SEQ_MAX_BYTES
+#define SEQ_MAX_OPS      CONFIG_APP_SEQ_MAX_OPS
+#define SEQ_MAX_SAMPLES  128
+#define SEQ_MAX_DEPTH    4
+
+/* Dry runs execute on the emulated lines, every write and sample timed on
+   the host clock (native_sim); elsewhere they walk the cost model. */
+#define SEQ_DRY_TIMED    (IS_ENABLED(CONFIG_GPIO_EMUL) && IS_ENABLED(CONFIG_APP_HOST_TIMING))
+
+/* What a compiled program will do, from static analysis (REPEAT counts
+   multiplied out). Times come from the per-operation costs measured by
+   seq_init(), so they are estimates for GPIO work and exact for waits;
+   seq_dry_run() measures the GPIO work where SEQ_DRY_TIMED. */
+struct seq_info {
+    uint16_t bytes;          /* bytecode length */
+    uint16_t ops;            /* compiled instructions */
+    uint16_t signals;        /* sigmask of the lines the program drives */
+    uint16_t samples;        /* SAMPLE executions */
+    uint32_t writes;         /* port writes */
+    uint64_t time_ns;        /* estimated run time */
+};
+
+/* Compile error: byte offset into the program and a short reason. */
+struct seq_err {
+    uint16_t pc;
+    const char *why;
+};
+
+/* One output change of a dry run: logical levels of all signals after it. */
+struct seq_trace_edge {
+    uint32_t t_ns;           /* since the start of the program */
+    uint16_t levels;         /* bit n = signal n */
+} __packed;
+
+struct seq_dry {
+    uint64_t time_ns;        /* run time: GPIO work plus the programmed waits */
+    uint32_t edges;          /* trace entries written */
+    bool truncated;          /* trace buffer full before the end */
+    bool measured;           /* GPIO work timed, not taken from the cost model */
+};
+
+/* Take the signals (NULL entries, or ones out_init() could not bind, are
+   unavailable to programs), the TX sampler and the abort poll, and measure
+   the cost of a port write and of a sample with the timing API. Call after
+   out_init() and timing_start(). */
+int seq_init(const struct gpio_dt_spec *const sig[SEQ_SIG_COUNT],
+             uint16_t (*sample)(void), bool (*abort)(void));
+
+/* Validate and compile; on success the program replaces the current one.
+   -EBUSY while a program is running, -EINVAL with `err` filled in. */
+int seq_load(const uint8_t *code, size_t len, struct seq_err *err);
+
+/* false if no program is loaded */
+bool seq_get_info(struct seq_info *info);
+
+/* Run the loaded program on the GPIOs. Samples land in words[0..n). The
+   caller prepares the TX inputs when info.samples > 0. Returns the number
+   of samples, -ENOENT without a program, -ECANCELED on abort. */
+int seq_run(uint16_t *words, size_t cap, uint32_t *elapsed_ns);
+
+/* Walk the loaded program on a virtual clock, recording every output change
+   into `trace` (may be NULL / 0); waits advance the clock by their length.
+   With SEQ_DRY_TIMED the program runs to the end on the emulated lines and
+   each write and sample adds its measured time (samples are discarded; the
+   caller prepares the TX inputs as for seq_run(), -EBUSY while a program
+   runs). Otherwise no pin moves, GPIO work is costed as in seq_info and the
+   walk stops where the trace is full. */
+int seq_dry_run(struct seq_trace_edge *trace, size_t cap, struct seq_dry *res);
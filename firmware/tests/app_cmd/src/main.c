@@ -0,0 +1,313 @@
+/* FFF1 parser and executor on a table of test commands: immediate
+ * replies, queued commands reported ACK then DONE / ERR under the same
+ * #id, binary batches decoded to their ASCII lines and answered under
+ * their request id, the Loop-4 hand-off to the stream and "AB".
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_cmd.h"
+
+/* FFF2 messages, binary ones kept as sent */
+#define MSG_MAX 16
+static struct {
+    uint8_t data[64];
+    uint16_t len;
+} msgs[MSG_MAX];
+static volatile int n_msgs;
+
+static void notify(const void *msg, uint16_t len)
+{
+    if (n_msgs < MSG_MAX) {
+        len = MIN(len, sizeof(msgs[0].data) - 1);
+        memcpy(msgs[n_msgs].data, msg, len);
+        msgs[n_msgs].data[len] = '\0';
+        msgs[n_msgs].len = len;
+        n_msgs++;
+    }
+}
+
+static const char *msg_text(int i)
+{
+    return (const char *)msgs[i].data;
+}
+
+/* The #id of a text report */
+static unsigned int msg_id(int i)
+{
+    const char *h = strchr(msg_text(i), '#');
+
+    return h ? strtoul(h + 1, NULL, 10) : 0;
+}
+
+static bool wait_msgs(int n)
+{
+    for (int t = 0; t < 1000 && n_msgs < n; t++) {
+        k_sleep(K_MSEC(1));
+    }
+    return n_msgs >= n;
+}
+
+/* Binary status: [0xB2][status][u16 req][u16 #id][text] */
+static void check_bin(int i, uint8_t status, uint16_t req, const char *text)
+{
+    zassert_true(msgs[i].len >= 6 && msgs[i].data[0] == APP_BIN_ST_MAGIC, "msg %d", i);
+    zassert_equal(msgs[i].data[1], status, "msg %d status %u", i, msgs[i].data[1]);
+    zassert_equal(sys_get_le16(&msgs[i].data[2]), req);
+    if (text) {
+        zassert_equal(strcmp((const char *)&msgs[i].data[6], text), 0,
+                      "%s", (const char *)&msgs[i].data[6]);
+    }
+}
+
+/* What the executor was given */
+static struct app_cmd last;
+static int exec_err;            /* returned with detail "bad" */
+static bool exec_block;         /* wait for gate before returning */
+static bool exec_l4_free;       /* app_cmd_l4_take() from inside a command */
+K_SEM_DEFINE(gate, 0, 1);
+
+static int execute(const struct app_cmd *cmd, char *detail, size_t len)
+{
+    last = *cmd;
+    if (exec_block) {
+        (void)k_sem_take(&gate, K_FOREVER);
+    }
+    if (cmd->op == APP_CMD_LOOP4) {
+        exec_l4_free = app_cmd_l4_take();
+        if (exec_l4_free) {
+            app_cmd_l4_give();
+        }
+    }
+    if (exec_err) {
+        snprintk(detail, len, "bad");
+        return exec_err;
+    }
+    return 0;
+}
+
+static void cmd_echo(const char *args, struct app_cmd_ctx *c)
+{
+    snprintk(c->reply, c->reply_len, "DONE_ECHO%s", args);
+}
+
+static void cmd_run(const char *args, struct app_cmd_ctx *c)
+{
+    uint32_t v[APP_CMD_ARGC] = { 1 };
+
+    if (app_parse_kv(args, "n", v) < 0) {
+        strcpy(c->reply, "ERR_RUN");
+    } else {
+        app_cmd_submit(c, APP_CMD_LOOP1, 0, v);
+    }
+}
+
+static void cmd_capture(const char *args, struct app_cmd_ctx *c)
+{
+    app_cmd_submit(c, APP_CMD_LOOP4, args[0], NULL);
+}
+
+/* "CAL4" and "01" so binary codes 15 and 0 land here; "01X" before "01" */
+static const struct app_cmd_def cmds[] = {
+    { "ECHO", cmd_echo },
+    { "CAL4", cmd_echo },
+    { "RUN", cmd_run },
+    { "01X", cmd_echo },
+    { "01", cmd_run },
+    { "CAP", cmd_capture },
+};
+
+static const struct app_cmd_ops ops = {
+    .cmds = cmds,
+    .n_cmds = ARRAY_SIZE(cmds),
+    .execute = execute,
+    .notify = notify,
+};
+
+static void *setup(void)
+{
+    timing_init();
+    timing_start();
+    app_cmd_init(&ops);
+    return NULL;
+}
+
+static void before(void *f)
+{
+    n_msgs = 0;
+    exec_err = 0;
+    exec_block = false;
+    memset(&last, 0, sizeof(last));
+}
+
+ZTEST(app_cmd, test_parse_kv)
+{
+    uint32_t v[3] = { 7, 7, 7 };
+
+    zassert_equal(app_parse_kv("  a=5 c=0x10", "abc", v), 2);
+    zassert_equal(v[0], 5);
+    zassert_equal(v[1], 7, "absent keys are left alone");
+    zassert_equal(v[2], 16);
+    zassert_equal(app_parse_kv("", "abc", v), 0);
+    zassert_equal(app_parse_kv(" d=1", "abc", v), -EINVAL);
+    zassert_equal(app_parse_kv(" a=", "abc", v), -EINVAL);
+    zassert_equal(app_parse_kv(" a 1", "abc", v), -EINVAL);
+}
+
+ZTEST(app_cmd, test_line_immediate)
+{
+    app_cmd_line("ECHO x=1", 0);
+    app_cmd_line("01X", 0);
+    app_cmd_line("NOPE", 0);            /* unknown ASCII: no answer */
+
+    zassert_equal(n_msgs, 2);
+    zassert_equal(strcmp(msg_text(0), "DONE_ECHO x=1"), 0, "%s", msg_text(0));
+    zassert_equal(strcmp(msg_text(1), "DONE_ECHO"), 0, "%s", msg_text(1));
+}
+
+ZTEST(app_cmd, test_line_queued)
+{
+    struct app_stats_cmd st[APP_CMD_COUNT];
+    char expect[32];
+    unsigned int id;
+    uint8_t hw;
+
+    app_cmd_stats_reset();
+    app_cmd_line("RUN n=3", 0);
+    zassert_true(wait_msgs(2));
+
+    zassert_equal(strncmp(msg_text(0), "ACK_01 #", 8), 0, "%s", msg_text(0));
+    id = msg_id(0);
+    snprintk(expect, sizeof(expect), "DONE_01 #%u", id);
+    zassert_equal(strcmp(msg_text(1), expect), 0, "%s", msg_text(1));
+    zassert_equal(last.op, APP_CMD_LOOP1);
+    zassert_equal(last.argv[0], 3);
+
+    exec_err = -EIO;
+    app_cmd_line("RUN", 0);
+    zassert_true(wait_msgs(4));
+    snprintk(expect, sizeof(expect), "ERR_01 #%u bad", id + 1);
+    zassert_equal(strcmp(msg_text(3), expect), 0, "%s", msg_text(3));
+    zassert_equal(last.argv[0], 1, "default");
+
+    app_cmd_stats_get(st, &hw);
+    zassert_equal(st[APP_CMD_LOOP1].count, 2);
+    zassert_equal(hw, 1);
+}
+
+ZTEST(app_cmd, test_batch)
+{
+    /* "CAL4 r=5 m=300" req 7, "01 n=9" req 8, "WF" req 9 (not in this table) */
+    const uint8_t batch[] = {
+        APP_BIN_MAGIC, 0,
+        15, 7, 7, 0, 'r', 1, 5, 'm', 2, 0x2c, 0x01,
+        0, 6, 8, 0, 'n', 4, 9, 0, 0, 0,
+        13, 0, 9, 0,
+    };
+
+    app_cmd_batch(batch, sizeof(batch), 0);
+    zassert_true(wait_msgs(4));
+
+    check_bin(0, APP_BIN_DONE, 7, "DONE_ECHO r=5 m=300");
+    check_bin(1, APP_BIN_ACK, 8, NULL);
+    zassert_not_equal(sys_get_le16(&msgs[1].data[4]), 0, "queued: command #id");
+    /* The unknown record is answered before the queued one ends */
+    check_bin(2, APP_BIN_ERR, 9, "unknown");
+    check_bin(3, APP_BIN_DONE, 8, "");
+    zassert_equal(last.argv[0], 9);
+    zassert_equal(last.req, 8);
+}
+
+ZTEST(app_cmd, test_batch_quiet)
+{
+    const uint8_t batch[] = { APP_BIN_MAGIC, APP_BIN_F_QUIET, 0, 0, 3, 0 };
+
+    app_cmd_batch(batch, sizeof(batch), 0);
+    zassert_true(wait_msgs(1));
+    k_sleep(K_MSEC(5));
+    zassert_equal(n_msgs, 1, "no ACK");
+    check_bin(0, APP_BIN_DONE, 3, "");
+}
+
+ZTEST(app_cmd, test_batch_malformed)
+{
+    /* A good record, then one whose param size is 3: the rest is dropped */
+    const uint8_t batch[] = {
+        APP_BIN_MAGIC, 0,
+        15, 0, 4, 0,
+        15, 3, 5, 0, 'r', 3, 1,
+        15, 0, 6, 0,
+    };
+
+    app_cmd_batch(batch, sizeof(batch), 0);
+    zassert_equal(n_msgs, 2);
+    check_bin(0, APP_BIN_DONE, 4, "DONE_ECHO");
+    check_bin(1, APP_BIN_ERR, 5, "tlv @10");
+}
+
+ZTEST(app_cmd, test_l4_owner)
+{
+    char expect[32];
+    unsigned int id;
+
+    /* Streaming: a capture command is refused, others still run */
+    zassert_true(app_cmd_l4_take());
+    zassert_false(app_cmd_l4_take(), "one stream");
+    app_cmd_line("CAP", 0);
+    app_cmd_line("RUN", 0);
+    zassert_true(wait_msgs(4));
+    zassert_equal(strncmp(msg_text(0), "ACK_04 #", 8), 0, "%s", msg_text(0));
+    id = msg_id(0);
+    snprintk(expect, sizeof(expect), "BUSY_04 #%u stream", id);
+    zassert_equal(strcmp(msg_text(2), expect), 0, "%s", msg_text(2));
+    zassert_equal(strncmp(msg_text(3), "DONE_01 ", 8), 0, "%s", msg_text(3));
+    app_cmd_l4_give();
+
+    /* Capturing: the stream cannot take the lines */
+    n_msgs = 0;
+    exec_l4_free = true;
+    app_cmd_line("CAP", 0);
+    zassert_true(wait_msgs(2));
+    zassert_false(exec_l4_free);
+    zassert_equal(strncmp(msg_text(1), "DONE_04 ", 8), 0, "%s", msg_text(1));
+    zassert_true(app_cmd_l4_take(), "given back");
+    app_cmd_l4_give();
+}
+
+ZTEST(app_cmd, test_abort)
+{
+    unsigned int id;
+    char expect[32];
+
+    exec_block = true;
+    app_cmd_line("RUN", 0);
+    app_cmd_line("RUN", 0);
+    app_cmd_line("RUN", 0);
+    zassert_true(wait_msgs(3));
+    zassert_equal(strncmp(msg_text(0), "ACK_01 #", 8), 0, "%s", msg_text(0));
+    id = msg_id(0);
+
+    /* The first is running; the two behind it are dropped */
+    while (last.id != id) {
+        k_sleep(K_MSEC(1));
+    }
+    app_cmd_abort();
+    zassert_true(app_cmd_abort_requested());
+    k_sem_give(&gate);
+    zassert_true(wait_msgs(6));
+
+    snprintk(expect, sizeof(expect), "ABORTED_01 #%u", id + 1);
+    zassert_equal(strcmp(msg_text(3), expect), 0, "%s", msg_text(3));
+    snprintk(expect, sizeof(expect), "ABORTED_01 #%u", id);
+    zassert_equal(strcmp(msg_text(5), expect), 0, "%s", msg_text(5));
+    zassert_false(app_cmd_abort_requested(), "reported, then cleared");
+}
+
+ZTEST_SUITE(app_cmd, NULL, setup, before, NULL, NULL);
@@ -0,0 +1,160 @@
+/* ble_xfer chunk framing, retention and resend, through a recording sink */
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ble_xfer.h"
+
+#define PAYLOAD  64             /* bytes per notification: ATT_MTU 67 */
+#define ROOM     (PAYLOAD - sizeof(struct ble_chunk_hdr))
+#define MAX_PKTS 64
+
+static struct {
+    struct ble_chunk_hdr hdr;
+    uint8_t data[PAYLOAD];
+    uint16_t len;               /* payload bytes after the header */
+} pkt[MAX_PKTS];
+static int n_pkt;
+static int fail_at = -1;        /* tx error on this packet */
+static uint8_t big[UINT16_MAX + 1];
+
+static int rec_tx(const void *data, uint16_t len)
+{
+    zassert_true(len >= sizeof(struct ble_chunk_hdr) && len <= PAYLOAD);
+    if (n_pkt == fail_at) {
+        return -ENOTCONN;
+    }
+    if (n_pkt >= MAX_PKTS) {
+        n_pkt++;                /* counted, not kept */
+        return 0;
+    }
+    memcpy(&pkt[n_pkt].hdr, data, sizeof(pkt[n_pkt].hdr));
+    pkt[n_pkt].len = len - sizeof(struct ble_chunk_hdr);
+    memcpy(pkt[n_pkt].data, (const uint8_t *)data + sizeof(struct ble_chunk_hdr),
+           pkt[n_pkt].len);
+    n_pkt++;
+    return 0;
+}
+
+static uint16_t rec_payload(void)
+{
+    return PAYLOAD;
+}
+
+static void *xfer_setup(void)
+{
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    return NULL;
+}
+
+static void xfer_before(void *fixture)
+{
+    ble_xfer_init(rec_tx, rec_payload);
+    n_pkt = 0;
+    fail_at = -1;
+}
+
+/* Packets first.. are transfer `id` of `len` bytes of big[], in order */
+static void check_chunks(int first, uint32_t id, size_t len, uint8_t flags)
+{
+    uint16_t count = DIV_ROUND_UP(len, ROOM);
+
+    zassert_equal(n_pkt - first, count, "%d chunks, expected %u", n_pkt - first, count);
+    for (uint16_t k = 0; k < count; k++) {
+        const struct ble_chunk_hdr *h = &pkt[first + k].hdr;
+
+        zassert_equal(h->magic, BLE_CHUNK_MAGIC);
+        zassert_equal(h->flags, flags);
+        zassert_equal(sys_le16_to_cpu(h->idx), k);
+        zassert_equal(sys_le16_to_cpu(h->count), count);
+        zassert_equal(sys_le16_to_cpu(h->crc), crc16_itu_t(0xFFFF, big, len));
+        zassert_equal(sys_le32_to_cpu(h->id), id);
+        zassert_equal(pkt[first + k].len, MIN(ROOM, len - k * ROOM));
+        zassert_mem_equal(pkt[first + k].data, &big[k * ROOM], pkt[first + k].len);
+    }
+}
+
+ZTEST(ble_xfer, test_chunking)
+{
+    zassert_ok(ble_xfer_send(big, 3 * ROOM + 5));
+    check_chunks(0, 1, 3 * ROOM + 5, 0);
+    zassert_equal(ble_xfer_last_id(), 1);
+
+    /* Exactly full chunks: no empty tail chunk */
+    zassert_ok(ble_xfer_send(big, 2 * ROOM));
+    check_chunks(4, 2, 2 * ROOM, 0);
+}
+
+ZTEST(ble_xfer, test_resend)
+{
+    uint16_t sent;
+
+    zassert_ok(ble_xfer_send(big, 5 * ROOM));
+    n_pkt = 0;
+
+    /* All of it */
+    zassert_ok(ble_xfer_resend(1, 0, 0, &sent));
+    zassert_equal(sent, 5);
+    check_chunks(0, 1, 5 * ROOM, BLE_CHUNK_RETX);
+
+    /* Chunks 1 and 3 only */
+    n_pkt = 0;
+    zassert_ok(ble_xfer_resend(1, 1, BIT(0) | BIT(2), &sent));
+    zassert_equal(sent, 2);
+    zassert_equal(sys_le16_to_cpu(pkt[0].hdr.idx), 1);
+    zassert_equal(sys_le16_to_cpu(pkt[1].hdr.idx), 3);
+    zassert_mem_equal(pkt[1].data, &big[3 * ROOM], ROOM);
+
+    /* A transfer that was never sent */
+    zassert_equal(ble_xfer_resend(7, 0, 0, &sent), -ENOENT);
+    zassert_equal(sent, 0);
+}
+
+/* A failed chunk stops the transfer, which stays retained */
+ZTEST(ble_xfer, test_tx_error)
+{
+    uint16_t sent;
+
+    fail_at = 2;
+    zassert_equal(ble_xfer_send(big, 4 * ROOM), -ENOTCONN);
+    zassert_equal(n_pkt, 2);
+
+    fail_at = -1;
+    n_pkt = 0;
+    zassert_ok(ble_xfer_resend(1, 2, BIT(0) | BIT(1), &sent));
+    zassert_equal(sent, 2);
+    zassert_mem_equal(pkt[0].data, &big[2 * ROOM], ROOM);
+}
+
+/* Oldest transfers make room in the arena */
+ZTEST(ble_xfer, test_retention)
+{
+    uint16_t sent;
+    size_t len = CONFIG_APP_BLE_RETX_KB * 1024 / 3;
+
+    for (int i = 0; i < 4; i++) {
+        zassert_ok(ble_xfer_send(big, len));
+        n_pkt = 0;
+    }
+    zassert_equal(ble_xfer_resend(1, 0, BIT(0), &sent), -ENOENT);
+    zassert_ok(ble_xfer_resend(4, 0, BIT(0), &sent));
+    zassert_equal(sent, 1);
+}
+
+/* Longer than a 16-bit length or the arena: refused, nothing sent */
+ZTEST(ble_xfer, test_too_long)
+{
+    size_t max = MIN(UINT16_MAX, CONFIG_APP_BLE_RETX_KB * 1024);
+
+    zassert_equal(ble_xfer_send(big, max + 1), -EMSGSIZE);
+    zassert_equal(n_pkt, 0);
+    zassert_equal(ble_xfer_last_id(), 0);
+}
+
+ZTEST_SUITE(ble_xfer, NULL, xfer_setup, xfer_before, NULL, NULL);
@@ -0,0 +1,223 @@
+/* Loop-4 codec: round trip through every encoding, and byte-exact output
+ * against the records in "Python Script/tests/data" that the host decoder
+ * is tested with (see the README there).
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <string.h>
+
+#include "l4_codec.h"
+
+static const uint8_t sim_s1_raw[] = {
+#include "sim_s1.raw.rec.inc"
+};
+static const uint8_t sim_s1_zrle[] = {
+#include "sim_s1.zrle.rec.inc"
+};
+static const uint8_t sim_s1_xbp[] = {
+#include "sim_s1.xbp.rec.inc"
+};
+static const uint8_t sim_s1_csv[] = {
+#include "sim_s1.csv.inc"
+};
+static const uint8_t sparse_raw[] = {
+#include "sparse.raw.rec.inc"
+};
+static const uint8_t sparse_zrle[] = {
+#include "sparse.zrle.rec.inc"
+};
+static const uint8_t sparse_xbp[] = {
+#include "sparse.xbp.rec.inc"
+};
+static const uint8_t sparse_csv[] = {
+#include "sparse.csv.inc"
+};
+
+struct blob {
+    const uint8_t *p;
+    size_t len;
+};
+
+#define BLOB(a) { a, sizeof(a) }
+
+static const struct {
+    const char *name;
+    struct blob rec[3];         /* by enum l4_rec_encoding */
+    struct blob csv;
+} fixture[] = {
+    { "sim_s1", { BLOB(sim_s1_raw), BLOB(sim_s1_zrle), BLOB(sim_s1_xbp) }, BLOB(sim_s1_csv) },
+    { "sparse", { BLOB(sparse_raw), BLOB(sparse_zrle), BLOB(sparse_xbp) }, BLOB(sparse_csv) },
+};
+
+static struct l4_frame f;
+static struct l4_enc_frame e;
+static uint16_t back[L4_TOTAL_READS];
+
+static const struct l4_rec_hdr *hdr_of(const struct blob *b)
+{
+    return (const struct l4_rec_hdr *)b->p;
+}
+
+static size_t payload_len(const struct blob *b)
+{
+    return sys_le16_to_cpu(hdr_of(b)->payload_len);
+}
+
+/* The raw record is the frame itself */
+static void load(int k)
+{
+    zassert_equal(fixture[k].rec[L4_ENC_RAW].len, sizeof(f));
+    memcpy(&f, fixture[k].rec[L4_ENC_RAW].p, sizeof(f));
+}
+
+ZTEST(l4_codec, test_fixture_decode)
+{
+    for (int k = 0; k < (int)ARRAY_SIZE(fixture); k++) {
+        load(k);
+        for (int enc = L4_ENC_RAW; enc <= L4_ENC_XBP; enc++) {
+            const struct blob *b = &fixture[k].rec[enc];
+
+            zassert_equal(hdr_of(b)->encoding, enc);
+            zassert_equal(b->len, sizeof(struct l4_rec_hdr) + payload_len(b));
+            zassert_ok(l4_decode(hdr_of(b), back), "%s enc %d", fixture[k].name, enc);
+            zassert_mem_equal(back, f.words, sizeof(back), "%s enc %d", fixture[k].name, enc);
+        }
+    }
+}
+
+/* The encoders, without the size cap, produce the stored payloads */
+ZTEST(l4_codec, test_fixture_encode)
+{
+    static uint8_t out[1024];
+    static char csv[L4_CSV_BYTES];
+
+    for (int k = 0; k < (int)ARRAY_SIZE(fixture); k++) {
+        const struct blob *z = &fixture[k].rec[L4_ENC_ZRLE];
+        const struct blob *x = &fixture[k].rec[L4_ENC_XBP];
+        int n;
+
+        load(k);
+        n = l4_enc_zrle(&f, out, sizeof(out));
+        zassert_equal(n, (int)payload_len(z), "%s zrle %d bytes", fixture[k].name, n);
+        zassert_mem_equal(out, hdr_of(z) + 1, n);
+        n = l4_enc_xbp(&f, out, sizeof(out));
+        zassert_equal(n, (int)payload_len(x), "%s xbp %d bytes", fixture[k].name, n);
+        zassert_mem_equal(out, hdr_of(x) + 1, n);
+
+        zassert_equal(l4_format_csv(&f, csv), fixture[k].csv.len);
+        zassert_mem_equal(csv, fixture[k].csv.p, fixture[k].csv.len);
+    }
+}
+
+/* Each mode sends its encoding only when it is smaller than the raw words,
+   and auto the smallest; whatever is sent decodes to the frame */
+ZTEST(l4_codec, test_fixture_modes)
+{
+    for (int k = 0; k < (int)ARRAY_SIZE(fixture); k++) {
+        size_t sz[3];
+
+        load(k);
+        for (int enc = L4_ENC_RAW; enc <= L4_ENC_XBP; enc++) {
+            sz[enc] = payload_len(&fixture[k].rec[enc]);
+        }
+        for (int m = L4_ENC_MODE_RAW; m <= L4_ENC_MODE_XBP; m++) {
+            const struct l4_rec_hdr *h;
+            size_t bytes;
+            int want = L4_ENC_RAW;
+
+            if ((m == L4_ENC_MODE_XBP || m == L4_ENC_MODE_AUTO) && sz[L4_ENC_XBP] < sz[want]) {
+                want = L4_ENC_XBP;
+            }
+            if ((m == L4_ENC_MODE_ZRLE || m == L4_ENC_MODE_AUTO) && sz[L4_ENC_ZRLE] < sz[want]) {
+                want = L4_ENC_ZRLE;
+            }
+            h = l4_encode(&f, &e, m, &bytes);
+            zassert_equal(h->encoding, want, "%s mode %d", fixture[k].name, m);
+            zassert_equal(bytes, sz[want]);
+            zassert_mem_equal(h, fixture[k].rec[want].p, fixture[k].rec[want].len);
+            zassert_ok(l4_decode(h, back));
+            zassert_mem_equal(back, f.words, sizeof(back));
+        }
+    }
+}
+
+/* Empty, single hit, sparse, dense counter and pseudo-random frames */
+ZTEST(l4_codec, test_round_trip)
+{
+    uint32_t lfsr = 0xACE1u;
+
+    for (int kind = 0; kind < 5; kind++) {
+        memset(&f, 0, sizeof(f));
+        for (int r = 0; r < L4_TOTAL_READS; r++) {
+            lfsr = lfsr * 1103515245u + 12345u;
+            switch (kind) {
+            case 0: f.words[r] = 0; break;
+            case 1: f.words[r] = (r == 77) ? 0x1234 : 0; break;
+            case 2: f.words[r] = ((lfsr >> 16) % 10 == 0) ? (lfsr & BIT_MASK(L4_NUM_PINS)) : 0;
+                break;
+            case 3: f.words[r] = 1000 + r; break;
+            default: f.words[r] = (lfsr >> 8) & BIT_MASK(L4_NUM_PINS); break;
+            }
+        }
+        f.hdr.encoding    = L4_ENC_RAW;
+        f.hdr.payload_len = sys_cpu_to_le16(sizeof(f.words));
+
+        for (int m = L4_ENC_MODE_RAW; m <= L4_ENC_MODE_XBP; m++) {
+            const struct l4_rec_hdr *h = l4_encode(&f, &e, m, NULL);
+
+            zassert_true(sys_le16_to_cpu(h->payload_len) <= sizeof(f.words));
+            zassert_ok(l4_decode(h, back), "kind %d mode %d", kind, m);
+            zassert_mem_equal(back, f.words, sizeof(back), "kind %d mode %d", kind, m);
+        }
+    }
+}
+
+ZTEST(l4_codec, test_decode_errors)
+{
+    memset(&f, 0, sizeof(f));
+    f.hdr.payload_len = sys_cpu_to_le16(sizeof(f.words));
+
+    /* ZRLE: one zero row short, then one row too many */
+    e.hdr = f.hdr;
+    e.hdr.encoding = L4_ENC_ZRLE;
+    e.hdr.payload_len = sys_cpu_to_le16(1);
+    e.payload[0] = 0x80 | 126;
+    zassert_equal(l4_decode(&e.hdr, back), -EINVAL);
+    e.hdr.payload_len = sys_cpu_to_le16(2);
+    e.payload[1] = 0x80 | 1;
+    zassert_equal(l4_decode(&e.hdr, back), -EINVAL);
+
+    /* XBP: payload longer than its planes */
+    e.hdr.encoding = L4_ENC_XBP;
+    e.hdr.payload_len = sys_cpu_to_le16(3);
+    e.payload[0] = e.payload[1] = 0;
+    zassert_equal(l4_decode(&e.hdr, back), -EINVAL);
+
+    e.hdr.encoding = 7;
+    zassert_equal(l4_decode(&e.hdr, back), -ENOTSUP);
+}
+
+/* An encoder stops with -ENOSPC rather than reach its cap */
+ZTEST(l4_codec, test_cap)
+{
+    static uint8_t out[1024];
+
+    load(1);
+    zassert_equal(l4_enc_zrle(&f, out, payload_len(&fixture[1].rec[L4_ENC_ZRLE])), -ENOSPC);
+    zassert_equal(l4_enc_xbp(&f, out, payload_len(&fixture[1].rec[L4_ENC_XBP])), -ENOSPC);
+}
+
+ZTEST(l4_codec, test_csv_row)
+{
+    char line[2 * L4_NUM_PINS + 1];
+
+    zassert_equal(l4_format_csv_row(line, 0x2001, '\n'), 2 * L4_NUM_PINS);
+    zassert_mem_equal(line, "1,0,0,0,0,0,0,0,0,0,0,0,0,1\n", 2 * L4_NUM_PINS);
+    zassert_equal(l4_format_csv_row(line, 0x0002, 0), 2 * L4_NUM_PINS - 1);
+    zassert_mem_equal(line, "0,1,0", 5);
+}
+
+ZTEST_SUITE(l4_codec, NULL, NULL, NULL, NULL, NULL);
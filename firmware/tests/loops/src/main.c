@@ -0,0 +1,286 @@
+/* Loops 2 and 4 and the CY scheduler against the chip model on the
+ * emulated lines: the configuration word must land in the chip's register
+ * and read back on cfg-sdo, a capture must return the word sequence the
+ * chip plays, and the histogram must bin every captured word. CY runs on
+ * counting steps, without any GPIO.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <errno.h>
+#include <string.h>
+
+#include "chip_model.h"
+#include "cycle.h"
+#include "gpio_out.h"
+#include "loop4.h"
+#include "loops.h"
+#include "seq.h"
+
+static const struct gpio_dt_spec sig_spec[SEQ_SIG_COUNT] = {
+    [SEQ_SIG_RST]       = GPIO_DT_SPEC_GET(DT_ALIAS(rst), gpios),
+    [SEQ_SIG_RST_CTR]   = GPIO_DT_SPEC_GET(DT_ALIAS(rst_ctr), gpios),
+    [SEQ_SIG_ENBIAS]    = GPIO_DT_SPEC_GET(DT_ALIAS(enbias), gpios),
+    [SEQ_SIG_STAB]      = GPIO_DT_SPEC_GET(DT_ALIAS(stab), gpios),
+    [SEQ_SIG_CLK_WRD]   = GPIO_DT_SPEC_GET(DT_ALIAS(clk_wrd), gpios),
+    [SEQ_SIG_IN_WRD]    = GPIO_DT_SPEC_GET(DT_ALIAS(in_wrd), gpios),
+    [SEQ_SIG_PULSE]     = GPIO_DT_SPEC_GET(DT_ALIAS(pulse), gpios),
+    [SEQ_SIG_RST_TDC]   = GPIO_DT_SPEC_GET(DT_ALIAS(rst_tdc), gpios),
+    [SEQ_SIG_CELL]      = GPIO_DT_SPEC_GET(DT_ALIAS(cell), gpios),
+    [SEQ_SIG_CLK_SHIFT] = GPIO_DT_SPEC_GET(DT_ALIAS(clk_shift), gpios),
+};
+static const struct gpio_dt_spec sdo_spec = GPIO_DT_SPEC_GET(DT_ALIAS(cfg_sdo), gpios);
+
+#define TX(i) GPIO_DT_SPEC_GET(DT_ALIAS(tx##i), gpios)
+static const struct gpio_dt_spec tx_spec[L4_NUM_PINS] = {
+    TX(0), TX(1), TX(2), TX(3), TX(4), TX(5), TX(6),
+    TX(7), TX(8), TX(9), TX(10), TX(11), TX(12), TX(13),
+};
+
+static struct l4_frame frame;
+
+/* The last H4 record sent */
+static struct {
+    struct l4_rec_hdr hdr;
+    struct l4_hist_meta meta;
+    uint32_t counts[4];
+} __packed hist;
+
+static int send_err;       /* returned by send() instead of taking the record */
+
+static int send(const struct l4_rec_hdr *rec)
+{
+    if (send_err) {
+        return send_err;
+    }
+    if (rec->type == L4_REC_HIST) {
+        memcpy(&hist, rec, sizeof(hist));
+    }
+    return 0;
+}
+
+static bool no_abort(void)
+{
+    return false;
+}
+
+static void *setup(void)
+{
+    const struct gpio_dt_spec *sig[SEQ_SIG_COUNT];
+    struct l4_lines lines = {
+        .cell = &sig_spec[SEQ_SIG_CELL],
+        .clk_shift = &sig_spec[SEQ_SIG_CLK_SHIFT],
+        .rst_ctr = &sig_spec[SEQ_SIG_RST_CTR],
+    };
+
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        sig[s] = &sig_spec[s];
+        zassert_ok(gpio_pin_configure_dt(sig[s], GPIO_OUTPUT_INACTIVE));
+    }
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        lines.tx[i] = &tx_spec[i];
+    }
+    timing_init();
+    timing_start();
+    zassert_ok(out_init(sig, SEQ_SIG_COUNT));
+    zassert_ok(loops_init(sig, &sdo_spec, no_abort));
+    zassert_ok(l4_init(&lines, no_abort, send));
+    return NULL;
+}
+
+ZTEST(loops, test_l2_apply_verify)
+{
+    struct l2_word cw = { .nbits = CHIP_MODEL_CFG_BITS };
+    uint32_t reg[L2_MAX_WORDS] = {0};
+    char out[32];
+
+    for (int b = 0; b < cw.nbits; b++) {
+        if ((b * 7) % 3 == 1) {
+            cw.w[b / 32] |= BIT(b % 32);
+        }
+    }
+    l2_stage(&cw);
+
+    zassert_ok(l2_apply(true, true, out, sizeof(out)));
+    zassert_equal(strcmp(out, "95b verify ok"), 0, "%s", out);
+    zassert_equal(chip_model_cfg_get(reg, ARRAY_SIZE(reg)), CHIP_MODEL_CFG_BITS);
+    zassert_mem_equal(reg, cw.w, sizeof(reg));
+
+    /* Unchanged word: no shift */
+    zassert_ok(l2_apply(false, false, out, sizeof(out)));
+    zassert_equal(strcmp(out, "cached 95b"), 0, "%s", out);
+}
+
+ZTEST(loops, test_l4_capture)
+{
+    uint16_t words[L4_TOTAL_READS];
+    struct l4_timing t = l4_timing_get();
+
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        words[r] = (r * 37 + 5) & (L4_CODE_MAX - 1);
+    }
+    zassert_ok(chip_model_load(words, ARRAY_SIZE(words)));
+
+    zassert_ok(l4_capture_frame(&frame, &t));
+    zassert_mem_equal(frame.words, words, sizeof(words));
+    zassert_equal(frame.hdr.type, L4_REC_FRAME);
+    zassert_equal(sys_le16_to_cpu(frame.hdr.word_count), L4_TOTAL_READS);
+}
+
+ZTEST(loops, test_l4_histogram)
+{
+    uint16_t words[L4_TOTAL_READS];
+    char out[32];
+
+    /* 99..103 in turn: 26 x 99 (under), 52 in [100, 102), 50 x 102..103 (over) */
+    for (int r = 0; r < L4_TOTAL_READS; r++) {
+        words[r] = 99 + r % 5;
+    }
+    zassert_ok(chip_model_load(words, ARRAY_SIZE(words)));
+
+    zassert_equal(l4_histogram(&frame, 3, 2, 100, 1, out, sizeof(out)), 3);
+    zassert_equal(strcmp(out, "n=3 u=78 o=150"), 0, "%s", out);
+    zassert_equal(hist.hdr.type, L4_REC_HIST);
+    zassert_equal(sys_le32_to_cpu(hist.meta.shots), 3);
+    zassert_equal(sys_le32_to_cpu(hist.counts[0]), 156);
+}
+
+ZTEST(loops, test_l4_histogram_not_sent)
+{
+    char out[32], expect[32];
+
+    zassert_ok(chip_model_load((const uint16_t[]){ 100 }, 1));
+
+    send_err = -EMSGSIZE;
+    zassert_equal(l4_histogram(&frame, 2, 1, 0, 4, out, sizeof(out)), -EMSGSIZE);
+    send_err = 0;
+    snprintk(expect, sizeof(expect), "send %d", -EMSGSIZE);
+    zassert_equal(strcmp(out, expect), 0, "%s", out);
+    zassert_equal(frame.words[0], 100, "the last shot stays in the frame");
+}
+
+/* CY on counting steps */
+static struct {
+    uint32_t reset, pulses, capture, flush;
+    uint32_t abort_at;      /* abort once this many resets ran, 0 = never */
+    bool drain;             /* flush takes the entries, checking their order */
+    uint32_t taken, next;
+} cy_n;
+
+static void cy_reset(void)
+{
+    cy_n.reset++;
+}
+
+static void cy_pulses(void)
+{
+    cy_n.pulses++;
+}
+
+static int cy_capture(struct l4_cycle_ent *e)
+{
+    e->frame_id = cy_n.capture++;
+    e->flags |= CY_F_FRAME;
+    return 0;
+}
+
+static void cy_flush(void)
+{
+    struct l4_cycle_ent ent[CY_REC_ENTRIES];
+    size_t n;
+
+    cy_n.flush++;
+    while (cy_n.drain && (n = cy_take(ent, ARRAY_SIZE(ent))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            cy_n.next += (ent[i].cycle == cy_n.next);
+        }
+        cy_n.taken += n;
+    }
+}
+
+static bool cy_abort(void)
+{
+    return cy_n.abort_at && cy_n.reset >= cy_n.abort_at;
+}
+
+static const struct cy_ops cy_ops = { cy_reset, cy_pulses, cy_capture, cy_flush, cy_abort };
+
+ZTEST(loops, test_cy_run)
+{
+    struct l4_cycle_ent ent[8];
+    char out[64];
+
+    memset(&cy_n, 0, sizeof(cy_n));
+    cy_init(&cy_ops);
+    cy_run(CY_MIN_PERIOD_US, 5, CY_STEP_RESET | CY_STEP_CAPTURE, out, sizeof(out));
+
+    zassert_equal(cy_n.reset, 5);
+    zassert_equal(cy_n.pulses, 0);
+    zassert_equal(cy_n.capture, 5);
+    zassert_true(cy_n.flush >= 1);
+    zassert_equal(strncmp(out, "n=5 ", 4), 0, "%s", out);
+
+    zassert_equal(cy_take(ent, ARRAY_SIZE(ent)), 5);
+    for (uint32_t k = 0; k < 5; k++) {
+        zassert_equal(ent[k].cycle, k);
+        zassert_equal(ent[k].frame_id, k);
+        zassert_equal(ent[k].flags, CY_F_FRAME);
+    }
+    /* One period between expiries, give or take a missed one */
+    zassert_true(ent[1].interval_ns >= CY_MIN_PERIOD_US * NSEC_PER_USEC / 2,
+                 "%u ns", ent[1].interval_ns);
+}
+
+ZTEST(loops, test_cy_abort)
+{
+    struct l4_cycle_ent ent[8];
+    char out[64];
+
+    memset(&cy_n, 0, sizeof(cy_n));
+    cy_n.abort_at = 3;
+    cy_init(&cy_ops);
+    cy_run(CY_MIN_PERIOD_US, 0, CY_STEP_ALL, out, sizeof(out));
+
+    /* The third cycle resets, sees the abort, skips its other steps */
+    zassert_equal(cy_n.reset, 3);
+    zassert_equal(cy_n.pulses, 2);
+    zassert_equal(cy_n.capture, 2);
+    zassert_equal(cy_take(ent, ARRAY_SIZE(ent)), 3);
+    zassert_equal(ent[2].flags, CY_F_ABORTED);
+}
+
+ZTEST(loops, test_cy_no_loss)
+{
+    char out[64];
+
+    /* More cycles than cy_q holds: every entry reaches the transport */
+    memset(&cy_n, 0, sizeof(cy_n));
+    cy_n.drain = true;
+    cy_init(&cy_ops);
+    cy_run(CY_MIN_PERIOD_US, 5 * CY_REC_ENTRIES, CY_STEP_RESET, out, sizeof(out));
+
+    zassert_equal(cy_n.taken, 5 * CY_REC_ENTRIES);
+    zassert_equal(cy_n.next, 5 * CY_REC_ENTRIES, "out of order at %u", cy_n.next);
+    zassert_not_null(strstr(out, " e=0"), "%s", out);
+}
+
+ZTEST(loops, test_cy_lost)
+{
+    struct l4_cycle_ent ent[2 * CY_REC_ENTRIES];
+    char out[64];
+
+    /* A transport that never takes: what does not fit is counted */
+    memset(&cy_n, 0, sizeof(cy_n));
+    cy_init(&cy_ops);
+    cy_run(CY_MIN_PERIOD_US, 2 * CY_REC_ENTRIES + 3, CY_STEP_RESET, out, sizeof(out));
+
+    zassert_not_null(strstr(out, " e=3"), "%s", out);
+    zassert_equal(cy_take(ent, ARRAY_SIZE(ent)), 2 * CY_REC_ENTRIES);
+    zassert_equal(ent[0].cycle, 0);
+}
+
+ZTEST_SUITE(loops, NULL, setup, NULL, NULL, NULL);
@@ -0,0 +1,152 @@
+/* Performance gate without stored numbers: every perf_check metric is
+ * measured as at boot and checked against another measurement taken in
+ * the same run on the same host, so the suite means the same on any CI
+ * machine. The port-wide Loop-4 sample must beat the per-pin one, FFF4
+ * encoding must beat CSV formatting, a Loop-2 bit past its setup hold
+ * (three port writes, the hold timed on its own) must not cost more than
+ * two per-pin samples, and the transfer path must stay linear in the
+ * amount sent.
+ * Absolute baselines are per board, for the boot check (perf_check.h).
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+
+#include "gpio_out.h"
+#include "loop4.h"
+#include "loops.h"
+#include "perf_check.h"
+#include "seq.h"
+
+static const struct gpio_dt_spec sig_spec[SEQ_SIG_COUNT] = {
+    [SEQ_SIG_RST]       = GPIO_DT_SPEC_GET(DT_ALIAS(rst), gpios),
+    [SEQ_SIG_RST_CTR]   = GPIO_DT_SPEC_GET(DT_ALIAS(rst_ctr), gpios),
+    [SEQ_SIG_ENBIAS]    = GPIO_DT_SPEC_GET(DT_ALIAS(enbias), gpios),
+    [SEQ_SIG_STAB]      = GPIO_DT_SPEC_GET(DT_ALIAS(stab), gpios),
+    [SEQ_SIG_CLK_WRD]   = GPIO_DT_SPEC_GET(DT_ALIAS(clk_wrd), gpios),
+    [SEQ_SIG_IN_WRD]    = GPIO_DT_SPEC_GET(DT_ALIAS(in_wrd), gpios),
+    [SEQ_SIG_PULSE]     = GPIO_DT_SPEC_GET(DT_ALIAS(pulse), gpios),
+    [SEQ_SIG_RST_TDC]   = GPIO_DT_SPEC_GET(DT_ALIAS(rst_tdc), gpios),
+    [SEQ_SIG_CELL]      = GPIO_DT_SPEC_GET(DT_ALIAS(cell), gpios),
+    [SEQ_SIG_CLK_SHIFT] = GPIO_DT_SPEC_GET(DT_ALIAS(clk_shift), gpios),
+};
+
+#define TX(i) GPIO_DT_SPEC_GET(DT_ALIAS(tx##i), gpios)
+static const struct gpio_dt_spec tx_spec[L4_NUM_PINS] = {
+    TX(0), TX(1), TX(2), TX(3), TX(4), TX(5), TX(6),
+    TX(7), TX(8), TX(9), TX(10), TX(11), TX(12), TX(13),
+};
+
+static bool no_abort(void)
+{
+    return false;
+}
+
+static void *setup(void)
+{
+    const struct gpio_dt_spec *sig[SEQ_SIG_COUNT];
+    struct l4_lines lines = {
+        .cell = &sig_spec[SEQ_SIG_CELL],
+        .clk_shift = &sig_spec[SEQ_SIG_CLK_SHIFT],
+    };
+
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        sig[s] = &sig_spec[s];
+        zassert_ok(gpio_pin_configure_dt(sig[s], GPIO_OUTPUT_INACTIVE));
+    }
+    for (int i = 0; i < L4_NUM_PINS; i++) {
+        lines.tx[i] = &tx_spec[i];
+    }
+    timing_init();
+    timing_start();
+    zassert_ok(out_init(sig, SEQ_SIG_COUNT));
+    zassert_ok(loops_init(sig, NULL, no_abort));
+    zassert_ok(l4_init(&lines, no_abort, NULL));
+    return NULL;
+}
+
+/* Cycles per per-pin Loop-4 sample, the reference for the Loop-4 and
+   Loop-2 checks */
+static uint32_t pin_cyc;
+
+ZTEST(perf, test_l4_sample)
+{
+    uint32_t port = l4_bench_sampling(NULL, 0, &pin_cyc);
+
+    perf_set(PERF_L4_SAMPLE, port);
+    TC_PRINT("l4_sample: port %u, pin %u cyc\n", port, pin_cyc);
+    zassert_not_equal(port, 0, "not measured");
+    zassert_true(port < pin_cyc, "port-wide %u cyc, per-pin %u cyc", port, pin_cyc);
+}
+
+/* nbits setup holds alone, best of 5 (ns): what l2_shift_out() waits */
+static uint32_t l2_hold_ns(uint16_t nbits)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int i = 0; i < 5; i++) {
+        timing_t t0 = timing_counter_get();
+
+        for (uint16_t b = 0; b < nbits; b++) {
+            k_busy_wait(CONFIG_APP_L2_SETUP_US);
+        }
+
+        timing_t t1 = timing_counter_get();
+
+        best = MIN(best, timing_cycles_to_ns(timing_cycles_get(&t0, &t1)));
+    }
+    return (uint32_t)best;
+}
+
+ZTEST(perf, test_l2_shift)
+{
+    struct l2_word cw;
+    uint32_t ns = l2_bench_ns();
+    uint32_t hold, work, pin_ns;
+
+    perf_set(PERF_L2_SHIFT, ns);
+    if (pin_cyc == 0) {
+        (void)l4_bench_sampling(NULL, 0, &pin_cyc);
+    }
+    pin_ns = (uint32_t)timing_cycles_to_ns(pin_cyc);
+    l2_staged_get(&cw);
+    zassert_not_equal(ns, 0, "not measured");
+    zassert_not_equal(cw.nbits, 0);
+
+    /* The setup holds are timed on their own and taken out */
+    hold = l2_hold_ns(cw.nbits);
+    work = (ns > hold ? ns - hold : 0) / cw.nbits;
+    TC_PRINT("l2_shift: %u ns, holds %u ns, %u ns/bit; pin sample %u ns\n",
+             ns, hold, work, pin_ns);
+    /* Three port writes per bit against 2 x 14 pin reads */
+    zassert_true(work <= 2 * pin_ns, "%u ns per bit, pin sample %u ns", work, pin_ns);
+}
+
+ZTEST(perf, test_fmt)
+{
+    uint32_t csv, enc;
+
+    perf_measure_fmt();
+    csv = perf_get(PERF_FMT_CSV);
+    enc = perf_get(PERF_FMT_ENC);
+    TC_PRINT("fmt: csv %u, enc %u ns/frame\n", csv, enc);
+    zassert_not_equal(csv, 0, "not measured");
+    zassert_not_equal(enc, 0, "not measured");
+    zassert_true(enc < csv, "encoding %u ns, CSV %u ns", enc, csv);
+}
+
+ZTEST(perf, test_xfer)
+{
+    uint32_t few = perf_xfer_ns(16), many = perf_xfer_ns(128);
+
+    perf_measure_xfer();
+    TC_PRINT("xfer: %u ns/KiB for 16 frames, %u for 128\n", few, many);
+    zassert_not_equal(few, 0, "not measured");
+    zassert_true((uint64_t)many * 100 <= (uint64_t)few * (100 + CONFIG_APP_PERF_TOLERANCE_PCT),
+                 "%u ns/KiB for 128 frames, %u for 16", many, few);
+}
+
+ZTEST_SUITE(perf, NULL, setup, NULL, NULL, NULL);
@@ -0,0 +1,222 @@
+/* Sequence programs: compile checks, and the timed dry run on the emulated
+ * lines. A SHIFT must leave the data line at each bit before the clock
+ * rises, with the programmed half period between the edges; the dry run
+ * moves the pins and its time is the programmed waits plus the measured
+ * GPIO work.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/timing/timing.h>
+#include <errno.h>
+#include <string.h>
+
+#include "gpio_out.h"
+#include "seq.h"
+
+static const struct gpio_dt_spec sig_spec[SEQ_SIG_COUNT] = {
+    [SEQ_SIG_RST]       = GPIO_DT_SPEC_GET(DT_ALIAS(rst), gpios),
+    [SEQ_SIG_RST_CTR]   = GPIO_DT_SPEC_GET(DT_ALIAS(rst_ctr), gpios),
+    [SEQ_SIG_ENBIAS]    = GPIO_DT_SPEC_GET(DT_ALIAS(enbias), gpios),
+    [SEQ_SIG_STAB]      = GPIO_DT_SPEC_GET(DT_ALIAS(stab), gpios),
+    [SEQ_SIG_CLK_WRD]   = GPIO_DT_SPEC_GET(DT_ALIAS(clk_wrd), gpios),
+    [SEQ_SIG_IN_WRD]    = GPIO_DT_SPEC_GET(DT_ALIAS(in_wrd), gpios),
+    [SEQ_SIG_PULSE]     = GPIO_DT_SPEC_GET(DT_ALIAS(pulse), gpios),
+    [SEQ_SIG_RST_TDC]   = GPIO_DT_SPEC_GET(DT_ALIAS(rst_tdc), gpios),
+    [SEQ_SIG_CELL]      = GPIO_DT_SPEC_GET(DT_ALIAS(cell), gpios),
+    [SEQ_SIG_CLK_SHIFT] = GPIO_DT_SPEC_GET(DT_ALIAS(clk_shift), gpios),
+};
+
+static uint16_t sample_n;
+
+static uint16_t sample(void)
+{
+    return sample_n++;
+}
+
+static bool no_abort(void)
+{
+    return false;
+}
+
+static void *setup(void)
+{
+    const struct gpio_dt_spec *sig[SEQ_SIG_COUNT];
+
+    for (int s = 0; s < SEQ_SIG_COUNT; s++) {
+        sig[s] = &sig_spec[s];
+        zassert_ok(gpio_pin_configure_dt(sig[s], GPIO_OUTPUT_INACTIVE));
+    }
+    timing_init();
+    timing_start();
+    zassert_ok(out_init(sig, SEQ_SIG_COUNT));
+    zassert_ok(seq_init(sig, sample, no_abort));
+    return NULL;
+}
+
+static int level(enum seq_sig s)
+{
+    return gpio_emul_output_get(sig_spec[s].port, sig_spec[s].pin);
+}
+
+static void load(const uint8_t *code, size_t len)
+{
+    struct seq_err err = {0};
+
+    zassert_ok(seq_load(code, len, &err), "@%u %s", err.pc, err.why ? err.why : "");
+}
+
+static void expect_err(const uint8_t *code, size_t len, uint16_t pc, const char *why)
+{
+    struct seq_err err = {0};
+
+    zassert_equal(seq_load(code, len, &err), -EINVAL);
+    zassert_equal(err.pc, pc, "pc %u", err.pc);
+    zassert_equal(strcmp(err.why, why), 0, "%s", err.why);
+}
+
+ZTEST(seq, test_compile_errors)
+{
+    static const uint8_t bad_op[] = { 0x09 };
+    static const uint8_t bad_sig[] = { SEQ_OP_SET, 0x00, 0x10 };
+    static const uint8_t no_repeat[] = { SEQ_OP_SET, 0x01, 0x00, SEQ_OP_LOOP };
+    static const uint8_t open_repeat[] = { SEQ_OP_REPEAT, 0x02, 0x00, SEQ_OP_SAMPLE };
+    static const uint8_t wait0[] = { SEQ_OP_WAIT, 0, 0, 0, 0 };
+    static const uint8_t shift_same[] = { SEQ_OP_SHIFT, SEQ_SIG_CLK_WRD, SEQ_SIG_CLK_WRD,
+                                          8, 0, 1, 0, 0xFF };
+    static const uint8_t shift_short[] = { SEQ_OP_SHIFT, SEQ_SIG_CLK_WRD, SEQ_SIG_IN_WRD,
+                                           16, 0, 1, 0, 0xFF };
+    static const uint8_t empty[] = { SEQ_OP_END };
+
+    expect_err(bad_op, sizeof(bad_op), 0, "op");
+    expect_err(bad_sig, sizeof(bad_sig), 0, "sig");
+    expect_err(no_repeat, sizeof(no_repeat), 3, "nest");
+    expect_err(open_repeat, sizeof(open_repeat), 4, "nest");
+    expect_err(wait0, sizeof(wait0), 0, "arg");
+    expect_err(shift_same, sizeof(shift_same), 0, "arg");
+    expect_err(shift_short, sizeof(shift_short), 0, "len");
+    expect_err(empty, sizeof(empty), 0, "empty");
+}
+
+/* SET rst|enbias, WAIT 10 us, 3 x (SAMPLE, pulse clk_shift), SHIFT 10 bits */
+#define SHIFT_BITS  10
+#define SHIFT_WORD  0x2A5       /* bit 0 first: 1,0,1,0,0,1,0,1,0,1 */
+#define SHIFT_HALF  2
+
+static const uint8_t prog[] = {
+    SEQ_OP_SET, BIT(SEQ_SIG_RST) | BIT(SEQ_SIG_ENBIAS), 0,
+    SEQ_OP_WAIT, 10, 0, 0, 0,
+    SEQ_OP_REPEAT, 3, 0,
+        SEQ_OP_SAMPLE,
+        SEQ_OP_SET, 0, BIT(SEQ_SIG_CLK_SHIFT - 8),
+        SEQ_OP_CLR, 0, BIT(SEQ_SIG_CLK_SHIFT - 8),
+    SEQ_OP_LOOP,
+    SEQ_OP_SHIFT, SEQ_SIG_CLK_WRD, SEQ_SIG_IN_WRD, SHIFT_BITS, 0, SHIFT_HALF, 0,
+        SHIFT_WORD & 0xFF, SHIFT_WORD >> 8,
+    SEQ_OP_END,
+};
+
+#define PROG_WAIT_NS ((10 + SHIFT_BITS * 2 * SHIFT_HALF) * NSEC_PER_USEC)
+#define PROG_EDGES   (1 + 3 * 2 + SHIFT_BITS * 3)
+
+ZTEST(seq, test_info)
+{
+    struct seq_info info;
+
+    load(prog, sizeof(prog));
+    zassert_true(seq_get_info(&info));
+    zassert_equal(info.bytes, sizeof(prog));
+    zassert_equal(info.ops, 8);
+    zassert_equal(info.samples, 3);
+    zassert_equal(info.signals, BIT(SEQ_SIG_RST) | BIT(SEQ_SIG_ENBIAS) |
+                  BIT(SEQ_SIG_CLK_SHIFT) | BIT(SEQ_SIG_CLK_WRD) | BIT(SEQ_SIG_IN_WRD));
+    /* rst and enbias share a port, as do clk_wrd and in_wrd: one write each */
+    zassert_equal(info.writes, PROG_EDGES);
+    zassert_true(info.time_ns > PROG_WAIT_NS);
+}
+
+ZTEST(seq, test_run)
+{
+    uint16_t words[8];
+    uint32_t ns;
+
+    load(prog, sizeof(prog));
+    sample_n = 0;
+    zassert_equal(seq_run(words, ARRAY_SIZE(words), &ns), 3);
+    for (int i = 0; i < 3; i++) {
+        zassert_equal(words[i], i);
+    }
+    zassert_equal(level(SEQ_SIG_RST), 1);
+    zassert_equal(level(SEQ_SIG_ENBIAS), 1);
+    zassert_equal(level(SEQ_SIG_CLK_WRD), 0);
+    zassert_equal(level(SEQ_SIG_IN_WRD), (SHIFT_WORD >> (SHIFT_BITS - 1)) & 1);
+}
+
+/* Per bit: data at the bit with the clock low, clock high, clock low */
+ZTEST(seq, test_dry_run_shift)
+{
+    static struct seq_trace_edge tr[64];
+    const struct seq_trace_edge *e = &tr[1 + 3 * 2];
+    struct seq_dry dry;
+
+    load(prog, sizeof(prog));
+    zassert_ok(seq_dry_run(tr, ARRAY_SIZE(tr), &dry));
+    zassert_equal(dry.edges, PROG_EDGES);
+    zassert_false(dry.truncated);
+    zassert_true(tr[0].t_ns > 0);
+    zassert_true(tr[1].t_ns - tr[0].t_ns >= 10 * NSEC_PER_USEC);
+
+    for (int b = 0; b < SHIFT_BITS; b++, e += 3) {
+        uint16_t bit = (SHIFT_WORD >> b) & 1;
+
+        zassert_equal((e[0].levels >> SEQ_SIG_IN_WRD) & 1, bit, "bit %d", b);
+        zassert_equal((e[0].levels >> SEQ_SIG_CLK_WRD) & 1, 0, "bit %d", b);
+        zassert_equal((e[1].levels >> SEQ_SIG_CLK_WRD) & 1, 1, "bit %d", b);
+        zassert_equal((e[1].levels >> SEQ_SIG_IN_WRD) & 1, bit, "bit %d", b);
+        zassert_equal((e[2].levels >> SEQ_SIG_CLK_WRD) & 1, 0, "bit %d", b);
+        zassert_true(e[1].t_ns - e[0].t_ns >= SHIFT_HALF * NSEC_PER_USEC);
+        zassert_true(e[2].t_ns - e[1].t_ns >= SHIFT_HALF * NSEC_PER_USEC);
+    }
+    zassert_true(dry.time_ns >= tr[PROG_EDGES - 1].t_ns);
+}
+
+/* The GPIO work is timed on the emulated lines; only the waits are virtual */
+ZTEST(seq, test_dry_run_timed)
+{
+    static const uint8_t toggle[] = {
+        SEQ_OP_CLR, BIT(SEQ_SIG_RST), 0,
+        SEQ_OP_REPEAT, 0xE8, 0x03,
+            SEQ_OP_SET, BIT(SEQ_SIG_RST), 0,
+            SEQ_OP_CLR, BIT(SEQ_SIG_RST), 0,
+        SEQ_OP_LOOP,
+        SEQ_OP_SET, BIT(SEQ_SIG_RST), 0,
+        SEQ_OP_WAIT, 0xA0, 0x86, 0x01, 0x00,        /* 100 ms */
+    };
+    struct seq_trace_edge tr[4];
+    struct seq_dry dry;
+    timing_t t0, t1;
+
+    if (!SEQ_DRY_TIMED) {
+        ztest_test_skip();
+    }
+    load(toggle, sizeof(toggle));
+
+    t0 = timing_counter_get();
+    zassert_ok(seq_dry_run(tr, ARRAY_SIZE(tr), &dry));
+    t1 = timing_counter_get();
+
+    zassert_true(dry.measured);
+    zassert_true(dry.truncated);
+    zassert_equal(dry.edges, ARRAY_SIZE(tr));
+    /* ran to the end on the pins: rst high, 2002 writes measured */
+    zassert_equal(level(SEQ_SIG_RST), 1);
+    zassert_true(dry.time_ns > 100 * NSEC_PER_MSEC);
+    zassert_true(dry.time_ns - 100 * NSEC_PER_MSEC <=
+                 timing_cycles_to_ns(timing_cycles_get(&t0, &t1)));
+    /* the 100 ms wait is added, not waited */
+    zassert_true(timing_cycles_to_ns(timing_cycles_get(&t0, &t1)) < 100 * NSEC_PER_MSEC);
+}
+
+ZTEST_SUITE(seq, NULL, setup, NULL, NULL, NULL);
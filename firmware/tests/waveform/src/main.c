@@ -0,0 +1,182 @@
+/* Loop-3 waveform generator: the edges the native_sim backend records for
+ * known parameters, against the schedule worked out here from first
+ * principles (1 tick = 1 ns):
+ *
+ *   pulse   rises at k*P (k >= 1), falls at k*P + H, k = 0..n-1
+ *   rst_tdc falls at phase + k*P, rises at phase + H + k*P
+ *
+ * with P = 1e9 / f, H = P * duty / 100, and the run ending on the last
+ * pulse falling edge, (n-1)*P + H.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <errno.h>
+
+#include "waveform.h"
+
+static const struct gpio_dt_spec pulse = GPIO_DT_SPEC_GET(DT_ALIAS(pulse), gpios);
+static const struct gpio_dt_spec rst = GPIO_DT_SPEC_GET(DT_ALIAS(rst_tdc), gpios);
+
+static size_t run(const struct wfg_params *p, const struct wfg_trace_edge **e)
+{
+    zassert_ok(wfg_configure(p));
+    zassert_ok(wfg_start());
+    zassert_ok(wfg_wait(K_SECONDS(5)));
+    zassert_false(wfg_busy());
+
+    /* Idle levels after the run: pulse low, rst_tdc high */
+    zassert_equal(gpio_emul_output_get(pulse.port, pulse.pin), 0);
+    zassert_equal(gpio_emul_output_get(rst.port, rst.pin), 1);
+    return wfg_trace_get(e);
+}
+
+static bool has_edge(const struct wfg_trace_edge *e, size_t n, uint64_t t, uint8_t sig,
+                     uint8_t level)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (e[i].t_ns == t && e[i].sig == sig && e[i].level == level) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Every edge of the schedule above is recorded, and nothing else */
+static void check_schedule(const struct wfg_params *p)
+{
+    const struct wfg_trace_edge *e;
+    size_t n = run(p, &e);
+    uint64_t per = NSEC_PER_SEC / p->freq_hz;
+    uint64_t high = per * p->duty_pct / 100;
+    uint64_t phase = p->phase_ns % per;
+    uint64_t end = (p->count - 1) * per + high;
+    size_t expect = 2;
+
+    /* t = 0: pulse high; rst_tdc low if its window starts at 0 or wraps */
+    zassert_true(n >= 2);
+    zassert_true(has_edge(e, 2, 0, WFG_SIG_PULSE, 1));
+    zassert_true(has_edge(e, 2, 0, WFG_SIG_RST, (phase == 0 || phase + high > per) ? 0 : 1));
+
+    for (uint64_t k = 0; k < p->count; k++) {
+        if (k > 0) {
+            zassert_true(has_edge(e, n, k * per, WFG_SIG_PULSE, 1), "rise %llu", k);
+            expect++;
+        }
+        zassert_true(has_edge(e, n, k * per + high, WFG_SIG_PULSE, 0), "fall %llu", k);
+        expect++;
+    }
+    for (int64_t k = -1; k <= (int64_t)p->count; k++) {
+        int64_t fall = (int64_t)phase + k * (int64_t)per;
+        int64_t rise = fall + (int64_t)high;
+
+        if (fall > 0 && fall <= (int64_t)end) {
+            zassert_true(has_edge(e, n, fall, WFG_SIG_RST, 0), "rst fall at %lld", fall);
+            expect++;
+        }
+        if (rise > 0 && rise <= (int64_t)end) {
+            zassert_true(has_edge(e, n, rise, WFG_SIG_RST, 1), "rst rise at %lld", rise);
+            expect++;
+        }
+    }
+    zassert_equal(n, expect, "%u edges recorded, %u expected", (unsigned)n, (unsigned)expect);
+    for (size_t i = 1; i < n; i++) {
+        zassert_true(e[i].t_ns >= e[i - 1].t_ns, "edge %u out of order", (unsigned)i);
+    }
+}
+
+static void *wfg_setup(void)
+{
+    zassert_ok(wfg_init(&pulse, &rst));
+    return NULL;
+}
+
+/* 1 MHz, 25 %, rst_tdc 100 ns after the rising edge, 10 pulses */
+ZTEST(waveform, test_period_duty_phase)
+{
+    const struct wfg_params p = { .freq_hz = 1000000, .duty_pct = 25, .phase_ns = 100,
+                                  .count = 10 };
+    const struct wfg_trace_edge *e;
+    size_t n = run(&p, &e);
+    int64_t rise[10], fall[10], rst_fall[10], rst_rise[10];
+    int nr = 0, nf = 0, nrf = 0, nrr = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (e[i].sig == WFG_SIG_PULSE && e[i].level && nr < 10) {
+            rise[nr++] = e[i].t_ns;
+        } else if (e[i].sig == WFG_SIG_PULSE && !e[i].level && nf < 10) {
+            fall[nf++] = e[i].t_ns;
+        } else if (e[i].sig == WFG_SIG_RST && !e[i].level && nrf < 10) {
+            rst_fall[nrf++] = e[i].t_ns;
+        } else if (e[i].sig == WFG_SIG_RST && e[i].level && e[i].t_ns > 0 && nrr < 10) {
+            rst_rise[nrr++] = e[i].t_ns;
+        }
+    }
+    /* 10 pulses; the run stops on the 10th falling edge, before the last
+       rst_tdc rising edge */
+    zassert_equal(nr, 10);
+    zassert_equal(nf, 10);
+    zassert_equal(nrf, 10);
+    zassert_equal(nrr, 9);
+    for (int k = 0; k < 10; k++) {
+        zassert_equal(rise[k], k * 1000, "rise %d at %lld", k, rise[k]);
+        zassert_equal(fall[k] - rise[k], 250, "high time %d", k);
+        zassert_equal(rst_fall[k] - rise[k], 100, "phase %d", k);
+        if (k < 9) {
+            zassert_equal(rst_rise[k] - rst_fall[k], 250, "rst window %d", k);
+        }
+    }
+    zassert_equal(e[n - 1].t_ns, 9250);
+}
+
+/* Phase 0, 50 %: rst_tdc is the complement of pulse, as in the old loop */
+ZTEST(waveform, test_complement)
+{
+    const struct wfg_params p = { .freq_hz = 500000, .duty_pct = 50, .phase_ns = 0,
+                                  .count = 20 };
+    const struct wfg_trace_edge *e;
+    size_t n;
+
+    check_schedule(&p);
+    n = wfg_trace_get(&e);
+    for (size_t i = 0; i + 1 < n; i++) {
+        if (e[i].t_ns == e[i + 1].t_ns && e[i].sig != e[i + 1].sig) {
+            zassert_not_equal(e[i].level, e[i + 1].level, "at %llu", e[i].t_ns);
+        }
+    }
+}
+
+/* rst_tdc window crossing the period boundary: low at t = 0 */
+ZTEST(waveform, test_wrapped_window)
+{
+    const struct wfg_params p = { .freq_hz = 1000000, .duty_pct = 25, .phase_ns = 900,
+                                  .count = 8 };
+
+    check_schedule(&p);
+}
+
+/* Phase beyond a period is taken modulo the period */
+ZTEST(waveform, test_phase_modulo)
+{
+    const struct wfg_params p = { .freq_hz = 2000000, .duty_pct = 40, .phase_ns = 1100,
+                                  .count = 5 };
+
+    check_schedule(&p);
+}
+
+ZTEST(waveform, test_rejected)
+{
+    struct wfg_params p = { .freq_hz = 1000000, .duty_pct = 0, .count = 1 };
+
+    zassert_equal(wfg_configure(&p), -EINVAL);
+    p.duty_pct = 100;
+    zassert_equal(wfg_configure(&p), -EINVAL);
+    p.duty_pct = 50;
+    p.freq_hz = 0;
+    zassert_equal(wfg_configure(&p), -EINVAL);
+    p.freq_hz = 600000000;      /* period under 2 ticks */
+    zassert_equal(wfg_configure(&p), -EINVAL);
+}
+
+ZTEST_SUITE(waveform, NULL, wfg_setup, NULL, NULL, NULL);
@@ -0,0 +1,163 @@
+/* waveform.c - parameter handling and edge planning for the waveform generator */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+#include "waveform_backend.h"
+
+LOG_MODULE_REGISTER(waveform, LOG_LEVEL_INF);
+
+static struct wfg_params wfg_cur = {
+    .freq_hz  = 1000000,
+    .duty_pct = 50,
+    .phase_ns = 0,
+    .count    = 1000000,     /* same pulse count as the old software loop */
+};
+static struct wfg_plan wfg_plan;
+static atomic_t wfg_running = ATOMIC_INIT(0);
+static K_SEM_DEFINE(wfg_done_sem, 0, 1);
+static bool wfg_ready = false;
+
+/* Turn parameters into per-period edges in backend ticks. */
+static int wfg_build_plan(const struct wfg_params *p, struct wfg_plan *plan)
+{
+    uint64_t tick_hz = wfg_backend_tick_hz();
+    uint32_t period, high, phase, rst_fall, rst_rise, pulse_fall;
+
+    if (p->freq_hz == 0 || p->duty_pct == 0 || p->duty_pct >= 100) {
+        return -EINVAL;
+    }
+
+    period = (uint32_t)(tick_hz / p->freq_hz);
+    if (period < 2) {
+        return -EINVAL;
+    }
+    high = (uint32_t)(((uint64_t)period * p->duty_pct) / 100U);
+    high = CLAMP(high, 1U, period - 1U);
+    phase = (uint32_t)(((uint64_t)p->phase_ns * tick_hz / NSEC_PER_SEC) % period);
+
+    pulse_fall = high;
+    rst_fall   = (phase == 0) ? period : phase;
+    rst_rise   = (phase + high) % period;
+    if (rst_rise == 0) {
+        rst_rise = period;
+    }
+
+    memset(plan, 0, sizeof(*plan));
+    plan->period = period;
+    plan->count  = p->count;
+    plan->init_pulse = 1;
+    /* rst_tdc is low at t = 0 if its window starts at 0 or wraps across it */
+    plan->init_rst = !((phase == 0) || (phase + high > period));
+
+    plan->edge[0] = (struct wfg_edge){ .t = period,     .sig = WFG_SIG_PULSE, .level = 1 };
+    plan->edge[1] = (struct wfg_edge){ .t = pulse_fall, .sig = WFG_SIG_PULSE, .level = 0 };
+    plan->edge[2] = (struct wfg_edge){ .t = rst_fall,   .sig = WFG_SIG_RST,   .level = 0 };
+    plan->edge[3] = (struct wfg_edge){ .t = rst_rise,   .sig = WFG_SIG_RST,   .level = 1 };
+    plan->n_edges = 4;
+
+    /* Sort by time (stable, 4 entries) so backends can replay in order */
+    for (int i = 1; i < plan->n_edges; i++) {
+        struct wfg_edge e = plan->edge[i];
+        int j = i - 1;
+
+        while (j >= 0 && plan->edge[j].t > e.t) {
+            plan->edge[j + 1] = plan->edge[j];
+            j--;
+        }
+        plan->edge[j + 1] = e;
+    }
+    for (int i = 0; i < plan->n_edges; i++) {
+        if (plan->edge[i].sig == WFG_SIG_PULSE && plan->edge[i].level == 0) {
+            plan->fall_idx = i;
+        }
+    }
+    return 0;
+}
+
+int wfg_init(const struct gpio_dt_spec *pulse, const struct gpio_dt_spec *rst)
+{
+    int err = wfg_backend_init(pulse, rst);
+
+    if (err) {
+        LOG_ERR("Waveform backend init failed (err %d)", err);
+        return err;
+    }
+    wfg_ready = true;
+    return wfg_build_plan(&wfg_cur, &wfg_plan);
+}
+
+int wfg_configure(const struct wfg_params *p)
+{
+    struct wfg_plan plan;
+    int err;
+
+    if (atomic_get(&wfg_running)) {
+        return -EBUSY;
+    }
+    err = wfg_build_plan(p, &plan);
+    if (err) {
+        return err;
+    }
+    wfg_cur = *p;
+    wfg_plan = plan;
+    LOG_INF("Waveform: %u Hz, %u %%, phase %u ns, %u pulses (period %u ticks)",
+            p->freq_hz, p->duty_pct, p->phase_ns, p->count, plan.period);
+    return 0;
+}
+
+void wfg_get_params(struct wfg_params *p)
+{
+    *p = wfg_cur;
+}
+
+int wfg_start(void)
+{
+    int err;
+
+    if (!wfg_ready) {
+        return -ENODEV;
+    }
+    if (!atomic_cas(&wfg_running, 0, 1)) {
+        return -EBUSY;
+    }
+    k_sem_reset(&wfg_done_sem);
+
+    err = wfg_backend_start(&wfg_plan);
+    if (err) {
+        atomic_clear(&wfg_running);
+    }
+    return err;
+}
+
+int wfg_stop(void)
+{
+    if (!atomic_get(&wfg_running)) {
+        return 0;
+    }
+    wfg_backend_stop();
+    wfg_backend_done();
+    return 0;
+}
+
+int wfg_wait(k_timeout_t timeout)
+{
+    if (!atomic_get(&wfg_running)) {
+        return 0;
+    }
+    return (k_sem_take(&wfg_done_sem, timeout) == 0) ? 0 : -EAGAIN;
+}
+
+bool wfg_busy(void)
+{
+    return atomic_get(&wfg_running) != 0;
+}
+
+void wfg_backend_done(void)
+{
+    if (atomic_cas(&wfg_running, 1, 0)) {
+        k_sem_give(&wfg_done_sem);
+    }
+}
@@ -0,0 +1,51 @@
+/* waveform.h - Loop-3 pulse / rst_tdc waveform generator
+ *
+ * Generates a train of `pulse` periods with an active-low `rst_tdc` window
+ * at a programmable phase, timed by hardware instead of a CPU loop. With
+ * phase 0 and 50 % duty the output matches the old software loop (rst_tdc
+ * is the complement of pulse).
+ *
+ *   pulse   : high for duty % of the period, rising at t = 0
+ *   rst_tdc : low for the same high time, falling at t = phase
+ *
+ * Backends: nRF TIMER + DPPI + GPIOTE on the nRF5340, and an edge-recording
+ * simulation on native_sim.
+ */
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+
+struct wfg_params {
+    uint32_t freq_hz;     /* pulse repetition rate */
+    uint8_t  duty_pct;    /* pulse high time, 1..99 % of the period */
+    uint32_t phase_ns;    /* rst_tdc falling edge after pulse rising edge */
+    uint32_t count;       /* pulses to emit, 0 = until wfg_stop() */
+};
+
+/* One output transition, recorded by the native_sim backend. */
+struct wfg_trace_edge {
+    uint64_t t_ns;        /* since wfg_start() */
+    uint8_t  sig;         /* WFG_SIG_PULSE / WFG_SIG_RST */
+    uint8_t  level;
+};
+
+#define WFG_SIG_PULSE 0
+#define WFG_SIG_RST   1
+
+/* Bind the generator to its output pins (call once). */
+int wfg_init(const struct gpio_dt_spec *pulse, const struct gpio_dt_spec *rst);
+
+/* Validate and latch parameters; -EINVAL if they cannot be met. */
+int wfg_configure(const struct wfg_params *p);
+void wfg_get_params(struct wfg_params *p);
+
+int wfg_start(void);
+int wfg_stop(void);
+
+/* Wait until `count` pulses were emitted; -EAGAIN on timeout. */
+int wfg_wait(k_timeout_t timeout);
+bool wfg_busy(void);
+
+/* Edges of the last run (native_sim only; returns 0 edges on hardware). */
+size_t wfg_trace_get(const struct wfg_trace_edge **edges);
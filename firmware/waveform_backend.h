@@ -0,0 +1,33 @@
+/* waveform_backend.h - interface between waveform.c and its backends */
+#pragma once
+
+#include "waveform.h"
+
+#define WFG_MAX_EDGES 4
+
+/* Edge times are in backend ticks within (0, period]; an edge at `period`
+   is the t = 0 edge of the following period. */
+struct wfg_edge {
+    uint32_t t;
+    uint8_t  sig;
+    uint8_t  level;
+};
+
+struct wfg_plan {
+    uint32_t period;          /* ticks */
+    uint32_t count;           /* pulses, 0 = continuous */
+    uint8_t  init_pulse;      /* levels at t = 0 of the first period */
+    uint8_t  init_rst;
+    uint8_t  n_edges;
+    uint8_t  fall_idx;        /* edge[] index of the pulse falling edge */
+    struct wfg_edge edge[WFG_MAX_EDGES];
+};
+
+/* Provided by the backend */
+uint32_t wfg_backend_tick_hz(void);
+int wfg_backend_init(const struct gpio_dt_spec *pulse, const struct gpio_dt_spec *rst);
+int wfg_backend_start(const struct wfg_plan *plan);
+void wfg_backend_stop(void);
+
+/* Called by the backend (any context) once the last pulse has been emitted */
+void wfg_backend_done(void);
@@ -0,0 +1,177 @@
+/* waveform_nrf.c - nRF5340 TIMER + DPPI + GPIOTE waveform backend
+ *
+ * TIMER1 runs at 16 MHz and is cleared at the end of each period. Every
+ * distinct edge time gets a compare channel whose event is published on its
+ * own DPPI channel; the GPIOTE SET/CLR tasks of `pulse` and `rst_tdc`
+ * subscribe to the channel of their edge. TIMER2 in counter mode counts
+ * pulse falling edges and, at `count`, stops TIMER1 over DPPI and raises an
+ * interrupt. The CPU is not involved between start and completion.
+ *
+ * Written against the nrfx 2.x API shipped with this NCS release.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/irq.h>
+#include <zephyr/logging/log.h>
+#include <nrfx_dppi.h>
+#include <nrfx_gpiote.h>
+#include <hal/nrf_timer.h>
+#include <hal/nrf_gpiote.h>
+#include <hal/nrf_dppi.h>
+
+#include "waveform_backend.h"
+
+LOG_MODULE_DECLARE(waveform, LOG_LEVEL_INF);
+
+#define WFG_TIMER        NRF_TIMER1
+#define WFG_COUNTER      NRF_TIMER2
+#define WFG_COUNTER_IRQN DT_IRQN(DT_NODELABEL(timer2))
+#define WFG_TICK_HZ      16000000U
+
+static uint32_t wfg_psel[2];          /* absolute pin per WFG_SIG_* */
+static uint8_t  wfg_gpiote_ch[2];
+static uint8_t  wfg_dppi_edge[WFG_MAX_EDGES];
+static uint8_t  wfg_dppi_stop;
+
+static uint32_t wfg_abs_pin(const struct gpio_dt_spec *spec)
+{
+    return spec->pin + ((spec->port == DEVICE_DT_GET(DT_NODELABEL(gpio1))) ? 32U : 0U);
+}
+
+static void wfg_counter_isr(const void *arg)
+{
+    ARG_UNUSED(arg);
+
+    nrf_timer_event_clear(WFG_COUNTER, NRF_TIMER_EVENT_COMPARE0);
+    wfg_backend_stop();
+    wfg_backend_done();
+}
+
+uint32_t wfg_backend_tick_hz(void)
+{
+    return WFG_TICK_HZ;
+}
+
+int wfg_backend_init(const struct gpio_dt_spec *pulse, const struct gpio_dt_spec *rst)
+{
+    /* Pins start as ordinary outputs at their idle level */
+    if (!device_is_ready(pulse->port) || !device_is_ready(rst->port)) {
+        return -ENODEV;
+    }
+    (void)gpio_pin_configure_dt(pulse, GPIO_OUTPUT_INACTIVE);
+    (void)gpio_pin_configure_dt(rst,   GPIO_OUTPUT_ACTIVE);
+
+    wfg_psel[WFG_SIG_PULSE] = wfg_abs_pin(pulse);
+    wfg_psel[WFG_SIG_RST]   = wfg_abs_pin(rst);
+
+    for (int s = 0; s < 2; s++) {
+        if (nrfx_gpiote_channel_alloc(&wfg_gpiote_ch[s]) != NRFX_SUCCESS) {
+            return -EBUSY;
+        }
+    }
+    for (int i = 0; i < WFG_MAX_EDGES; i++) {
+        if (nrfx_dppi_channel_alloc(&wfg_dppi_edge[i]) != NRFX_SUCCESS) {
+            return -EBUSY;
+        }
+    }
+    if (nrfx_dppi_channel_alloc(&wfg_dppi_stop) != NRFX_SUCCESS) {
+        return -EBUSY;
+    }
+
+    nrf_timer_mode_set(WFG_TIMER, NRF_TIMER_MODE_TIMER);
+    nrf_timer_bit_width_set(WFG_TIMER, NRF_TIMER_BIT_WIDTH_32);
+    nrf_timer_frequency_set(WFG_TIMER, NRF_TIMER_FREQ_16MHz);
+    nrf_timer_subscribe_set(WFG_TIMER, NRF_TIMER_TASK_STOP, wfg_dppi_stop);
+
+    nrf_timer_mode_set(WFG_COUNTER, NRF_TIMER_MODE_LOW_POWER_COUNTER);
+    nrf_timer_bit_width_set(WFG_COUNTER, NRF_TIMER_BIT_WIDTH_32);
+    nrf_timer_publish_set(WFG_COUNTER, NRF_TIMER_EVENT_COMPARE0, wfg_dppi_stop);
+    nrf_timer_int_enable(WFG_COUNTER, NRF_TIMER_INT_COMPARE0_MASK);
+
+    IRQ_CONNECT(WFG_COUNTER_IRQN, 2, wfg_counter_isr, NULL, 0);
+    irq_enable(WFG_COUNTER_IRQN);
+    return 0;
+}
+
+int wfg_backend_start(const struct wfg_plan *plan)
+{
+    int cc = -1;
+    uint32_t last_t = 0;
+    uint32_t dppi_mask = BIT(wfg_dppi_stop);
+
+    nrf_timer_task_trigger(WFG_TIMER, NRF_TIMER_TASK_STOP);
+    nrf_timer_task_trigger(WFG_TIMER, NRF_TIMER_TASK_CLEAR);
+    nrf_timer_shorts_disable(WFG_TIMER, ~0U);
+
+    /* One compare channel per distinct edge time (edges are sorted) */
+    for (int i = 0; i < plan->n_edges; i++) {
+        const struct wfg_edge *e = &plan->edge[i];
+        uint8_t ch = wfg_gpiote_ch[e->sig];
+
+        if (cc < 0 || e->t != last_t) {
+            cc++;
+            last_t = e->t;
+            nrf_timer_cc_set(WFG_TIMER, (nrf_timer_cc_channel_t)cc, e->t);
+            nrf_timer_publish_set(WFG_TIMER, nrf_timer_compare_event_get(cc),
+                                  wfg_dppi_edge[cc]);
+            dppi_mask |= BIT(wfg_dppi_edge[cc]);
+            if (e->t == plan->period) {
+                nrf_timer_shorts_enable(WFG_TIMER, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK << cc);
+            }
+        }
+
+        nrf_gpiote_subscribe_set(NRF_GPIOTE,
+                                 e->level ? nrf_gpiote_set_task_get(ch) : nrf_gpiote_clr_task_get(ch),
+                                 wfg_dppi_edge[cc]);
+        if (i == plan->fall_idx && plan->count) {
+            nrf_timer_subscribe_set(WFG_COUNTER, NRF_TIMER_TASK_COUNT, wfg_dppi_edge[cc]);
+        }
+    }
+
+    nrf_gpiote_task_configure(NRF_GPIOTE, wfg_gpiote_ch[WFG_SIG_PULSE], wfg_psel[WFG_SIG_PULSE],
+                              NRF_GPIOTE_POLARITY_NONE,
+                              plan->init_pulse ? NRF_GPIOTE_INITIAL_VALUE_HIGH
+                                               : NRF_GPIOTE_INITIAL_VALUE_LOW);
+    nrf_gpiote_task_configure(NRF_GPIOTE, wfg_gpiote_ch[WFG_SIG_RST], wfg_psel[WFG_SIG_RST],
+                              NRF_GPIOTE_POLARITY_NONE,
+                              plan->init_rst ? NRF_GPIOTE_INITIAL_VALUE_HIGH
+                                             : NRF_GPIOTE_INITIAL_VALUE_LOW);
+
+    if (plan->count) {
+        nrf_timer_task_trigger(WFG_COUNTER, NRF_TIMER_TASK_CLEAR);
+        nrf_timer_event_clear(WFG_COUNTER, NRF_TIMER_EVENT_COMPARE0);
+        nrf_timer_cc_set(WFG_COUNTER, NRF_TIMER_CC_CHANNEL0, plan->count);
+        nrf_timer_task_trigger(WFG_COUNTER, NRF_TIMER_TASK_START);
+    } else {
+        nrf_timer_subscribe_clear(WFG_COUNTER, NRF_TIMER_TASK_COUNT);
+    }
+
+    nrf_dppi_channels_enable(NRF_DPPIC, dppi_mask);
+    nrf_gpiote_task_enable(NRF_GPIOTE, wfg_gpiote_ch[WFG_SIG_PULSE]);
+    nrf_gpiote_task_enable(NRF_GPIOTE, wfg_gpiote_ch[WFG_SIG_RST]);
+    nrf_timer_task_trigger(WFG_TIMER, NRF_TIMER_TASK_START);
+    return 0;
+}
+
+void wfg_backend_stop(void)
+{
+    nrf_timer_task_trigger(WFG_TIMER, NRF_TIMER_TASK_STOP);
+    nrf_timer_task_trigger(WFG_COUNTER, NRF_TIMER_TASK_STOP);
+
+    /* Leave the pins at their idle level: pulse low, rst_tdc high */
+    nrf_gpiote_task_trigger(NRF_GPIOTE, nrf_gpiote_clr_task_get(wfg_gpiote_ch[WFG_SIG_PULSE]));
+    nrf_gpiote_task_trigger(NRF_GPIOTE, nrf_gpiote_set_task_get(wfg_gpiote_ch[WFG_SIG_RST]));
+
+    for (int i = 0; i < WFG_MAX_EDGES; i++) {
+        nrf_dppi_channels_disable(NRF_DPPIC, BIT(wfg_dppi_edge[i]));
+    }
+    nrf_gpiote_task_disable(NRF_GPIOTE, wfg_gpiote_ch[WFG_SIG_PULSE]);
+    nrf_gpiote_task_disable(NRF_GPIOTE, wfg_gpiote_ch[WFG_SIG_RST]);
+}
+
+size_t wfg_trace_get(const struct wfg_trace_edge **edges)
+{
+    *edges = NULL;
+    return 0;
+}
@@ -0,0 +1,177 @@
+/* waveform_sim.c - native_sim waveform backend
+ *
+ * Replays the planned edges period by period on the emulated GPIOs and
+ * records each transition with its ideal timestamp (1 tick = 1 ns), so a
+ * schedule can be checked without hardware. Simulated time is not advanced
+ * per edge; the trace is the reference, not the kernel clock. Edges that
+ * share a timestamp go out in one write per port, as the nRF backend fires
+ * them from the same compare event.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "waveform_backend.h"
+
+LOG_MODULE_DECLARE(waveform, LOG_LEVEL_INF);
+
+#define WFG_SIM_TRACE_LEN CONFIG_APP_WFG_SIM_TRACE_LEN
+#define WFG_SIM_YIELD_PERIODS 1024   /* native_sim does not preempt: let others run */
+
+static const struct gpio_dt_spec *wfg_pin[2];
+static int8_t wfg_pending[2] = { -1, -1 };     /* level due at the next flush */
+static struct wfg_trace_edge wfg_trace[WFG_SIM_TRACE_LEN];
+static size_t wfg_trace_len;
+static struct wfg_plan wfg_sim_plan;
+static atomic_t wfg_sim_stop = ATOMIC_INIT(0);
+static K_SEM_DEFINE(wfg_sim_go, 0, 1);
+
+static void wfg_sim_flush(void)
+{
+    gpio_port_pins_t set[2] = { 0 }, clr[2] = { 0 };
+
+    for (int s = 0; s < 2; s++) {
+        const struct gpio_dt_spec *pin = wfg_pin[s];
+        int w = (s == 1 && pin->port == wfg_pin[0]->port) ? 0 : s;
+        bool raw = (wfg_pending[s] > 0) != ((pin->dt_flags & GPIO_ACTIVE_LOW) != 0);
+
+        if (wfg_pending[s] < 0) {
+            continue;
+        }
+        if (raw) {
+            set[w] |= BIT(pin->pin);
+        } else {
+            clr[w] |= BIT(pin->pin);
+        }
+        wfg_pending[s] = -1;
+    }
+    for (int w = 0; w < 2; w++) {
+        if (set[w] | clr[w]) {
+            (void)gpio_port_set_clr_bits_raw(wfg_pin[w]->port, set[w], clr[w]);
+        }
+    }
+}
+
+static void wfg_sim_edge(uint64_t t_ns, uint8_t sig, uint8_t level)
+{
+    wfg_pending[sig] = level;
+    if (wfg_trace_len < WFG_SIM_TRACE_LEN) {
+        wfg_trace[wfg_trace_len++] = (struct wfg_trace_edge){
+            .t_ns = t_ns, .sig = sig, .level = level,
+        };
+    }
+}
+
+/* Period / high time / phase as seen in the trace, for a quick self-check */
+static void wfg_sim_report(void)
+{
+    int64_t rise[2] = { -1, -1 }, fall = -1, rst_fall = -1;
+
+    for (size_t i = 0; i < wfg_trace_len; i++) {
+        const struct wfg_trace_edge *e = &wfg_trace[i];
+
+        if (e->sig == WFG_SIG_PULSE && e->level) {
+            if (rise[0] < 0) {
+                rise[0] = e->t_ns;
+            } else if (rise[1] < 0) {
+                rise[1] = e->t_ns;
+            }
+        } else if (e->sig == WFG_SIG_PULSE && fall < 0 && rise[0] >= 0) {
+            fall = e->t_ns;
+        } else if (e->sig == WFG_SIG_RST && !e->level && rst_fall < 0 && rise[0] >= 0) {
+            rst_fall = e->t_ns;
+        }
+    }
+
+    LOG_INF("Waveform sim: %u edges, period %lld ns, high %lld ns, rst phase %lld ns",
+            (unsigned)wfg_trace_len,
+            (rise[1] >= 0) ? rise[1] - rise[0] : -1LL,
+            (fall >= 0) ? fall - rise[0] : -1LL,
+            (rst_fall >= 0) ? rst_fall - rise[0] : -1LL);
+}
+
+static void wfg_sim_thread(void *p1, void *p2, void *p3)
+{
+    for (;;) {
+        const struct wfg_plan *plan = &wfg_sim_plan;
+        uint32_t pulses = 0;
+        bool done = false;
+
+        k_sem_take(&wfg_sim_go, K_FOREVER);
+
+        wfg_trace_len = 0;
+        wfg_sim_edge(0, WFG_SIG_PULSE, plan->init_pulse);
+        wfg_sim_edge(0, WFG_SIG_RST, plan->init_rst);
+        wfg_sim_flush();
+
+        for (uint64_t base = 0; !done && !atomic_get(&wfg_sim_stop); base += plan->period) {
+            for (int i = 0; i < plan->n_edges; i++) {
+                const struct wfg_edge *e = &plan->edge[i];
+
+                wfg_sim_edge(base + e->t, e->sig, e->level);
+                if (i == plan->fall_idx && plan->count && ++pulses >= plan->count) {
+                    /* Counter stops the timer on the last falling edge;
+                       edges sharing its compare channel still fire. */
+                    while (i + 1 < plan->n_edges && plan->edge[i + 1].t == e->t) {
+                        i++;
+                        wfg_sim_edge(base + e->t, plan->edge[i].sig, plan->edge[i].level);
+                    }
+                    wfg_sim_flush();
+                    done = true;
+                    break;
+                }
+                if (i + 1 == plan->n_edges || plan->edge[i + 1].t != e->t) {
+                    wfg_sim_flush();
+                }
+            }
+            if ((base / plan->period) % WFG_SIM_YIELD_PERIODS == 0) {
+                k_sleep(K_TICKS(1));
+            }
+        }
+
+        /* Idle levels, as on hardware */
+        wfg_pending[WFG_SIG_PULSE] = 0;
+        wfg_pending[WFG_SIG_RST] = 1;
+        wfg_sim_flush();
+        wfg_sim_report();
+        wfg_backend_done();
+    }
+}
+K_THREAD_DEFINE(wfg_sim_tid, 1024, wfg_sim_thread, NULL, NULL, NULL,
+                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+uint32_t wfg_backend_tick_hz(void)
+{
+    return NSEC_PER_SEC;
+}
+
+int wfg_backend_init(const struct gpio_dt_spec *pulse, const struct gpio_dt_spec *rst)
+{
+    if (!device_is_ready(pulse->port) || !device_is_ready(rst->port)) {
+        return -ENODEV;
+    }
+    (void)gpio_pin_configure_dt(pulse, GPIO_OUTPUT_INACTIVE);
+    (void)gpio_pin_configure_dt(rst,   GPIO_OUTPUT_ACTIVE);
+    wfg_pin[WFG_SIG_PULSE] = pulse;
+    wfg_pin[WFG_SIG_RST]   = rst;
+    return 0;
+}
+
+int wfg_backend_start(const struct wfg_plan *plan)
+{
+    wfg_sim_plan = *plan;
+    atomic_clear(&wfg_sim_stop);
+    k_sem_give(&wfg_sim_go);
+    return 0;
+}
+
+void wfg_backend_stop(void)
+{
+    atomic_set(&wfg_sim_stop, 1);
+}
+
+size_t wfg_trace_get(const struct wfg_trace_edge **edges)
+{
+    *edges = wfg_trace;
+    return wfg_trace_len;
+}